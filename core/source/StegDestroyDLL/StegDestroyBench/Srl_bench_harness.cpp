@@ -0,0 +1,216 @@
+//------------------------------------------------------------------------------------
+///
+/// @file   Srl_bench_harness.cpp
+///
+/// @brief Timing loop and JSON report shared by every benchmark case
+///
+//------------------------------------------------------------------------------------
+
+#include "Srl_bench_harness.hpp"
+#include "Srl_batch_arena.hpp"
+#include "Srl_trace.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <iomanip>
+#include <new>
+#include <ostream>
+
+using namespace srl;
+using namespace std;
+
+namespace
+{
+	atomic<bool> g_counting_new(false);
+	atomic<uint64_t> g_new_calls(0);
+	atomic<uint64_t> g_new_bytes(0);
+
+	typedef chrono::steady_clock bench_clock;
+
+	double elapsed_ns( bench_clock::time_point begin, bench_clock::time_point end )
+	{
+		return static_cast<double>(chrono::duration_cast<chrono::nanoseconds>(end - begin).count());
+	}
+
+	///
+	/// @brief	rate per second of amount done in nanoseconds, 0 for an empty run
+	///
+	double per_second( double amount, double nanoseconds )
+	{
+		return (nanoseconds > 0.0) ? amount * 1e9 / nanoseconds : 0.0;
+	}
+}
+
+//Counting every operator new in the process, as well as the arena, catches the allocations
+//made outside any arena scope too: std::vector growth, Magick::Image handles and the like
+void* operator new( size_t bytes )
+{
+	if (g_counting_new.load(memory_order_relaxed))
+	{
+		g_new_calls.fetch_add(1, memory_order_relaxed);
+		g_new_bytes.fetch_add(bytes, memory_order_relaxed);
+	}
+
+	void *memory_p = std::malloc((0 != bytes) ? bytes : 1);
+	if (nullptr == memory_p)
+	{
+		throw bad_alloc();
+	}
+	return memory_p;
+}
+
+void operator delete( void *memory_p ) noexcept
+{
+	std::free(memory_p);
+}
+
+Srl_bench_options srl::default_bench_options( void )
+{
+	Srl_bench_options options;
+	options.warmup = 2;
+	options.min_iterations = 5;
+	options.min_time_ms = 500;
+	options.max_iterations = 100000;
+	return options;
+}
+
+Srl_bench_result srl::run_bench_case( const Srl_bench_case &bench_case, const Srl_bench_options &options )
+{
+	Srl_bench_result result;
+	result.name = bench_case.name;
+	result.params = bench_case.params;
+	result.pixels = bench_case.pixels;
+	result.bytes = bench_case.bytes;
+	result.iterations = 0;
+	result.median_ns = 0.0;
+	result.min_ns = 0.0;
+	result.mean_ns = 0.0;
+	result.allocations = 0;
+	result.allocated_bytes = 0;
+
+	try
+	{
+		for (unsigned int i = 0; i < options.warmup; i++)
+		{
+			if (bench_case.setup)
+			{
+				bench_case.setup();
+			}
+			bench_case.run();
+		}
+
+		vector<double> samples;
+		double total_ns = 0.0;
+		const double min_total_ns = static_cast<double>(options.min_time_ms) * 1e6;
+		while (samples.size() < options.max_iterations &&
+			   (samples.size() < options.min_iterations || total_ns < min_total_ns))
+		{
+			if (bench_case.setup)
+			{
+				bench_case.setup();
+			}
+			const bench_clock::time_point begin = bench_clock::now();
+			bench_case.run();
+			const double sample_ns = elapsed_ns(begin, bench_clock::now());
+			samples.push_back(sample_ns);
+			total_ns += sample_ns;
+		}
+
+		//One more repetition with the counters on, they cost an atomic add per allocation
+		if (bench_case.setup)
+		{
+			bench_case.setup();
+		}
+		g_new_calls = 0;
+		g_new_bytes = 0;
+		Srl_batch_arena::reset_allocation_counts();
+		Srl_batch_arena::set_allocation_counting(true);
+		g_counting_new = true;
+		bench_case.run();
+		g_counting_new = false;
+		Srl_batch_arena::set_allocation_counting(false);
+		const Srl_allocation_counts arena_counts = Srl_batch_arena::allocation_counts();
+		result.allocations = g_new_calls.load() + arena_counts.allocations;
+		result.allocated_bytes = g_new_bytes.load() + arena_counts.bytes;
+
+		result.iterations = static_cast<unsigned int>(samples.size());
+		if (!samples.empty())
+		{
+			sort(samples.begin(), samples.end());
+			const size_t middle = samples.size() / 2;
+			result.median_ns = (0 == samples.size() % 2) ? (samples[middle - 1] + samples[middle]) / 2.0 : samples[middle];
+			result.min_ns = samples.front();
+			result.mean_ns = total_ns / static_cast<double>(samples.size());
+		}
+	}
+	catch (const exception &ex)
+	{
+		g_counting_new = false;
+		Srl_batch_arena::set_allocation_counting(false);
+		result.error = ex.what();
+	}
+	catch (...)
+	{
+		g_counting_new = false;
+		Srl_batch_arena::set_allocation_counting(false);
+		result.error = "unknown exception";
+	}
+	return result;
+}
+
+void srl::write_bench_json( ostream &out,
+							const vector< pair<string, string> > &config,
+							const vector<Srl_bench_result> &results )
+{
+	out << "{\n\"config\":{";
+	for (size_t i = 0; i < config.size(); i++)
+	{
+		out << ((0 == i) ? "" : ",") << "\n\t";
+		write_json_string(out, config[i].first);
+		out << ':';
+		write_json_string(out, config[i].second);
+	}
+	out << "\n},\n\"results\":[";
+
+	const ios_base::fmtflags flags = out.flags();
+	const streamsize precision = out.precision();
+	out << fixed << setprecision(3);
+
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const Srl_bench_result &result = results[i];
+		const double images = static_cast<double>(result.params.batch);
+
+		out << ((0 == i) ? "" : ",") << "\n\t{\"name\":";
+		write_json_string(out, result.name);
+		out << ",\"format\":";
+		write_json_string(out, result.params.format);
+		out << ",\"width\":" << result.params.width
+			<< ",\"height\":" << result.params.height
+			<< ",\"quality\":" << result.params.quality
+			<< ",\"threads\":" << result.params.threads
+			<< ",\"batch\":" << result.params.batch
+			<< ",\"iterations\":" << result.iterations
+			<< ",\"median_ns\":" << result.median_ns
+			<< ",\"min_ns\":" << result.min_ns
+			<< ",\"mean_ns\":" << result.mean_ns
+			<< ",\"images_per_s\":" << per_second(images, result.median_ns)
+			<< ",\"mb_per_s\":" << per_second(static_cast<double>(result.bytes) / 1e6, result.median_ns)
+			<< ",\"ns_per_pixel\":" << ((0 != result.pixels) ? result.median_ns / static_cast<double>(result.pixels) : 0.0)
+			<< ",\"allocations\":" << result.allocations
+			<< ",\"allocated_bytes\":" << result.allocated_bytes;
+		if (!result.error.empty())
+		{
+			out << ",\"error\":";
+			write_json_string(out, result.error);
+		}
+		out << '}';
+	}
+	out << "\n]\n}\n";
+
+	out.flags(flags);
+	out.precision(precision);
+}
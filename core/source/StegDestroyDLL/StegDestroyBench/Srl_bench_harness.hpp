@@ -0,0 +1,129 @@
+// $Id$
+//------------------------------------------------------------------------------------
+///
+/// @file
+///
+/// @brief Timing loop and JSON report shared by every benchmark case
+///
+/// @section VERSION
+/// 1.0
+///
+/// @section DESCRIPTION
+/// A case is one operation on one set of parameters. The runner warms it up, then
+/// repeats it until both a minimum time and a minimum number of repetitions are reached
+/// and keeps the median, fastest and mean time per repetition. Allocations are counted
+/// on a separate pass so the counters never sit in the timed loop. The report is a
+/// single JSON document so runs before and after a change can be diffed or charted.
+//------------------------------------------------------------------------------------
+
+#pragma once
+
+#ifndef _SRL_BENCH_HARNESS_HPP
+#define _SRL_BENCH_HARNESS_HPP
+
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace srl
+{
+	///
+	/// @brief	What a case was run with, reported alongside its timings
+	///
+	struct Srl_bench_params
+	{
+		std::string format;
+		int width;
+		int height;
+
+		///
+		/// @brief	encode quality, 0 where the case doesn't encode
+		///
+		int quality;
+
+		unsigned int threads;
+
+		///
+		/// @brief	images handled by one repetition
+		///
+		size_t batch;
+	};
+
+	///
+	/// @brief	One benchmark, run() is timed, setup() runs before every repetition and isn't
+	///
+	struct Srl_bench_case
+	{
+		std::string name;
+		Srl_bench_params params;
+
+		///
+		/// @brief	pixels and bytes one repetition works through, for the ns/pixel and MB/s
+		///			figures. The bytes are the encoded input for cases that decode, raw pixels otherwise
+		///
+		uint64_t pixels;
+		uint64_t bytes;
+
+		std::function<void()> setup;
+		std::function<void()> run;
+	};
+
+	struct Srl_bench_options
+	{
+		///
+		/// @brief	untimed repetitions before measuring
+		///
+		unsigned int warmup;
+
+		unsigned int min_iterations;
+		unsigned int min_time_ms;
+
+		///
+		/// @brief	also stops a slow case that has met min_iterations but not min_time_ms
+		///
+		unsigned int max_iterations;
+	};
+
+	Srl_bench_options default_bench_options( void );
+
+	struct Srl_bench_result
+	{
+		std::string name;
+		Srl_bench_params params;
+		uint64_t pixels;
+		uint64_t bytes;
+
+		unsigned int iterations;
+		double median_ns;
+		double min_ns;
+		double mean_ns;
+
+		///
+		/// @brief	heap and arena allocations made by a single repetition, and their total size
+		///
+		uint64_t allocations;
+		uint64_t allocated_bytes;
+
+		///
+		/// @brief	empty unless the case threw, the timings are then 0
+		///
+		std::string error;
+	};
+
+	///
+	/// @brief	Warms up, times and counts the allocations of one case
+	///
+	Srl_bench_result run_bench_case( const Srl_bench_case &bench_case, const Srl_bench_options &options );
+
+	///
+	/// @brief	Writes the report. config is written as the "config" object, in order
+	///
+	void write_bench_json( std::ostream &out,
+						   const std::vector< std::pair<std::string, std::string> > &config,
+						   const std::vector<Srl_bench_result> &results );
+}
+
+#endif //_SRL_BENCH_HARNESS_HPP
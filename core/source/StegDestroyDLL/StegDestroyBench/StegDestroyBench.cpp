@@ -0,0 +1,445 @@
+//------------------------------------------------------------------------------------
+///
+/// @file   StegDestroyBench.cpp
+///
+/// @brief Codec and scrub throughput benchmarks, written out as JSON
+///
+/// @section DESCRIPTION
+/// Times decode, encode, the LSB scrub, the Mat and Magick::Image conversions and whole
+/// handler batches over every combination of the formats, resolutions, qualities and
+/// thread counts given on the command line. Inputs are synthesised from a fixed seed so
+/// two runs on the same machine time the same bytes.
+///
+///	StegDestroyBench [--formats jpeg,png,...] [--sizes 640x480,...] [--qualities 50,75,...]
+///					 [--threads 1,4,...] [--batch n] [--min-time-ms n] [--filter text] [--out file]
+//------------------------------------------------------------------------------------
+
+#include "Srl_bench_harness.hpp"
+
+#include "Srl_steg_data_types.hpp"
+#include "Srl_img_format_registry.hpp"
+#include "Srl_stegimg.hpp"
+#include "Srl_stegimg_handler.hpp"
+#include "Srl_cpu_features.hpp"
+#include "Srl_synthetic_corpus.hpp"
+#include "Srl_tool_options.hpp"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+using namespace srl;
+using namespace std;
+
+namespace
+{
+	///
+	/// @brief	seed every input image is synthesised from
+	///
+	const uint64_t SRL_BENCH_SEED = 1;
+
+	struct Srl_bench_size
+	{
+		int width;
+		int height;
+	};
+
+	struct Srl_bench_cli
+	{
+		vector<string> formats;
+		vector<Srl_bench_size> sizes;
+		vector<int> qualities;
+		vector<unsigned int> threads;
+		size_t batch;
+		string filter;
+		string out_path;
+		Srl_bench_options options;
+	};
+
+	void usage( void )
+	{
+		cerr << "StegDestroyBench [--formats jpeg,png,...] [--sizes 640x480,...] [--qualities 50,75,...]\n"
+			 << "                 [--threads 1,4,...] [--batch n] [--min-time-ms n] [--filter text] [--out file]\n";
+	}
+
+	bool parse_cli( int argc, char *argv[], Srl_bench_cli &cli )
+	{
+		const unsigned int hardware = std::max(1u, thread::hardware_concurrency());
+
+		cli.formats = split_list("jpeg,png,bmp,gif,tiff");
+		cli.sizes.push_back(Srl_bench_size{ 640, 480 });
+		cli.sizes.push_back(Srl_bench_size{ 1920, 1080 });
+		cli.qualities.push_back(50);
+		cli.qualities.push_back(75);
+		cli.qualities.push_back(95);
+		cli.threads.push_back(1);
+		if (1 != hardware)
+		{
+			cli.threads.push_back(hardware);
+		}
+		cli.batch = 16;
+		cli.options = default_bench_options();
+
+		const bool parsed = parse_options(argc, argv, [&](const string &arg, const string &value)
+		{
+			if ("--formats" == arg)
+			{
+				cli.formats = split_list(value);
+			}
+			else if ("--sizes" == arg)
+			{
+				cli.sizes.clear();
+				const vector<string> sizes = split_list(value);
+				for (size_t s = 0; s < sizes.size(); s++)
+				{
+					Srl_bench_size size;
+					if (!parse_dimensions(sizes[s], size.width, size.height))
+					{
+						return false;
+					}
+					cli.sizes.push_back(size);
+				}
+			}
+			else if ("--qualities" == arg)
+			{
+				cli.qualities.clear();
+				const vector<string> qualities = split_list(value);
+				for (size_t q = 0; q < qualities.size(); q++)
+				{
+					cli.qualities.push_back(atoi(qualities[q].c_str()));
+				}
+			}
+			else if ("--threads" == arg)
+			{
+				cli.threads.clear();
+				const vector<string> threads = split_list(value);
+				for (size_t t = 0; t < threads.size(); t++)
+				{	//0 is the hardware thread count, as it is for the handler
+					const int count = atoi(threads[t].c_str());
+					cli.threads.push_back((count > 0) ? static_cast<unsigned int>(count) : hardware);
+				}
+			}
+			else if ("--batch" == arg)
+			{
+				cli.batch = static_cast<size_t>(std::max(1, atoi(value.c_str())));
+			}
+			else if ("--min-time-ms" == arg)
+			{
+				cli.options.min_time_ms = static_cast<unsigned int>(std::max(0, atoi(value.c_str())));
+			}
+			else if ("--filter" == arg)
+			{
+				cli.filter = value;
+			}
+			else if ("--out" == arg)
+			{
+				cli.out_path = value;
+			}
+			else
+			{
+				return false;
+			}
+			return true;
+		});
+		return parsed && !cli.formats.empty() && !cli.sizes.empty() && !cli.qualities.empty() && !cli.threads.empty();
+	}
+
+	///
+	/// @brief	Encodes the source the way a user's file would arrive, throwing if it can't be written
+	///
+	vector<unsigned char> encode_source( const cv::Mat &mat, const Srl_img_format_traits &traits, int quality )
+	{
+		vector<unsigned char> encoded;
+		string err_msg;
+		if (!encode_synthetic_image(mat, traits, quality, encoded, err_msg))
+		{
+			throw runtime_error(err_msg);
+		}
+		return encoded;
+	}
+
+	Srl_bench_params make_params( const string &format, const Srl_bench_size &size, int quality,
+								  unsigned int threads, size_t batch )
+	{
+		Srl_bench_params params;
+		params.format = format;
+		params.width = size.width;
+		params.height = size.height;
+		params.quality = quality;
+		params.threads = threads;
+		params.batch = batch;
+		return params;
+	}
+
+	///
+	/// @brief	Decodes encoded, throwing the image's diagnostic if it failed
+	///
+	unique_ptr<Srl_steg_image> decode_checked( const vector<unsigned char> &encoded, const Srl_img_format_pair &format )
+	{
+		unique_ptr<Srl_steg_image> image_p(new Srl_steg_image(Srl_byte_view(encoded.data(), encoded.size()), format));
+		if (!image_p->has_pixels())
+		{
+			throw runtime_error("decode failed: " + image_p->diagnostic());
+		}
+		return image_p;
+	}
+
+	class Srl_bench_suite
+	{
+	public:
+		explicit Srl_bench_suite( const Srl_bench_cli &cli )
+			: m_cli(cli)
+		{
+		}
+
+		void add( const Srl_bench_case &bench_case )
+		{
+			if (m_cli.filter.empty() || string::npos != bench_case.name.find(m_cli.filter))
+			{
+				m_cases.push_back(bench_case);
+			}
+		}
+
+		///
+		/// @brief	Cases on one image's pixels, independent of its file format
+		///
+		void add_pixel_cases( const Srl_bench_size &size );
+
+		///
+		/// @brief	Cases on one format at one quality
+		///
+		void add_format_cases( const Srl_img_format_traits &traits, const Srl_bench_size &size, int quality );
+
+		vector<Srl_bench_result> run_all( void )
+		{
+			vector<Srl_bench_result> results;
+			for (size_t i = 0; i < m_cases.size(); i++)
+			{
+				const Srl_bench_case &bench_case = m_cases[i];
+				cerr << "[" << (i + 1) << "/" << m_cases.size() << "] " << bench_case.name << " "
+					 << bench_case.params.format << " " << bench_case.params.width << "x" << bench_case.params.height
+					 << " q" << bench_case.params.quality << " t" << bench_case.params.threads << endl;
+				results.push_back(run_bench_case(bench_case, m_cli.options));
+				if (!results.back().error.empty())
+				{
+					cerr << "\tfailed: " << results.back().error << endl;
+				}
+			}
+			return results;
+		}
+
+	private:
+		const Srl_bench_cli &m_cli;
+		vector<Srl_bench_case> m_cases;
+	};
+
+	void Srl_bench_suite::add_pixel_cases( const Srl_bench_size &size )
+	{
+		const cv::Mat source = synthesise_image(size.width, size.height, 3, SRL_BENCH_SEED);
+		const uint64_t pixels = static_cast<uint64_t>(size.width) * static_cast<uint64_t>(size.height);
+		const uint64_t raw_bytes = pixels * 3;
+
+		//PNG is lossless so the decoded pixels are the source, decoded once per repetition
+		//because a scrubbed image isn't scrubbed again
+		shared_ptr< vector<unsigned char> > png_p = make_shared< vector<unsigned char> >();
+		cv::imencode(".png", source, *png_p);
+		const Srl_img_format_pair png_format = get_format_pair("png");
+		shared_ptr< unique_ptr<Srl_steg_image> > image_pp = make_shared< unique_ptr<Srl_steg_image> >();
+
+		Srl_bench_case scrub;
+		scrub.name = "lsb_scrub";
+		scrub.params = make_params("raw", size, 0, 1, 1);
+		scrub.pixels = pixels;
+		scrub.bytes = raw_bytes;
+		scrub.setup = [=]() { *image_pp = decode_checked(*png_p, png_format); };
+		scrub.run = [=]()
+		{
+			if (!(*image_pp)->scrub_lsb(SRL_LSB_DEFAULT_PLANES, SRL_LSB_RANDOMIZE))
+			{
+				throw runtime_error("scrub failed: " + (*image_pp)->diagnostic());
+			}
+		};
+		add(scrub);
+
+		shared_ptr<cv::Mat> mat_p = make_shared<cv::Mat>(source.clone());
+		shared_ptr<Magick::Image> magick_p = make_shared<Magick::Image>();
+
+		Srl_bench_case to_magick;
+		to_magick.name = "mat_to_magick";
+		to_magick.params = make_params("raw", size, 0, 1, 1);
+		to_magick.pixels = pixels;
+		to_magick.bytes = raw_bytes;
+		to_magick.run = [=]() { Srl_jpgscrub_stegimg_handler::mat_to_magick(*mat_p, *magick_p); };
+		add(to_magick);
+
+		shared_ptr<Magick::Image> from_p = make_shared<Magick::Image>();
+		shared_ptr<cv::Mat> out_p = make_shared<cv::Mat>(size.height, size.width, CV_8UC3);
+
+		Srl_bench_case to_mat;
+		to_mat.name = "magick_to_mat";
+		to_mat.params = make_params("raw", size, 0, 1, 1);
+		to_mat.pixels = pixels;
+		to_mat.bytes = raw_bytes;
+		to_mat.setup = [=]()
+		{
+			if (0 == from_p->columns())
+			{
+				Srl_jpgscrub_stegimg_handler::mat_to_magick(*mat_p, *from_p);
+			}
+		};
+		to_mat.run = [=]() { Srl_jpgscrub_stegimg_handler::magick_to_mat(*from_p, *out_p); };
+		add(to_mat);
+	}
+
+	void Srl_bench_suite::add_format_cases( const Srl_img_format_traits &traits, const Srl_bench_size &size, int quality )
+	{
+		const cv::Mat source = synthesise_image(size.width, size.height, 3, SRL_BENCH_SEED);
+		const uint64_t pixels = static_cast<uint64_t>(size.width) * static_cast<uint64_t>(size.height);
+		const Srl_img_format_pair format = get_format_pair(traits.name);
+		const Srl_jpgscrub_compression_level level = static_cast<Srl_jpgscrub_compression_level>(quality);
+
+		shared_ptr< vector<unsigned char> > encoded_p =
+			make_shared< vector<unsigned char> >(encode_source(source, traits, quality));
+		const uint64_t encoded_bytes = encoded_p->size();
+
+		Srl_bench_case decode;
+		decode.name = "decode";
+		decode.params = make_params(traits.canonical, size, quality, 1, 1);
+		decode.pixels = pixels;
+		decode.bytes = encoded_bytes;
+		decode.run = [=]() { decode_checked(*encoded_p, format); };
+		add(decode);
+
+		shared_ptr< unique_ptr<Srl_steg_image> > image_pp = make_shared< unique_ptr<Srl_steg_image> >();
+
+		Srl_bench_case encode;
+		encode.name = "encode";
+		encode.params = make_params(traits.canonical, size, quality, 1, 1);
+		encode.pixels = pixels;
+		encode.bytes = pixels * 3;
+		encode.setup = [=]() { *image_pp = decode_checked(*encoded_p, format); };
+		encode.run = [=]()
+		{
+			if (!(*image_pp)->encode(format, level))
+			{
+				throw runtime_error("encode failed: " + (*image_pp)->diagnostic());
+			}
+		};
+		add(encode);
+
+		for (size_t t = 0; t < m_cli.threads.size(); t++)
+		{
+			const unsigned int threads = m_cli.threads[t];
+			const size_t batch_size = m_cli.batch;
+			shared_ptr<Srl_jpgscrub_stegimg_handler> handler_p = make_shared<Srl_jpgscrub_stegimg_handler>(threads);
+			handler_p->set_compression_level(level);
+
+			Srl_bench_case batch;
+			batch.name = "batch";
+			batch.params = make_params(traits.canonical, size, quality, threads, batch_size);
+			batch.pixels = pixels * batch_size;
+			batch.bytes = encoded_bytes * batch_size;
+			batch.run = [=]()
+			{
+				size_t next = 0;
+				size_t failed = 0;
+				Srl_pipeline_source source = [&](Srl_pipeline_input &input) -> bool
+				{
+					if (next == batch_size)
+					{
+						return false;
+					}
+					next++;
+					input.data = *encoded_p;
+					input.format = format;
+					return true;
+				};
+				Srl_pipeline_sink sink = [&](Srl_pipeline_result &result)
+				{
+					if (!result.success)
+					{
+						failed++;
+					}
+				};
+				handler_p->scrub_stream(source, sink, format);
+				if (0 != failed)
+				{
+					throw runtime_error("images failed in the batch");
+				}
+			};
+			add(batch);
+		}
+	}
+}
+
+int main( int argc, char *argv[] )
+{
+	Srl_bench_cli cli;
+	if (!parse_cli(argc, argv, cli))
+	{
+		usage();
+		return 2;
+	}
+
+	initialise_library();
+
+	Srl_bench_suite suite(cli);
+	for (size_t s = 0; s < cli.sizes.size(); s++)
+	{
+		suite.add_pixel_cases(cli.sizes[s]);
+
+		for (size_t f = 0; f < cli.formats.size(); f++)
+		{
+			const Srl_img_format_traits *traits_p = find_format_traits(cli.formats[f]);
+			if (nullptr == traits_p)
+			{
+				cerr << "unknown format " << cli.formats[f] << endl;
+				return 2;
+			}
+
+			//Lossless formats have no quality to sweep
+			const size_t qualities = traits_p->lossy ? cli.qualities.size() : 1;
+			for (size_t q = 0; q < qualities; q++)
+			{
+				suite.add_format_cases(*traits_p, cli.sizes[s], traits_p->lossy ? cli.qualities[q] : 0);
+			}
+		}
+	}
+
+	const vector<Srl_bench_result> results = suite.run_all();
+
+	static const char *simd_names[] = { "scalar", "sse2", "avx2" };
+	vector< pair<string, string> > config;
+	config.push_back(make_pair(string("hardware_threads"), to_string(thread::hardware_concurrency())));
+	config.push_back(make_pair(string("simd"), string(simd_names[cpu_simd_level()])));
+	config.push_back(make_pair(string("opencv"), string(CV_VERSION)));
+	config.push_back(make_pair(string("magick"), string(MagickCore::GetMagickVersion(nullptr))));
+	config.push_back(make_pair(string("min_time_ms"), to_string(cli.options.min_time_ms)));
+
+	if (cli.out_path.empty())
+	{
+		write_bench_json(cout, config, results);
+	}
+	else
+	{
+		ofstream out(cli.out_path.c_str(), ios::out | ios::trunc);
+		if (!out)
+		{
+			cerr << "couldn't write " << cli.out_path << endl;
+			return 1;
+		}
+		write_bench_json(out, config, results);
+	}
+
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		if (!results[i].error.empty())
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,575 @@
+//------------------------------------------------------------------------------------
+///
+/// @file   StegDestroyCorpus.cpp
+///
+/// @brief Writes a synthetic image corpus, some of it carrying known payloads
+///
+/// @section DESCRIPTION
+/// Every image is drawn from the corpus seed and its own index alone, so any corpus is
+/// rebuilt byte for byte from its command line and a larger count only appends images
+/// to a smaller one. Format, size and channel layout are picked per image from weighted
+/// lists. A share of the images get a seeded payload: in the low bit planes for the
+/// lossless formats, in the AC coefficients for JPEG. GIF is palettised on write, which
+/// loses any bit plane payload, so GIFs never carry one, nor do the other lossy formats.
+/// manifest.json lists each file with what it was drawn with and the payload's seed
+/// and length, which is all that is needed to read the payload back and count how much
+/// of it a scrub left behind.
+///
+///	StegDestroyCorpus --out dir [--seed n] [--count n] [--formats jpeg:4,png:2,...]
+///					  [--sizes web:3,photo:1,640x480:1,...] [--channels grey:1,bgr:8,bgra:1]
+///					  [--payload-share 0.5] [--payload-fill 0.25] [--lsb-planes 1]
+///					  [--quality 60-95]
+//------------------------------------------------------------------------------------
+
+#include "Srl_steg_data_types.hpp"
+#include "Srl_img_format_registry.hpp"
+#include "Srl_synthetic_corpus.hpp"
+#include "Srl_counter_rng.hpp"
+#include "Srl_tool_options.hpp"
+
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace srl;
+using namespace std;
+
+namespace
+{
+	///
+	/// @brief	streams of the corpus seed, one per decision so adding a decision later doesn't
+	///			shift the ones already made
+	///
+	enum Srl_corpus_stream
+	{
+		SRL_DRAW_IMAGE_SEED,
+		SRL_DRAW_FORMAT,
+		SRL_DRAW_SIZE,
+		SRL_DRAW_SIZE_LONG_SIDE,
+		SRL_DRAW_ASPECT,
+		SRL_DRAW_CHANNELS,
+		SRL_DRAW_QUALITY,
+		SRL_DRAW_PAYLOAD,
+		SRL_DRAW_PAYLOAD_SEED
+	};
+
+	///
+	/// @brief	A weighted choice, e.g. "png:2"
+	///
+	struct Srl_weighted
+	{
+		string name;
+		unsigned int weight;
+	};
+
+	///
+	/// @brief	A size choice, either fixed or a named range of long sides
+	///
+	struct Srl_size_choice
+	{
+		int width;
+		int height;
+		int long_min;
+		int long_max;
+	};
+
+	struct Srl_corpus_cli
+	{
+		string out_dir;
+		uint64_t seed;
+		size_t count;
+		vector<Srl_weighted> formats;
+		vector<Srl_weighted> sizes;
+		vector<Srl_weighted> channels;
+		double payload_share;
+		double payload_fill;
+		unsigned int lsb_planes;
+		int quality_min;
+		int quality_max;
+	};
+
+	///
+	/// @brief	Landscape and portrait versions of the common camera and screen aspect ratios
+	///
+	const double aspect_ratios[] = { 4.0 / 3.0, 3.0 / 2.0, 16.0 / 9.0, 1.0, 3.0 / 4.0, 2.0 / 3.0, 9.0 / 16.0 };
+
+	vector<Srl_weighted> parse_weighted( const string &text )
+	{
+		vector<Srl_weighted> choices;
+		const vector<string> items = split_list(text);
+		for (size_t i = 0; i < items.size(); i++)
+		{
+			const string &item = items[i];
+			Srl_weighted choice;
+			const size_t colon = item.find(':');
+			choice.name = item.substr(0, colon);
+			choice.weight = (string::npos == colon) ? 1u : static_cast<unsigned int>(atoi(item.c_str() + colon + 1));
+			if (0 != choice.weight)
+			{
+				choices.push_back(choice);
+			}
+		}
+		return choices;
+	}
+
+	///
+	/// @brief	Resolves a size name, "thumb", "web", "photo" or WxH
+	///
+	bool parse_size( const string &name, Srl_size_choice &size )
+	{
+		size.width = 0;
+		size.height = 0;
+		size.long_min = 0;
+		size.long_max = 0;
+		if ("thumb" == name)
+		{
+			size.long_min = 96;
+			size.long_max = 480;
+			return true;
+		}
+		if ("web" == name)
+		{
+			size.long_min = 480;
+			size.long_max = 2048;
+			return true;
+		}
+		if ("photo" == name)
+		{
+			size.long_min = 2048;
+			size.long_max = 6000;
+			return true;
+		}
+
+		return parse_dimensions(name, size.width, size.height);
+	}
+
+	int channels_from_name( const string &name )
+	{
+		if ("grey" == name || "gray" == name)
+		{
+			return 1;
+		}
+		if ("bgr" == name)
+		{
+			return 3;
+		}
+		if ("bgra" == name)
+		{
+			return 4;
+		}
+		return 0;
+	}
+
+	const char* channels_name( int channels )
+	{
+		return (1 == channels) ? "grey" : (4 == channels) ? "bgra" : "bgr";
+	}
+
+	void usage( void )
+	{
+		cerr << "StegDestroyCorpus --out dir [--seed n] [--count n] [--formats jpeg:4,png:2,...]\n"
+			 << "                  [--sizes web:3,photo:1,640x480:1,...] [--channels grey:1,bgr:8,bgra:1]\n"
+			 << "                  [--payload-share 0.5] [--payload-fill 0.25] [--lsb-planes 1] [--quality 60-95]\n";
+	}
+
+	bool parse_cli( int argc, char *argv[], Srl_corpus_cli &cli )
+	{
+		cli.seed = 1;
+		cli.count = 100;
+		cli.formats = parse_weighted("jpeg:6,png:3,bmp:1,gif:1,tiff:1,ppm:1");
+		cli.sizes = parse_weighted("thumb:1,web:6,photo:2");
+		cli.channels = parse_weighted("grey:1,bgr:8,bgra:1");
+		cli.payload_share = 0.5;
+		cli.payload_fill = 0.25;
+		cli.lsb_planes = 1;
+		cli.quality_min = 60;
+		cli.quality_max = 95;
+
+		const bool parsed = parse_options(argc, argv, [&](const string &arg, const string &value)
+		{
+			if ("--out" == arg)
+			{
+				cli.out_dir = value;
+			}
+			else if ("--seed" == arg)
+			{
+				cli.seed = strtoull(value.c_str(), nullptr, 10);
+			}
+			else if ("--count" == arg)
+			{
+				cli.count = static_cast<size_t>(strtoull(value.c_str(), nullptr, 10));
+			}
+			else if ("--formats" == arg)
+			{
+				cli.formats = parse_weighted(value);
+			}
+			else if ("--sizes" == arg)
+			{
+				cli.sizes = parse_weighted(value);
+			}
+			else if ("--channels" == arg)
+			{
+				cli.channels = parse_weighted(value);
+			}
+			else if ("--payload-share" == arg)
+			{
+				cli.payload_share = atof(value.c_str());
+			}
+			else if ("--payload-fill" == arg)
+			{
+				cli.payload_fill = atof(value.c_str());
+			}
+			else if ("--lsb-planes" == arg)
+			{
+				cli.lsb_planes = static_cast<unsigned int>(atoi(value.c_str()));
+			}
+			else if ("--quality" == arg)
+			{
+				const size_t dash = value.find('-');
+				cli.quality_min = atoi(value.c_str());
+				cli.quality_max = (string::npos == dash) ? cli.quality_min : atoi(value.c_str() + dash + 1);
+			}
+			else
+			{
+				return false;
+			}
+			return true;
+		});
+
+		if (!parsed || cli.out_dir.empty() || cli.formats.empty() || cli.sizes.empty() || cli.channels.empty())
+		{
+			return false;
+		}
+		if (cli.lsb_planes < 1 || cli.lsb_planes > 8 || cli.payload_fill <= 0.0 || cli.payload_fill > 1.0)
+		{
+			return false;
+		}
+		if (cli.quality_min < 1 || cli.quality_max > 100 || cli.quality_min > cli.quality_max)
+		{
+			return false;
+		}
+		for (size_t i = 0; i < cli.formats.size(); i++)
+		{
+			if (nullptr == find_format_traits(cli.formats[i].name))
+			{
+				cerr << "unknown format " << cli.formats[i].name << endl;
+				return false;
+			}
+		}
+		for (size_t i = 0; i < cli.sizes.size(); i++)
+		{
+			Srl_size_choice size;
+			if (!parse_size(cli.sizes[i].name, size))
+			{
+				cerr << "unknown size " << cli.sizes[i].name << endl;
+				return false;
+			}
+		}
+		for (size_t i = 0; i < cli.channels.size(); i++)
+		{
+			if (0 == channels_from_name(cli.channels[i].name))
+			{
+				cerr << "unknown channel layout " << cli.channels[i].name << endl;
+				return false;
+			}
+		}
+		return true;
+	}
+
+	///
+	/// @brief	Every draw for one image, from the corpus seed and the image's index
+	///
+	class Srl_image_draws
+	{
+	public:
+		Srl_image_draws( const Srl_counter_rng &rng, size_t index )
+			: m_rng(rng), m_index(index)
+		{
+		}
+
+		uint64_t raw( Srl_corpus_stream stream ) const
+		{
+			return m_rng.at(stream, m_index);
+		}
+
+		///
+		/// @brief	uniform in [0, 1)
+		///
+		double unit( Srl_corpus_stream stream ) const
+		{
+			return static_cast<double>(raw(stream) >> 11) / 9007199254740992.0;
+		}
+
+		const string& pick( Srl_corpus_stream stream, const vector<Srl_weighted> &choices ) const
+		{
+			uint64_t total = 0;
+			for (size_t i = 0; i < choices.size(); i++)
+			{
+				total += choices[i].weight;
+			}
+			uint64_t ticket = raw(stream) % total;
+			for (size_t i = 0; i < choices.size(); i++)
+			{
+				if (ticket < choices[i].weight)
+				{
+					return choices[i].name;
+				}
+				ticket -= choices[i].weight;
+			}
+			return choices.back().name;
+		}
+
+	private:
+		const Srl_counter_rng &m_rng;
+		size_t m_index;
+	};
+
+	///
+	/// @brief	One written image, as listed in the manifest
+	///
+	struct Srl_corpus_entry
+	{
+		string file;
+		string format;
+		int width;
+		int height;
+		int channels;
+		int quality;
+		size_t bytes;
+		uint64_t image_seed;
+		Srl_payload_kind payload;
+		uint64_t payload_seed;
+		size_t payload_bits;
+		unsigned int lsb_planes;
+	};
+
+	vector<unsigned char> encode_image( const cv::Mat &mat, const Srl_img_format_traits &traits, int quality )
+	{
+		vector<unsigned char> encoded;
+		string err_msg;
+		if (!encode_synthetic_image(mat, traits, quality, encoded, err_msg))
+		{
+			throw runtime_error(err_msg);
+		}
+		return encoded;
+	}
+
+	Srl_corpus_entry make_entry( const Srl_corpus_cli &cli, const Srl_counter_rng &rng, size_t index )
+	{
+		const Srl_image_draws draws(rng, index);
+		Srl_corpus_entry entry;
+
+		const Srl_img_format_traits *traits_p = find_format_traits(draws.pick(SRL_DRAW_FORMAT, cli.formats));
+		entry.format = traits_p->canonical;
+
+		Srl_size_choice size;
+		parse_size(draws.pick(SRL_DRAW_SIZE, cli.sizes), size);
+		if (0 != size.width)
+		{
+			entry.width = size.width;
+			entry.height = size.height;
+		}
+		else
+		{	//Log uniform, small images are as common as large ones relative to their range
+			const double long_side = size.long_min * pow(static_cast<double>(size.long_max) / size.long_min,
+														 draws.unit(SRL_DRAW_SIZE_LONG_SIDE));
+			const double aspect = aspect_ratios[draws.raw(SRL_DRAW_ASPECT) % (sizeof(aspect_ratios) / sizeof(aspect_ratios[0]))];
+			entry.width = static_cast<int>((aspect >= 1.0) ? long_side : long_side * aspect);
+			entry.height = static_cast<int>((aspect >= 1.0) ? long_side / aspect : long_side);
+			entry.width = std::max(entry.width, 8);
+			entry.height = std::max(entry.height, 8);
+		}
+
+		entry.channels = channels_from_name(draws.pick(SRL_DRAW_CHANNELS, cli.channels));
+		if ((4 == entry.channels && !traits_p->alpha) || SRL_IMG_FORMAT_PPM_CVIM == traits_p->format)
+		{	//A grey PPM would be written as a PGM
+			entry.channels = 3;
+		}
+
+		entry.quality = traits_p->lossy ?
+			cli.quality_min + static_cast<int>(draws.raw(SRL_DRAW_QUALITY) % (cli.quality_max - cli.quality_min + 1)) : 0;
+		entry.image_seed = draws.raw(SRL_DRAW_IMAGE_SEED);
+		entry.payload_seed = draws.raw(SRL_DRAW_PAYLOAD_SEED);
+		entry.payload_bits = 0;
+		entry.lsb_planes = 0;
+
+		entry.payload = SRL_PAYLOAD_NONE;
+		if (draws.unit(SRL_DRAW_PAYLOAD) < cli.payload_share)
+		{
+			if (SRL_IMG_FORMAT_JPEG_CVIM == traits_p->format)
+			{
+				entry.payload = SRL_PAYLOAD_JPEG_COEF;
+			}
+			else if (!traits_p->lossy && SRL_IMG_FORMAT_GIF_IM != traits_p->format)
+			{
+				entry.payload = SRL_PAYLOAD_LSB;
+			}
+		}
+
+		//The index alone names the file so reruns overwrite rather than add
+		stringstream name;
+		name << setw(6) << setfill('0') << index << traits_p->extension;
+		entry.file = name.str();
+		return entry;
+	}
+
+	///
+	/// @brief	Draws, embeds and encodes one entry
+	///
+	vector<unsigned char> build_image( const Srl_corpus_cli &cli, Srl_corpus_entry &entry )
+	{
+		const Srl_img_format_traits *traits_p = find_format_traits(entry.format);
+		cv::Mat mat = synthesise_image(entry.width, entry.height, entry.channels, entry.image_seed);
+
+		if (SRL_PAYLOAD_LSB == entry.payload)
+		{
+			const size_t bytes = static_cast<size_t>(lsb_capacity_bits(mat, cli.lsb_planes) * cli.payload_fill) / 8;
+			entry.lsb_planes = cli.lsb_planes;
+			entry.payload_bits = embed_lsb_payload(mat, make_payload(bytes, entry.payload_seed), cli.lsb_planes);
+		}
+
+		vector<unsigned char> encoded = encode_image(mat, *traits_p, entry.quality);
+
+		if (SRL_PAYLOAD_JPEG_COEF == entry.payload)
+		{
+			string err_msg;
+			size_t capacity = 0;
+			if (!jpeg_coefficient_payload_capacity(encoded.data(), encoded.size(), capacity, err_msg))
+			{
+				throw runtime_error("couldn't read back the JPEG: " + err_msg);
+			}
+
+			const vector<unsigned char> payload = make_payload(static_cast<size_t>(capacity * cli.payload_fill) / 8,
+															   entry.payload_seed);
+			vector<unsigned char> carrier;
+			if (!jpeg_embed_coefficient_payload(encoded.data(), encoded.size(), payload, entry.payload_bits,
+												carrier, err_msg))
+			{
+				throw runtime_error("couldn't embed the JPEG payload: " + err_msg);
+			}
+			encoded.swap(carrier);
+		}
+
+		if (0 == entry.payload_bits)
+		{	//Too small to carry anything
+			entry.payload = SRL_PAYLOAD_NONE;
+		}
+		entry.bytes = encoded.size();
+		return encoded;
+	}
+
+	string join_path( const string &dir, const string &file )
+	{
+		const char last = dir[dir.size() - 1];
+		return ('/' == last || '\\' == last) ? dir + file : dir + "\\" + file;
+	}
+
+	string weighted_text( const vector<Srl_weighted> &choices )
+	{
+		stringstream text;
+		for (size_t i = 0; i < choices.size(); i++)
+		{
+			text << ((0 == i) ? "" : ",") << choices[i].name << ':' << choices[i].weight;
+		}
+		return text.str();
+	}
+
+	void write_manifest( ostream &out, const Srl_corpus_cli &cli, const vector<Srl_corpus_entry> &entries )
+	{
+		out << "{\n\"generator\":{\"seed\":" << cli.seed
+			<< ",\"count\":" << cli.count
+			<< ",\"formats\":\"" << weighted_text(cli.formats)
+			<< "\",\"sizes\":\"" << weighted_text(cli.sizes)
+			<< "\",\"channels\":\"" << weighted_text(cli.channels)
+			<< "\",\"payload_share\":" << cli.payload_share
+			<< ",\"payload_fill\":" << cli.payload_fill
+			<< ",\"lsb_planes\":" << cli.lsb_planes
+			<< ",\"quality\":\"" << cli.quality_min << '-' << cli.quality_max << "\"},\n\"images\":[";
+
+		for (size_t i = 0; i < entries.size(); i++)
+		{
+			const Srl_corpus_entry &entry = entries[i];
+			out << ((0 == i) ? "" : ",") << "\n\t{\"file\":\"" << entry.file
+				<< "\",\"format\":\"" << entry.format
+				<< "\",\"width\":" << entry.width
+				<< ",\"height\":" << entry.height
+				<< ",\"channels\":\"" << channels_name(entry.channels)
+				<< "\",\"quality\":" << entry.quality
+				<< ",\"bytes\":" << entry.bytes
+				<< ",\"image_seed\":" << entry.image_seed
+				<< ",\"payload\":\"" << payload_kind_name(entry.payload) << '"';
+			if (SRL_PAYLOAD_NONE != entry.payload)
+			{
+				out << ",\"payload_seed\":" << entry.payload_seed
+					<< ",\"payload_bits\":" << entry.payload_bits;
+				if (SRL_PAYLOAD_LSB == entry.payload)
+				{
+					out << ",\"lsb_planes\":" << entry.lsb_planes;
+				}
+			}
+			out << '}';
+		}
+		out << "\n]\n}\n";
+	}
+}
+
+int main( int argc, char *argv[] )
+{
+	Srl_corpus_cli cli;
+	if (!parse_cli(argc, argv, cli))
+	{
+		usage();
+		return 2;
+	}
+
+	initialise_library();
+
+	const Srl_counter_rng rng(cli.seed);
+	vector<Srl_corpus_entry> entries;
+	entries.reserve(cli.count);
+
+	try
+	{
+		for (size_t index = 0; index < cli.count; index++)
+		{
+			Srl_corpus_entry entry = make_entry(cli, rng, index);
+			const vector<unsigned char> encoded = build_image(cli, entry);
+
+			const string path = join_path(cli.out_dir, entry.file);
+			ofstream out(path.c_str(), ios::out | ios::binary | ios::trunc);
+			out.write(reinterpret_cast<const char*>(encoded.data()), static_cast<streamsize>(encoded.size()));
+			if (!out)
+			{
+				cerr << "couldn't write " << path << ", does the directory exist?" << endl;
+				return 1;
+			}
+			entries.push_back(entry);
+
+			if (0 == (index + 1) % 100 || index + 1 == cli.count)
+			{
+				cerr << (index + 1) << "/" << cli.count << endl;
+			}
+		}
+	}
+	catch (const exception &ex)
+	{
+		cerr << "image " << entries.size() << ": " << ex.what() << endl;
+		return 1;
+	}
+
+	const string manifest_path = join_path(cli.out_dir, "manifest.json");
+	ofstream manifest(manifest_path.c_str(), ios::out | ios::trunc);
+	write_manifest(manifest, cli, entries);
+	if (!manifest)
+	{
+		cerr << "couldn't write " << manifest_path << endl;
+		return 1;
+	}
+	return 0;
+}
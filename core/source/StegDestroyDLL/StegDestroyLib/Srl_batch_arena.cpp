@@ -0,0 +1,514 @@
+//------------------------------------------------------------------------------------
+///
+/// @file   Srl_batch_arena.cpp
+///
+/// @brief Per thread bump allocator for the scratch memory of each image
+///
+//------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+
+#include "Srl_batch_arena.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+
+#include <opencv2\core.hpp>
+#include <Magick++.h>
+
+using namespace srl;
+using namespace std;
+
+namespace srl
+{
+	///
+	/// @brief	Block header, the block's memory follows it. refs counts live allocations plus one for
+	///			the owning arena, whoever drops it to 0 frees the block
+	///
+	struct Srl_arena_block
+	{
+		std::atomic<size_t> refs;
+		size_t capacity;
+		size_t used;
+		unsigned char *data_p;
+	};
+}
+
+namespace
+{
+	///
+	/// @brief	Written in front of every allocation. block_p is nullptr for heap allocations, which are
+	///			freed through base_p
+	///
+	struct Srl_arena_header
+	{
+		Srl_arena_block *block_p;
+		void *base_p;
+		size_t size;
+	};
+
+	const size_t SRL_ARENA_BLOCK_ALIGN = 64;
+
+	///
+	/// @brief	Magick only needs what malloc guarantees
+	///
+	const size_t SRL_MAGICK_ALIGN = 16;
+
+	///
+	/// @brief	arena of the thread's open scope, nullptr when there is none
+	///
+	thread_local Srl_batch_arena *t_active_arena_p = nullptr;
+
+	std::atomic<bool> g_installed(false);
+
+	std::atomic<bool> g_counting(false);
+	std::atomic<uint64_t> g_allocations(0);
+	std::atomic<uint64_t> g_allocated_bytes(0);
+
+	inline unsigned char* align_up( unsigned char *ptr, size_t alignment )
+	{
+		uintptr_t value = reinterpret_cast<uintptr_t>(ptr);
+		return reinterpret_cast<unsigned char*>((value + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1));
+	}
+
+	inline Srl_arena_header* header_of( void *memory_p )
+	{
+		return reinterpret_cast<Srl_arena_header*>(static_cast<unsigned char*>(memory_p) - sizeof(Srl_arena_header));
+	}
+
+	Srl_arena_block* new_block( size_t capacity )
+	{
+		void *raw_p = std::malloc(sizeof(Srl_arena_block) + capacity + SRL_ARENA_BLOCK_ALIGN);
+		if (nullptr == raw_p)
+		{
+			throw std::bad_alloc();
+		}
+
+		Srl_arena_block *block_p = new (raw_p) Srl_arena_block();
+		block_p->refs.store(1);
+		block_p->capacity = capacity;
+		block_p->used = 0;
+		block_p->data_p = align_up(static_cast<unsigned char*>(raw_p) + sizeof(Srl_arena_block), SRL_ARENA_BLOCK_ALIGN);
+		return block_p;
+	}
+
+	void release_block( Srl_arena_block *block_p )
+	{
+		if (1 == block_p->refs.fetch_sub(1, std::memory_order_acq_rel))
+		{
+			block_p->~Srl_arena_block();
+			std::free(block_p);
+		}
+	}
+
+	///
+	/// @brief	Carves bytes out of block, nullptr if it doesn't fit
+	///
+	void* place( Srl_arena_block *block_p, size_t bytes, size_t alignment )
+	{
+		unsigned char *cursor_p = block_p->data_p + block_p->used;
+		unsigned char *memory_p = align_up(cursor_p + sizeof(Srl_arena_header), alignment);
+		if (memory_p + bytes > block_p->data_p + block_p->capacity)
+		{
+			return nullptr;
+		}
+
+		Srl_arena_header *header_p = header_of(memory_p);
+		header_p->block_p = block_p;
+		header_p->base_p = nullptr;
+		header_p->size = bytes;
+
+		block_p->used = static_cast<size_t>(memory_p + bytes - block_p->data_p);
+		block_p->refs.fetch_add(1, std::memory_order_relaxed);
+		return memory_p;
+	}
+
+	void* heap_allocate( size_t bytes, size_t alignment )
+	{
+		void *base_p = std::malloc(bytes + sizeof(Srl_arena_header) + alignment - 1);
+		if (nullptr == base_p)
+		{
+			return nullptr;
+		}
+
+		unsigned char *memory_p = align_up(static_cast<unsigned char*>(base_p) + sizeof(Srl_arena_header), alignment);
+		Srl_arena_header *header_p = header_of(memory_p);
+		header_p->block_p = nullptr;
+		header_p->base_p = base_p;
+		header_p->size = bytes;
+		return memory_p;
+	}
+
+	///
+	/// @brief	OpenCV's StdMatAllocator with the data taken from the arena
+	///
+	class Srl_arena_mat_allocator : public cv::MatAllocator
+	{
+	public:
+		cv::UMatData* allocate( int dims, const int *sizes, int type, void *data_p, size_t *step,
+								int /*flags*/, cv::UMatUsageFlags /*usage_flags*/ ) const
+		{
+			size_t total = CV_ELEM_SIZE(type);
+			for (int i = dims - 1; i >= 0; i--)
+			{
+				if (nullptr != step)
+				{
+					if (nullptr != data_p && step[i] != CV_AUTOSTEP)
+					{
+						CV_Assert(total <= step[i]);
+						total = step[i];
+					}
+					else
+					{
+						step[i] = total;
+					}
+				}
+				total *= sizes[i];
+			}
+
+			unsigned char *memory_p = static_cast<unsigned char*>(data_p);
+			if (nullptr == memory_p)
+			{
+				memory_p = static_cast<unsigned char*>(Srl_batch_arena::allocate(total, CV_MALLOC_ALIGN));
+				if (nullptr == memory_p)
+				{
+					throw std::bad_alloc();
+				}
+			}
+
+			cv::UMatData *u = new cv::UMatData(this);
+			u->data = u->origdata = memory_p;
+			u->size = total;
+			if (nullptr != data_p)
+			{
+				u->flags |= cv::UMatData::USER_ALLOCATED;
+			}
+			return u;
+		}
+
+		bool allocate( cv::UMatData *u, int /*access_flags*/, cv::UMatUsageFlags /*usage_flags*/ ) const
+		{
+			return nullptr != u;
+		}
+
+		void deallocate( cv::UMatData *u ) const
+		{
+			if (nullptr == u)
+			{
+				return;
+			}
+			if (!(u->flags & cv::UMatData::USER_ALLOCATED))
+			{
+				Srl_batch_arena::deallocate(u->origdata);
+				u->origdata = nullptr;
+			}
+			delete u;
+		}
+	};
+
+	///
+	/// @brief	Never destroyed, Mats allocated by it can outlive static destruction
+	///
+	Srl_arena_mat_allocator* mat_allocator( void )
+	{
+		static Srl_arena_mat_allocator *allocator_p = new Srl_arena_mat_allocator();
+		return allocator_p;
+	}
+
+	void* magick_acquire( size_t bytes )
+	{
+		return Srl_batch_arena::allocate(bytes, SRL_MAGICK_ALIGN);
+	}
+
+	void* magick_resize( void *memory_p, size_t bytes )
+	{
+		return Srl_batch_arena::reallocate(memory_p, bytes, SRL_MAGICK_ALIGN);
+	}
+
+	void magick_destroy( void *memory_p )
+	{
+		Srl_batch_arena::deallocate(memory_p);
+	}
+}
+
+/***************************************************
+*
+*					Static interface
+*
+****************************************************/
+
+Srl_batch_arena& Srl_batch_arena::thread_local_arena( void )
+{
+	static thread_local Srl_batch_arena arena;
+	return arena;
+}
+
+void Srl_batch_arena::install( void )
+{
+	static std::once_flag install_flag;
+	std::call_once(install_flag, []()
+	{
+		cv::Mat::setDefaultAllocator(mat_allocator());
+
+		//Memory Magick already holds came from malloc and can't be handed to the arena's free,
+		//so once Magick is running it keeps its own methods
+		if (MagickCore::MagickFalse == MagickCore::IsMagickCoreInstantiated())
+		{
+			MagickCore::SetMagickMemoryMethods(magick_acquire, magick_resize, magick_destroy);
+		}
+		g_installed = true;
+	});
+}
+
+bool Srl_batch_arena::installed( void )
+{
+	return g_installed.load();
+}
+
+void* Srl_batch_arena::allocate( size_t bytes, size_t alignment )
+{
+	if (0 == bytes)
+	{
+		bytes = 1;
+	}
+	if (g_counting.load(std::memory_order_relaxed))
+	{
+		g_allocations.fetch_add(1, std::memory_order_relaxed);
+		g_allocated_bytes.fetch_add(bytes, std::memory_order_relaxed);
+	}
+	if (nullptr != t_active_arena_p)
+	{
+		return t_active_arena_p->bump(bytes, alignment);
+	}
+	return heap_allocate(bytes, alignment);
+}
+
+void Srl_batch_arena::set_allocation_counting( bool counting )
+{
+	g_counting = counting;
+}
+
+Srl_allocation_counts Srl_batch_arena::allocation_counts( void )
+{
+	Srl_allocation_counts counts;
+	counts.allocations = g_allocations.load();
+	counts.bytes = g_allocated_bytes.load();
+	return counts;
+}
+
+void Srl_batch_arena::reset_allocation_counts( void )
+{
+	g_allocations = 0;
+	g_allocated_bytes = 0;
+}
+
+void Srl_batch_arena::deallocate( void *memory_p )
+{
+	if (nullptr == memory_p)
+	{
+		return;
+	}
+
+	Srl_arena_header *header_p = header_of(memory_p);
+	if (nullptr == header_p->block_p)
+	{
+		std::free(header_p->base_p);
+		return;
+	}
+
+	if (nullptr != t_active_arena_p && t_active_arena_p->is_last(header_p->block_p, memory_p))
+	{	//Most recent allocation on its own thread, give the space straight back
+		header_p->block_p->used = static_cast<size_t>(reinterpret_cast<unsigned char*>(header_p) - header_p->block_p->data_p);
+	}
+	//Otherwise arena memory comes back in one go when the block is rewound
+	release_block(header_p->block_p);
+}
+
+void* Srl_batch_arena::reallocate( void *memory_p, size_t bytes, size_t alignment )
+{
+	if (nullptr == memory_p)
+	{
+		return allocate(bytes, alignment);
+	}
+
+	Srl_arena_header *header_p = header_of(memory_p);
+	if (bytes <= header_p->size)
+	{
+		return memory_p;
+	}
+
+	Srl_arena_block *block_p = header_p->block_p;
+	if (nullptr != block_p && nullptr != t_active_arena_p && t_active_arena_p->is_last(block_p, memory_p) &&
+		static_cast<unsigned char*>(memory_p) + bytes <= block_p->data_p + block_p->capacity)
+	{	//Blobs grow by repeated resizes, extend the latest one where it lies
+		block_p->used += bytes - header_p->size;
+		header_p->size = bytes;
+		return memory_p;
+	}
+
+	void *resized_p = allocate(bytes, alignment);
+	if (nullptr != resized_p)
+	{
+		std::memcpy(resized_p, memory_p, header_p->size);
+		deallocate(memory_p);
+	}
+	return resized_p;
+}
+
+/***************************************************
+*
+*					CTOR & DTOR
+*
+****************************************************/
+
+Srl_batch_arena::Srl_batch_arena( void )
+	:	m_current(0),
+		m_depth(0)
+{
+}
+
+Srl_batch_arena::~Srl_batch_arena()
+{
+	for (size_t i = 0; i < m_blocks.size(); i++)
+	{
+		release_block(m_blocks[i]);
+	}
+}
+
+/***************************************************
+*
+*					Blocks
+*
+****************************************************/
+
+void* Srl_batch_arena::bump( size_t bytes, size_t alignment )
+{
+	while (m_current < m_blocks.size())
+	{
+		void *memory_p = place(m_blocks[m_current], bytes, alignment);
+		if (nullptr != memory_p)
+		{
+			return memory_p;
+		}
+
+		if (bytes > SRL_ARENA_BLOCK_BYTES / 2)
+		{	//Don't abandon the rest of the current block for one oversized allocation
+			break;
+		}
+		m_current++;
+	}
+
+	size_t index = add_block(bytes + sizeof(Srl_arena_header) + alignment);
+	return place(m_blocks[index], bytes, alignment);
+}
+
+size_t Srl_batch_arena::add_block( size_t bytes )
+{
+	Srl_arena_block *block_p = new_block(std::max(bytes, SRL_ARENA_BLOCK_BYTES));
+
+	if (m_current < m_blocks.size())
+	{	//Oversized, slot it in ahead of the partly used current block so that stays current
+		m_blocks.insert(m_blocks.begin() + m_current, block_p);
+		return m_current++;
+	}
+
+	m_blocks.push_back(block_p);
+	m_current = m_blocks.size() - 1;
+	return m_current;
+}
+
+void Srl_batch_arena::reset( void )
+{
+	size_t retained = 0;
+	size_t kept = 0;
+
+	for (size_t i = 0; i < m_blocks.size(); i++)
+	{
+		Srl_arena_block *block_p = m_blocks[i];
+
+		//Only this thread allocates from the block, so with just the arena's reference left nothing
+		//can take a new one and it is safe to rewind
+		if (1 == block_p->refs.load(std::memory_order_acquire) &&
+			retained + block_p->capacity <= SRL_ARENA_RETAIN_BYTES)
+		{
+			block_p->used = 0;
+			retained += block_p->capacity;
+			m_blocks[kept++] = block_p;
+		}
+		else
+		{	//Still in use or surplus, freed now or by its last deallocate()
+			release_block(block_p);
+		}
+	}
+
+	m_blocks.resize(kept);
+	m_current = 0;
+}
+
+bool Srl_batch_arena::is_last( const Srl_arena_block *block_p, const void *memory_p ) const
+{
+	return m_current < m_blocks.size() && m_blocks[m_current] == block_p &&
+		   static_cast<const unsigned char*>(memory_p) + header_of(const_cast<void*>(memory_p))->size ==
+		   block_p->data_p + block_p->used;
+}
+
+size_t Srl_batch_arena::bytes_reserved( void ) const
+{
+	size_t total = 0;
+	for (size_t i = 0; i < m_blocks.size(); i++)
+	{
+		total += m_blocks[i]->capacity;
+	}
+	return total;
+}
+
+bool Srl_batch_arena::active( void ) const
+{
+	return 0 != m_depth;
+}
+
+/***************************************************
+*
+*					Srl_arena_scope
+*
+****************************************************/
+
+Srl_arena_scope::Srl_arena_scope( void )
+	:	m_arena(Srl_batch_arena::thread_local_arena()),
+		m_previous_p(t_active_arena_p)
+{
+	m_arena.m_depth++;
+	t_active_arena_p = &m_arena;
+}
+
+Srl_arena_scope::~Srl_arena_scope()
+{
+	//Back to the heap if this scope was opened under a bypass
+	t_active_arena_p = m_previous_p;
+	if (0 == --m_arena.m_depth)
+	{
+		m_arena.reset();
+	}
+}
+
+/***************************************************
+*
+*					Srl_arena_bypass
+*
+****************************************************/
+
+Srl_arena_bypass::Srl_arena_bypass( void )
+	:	m_suspended_p(t_active_arena_p)
+{
+	t_active_arena_p = nullptr;
+}
+
+Srl_arena_bypass::~Srl_arena_bypass()
+{
+	t_active_arena_p = m_suspended_p;
+}
@@ -0,0 +1,205 @@
+// $Id$
+//------------------------------------------------------------------------------------
+///
+/// @file
+///
+/// @brief Per thread bump allocator for the scratch memory of each image
+///
+/// @section VERSION
+/// 1.0
+///
+/// @section DESCRIPTION
+/// Every image makes hundreds of heap allocations for its cv::Mat temporaries, Magick
+/// blobs and exception info, all from every worker at once. Once installed the arena
+/// is OpenCV's default MatAllocator and ImageMagick's memory methods. While a scope is
+/// open on a thread their allocations are bumped out of that thread's blocks, and
+/// frees are just a counter decrement (or a cursor rewind for the latest allocation). The blocks are rewound in one step when the
+/// outermost scope closes. Blocks still holding an allocation at that point (a Mat
+/// that outlives its image) are retired instead and freed when the last one is freed,
+/// so an escaping allocation is never left dangling.
+//------------------------------------------------------------------------------------
+
+#pragma once
+
+#ifndef _SRL_BATCH_ARENA_HPP
+#define _SRL_BATCH_ARENA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace srl
+{
+	///
+	/// @brief	size of each arena block, larger allocations get a block of their own
+	///
+	const size_t SRL_ARENA_BLOCK_BYTES = 4 * 1024 * 1024;
+
+	///
+	/// @brief	bytes of empty blocks each thread keeps for the next scope, the rest are freed
+	///
+	const size_t SRL_ARENA_RETAIN_BYTES = 64 * 1024 * 1024;
+
+	struct Srl_arena_block;
+
+	///
+	/// @brief	allocate() calls, and the bytes they asked for, made while counting was on
+	///
+	struct Srl_allocation_counts
+	{
+		uint64_t allocations;
+		uint64_t bytes;
+	};
+
+	///
+	/// @brief	Blocks owned by a single thread. Only that thread allocates from them, any thread may free
+	///
+	class Srl_batch_arena
+	{
+	public:
+
+		///
+		/// @brief	returns the calling thread's arena, created on first use and released when the thread exits
+		///
+		static Srl_batch_arena& thread_local_arena( void );
+
+		///
+		/// @brief	Makes the arena OpenCV's default MatAllocator and ImageMagick's memory methods.
+		///			Magick's are only replaced if it hasn't been initialised yet, initialise_library()
+		///			calls this first
+		///
+		static void install( void );
+
+		///
+		/// @brief	true once install() has been called
+		///
+		static bool installed( void );
+
+		///
+		/// @brief	Allocates from the calling thread's arena if a scope is open on it, from the heap
+		///			otherwise. Either way the result must be freed with deallocate()
+		///
+		/// @param[in]	alignment	power of two
+		///
+		static void* allocate( size_t bytes, size_t alignment );
+
+		///
+		/// @brief	Frees memory from allocate()
+		///
+		static void deallocate( void *memory_p );
+
+		///
+		/// @brief	realloc equivalent for memory from allocate()
+		///
+		static void* reallocate( void *memory_p, size_t bytes, size_t alignment );
+
+		///
+		/// @brief	Turns counting of every allocate() on or off, off by default. Every thread counts
+		///			into the same counters so leave it off while timing anything
+		///
+		static void set_allocation_counting( bool counting );
+
+		static Srl_allocation_counts allocation_counts( void );
+		static void reset_allocation_counts( void );
+
+		Srl_batch_arena( void );
+
+		///
+		/// @brief	frees the empty blocks, blocks still in use are freed by their last deallocate()
+		///
+		~Srl_batch_arena();
+
+		Srl_batch_arena( const Srl_batch_arena& ) = delete;
+		Srl_batch_arena& operator=( const Srl_batch_arena& ) = delete;
+
+		///
+		/// @brief	Rewinds every block with nothing left in it and retires the others. Empty blocks over
+		///			SRL_ARENA_RETAIN_BYTES are freed
+		///
+		void reset( void );
+
+		///
+		/// @brief	bytes of block memory the arena currently owns
+		///
+		size_t bytes_reserved( void ) const;
+
+		///
+		/// @brief	true while a scope is open on the owning thread
+		///
+		bool active( void ) const;
+
+	private:
+
+		friend class Srl_arena_scope;
+		friend class Srl_arena_bypass;
+
+		void* bump( size_t bytes, size_t alignment );
+
+		///
+		/// @brief	true if memory_p is the latest allocation in the block being bumped, which the owning
+		///			thread can then shrink or grow in place
+		///
+		bool is_last( const Srl_arena_block *block_p, const void *memory_p ) const;
+
+		///
+		/// @brief	appends a block with room for at least bytes, returns its index
+		///
+		size_t add_block( size_t bytes );
+
+		///
+		///	@brief	m_blocks	every block the arena holds a reference on, filled in order
+		///
+		std::vector<Srl_arena_block*> m_blocks;
+
+		///
+		///	@brief	m_current	index into m_blocks of the block being bumped
+		///
+		size_t m_current;
+
+		///
+		///	@brief	m_depth		open scopes on the owning thread, the arena is reset when it drops to 0
+		///
+		unsigned int m_depth;
+	};
+
+	///
+	/// @brief	Routes the calling thread's allocations into its arena for the scope's lifetime. Scopes
+	///			nest, the arena is reset when the outermost one closes
+	///
+	class Srl_arena_scope
+	{
+	public:
+		Srl_arena_scope( void );
+		~Srl_arena_scope();
+
+		Srl_arena_scope( const Srl_arena_scope& ) = delete;
+		Srl_arena_scope& operator=( const Srl_arena_scope& ) = delete;
+
+	private:
+		Srl_batch_arena &m_arena;
+
+		///
+		///	@brief	m_previous_p	arena allocations went to when the scope opened, restored on close
+		///
+		Srl_batch_arena *m_previous_p;
+	};
+
+	///
+	/// @brief	Sends the calling thread's allocations to the heap for the bypass's lifetime, even with
+	///			a scope open. For memory that outlives the scope it is made in, such as decoded pixels
+	///
+	class Srl_arena_bypass
+	{
+	public:
+		Srl_arena_bypass( void );
+		~Srl_arena_bypass();
+
+		Srl_arena_bypass( const Srl_arena_bypass& ) = delete;
+		Srl_arena_bypass& operator=( const Srl_arena_bypass& ) = delete;
+
+	private:
+		Srl_batch_arena *m_suspended_p;
+	};
+}
+
+#endif //_SRL_BATCH_ARENA_HPP
@@ -0,0 +1,141 @@
+// $Id$
+//------------------------------------------------------------------------------------
+///
+/// @file
+///
+/// @brief Fixed capacity blocking queue used between the pipeline stages
+///
+/// @section VERSION
+/// 1.0
+///
+/// @section DESCRIPTION
+/// push() blocks while the queue is full, which is what stops a fast stage running
+/// ahead of a slow one and holds the number of images in flight to the queue depths.
+//------------------------------------------------------------------------------------
+
+#pragma once
+
+#ifndef _SRL_BOUNDED_QUEUE_HPP
+#define _SRL_BOUNDED_QUEUE_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+namespace srl
+{
+	///
+	/// @brief	Multi producer, multi consumer FIFO with a fixed capacity
+	///
+	template <typename T>
+	class Srl_bounded_queue
+	{
+	public:
+
+		///
+		/// @param[in]	capacity	maximum number of queued elements, 0 is treated as 1
+		///
+		explicit Srl_bounded_queue( size_t capacity )
+			:	m_capacity( (0 == capacity) ? 1 : capacity ),
+				m_closed( false ),
+				m_aborted( false )
+		{
+		}
+
+		Srl_bounded_queue( const Srl_bounded_queue& ) = delete;
+		Srl_bounded_queue& operator=( const Srl_bounded_queue& ) = delete;
+
+		///
+		/// @brief	Adds an element, blocking while the queue is full
+		///
+		/// @return	bool	false if the queue was closed or aborted, value is left untouched
+		///
+		bool push( T &&value )
+		{
+			std::unique_lock<std::mutex> lock( m_lock );
+			m_not_full.wait( lock, [this] { return m_closed || m_aborted || m_items.size() < m_capacity; } );
+			if ( m_closed || m_aborted )
+			{
+				return false;
+			}
+			m_items.push_back( std::move( value ) );
+			lock.unlock();
+			m_not_empty.notify_one();
+			return true;
+		}
+
+		///
+		/// @brief	Removes the oldest element, blocking while the queue is empty and still open
+		///
+		/// @return	bool	false once the queue is closed and drained, or aborted
+		///
+		bool pop( T &value )
+		{
+			std::unique_lock<std::mutex> lock( m_lock );
+			m_not_empty.wait( lock, [this] { return m_aborted || m_closed || !m_items.empty(); } );
+			if ( m_aborted || m_items.empty() )
+			{
+				return false;
+			}
+			value = std::move( m_items.front() );
+			m_items.pop_front();
+			lock.unlock();
+			m_not_full.notify_one();
+			return true;
+		}
+
+		///
+		/// @brief	No more pushes are accepted, consumers drain what is left then see false from pop()
+		///
+		void close( void )
+		{
+			{
+				std::lock_guard<std::mutex> lock( m_lock );
+				m_closed = true;
+			}
+			m_not_empty.notify_all();
+			m_not_full.notify_all();
+		}
+
+		///
+		/// @brief	Discards the contents and wakes every waiter, used when a pipeline is torn down early
+		///
+		void abort( void )
+		{
+			std::deque<T> discarded;
+			{
+				std::lock_guard<std::mutex> lock( m_lock );
+				m_aborted = true;
+				discarded.swap( m_items );
+			}
+			m_not_empty.notify_all();
+			m_not_full.notify_all();
+		}
+
+		size_t size( void ) const
+		{
+			std::lock_guard<std::mutex> lock( m_lock );
+			return m_items.size();
+		}
+
+		size_t capacity( void ) const
+		{
+			return m_capacity;
+		}
+
+	private:
+
+		const size_t m_capacity;
+		bool m_closed;
+		bool m_aborted;
+		std::deque<T> m_items;
+
+		mutable std::mutex m_lock;
+		std::condition_variable m_not_full;
+		std::condition_variable m_not_empty;
+	};
+}
+
+#endif //_SRL_BOUNDED_QUEUE_HPP
@@ -0,0 +1,99 @@
+//------------------------------------------------------------------------------------
+///
+/// @file   Srl_buffer_pool.cpp
+///
+/// @brief Per thread pool of reusable encoder output buffers
+///
+//------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+
+#include "Srl_buffer_pool.hpp"
+
+#include <algorithm>
+
+using namespace srl;
+using namespace std;
+
+namespace
+{
+	///
+	/// @brief	true if a has less capacity than b
+	///
+	bool smaller_capacity(const Srl_buffer_pool::buffer_type &a, const Srl_buffer_pool::buffer_type &b)
+	{
+		return a.capacity() < b.capacity();
+	}
+}
+
+Srl_buffer_pool& Srl_buffer_pool::thread_local_pool( void )
+{
+	static thread_local Srl_buffer_pool pool;
+	return pool;
+}
+
+Srl_buffer_pool::Srl_buffer_pool( void )
+	:	m_high_water(0)
+{
+	m_free_v.reserve(SRL_MAX_POOLED_BUFFERS);
+}
+
+Srl_buffer_pool::buffer_type Srl_buffer_pool::acquire( size_t size_hint )
+{
+	buffer_type buffer;
+	if (!m_free_v.empty())
+	{
+		vector<buffer_type>::iterator largest = std::max_element(m_free_v.begin(), m_free_v.end(), smaller_capacity);
+		buffer.swap(*largest);
+		m_free_v.erase(largest);
+	}
+
+	buffer.clear();
+	//Encoders grow the buffer as they go, reserving up front saves the repeated reallocation
+	buffer.reserve(std::max(size_hint, m_high_water));
+	return buffer;
+}
+
+void Srl_buffer_pool::release( buffer_type &&buffer )
+{
+	if (0 == buffer.capacity())
+	{
+		return;
+	}
+	if (buffer.capacity() / 2 > m_high_water)
+	{	//Far bigger than anything this thread encodes, keeping it would pin the memory for nothing
+		buffer_type().swap(buffer);
+		return;
+	}
+
+	if (m_free_v.size() < SRL_MAX_POOLED_BUFFERS)
+	{
+		m_free_v.push_back(std::move(buffer));
+		return;
+	}
+
+	vector<buffer_type>::iterator smallest = std::min_element(m_free_v.begin(), m_free_v.end(), smaller_capacity);
+	if (smallest->capacity() < buffer.capacity())
+	{
+		smallest->swap(buffer);
+	}
+	//Free whichever buffer lost out rather than leaving it to the caller
+	buffer_type().swap(buffer);
+}
+
+void Srl_buffer_pool::record_size( size_t bytes )
+{
+	m_high_water = std::max(m_high_water, bytes);
+}
+
+size_t Srl_buffer_pool::high_water_mark( void ) const
+{
+	return m_high_water;
+}
+
+void Srl_buffer_pool::trim( void )
+{
+	vector<buffer_type>().swap(m_free_v);
+	m_free_v.reserve(SRL_MAX_POOLED_BUFFERS);
+	m_high_water = 0;
+}
@@ -0,0 +1,94 @@
+// $Id$
+//------------------------------------------------------------------------------------
+///
+/// @file
+///
+/// @brief Per thread pool of reusable encoder output buffers
+///
+/// @section VERSION
+/// 1.0
+///
+/// @section DESCRIPTION
+/// Encoding a large image into a fresh vector means faulting in tens of MB of pages
+/// which are handed straight back to the OS. Each thread instead keeps a handful of
+/// released buffers and hands them out again, reserved up to the largest encode that
+/// thread has produced so far, so steady state batches stop allocating altogether.
+//------------------------------------------------------------------------------------
+
+#pragma once
+
+#ifndef _SRL_BUFFER_POOL_HPP
+#define _SRL_BUFFER_POOL_HPP
+
+#include <cstddef>
+#include <vector>
+
+namespace srl
+{
+	///
+	/// @brief	Free list of byte buffers owned by a single thread, never shared so it takes no locks
+	///
+	class Srl_buffer_pool
+	{
+	public:
+
+		typedef std::vector<unsigned char> buffer_type;
+
+		///
+		/// @brief	maximum number of released buffers each thread holds on to
+		///
+		static const size_t SRL_MAX_POOLED_BUFFERS = 4;
+
+		///
+		/// @brief	returns the calling thread's pool, created on first use and freed when the thread exits
+		///
+		static Srl_buffer_pool& thread_local_pool( void );
+
+		Srl_buffer_pool( void );
+
+		Srl_buffer_pool( const Srl_buffer_pool& ) = delete;
+		Srl_buffer_pool& operator=( const Srl_buffer_pool& ) = delete;
+
+		///
+		/// @brief	Hands out an empty buffer with at least the high-water mark (or size_hint if larger)
+		///			reserved. The largest pooled buffer is reused where there is one
+		///
+		buffer_type acquire( size_t size_hint = 0 );
+
+		///
+		/// @brief	Returns a buffer to the pool. Buffers with no capacity are ignored, as are buffers over
+		///			twice the high-water mark, e.g. from before a trim(). When the pool is full the smallest
+		///			buffer is the one freed. Must be called on the thread the pool belongs to
+		///
+		void release( buffer_type &&buffer );
+
+		///
+		/// @brief	Records the size of a finished encode, raising the high-water mark if needed
+		///
+		void record_size( size_t bytes );
+
+		///
+		/// @brief	largest size passed to record_size() since construction or the last trim()
+		///
+		size_t high_water_mark( void ) const;
+
+		///
+		/// @brief	frees every pooled buffer and resets the high-water mark, e.g. after an unusually large batch
+		///
+		void trim( void );
+
+	private:
+
+		///
+		///	@brief	m_free_v	released buffers waiting to be reused
+		///
+		std::vector<buffer_type> m_free_v;
+
+		///
+		///	@brief	m_high_water	largest encode seen by this thread
+		///
+		size_t m_high_water;
+	};
+}
+
+#endif //_SRL_BUFFER_POOL_HPP
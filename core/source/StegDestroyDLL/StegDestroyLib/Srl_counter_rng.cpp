@@ -0,0 +1,198 @@
+//------------------------------------------------------------------------------------
+///
+/// @file   Srl_counter_rng.cpp
+///
+/// @brief Philox4x32-10 with a scalar and an eight lane AVX2 block generator
+///
+//------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+
+#include "Srl_counter_rng.hpp"
+#include "Srl_cpu_features.hpp"
+
+#include <cstring>
+
+#include <immintrin.h>
+
+using namespace srl;
+using namespace std;
+
+namespace
+{
+	const uint32_t PHILOX_M0 = 0xD2511F53u;
+	const uint32_t PHILOX_M1 = 0xCD9E8D57u;
+	const uint32_t PHILOX_W0 = 0x9E3779B9u;
+	const uint32_t PHILOX_W1 = 0xBB67AE85u;
+	const int PHILOX_ROUNDS = 10;
+
+	///
+	/// @brief	counters per fill() block, each gives four 32 bit words
+	///
+	const size_t BLOCK_LANES = 8;
+
+	inline uint32_t lo32(uint64_t value)
+	{
+		return static_cast<uint32_t>(value);
+	}
+
+	inline uint32_t hi32(uint64_t value)
+	{
+		return static_cast<uint32_t>(value >> 32);
+	}
+
+	/***************************************************
+	*
+	*					Block generators
+	*
+	****************************************************/
+
+	///
+	/// @brief	Writes one SRL_RNG_BLOCK_BYTES block. Word w of lane l lands at byte (w * 8 + l) * 4,
+	///			the layout the AVX2 generator stores in without a transpose
+	///
+	typedef void (*Srl_rng_block_fn)(const uint32_t key[2], uint64_t stream, uint64_t block, unsigned char *out_p);
+
+	void rng_block_scalar(const uint32_t key[2], uint64_t stream, uint64_t block, unsigned char *out_p)
+	{
+		uint32_t words[4][BLOCK_LANES];
+		for (size_t lane = 0; lane < BLOCK_LANES; lane++)
+		{
+			uint64_t index = block * BLOCK_LANES + lane;
+			uint32_t counter[4] = { lo32(index), hi32(index), lo32(stream), hi32(stream) };
+			uint32_t result[4];
+			Srl_counter_rng::philox4x32(counter, key, result);
+			for (int w = 0; w < 4; w++)
+			{
+				words[w][lane] = result[w];
+			}
+		}
+		//Byte order matches the little endian vector stores of the AVX2 path
+		memcpy(out_p, words, sizeof(words));
+	}
+
+	///
+	/// @brief	high and low halves of the eight 32x32 bit products of a and m
+	///
+	SRL_TARGET_AVX2
+	inline void mulhilo_avx2(__m256i a, __m256i m, __m256i &hi, __m256i &lo)
+	{
+		lo = _mm256_mullo_epi32(a, m);
+		__m256i even = _mm256_mul_epu32(a, m);
+		__m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), _mm256_srli_epi64(m, 32));
+		hi = _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+	}
+
+	SRL_TARGET_AVX2
+	void rng_block_avx2(const uint32_t key[2], uint64_t stream, uint64_t block, unsigned char *out_p)
+	{
+		const uint64_t first = block * BLOCK_LANES;
+		//Eight consecutive 64 bit indices, the carry into the high word is rare but must be honoured
+		alignas(32) uint32_t index_lo[BLOCK_LANES];
+		alignas(32) uint32_t index_hi[BLOCK_LANES];
+		for (size_t lane = 0; lane < BLOCK_LANES; lane++)
+		{
+			index_lo[lane] = lo32(first + lane);
+			index_hi[lane] = hi32(first + lane);
+		}
+
+		__m256i x0 = _mm256_load_si256(reinterpret_cast<const __m256i*>(index_lo));
+		__m256i x1 = _mm256_load_si256(reinterpret_cast<const __m256i*>(index_hi));
+		__m256i x2 = _mm256_set1_epi32(static_cast<int>(lo32(stream)));
+		__m256i x3 = _mm256_set1_epi32(static_cast<int>(hi32(stream)));
+
+		const __m256i m0 = _mm256_set1_epi32(static_cast<int>(PHILOX_M0));
+		const __m256i m1 = _mm256_set1_epi32(static_cast<int>(PHILOX_M1));
+		uint32_t k0 = key[0];
+		uint32_t k1 = key[1];
+
+		for (int round = 0; round < PHILOX_ROUNDS; round++)
+		{
+			if (round > 0)
+			{
+				k0 += PHILOX_W0;
+				k1 += PHILOX_W1;
+			}
+			__m256i hi0, lo0, hi1, lo1;
+			mulhilo_avx2(x0, m0, hi0, lo0);
+			mulhilo_avx2(x2, m1, hi1, lo1);
+
+			x0 = _mm256_xor_si256(_mm256_xor_si256(hi1, x1), _mm256_set1_epi32(static_cast<int>(k0)));
+			x1 = lo1;
+			x2 = _mm256_xor_si256(_mm256_xor_si256(hi0, x3), _mm256_set1_epi32(static_cast<int>(k1)));
+			x3 = lo0;
+		}
+
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out_p), x0);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out_p + 32), x1);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out_p + 64), x2);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out_p + 96), x3);
+		_mm256_zeroupper();
+	}
+
+	Srl_rng_block_fn select_block_fn()
+	{
+		return (SRL_SIMD_AVX2 == cpu_simd_level()) ? rng_block_avx2 : rng_block_scalar;
+	}
+}
+
+Srl_counter_rng::Srl_counter_rng( uint64_t seed )
+{
+	m_key[0] = lo32(seed);
+	m_key[1] = hi32(seed);
+}
+
+void Srl_counter_rng::philox4x32( const uint32_t counter[4], const uint32_t key[2], uint32_t out[4] )
+{
+	uint32_t x0 = counter[0], x1 = counter[1], x2 = counter[2], x3 = counter[3];
+	uint32_t k0 = key[0], k1 = key[1];
+
+	for (int round = 0; round < PHILOX_ROUNDS; round++)
+	{
+		if (round > 0)
+		{
+			k0 += PHILOX_W0;
+			k1 += PHILOX_W1;
+		}
+		uint64_t p0 = static_cast<uint64_t>(PHILOX_M0) * x0;
+		uint64_t p1 = static_cast<uint64_t>(PHILOX_M1) * x2;
+
+		x0 = hi32(p1) ^ x1 ^ k0;
+		x1 = lo32(p1);
+		x2 = hi32(p0) ^ x3 ^ k1;
+		x3 = lo32(p0);
+	}
+
+	out[0] = x0;
+	out[1] = x1;
+	out[2] = x2;
+	out[3] = x3;
+}
+
+void Srl_counter_rng::fill( uint64_t stream, uint64_t offset, unsigned char *out_p, size_t length ) const
+{
+	static const Srl_rng_block_fn block_fn = select_block_fn();
+
+	uint64_t block = offset / SRL_RNG_BLOCK_BYTES;
+	while (length >= SRL_RNG_BLOCK_BYTES)
+	{
+		block_fn(m_key, stream, block++, out_p);
+		out_p += SRL_RNG_BLOCK_BYTES;
+		length -= SRL_RNG_BLOCK_BYTES;
+	}
+
+	if (length > 0)
+	{	//Partial tail, generate the whole block and keep the front of it
+		unsigned char tail[SRL_RNG_BLOCK_BYTES];
+		block_fn(m_key, stream, block, tail);
+		memcpy(out_p, tail, length);
+	}
+}
+
+uint64_t Srl_counter_rng::at( uint64_t stream, uint64_t index ) const
+{
+	uint32_t counter[4] = { lo32(index), hi32(index), lo32(stream), hi32(stream) };
+	uint32_t result[4];
+	philox4x32(counter, m_key, result);
+	return (static_cast<uint64_t>(result[1]) << 32) | result[0];
+}
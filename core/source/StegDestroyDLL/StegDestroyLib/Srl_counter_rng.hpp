@@ -0,0 +1,77 @@
+// $Id$
+//------------------------------------------------------------------------------------
+///
+/// @file
+///
+/// @brief Counter based random source shared by the scrub kernels
+///
+/// @section VERSION
+/// 1.0
+///
+/// @section DESCRIPTION
+/// Philox4x32-10 maps a (stream, index) counter and the image seed straight to random
+/// bits with no state carried between calls. Any thread can generate any part of any
+/// stream, so scrub output depends only on the seed and the pixel or block position
+/// and never on how many threads the work was split across.
+//------------------------------------------------------------------------------------
+
+#pragma once
+
+#ifndef _SRL_COUNTER_RNG_HPP
+#define _SRL_COUNTER_RNG_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace srl
+{
+	///
+	/// @brief	Stateless Philox4x32-10 generator keyed by a per image seed
+	///
+	/// @description	Streams separate independent consumers, e.g. one per pixel row or per JPEG
+	///					component and block row. A stream should be read either through fill() or
+	///					through at(), the two index the same counters differently.
+	///
+	class Srl_counter_rng
+	{
+	public:
+
+		///
+		/// @brief	bytes produced per block by fill(), eight Philox counters
+		///
+		static const size_t SRL_RNG_BLOCK_BYTES = 128;
+
+		///
+		/// @param[in]	seed	per image seed, the 64 bit Philox key
+		///
+		explicit Srl_counter_rng( uint64_t seed );
+
+		///
+		/// @brief	Fills length bytes of the given stream, starting offset bytes in. Vectorised with
+		///			AVX2 where available, the output is identical either way
+		///
+		/// @param[in]	offset	must be a multiple of SRL_RNG_BLOCK_BYTES, length need not be
+		///
+		void fill( uint64_t stream, uint64_t offset, unsigned char *out_p, size_t length ) const;
+
+		///
+		/// @brief	Single 64 bit value for sparse use, e.g. one per DCT block
+		///
+		uint64_t at( uint64_t stream, uint64_t index ) const;
+
+		///
+		/// @brief	The raw Philox4x32-10 bijection, exposed so it can be checked against the
+		///			published known answer vectors
+		///
+		static void philox4x32( const uint32_t counter[4], const uint32_t key[2], uint32_t out[4] );
+
+	private:
+
+		///
+		///	@brief	m_key	seed split into the two Philox key words
+		///
+		uint32_t m_key[2];
+	};
+}
+
+#endif //_SRL_COUNTER_RNG_HPP
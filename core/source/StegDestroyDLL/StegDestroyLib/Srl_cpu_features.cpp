@@ -0,0 +1,64 @@
+//------------------------------------------------------------------------------------
+///
+/// @file   Srl_cpu_features.cpp
+///
+/// @brief Runtime detection of the SIMD instruction sets the kernels can use
+///
+//------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+
+#include "Srl_cpu_features.hpp"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+using namespace srl;
+
+namespace
+{
+	Srl_simd_level detect_simd_level()
+	{
+#if defined(_MSC_VER)
+		int regs[4] = { 0 };
+		__cpuid(regs, 0);
+		const int max_leaf = regs[0];
+
+		__cpuid(regs, 1);
+		const bool sse2 = 0 != (regs[3] & (1 << 26));
+		const bool osxsave = 0 != (regs[2] & (1 << 27));
+		const bool avx = 0 != (regs[2] & (1 << 28));
+
+		bool avx2 = false;
+		//The OS has to save the YMM registers on a context switch as well as the CPU supporting AVX2
+		if (max_leaf >= 7 && osxsave && avx && 6 == (_xgetbv(0) & 6))
+		{
+			__cpuidex(regs, 7, 0);
+			avx2 = 0 != (regs[1] & (1 << 5));
+		}
+#elif defined(__GNUC__) || defined(__clang__)
+		__builtin_cpu_init();
+		const bool sse2 = 0 != __builtin_cpu_supports("sse2");
+		const bool avx2 = 0 != __builtin_cpu_supports("avx2");
+#else
+		const bool sse2 = false;
+		const bool avx2 = false;
+#endif
+		if (avx2)
+		{
+			return SRL_SIMD_AVX2;
+		}
+		return sse2 ? SRL_SIMD_SSE2 : SRL_SIMD_SCALAR;
+	}
+}
+
+namespace srl
+{
+	Srl_simd_level cpu_simd_level( void )
+	{
+		//Function local static so the detection is thread safe and runs once
+		static const Srl_simd_level level = detect_simd_level();
+		return level;
+	}
+}
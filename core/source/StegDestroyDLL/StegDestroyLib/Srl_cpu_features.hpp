@@ -0,0 +1,47 @@
+// $Id$
+//------------------------------------------------------------------------------------
+///
+/// @file
+///
+/// @brief Runtime detection of the SIMD instruction sets the kernels can use
+///
+/// @section VERSION
+/// 1.0
+///
+/// @section DESCRIPTION
+/// The library is built for the x64 baseline so AVX2 kernels are compiled alongside
+/// the portable ones and picked at runtime. Detection runs once per process.
+//------------------------------------------------------------------------------------
+
+#pragma once
+
+#ifndef _SRL_CPU_FEATURES_HPP
+#define _SRL_CPU_FEATURES_HPP
+
+//MSVC lets any function use any intrinsic, GCC and clang need the target enabling per function
+#if defined(__GNUC__) || defined(__clang__)
+#define SRL_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define SRL_TARGET_AVX2
+#endif
+
+namespace srl
+{
+	///
+	/// @brief	Widest instruction set usable on this machine, in increasing order
+	///
+	enum Srl_simd_level
+	{
+		SRL_SIMD_SCALAR,
+		SRL_SIMD_SSE2,
+		SRL_SIMD_AVX2
+	};
+
+	///
+	/// @brief	Instruction set kernels should be selected for. AVX2 is only reported if the OS also
+	///			saves the YMM registers
+	///
+	Srl_simd_level cpu_simd_level( void );
+}
+
+#endif //_SRL_CPU_FEATURES_HPP
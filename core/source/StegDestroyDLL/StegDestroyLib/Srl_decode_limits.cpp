@@ -0,0 +1,96 @@
+//------------------------------------------------------------------------------------
+///
+/// @file   Srl_decode_limits.cpp
+///
+/// @brief Limits on what an image may decode to, checked from its headers
+///
+//------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+
+#include "Srl_decode_limits.hpp"
+
+#include <mutex>
+
+#include <Magick++.h>
+
+using namespace srl;
+using namespace std;
+
+namespace
+{
+	mutex g_limits_lock;
+	Srl_decode_limits g_limits = default_decode_limits();
+
+	///
+	/// @brief	true if value is over limit, SRL_LIMIT_NONE never is
+	///
+	bool over( uint64_t value, uint64_t limit )
+	{
+		return SRL_LIMIT_NONE != limit && value > limit;
+	}
+
+	MagickCore::MagickSizeType magick_limit( uint64_t limit )
+	{
+		return (SRL_LIMIT_NONE == limit) ? MagickResourceInfinity : static_cast<MagickCore::MagickSizeType>(limit);
+	}
+}
+
+namespace srl
+{
+	Srl_decode_limits default_decode_limits( void )
+	{
+		Srl_decode_limits limits;
+		limits.max_width = 32768;
+		limits.max_height = 32768;
+		limits.max_pixels = 1ULL << 28;
+		limits.max_decoded_bytes = 1ULL << 31;
+		limits.max_frames = 1024;
+		return limits;
+	}
+
+	void set_decode_limits( const Srl_decode_limits &limits )
+	{
+		lock_guard<mutex> lock(g_limits_lock);
+		g_limits = limits;
+
+		//Width, height and area are per image, so they carry over as they are. Magick's memory limit is
+		//a total over every image it holds at once, a per image cap there would push concurrent decodes
+		//to a disk pixel cache, so it is left at Magick's own default
+		Magick::ResourceLimits::width(magick_limit(limits.max_width));
+		Magick::ResourceLimits::height(magick_limit(limits.max_height));
+		Magick::ResourceLimits::area(magick_limit(limits.max_pixels));
+	}
+
+	Srl_decode_limits decode_limits( void )
+	{
+		lock_guard<mutex> lock(g_limits_lock);
+		return g_limits;
+	}
+
+	Srl_exception_status check_decode_limits( const Srl_image_header &header,
+											  const Srl_decode_limits &limits,
+											  bool dct_mode )
+	{
+		const uint64_t pixels = static_cast<uint64_t>(header.width) * header.height;
+
+		if (over(header.width, limits.max_width) || over(header.height, limits.max_height) ||
+			over(pixels, limits.max_pixels) || over(header.frames, limits.max_frames) ||
+			header.frames_truncated ||
+			over(estimate_decoded_bytes(header, dct_mode), limits.max_decoded_bytes))
+		{
+			return SRL_ERROR_LIMIT_EXCEEDED;
+		}
+		return SRL_EXCEPT_NONE;
+	}
+
+	Srl_exception_status check_decode_limits( Srl_byte_view img_data, bool dct_mode )
+	{
+		Srl_image_header header;
+		if (!probe_image(img_data, header))
+		{
+			return SRL_EXCEPT_NONE;
+		}
+		return check_decode_limits(header, decode_limits(), dct_mode);
+	}
+}
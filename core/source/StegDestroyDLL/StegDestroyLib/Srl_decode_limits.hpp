@@ -0,0 +1,101 @@
+// $Id$
+//------------------------------------------------------------------------------------
+///
+/// @file
+///
+/// @brief Limits on what an image may decode to, checked from its headers
+///
+/// @section VERSION
+/// 1.0
+///
+/// @section DESCRIPTION
+/// A 100 byte PNG can declare 65535x65535 pixels and a TIFF can chain directories
+/// without end, and the decoders find out by allocating. Every Srl_steg_image probes
+/// its headers (see Srl_image_probe) and checks them against these limits before any
+/// decoder sees the data, failing with SRL_ERROR_LIMIT_EXCEEDED. The width, height and
+/// pixel limits are also set as ImageMagick resource limits to catch anything the probe
+/// couldn't read. max_decoded_bytes is only checked from the headers, Magick's memory
+/// limit is process wide and is left alone.
+/// OpenCV 3.4 has no runtime setting for this, the header check is its only guard.
+//------------------------------------------------------------------------------------
+
+#pragma once
+
+#ifndef _SRL_DECODE_LIMITS_HPP
+#define _SRL_DECODE_LIMITS_HPP
+
+#include <cstdint>
+
+#include "Srl_steg_data_types.hpp"
+#include "Srl_image_probe.hpp"
+
+namespace srl
+{
+	///
+	/// @brief	limit value meaning no limit
+	///
+	const uint64_t SRL_LIMIT_NONE = 0;
+
+	///
+	/// @brief	Largest image the library will decode, SRL_LIMIT_NONE disables a field
+	///
+	struct Srl_decode_limits
+	{
+		///
+		/// @brief	widest and tallest frame
+		///
+		uint64_t max_width;
+		uint64_t max_height;
+
+		///
+		/// @brief	most pixels in one frame
+		///
+		uint64_t max_pixels;
+
+		///
+		/// @brief	most bytes the decoded pixels may take, see estimate_decoded_bytes()
+		///
+		uint64_t max_decoded_bytes;
+
+		///
+		/// @brief	most frames (GIF) or directories (TIFF). A file with more than SRL_PROBE_MAX_FRAMES
+		///			is always rejected
+		///
+		uint64_t max_frames;
+	};
+
+	///
+	/// @brief	32768 pixels a side, 256 megapixels, 2GB decoded and 1024 frames
+	///
+	Srl_decode_limits default_decode_limits( void );
+
+	///
+	/// @brief	Replaces the process wide limits and applies the per image ones to ImageMagick. initialise_library()
+	///			sets default_decode_limits(), images already constructed keep the check they had
+	///
+	void set_decode_limits( const Srl_decode_limits &limits );
+
+	///
+	/// @brief	the limits currently in force
+	///
+	Srl_decode_limits decode_limits( void );
+
+	///
+	/// @brief	Checks a probed header against limits
+	///
+	/// @param[in]	dct_mode	the image will be held as JPEG coefficients rather than decoded
+	///
+	/// @return	Srl_exception_status	SRL_ERROR_LIMIT_EXCEEDED or SRL_EXCEPT_NONE
+	///
+	Srl_exception_status check_decode_limits( const Srl_image_header &header,
+											  const Srl_decode_limits &limits,
+											  bool dct_mode = false );
+
+	///
+	/// @brief	Probes img_data and checks it against the limits in force. Data whose headers can't be
+	///			read passes, the decoder will reject it or be stopped by the ImageMagick limits
+	///
+	Srl_exception_status check_decode_limits( Srl_byte_view img_data, bool dct_mode = false );
+}
+
+#endif //_SRL_DECODE_LIMITS_HPP
@@ -0,0 +1,142 @@
+//------------------------------------------------------------------------------------
+///
+/// @file   Srl_format_sniffer.cpp
+///
+/// @brief Signature based image format detection
+///
+//------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+
+#include "Srl_format_sniffer.hpp"
+#include "Srl_img_format_registry.hpp"
+
+#include <cctype>
+#include <cstring>
+
+using namespace std;
+
+namespace
+{
+	///
+	/// @brief	true if the buffer starts with the given signature
+	///
+	inline bool starts_with(const unsigned char *data_p, size_t length, const char *signature, size_t sig_length)
+	{
+		return (length >= sig_length) && (0 == memcmp(data_p, signature, sig_length));
+	}
+
+	///
+	/// @brief	Netpbm headers are 'P', the type digit, then whitespace
+	///
+	srl::Srl_img_format_enum sniff_netpbm(const unsigned char *data_p, size_t length)
+	{
+		if (length < 3 || 'P' != data_p[0] || !isspace(data_p[2]))
+		{
+			return srl::SRL_IMG_FORMAT_NONE;
+		}
+
+		switch (data_p[1])
+		{
+		case '1':
+		case '4':
+			return srl::SRL_IMG_FORMAT_PBM_CVIM;
+		case '2':
+		case '5':
+			return srl::SRL_IMG_FORMAT_PGM_CVIM;
+		case '3':
+		case '6':
+			return srl::SRL_IMG_FORMAT_PPM_CVIM;
+		case '7':
+			return srl::SRL_IMG_FORMAT_PAM_CVIM;
+		default:
+			return srl::SRL_IMG_FORMAT_NONE;
+		}
+	}
+}
+
+namespace srl
+{
+	Srl_img_format_enum sniff_img_format( Srl_byte_view img_data )
+	{
+		const unsigned char *data_p = img_data.data();
+		size_t length = img_data.size();
+
+		if (length < 2)
+		{
+			return SRL_IMG_FORMAT_NONE;
+		}
+
+		//Ordered roughly by how common each format is in mail traffic
+		if (starts_with(data_p, length, "\xFF\xD8\xFF", 3))
+		{
+			return SRL_IMG_FORMAT_JPEG_CVIM;
+		}
+		if (starts_with(data_p, length, "\x89PNG\r\n\x1A\n", 8))
+		{
+			return SRL_IMG_FORMAT_PNG_CVIM;
+		}
+		if (starts_with(data_p, length, "GIF87a", 6) || starts_with(data_p, length, "GIF89a", 6))
+		{
+			return SRL_IMG_FORMAT_GIF_IM;
+		}
+		if (starts_with(data_p, length, "BM", 2) && length >= 14)
+		{	//File header is 14 bytes, anything shorter is just text starting with BM
+			return SRL_IMG_FORMAT_BMP_CVIM;
+		}
+		//Classic TIFF is version 42, BigTIFF is 43
+		if (starts_with(data_p, length, "II*\0", 4) || starts_with(data_p, length, "MM\0*", 4) ||
+			starts_with(data_p, length, "II+\0", 4) || starts_with(data_p, length, "MM\0+", 4))
+		{
+			return SRL_IMG_FORMAT_TIFF_CVIM;
+		}
+		if (starts_with(data_p, length, "RIFF", 4) && length >= 12 && 0 == memcmp(data_p + 8, "WEBP", 4))
+		{
+			return SRL_IMG_FORMAT_WEBP_CVIM;
+		}
+		if (starts_with(data_p, length, "\0\0\0\x0CjP  \r\n\x87\n", 12) ||
+			starts_with(data_p, length, "\xFF\x4F\xFF\x51", 4))
+		{	//JP2 container or a raw J2K codestream
+			return SRL_IMG_FORMAT_JP2_CVIM;
+		}
+		if (starts_with(data_p, length, "\x59\xA6\x6A\x95", 4))
+		{
+			return SRL_IMG_FORMAT_RAS_CVIM;
+		}
+		if (starts_with(data_p, length, "#?RADIANCE", 10) || starts_with(data_p, length, "#?RGBE", 6))
+		{
+			return SRL_IMG_FORMAT_HDR_CVIM;
+		}
+		if (starts_with(data_p, length, "8BPS", 4))
+		{
+			return SRL_IMG_FORMAT_PSD_IM;
+		}
+		if (starts_with(data_p, length, "\0\0\x01\0", 4) && length >= 6 && 0 != data_p[4])
+		{	//Reserved, type 1, then a non zero image count
+			return SRL_IMG_FORMAT_ICO_IM;
+		}
+		return sniff_netpbm(data_p, length);
+	}
+
+	Srl_img_format_pair sniff_format_pair( Srl_byte_view img_data )
+	{
+		Srl_img_format_enum format = sniff_img_format(img_data);
+		if (SRL_IMG_FORMAT_NONE == format)
+		{
+			return INVALID_IMG_FORMAT_PAIR;
+		}
+		return Srl_img_format_pair(format, format_enum_to_string(format));
+	}
+
+	Srl_img_backend preferred_backend( Srl_img_format_enum format )
+	{
+		const Srl_img_format_traits *traits_p = find_format_traits(format);
+		return (nullptr != traits_p) ? traits_p->backend : SRL_BACKEND_NONE;
+	}
+
+	std::string format_enum_to_string( Srl_img_format_enum format )
+	{
+		const Srl_img_format_traits *traits_p = find_format_traits(format);
+		return (nullptr != traits_p) ? traits_p->canonical : INVALID_IMG_FORMAT_PAIR.second;
+	}
+}
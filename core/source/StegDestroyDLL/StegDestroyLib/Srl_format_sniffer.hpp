@@ -0,0 +1,57 @@
+// $Id$
+//------------------------------------------------------------------------------------
+///
+/// @file
+///
+/// @brief Identifies image formats from their leading signature bytes
+///
+/// @section VERSION
+/// 1.0
+///
+/// @section DESCRIPTION
+/// Mail attachments are frequently mislabelled so the caller supplied format string
+/// can't be trusted to pick a decoder. The sniffer reads only the first few bytes of
+/// the buffer, which lets Srl_steg_image choose a single backend before any decode.
+//------------------------------------------------------------------------------------
+
+#pragma once
+
+#ifndef _SRL_FORMAT_SNIFFER_HPP
+#define _SRL_FORMAT_SNIFFER_HPP
+
+#include "Srl_steg_data_types.hpp"
+
+namespace srl
+{
+	///
+	/// @brief	maximum number of bytes the sniffer will look at
+	///
+	const size_t SRL_SNIFF_LENGTH = 16;
+
+	///
+	/// @brief	Identifies the image format from its signature
+	///
+	/// @param[in]	img_data	view over the encoded image, only the first SRL_SNIFF_LENGTH bytes are read
+	///
+	/// @return	Srl_img_format_enum		SRL_IMG_FORMAT_NONE if the signature isn't recognised
+	///
+	Srl_img_format_enum sniff_img_format( Srl_byte_view img_data );
+
+	///
+	/// @brief	As sniff_img_format but returns the format pair, INVALID_IMG_FORMAT_PAIR if unrecognised
+	///
+	Srl_img_format_pair sniff_format_pair( Srl_byte_view img_data );
+
+	///
+	/// @brief	The backend which should decode and encode the given format, taken from the format 
+	///			registry. OpenCV wherever it can as the pixel scrub path works on cv::Mat
+	///
+	Srl_img_backend preferred_backend( Srl_img_format_enum format );
+
+	///
+	/// @brief	canonical lower case name for the format, as used by get_format_pair()
+	///
+	std::string format_enum_to_string( Srl_img_format_enum format );
+}
+
+#endif //_SRL_FORMAT_SNIFFER_HPP
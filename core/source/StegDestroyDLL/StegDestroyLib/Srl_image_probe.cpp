@@ -0,0 +1,634 @@
+//------------------------------------------------------------------------------------
+///
+/// @file   Srl_image_probe.cpp
+///
+/// @brief Reads image dimensions from the encoded headers without decoding
+///
+//------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+
+#include "Srl_image_probe.hpp"
+#include "Srl_format_sniffer.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+using namespace srl;
+using namespace std;
+
+namespace
+{
+	/***************************************************
+	*
+	*					Byte readers
+	*
+	****************************************************/
+
+	///
+	/// @brief	Bounds checked reads at an offset, every parser goes through these so a truncated
+	///			or lying header can only make the probe fail
+	///
+	class Srl_header_reader
+	{
+	public:
+		Srl_header_reader( Srl_byte_view img_data, bool little_endian )
+			:	m_data_p(img_data.data()),
+				m_length(img_data.size()),
+				m_little(little_endian)
+		{
+		}
+
+		bool has( uint64_t offset, uint64_t count ) const
+		{
+			return offset <= m_length && count <= m_length - offset;
+		}
+
+		uint32_t u8( uint64_t offset ) const
+		{
+			return m_data_p[offset];
+		}
+
+		uint32_t u16( uint64_t offset ) const
+		{
+			return m_little ? (m_data_p[offset] | (m_data_p[offset + 1] << 8))
+							: ((m_data_p[offset] << 8) | m_data_p[offset + 1]);
+		}
+
+		uint32_t u24( uint64_t offset ) const
+		{
+			return m_little ? (u16(offset) | (m_data_p[offset + 2] << 16))
+							: ((u16(offset) << 8) | m_data_p[offset + 2]);
+		}
+
+		uint32_t u32( uint64_t offset ) const
+		{
+			return m_little ? (u16(offset) | (u16(offset + 2) << 16))
+							: ((u16(offset) << 16) | u16(offset + 2));
+		}
+
+		uint64_t u64( uint64_t offset ) const
+		{
+			return m_little ? (u32(offset) | (static_cast<uint64_t>(u32(offset + 4)) << 32))
+							: ((static_cast<uint64_t>(u32(offset)) << 32) | u32(offset + 4));
+		}
+
+		size_t length( void ) const
+		{
+			return m_length;
+		}
+
+	private:
+		const unsigned char *m_data_p;
+		size_t m_length;
+		bool m_little;
+	};
+
+	inline uint64_t saturating_mul( uint64_t a, uint64_t b )
+	{
+		if (0 != a && b > UINT64_MAX / a)
+		{
+			return UINT64_MAX;
+		}
+		return a * b;
+	}
+
+	inline uint32_t clamp_u32( uint64_t value )
+	{
+		return static_cast<uint32_t>(std::min<uint64_t>(value, UINT32_MAX));
+	}
+
+	inline uint64_t saturating_add( uint64_t a, uint64_t b )
+	{
+		return (b > UINT64_MAX - a) ? UINT64_MAX : a + b;
+	}
+
+	/***************************************************
+	*
+	*					Format parsers
+	*
+	****************************************************/
+
+	bool parse_jpeg( const Srl_header_reader &in, Srl_image_header &header )
+	{
+		uint64_t pos = 2;
+		while (in.has(pos, 4))
+		{
+			if (0xFF != in.u8(pos))
+			{
+				return false;
+			}
+			//Any number of fill bytes may precede a marker
+			while (in.has(pos, 2) && 0xFF == in.u8(pos + 1))
+			{
+				pos++;
+			}
+			if (!in.has(pos, 2))
+			{
+				return false;
+			}
+
+			const uint32_t marker = in.u8(pos + 1);
+			pos += 2;
+			if (0x01 == marker || (marker >= 0xD0 && marker <= 0xD7))
+			{	//Standalone markers carry no length
+				continue;
+			}
+			if (0xD9 == marker || 0xDA == marker || !in.has(pos, 2))
+			{	//Scan data or the end before any frame header
+				return false;
+			}
+
+			const uint32_t segment_length = in.u16(pos);
+			const bool is_sof = marker >= 0xC0 && marker <= 0xCF && 0xC4 != marker && 0xC8 != marker && 0xCC != marker;
+			if (is_sof)
+			{
+				if (!in.has(pos, 8))
+				{
+					return false;
+				}
+				header.bit_depth = in.u8(pos + 2);
+				header.height = in.u16(pos + 3);
+				header.width = in.u16(pos + 5);
+				header.channels = in.u8(pos + 7);
+				//A height of 0 is deferred to a DNL marker after the scan, leave it to Magick
+				return 0 != header.height;
+			}
+			if (segment_length < 2)
+			{
+				return false;
+			}
+			pos += segment_length;
+		}
+		return false;
+	}
+
+	bool parse_png( const Srl_header_reader &in, Srl_image_header &header, const unsigned char *data_p )
+	{
+		if (!in.has(8, 18) || 0 != memcmp(data_p + 12, "IHDR", 4))
+		{
+			return false;
+		}
+		header.width = in.u32(16);
+		header.height = in.u32(20);
+		header.bit_depth = in.u8(24);
+
+		switch (in.u8(25))
+		{
+		case 0:	header.channels = 1; break;		//grey
+		case 2: header.channels = 3; break;		//RGB
+		case 3: header.channels = 3; break;		//palette, expanded on decode
+		case 4: header.channels = 2; break;		//grey + alpha
+		case 6: header.channels = 4; break;		//RGBA
+		default: return false;
+		}
+		return true;
+	}
+
+	///
+	/// @brief	Skips a chain of GIF data sub-blocks, returns the offset after the terminator
+	///
+	uint64_t skip_gif_sub_blocks( const Srl_header_reader &in, uint64_t pos )
+	{
+		while (in.has(pos, 1))
+		{
+			const uint32_t block_length = in.u8(pos++);
+			if (0 == block_length)
+			{
+				break;
+			}
+			pos += block_length;
+		}
+		return pos;
+	}
+
+	bool parse_gif( const Srl_header_reader &in, Srl_image_header &header )
+	{
+		if (!in.has(0, 13))
+		{
+			return false;
+		}
+		header.width = in.u16(6);
+		header.height = in.u16(8);
+		header.bit_depth = 8;
+		//Magick decodes with an alpha channel whenever a frame is transparent, assume one
+		header.channels = 4;
+		header.frames = 0;
+
+		const uint32_t screen_flags = in.u8(10);
+		uint64_t pos = 13;
+		if (screen_flags & 0x80)
+		{
+			pos += 3ULL << ((screen_flags & 0x07) + 1);
+		}
+
+		//Each frame is decoded at its own size, which may be larger than the logical screen
+		while (in.has(pos, 1))
+		{
+			const uint32_t block = in.u8(pos);
+			if (0x21 == block)
+			{
+				pos = skip_gif_sub_blocks(in, pos + 2);
+			}
+			else if (0x2C == block && in.has(pos, 10))
+			{
+				if (SRL_PROBE_MAX_FRAMES == header.frames)
+				{
+					header.frames_truncated = true;
+					break;
+				}
+				header.frames++;
+				header.width = std::max(header.width, in.u16(pos + 5));
+				header.height = std::max(header.height, in.u16(pos + 7));
+
+				const uint32_t frame_flags = in.u8(pos + 9);
+				pos += 10;
+				if (frame_flags & 0x80)
+				{
+					pos += 3ULL << ((frame_flags & 0x07) + 1);
+				}
+				//Skip the LZW minimum code size then the image data
+				pos = skip_gif_sub_blocks(in, pos + 1);
+			}
+			else
+			{	//Trailer, or a damaged stream the decoder will stop at too
+				break;
+			}
+		}
+		header.frames = std::max(1u, header.frames);
+		return true;
+	}
+
+	bool parse_bmp( const Srl_header_reader &in, Srl_image_header &header )
+	{
+		if (!in.has(0, 26))
+		{
+			return false;
+		}
+
+		uint32_t bits_per_pixel = 0;
+		if (12 == in.u32(14))
+		{	//OS/2 core header has 16 bit dimensions
+			header.width = in.u16(18);
+			header.height = in.u16(20);
+			bits_per_pixel = in.u16(24);
+		}
+		else if (in.has(0, 30))
+		{
+			const int32_t width = static_cast<int32_t>(in.u32(18));
+			const int32_t height = static_cast<int32_t>(in.u32(22));
+			if (width < 0 || INT32_MIN == height)
+			{
+				return false;
+			}
+			//Negative height is a top down bitmap
+			header.width = static_cast<uint32_t>(width);
+			header.height = static_cast<uint32_t>(height < 0 ? -height : height);
+			bits_per_pixel = in.u16(28);
+		}
+		else
+		{
+			return false;
+		}
+
+		header.bit_depth = 8;
+		header.channels = (32 == bits_per_pixel) ? 4 : 3;
+		return true;
+	}
+
+	///
+	/// @brief	Reads one value of a TIFF directory entry, inline or at the offset it holds
+	///
+	uint64_t tiff_value( const Srl_header_reader &in, uint64_t entry, bool big_tiff )
+	{
+		const uint32_t type = in.u16(entry + 2);
+		const uint64_t count = big_tiff ? in.u64(entry + 4) : in.u32(entry + 4);
+		const uint64_t field = entry + (big_tiff ? 12 : 8);
+		const uint64_t field_size = big_tiff ? 8 : 4;
+
+		uint64_t value_size = 0;
+		switch (type)
+		{
+		case 3: value_size = 2; break;		//SHORT
+		case 4: value_size = 4; break;		//LONG
+		case 16: value_size = 8; break;		//LONG8
+		default: return 0;
+		}
+
+		uint64_t pos = field;
+		if (saturating_mul(count, value_size) > field_size)
+		{	//Doesn't fit in the entry, the field is an offset to the values
+			pos = big_tiff ? in.u64(field) : in.u32(field);
+		}
+		if (0 == count || !in.has(pos, value_size))
+		{
+			return 0;
+		}
+		return (2 == value_size) ? in.u16(pos) : (4 == value_size) ? in.u32(pos) : in.u64(pos);
+	}
+
+	bool parse_tiff( Srl_byte_view img_data, Srl_image_header &header )
+	{
+		const Srl_header_reader in(img_data, 'I' == img_data.data()[0]);
+		if (!in.has(0, 8))
+		{
+			return false;
+		}
+
+		const bool big_tiff = (43 == in.u16(2));
+		if (big_tiff && !in.has(0, 16))
+		{
+			return false;
+		}
+		const uint64_t entry_size = big_tiff ? 20 : 12;
+		const uint64_t count_size = big_tiff ? 8 : 2;
+		uint64_t ifd = big_tiff ? in.u64(8) : in.u32(4);
+
+		header.frames = 0;
+		header.channels = 1;
+		header.bit_depth = 1;
+
+		//Every directory is a page Magick will decode, size for the largest of them
+		while (0 != ifd && in.has(ifd, count_size))
+		{
+			if (SRL_PROBE_MAX_FRAMES == header.frames)
+			{	//Also stops a directory chain that loops back on itself
+				header.frames_truncated = true;
+				break;
+			}
+
+			const uint64_t entries = big_tiff ? in.u64(ifd) : in.u16(ifd);
+			const uint64_t first_entry = ifd + count_size;
+			if (!in.has(first_entry, saturating_mul(entries, entry_size)))
+			{
+				break;
+			}
+
+			uint32_t samples = 1;
+			uint32_t photometric = 0;
+			for (uint64_t i = 0; i < entries; i++)
+			{
+				const uint64_t entry = first_entry + i * entry_size;
+				switch (in.u16(entry))
+				{
+				case 256: header.width = std::max(header.width, clamp_u32(tiff_value(in, entry, big_tiff))); break;
+				case 257: header.height = std::max(header.height, clamp_u32(tiff_value(in, entry, big_tiff))); break;
+				case 258: header.bit_depth = std::max(header.bit_depth, clamp_u32(tiff_value(in, entry, big_tiff))); break;
+				case 262: photometric = static_cast<uint32_t>(tiff_value(in, entry, big_tiff)); break;
+				case 277: samples = clamp_u32(tiff_value(in, entry, big_tiff)); break;
+				default: break;
+				}
+			}
+
+			//Palette pages are expanded to RGB
+			header.channels = std::max(header.channels, (3 == photometric) ? std::max(3u, samples) : samples);
+			header.frames++;
+
+			const uint64_t next = first_entry + entries * entry_size;
+			if (!in.has(next, big_tiff ? 8 : 4))
+			{
+				break;
+			}
+			ifd = big_tiff ? in.u64(next) : in.u32(next);
+		}
+		return 0 != header.frames && 0 != header.width && 0 != header.height;
+	}
+
+	bool parse_webp( const Srl_header_reader &in, Srl_image_header &header, const unsigned char *data_p )
+	{
+		if (!in.has(0, 30))
+		{
+			return false;
+		}
+		header.bit_depth = 8;
+
+		if (0 == memcmp(data_p + 12, "VP8 ", 4))
+		{	//Lossy, dimensions follow the frame tag and start code
+			if (0x9D != in.u8(23) || 0x01 != in.u8(24) || 0x2A != in.u8(25))
+			{
+				return false;
+			}
+			header.width = in.u16(26) & 0x3FFF;
+			header.height = in.u16(28) & 0x3FFF;
+			header.channels = 3;
+			return true;
+		}
+		if (0 == memcmp(data_p + 12, "VP8L", 4))
+		{
+			if (0x2F != in.u8(20))
+			{
+				return false;
+			}
+			const uint32_t bits = in.u32(21);
+			header.width = (bits & 0x3FFF) + 1;
+			header.height = ((bits >> 14) & 0x3FFF) + 1;
+			header.channels = ((bits >> 28) & 1) ? 4 : 3;
+			return true;
+		}
+		if (0 == memcmp(data_p + 12, "VP8X", 4))
+		{
+			header.width = in.u24(24) + 1;
+			header.height = in.u24(27) + 1;
+			header.channels = (in.u8(20) & 0x10) ? 4 : 3;
+			return true;
+		}
+		return false;
+	}
+
+	bool parse_psd( const Srl_header_reader &in, Srl_image_header &header )
+	{
+		if (!in.has(0, 26))
+		{
+			return false;
+		}
+		header.channels = in.u16(12);
+		header.height = in.u32(14);
+		header.width = in.u32(18);
+		header.bit_depth = in.u16(22);
+		return true;
+	}
+
+	///
+	/// @brief	Reads the next decimal number of a netpbm header, skipping whitespace and comments
+	///
+	bool netpbm_number( const unsigned char *data_p, size_t length, size_t &pos, uint32_t &value )
+	{
+		while (pos < length && (isspace(data_p[pos]) || '#' == data_p[pos]))
+		{
+			if ('#' == data_p[pos])
+			{
+				while (pos < length && '\n' != data_p[pos] && '\r' != data_p[pos])
+				{
+					pos++;
+				}
+			}
+			else
+			{
+				pos++;
+			}
+		}
+
+		uint64_t number = 0;
+		const size_t start = pos;
+		while (pos < length && isdigit(data_p[pos]) && number <= UINT32_MAX)
+		{
+			number = number * 10 + (data_p[pos++] - '0');
+		}
+		value = static_cast<uint32_t>(std::min<uint64_t>(number, UINT32_MAX));
+		return pos != start;
+	}
+
+	bool parse_netpbm( Srl_byte_view img_data, Srl_image_header &header )
+	{
+		const unsigned char *data_p = img_data.data();
+		const char type = static_cast<char>(data_p[1]);
+		if (type < '1' || type > '6')
+		{	//PAM headers are keyword based, leave them to Magick
+			return false;
+		}
+
+		size_t pos = 2;
+		if (!netpbm_number(data_p, img_data.size(), pos, header.width) ||
+			!netpbm_number(data_p, img_data.size(), pos, header.height))
+		{
+			return false;
+		}
+		header.channels = ('3' == type || '6' == type) ? 3 : 1;
+		header.bit_depth = 8;
+		return true;
+	}
+
+	///
+	/// @brief	Magick ping, reads the header through the format's own coder without the pixels
+	///
+	bool ping_image( Srl_byte_view img_data, Srl_image_header &header )
+	{
+		MagickCore::ImageInfo *info_p = MagickCore::AcquireImageInfo();
+		MagickCore::ExceptionInfo *except_p = MagickCore::AcquireExceptionInfo();
+
+		MagickCore::Image *image_p = MagickCore::PingBlob(info_p, img_data.data(), img_data.size(), except_p);
+		MagickCore::DestroyImageInfo(info_p);
+
+		const bool failed = (nullptr == image_p || except_p->severity >= MagickCore::ErrorException);
+		MagickCore::DestroyExceptionInfo(except_p);
+		if (failed)
+		{
+			if (nullptr != image_p)
+			{
+				MagickCore::DestroyImageList(image_p);
+			}
+			return false;
+		}
+
+		header.width = static_cast<uint32_t>(std::min<size_t>(image_p->columns, UINT32_MAX));
+		header.height = static_cast<uint32_t>(std::min<size_t>(image_p->rows, UINT32_MAX));
+		header.bit_depth = static_cast<uint32_t>(image_p->depth);
+		header.channels = (MagickCore::GRAYColorspace == image_p->colorspace) ? 1 : 3;
+		if (MagickCore::UndefinedPixelTrait != image_p->alpha_trait)
+		{
+			header.channels++;
+		}
+
+		const size_t frames = MagickCore::GetImageListLength(image_p);
+		header.frames = static_cast<uint32_t>(std::min<size_t>(frames, SRL_PROBE_MAX_FRAMES));
+		header.frames_truncated = frames > SRL_PROBE_MAX_FRAMES;
+
+		MagickCore::DestroyImageList(image_p);
+		return 0 != header.width && 0 != header.height;
+	}
+
+	void clear_header( Srl_image_header &header, Srl_img_format_enum format )
+	{
+		header.format = format;
+		header.width = 0;
+		header.height = 0;
+		header.channels = 0;
+		header.bit_depth = 0;
+		header.frames = 1;
+		header.frames_truncated = false;
+	}
+}
+
+namespace srl
+{
+	bool parse_image_header( Srl_byte_view img_data, Srl_image_header &header )
+	{
+		const Srl_img_format_enum format = sniff_img_format(img_data);
+		clear_header(header, format);
+
+		const Srl_header_reader big_endian(img_data, false);
+		const Srl_header_reader little_endian(img_data, true);
+
+		bool parsed = false;
+		switch (format)
+		{
+		case SRL_IMG_FORMAT_JPEG_CVIM:	parsed = parse_jpeg(big_endian, header); break;
+		case SRL_IMG_FORMAT_PNG_CVIM:	parsed = parse_png(big_endian, header, img_data.data()); break;
+		case SRL_IMG_FORMAT_GIF_IM:		parsed = parse_gif(little_endian, header); break;
+		case SRL_IMG_FORMAT_BMP_CVIM:	parsed = parse_bmp(little_endian, header); break;
+		case SRL_IMG_FORMAT_TIFF_CVIM:	parsed = parse_tiff(img_data, header); break;
+		case SRL_IMG_FORMAT_WEBP_CVIM:	parsed = parse_webp(little_endian, header, img_data.data()); break;
+		case SRL_IMG_FORMAT_PSD_IM:		parsed = parse_psd(big_endian, header); break;
+		case SRL_IMG_FORMAT_PBM_CVIM:
+		case SRL_IMG_FORMAT_PGM_CVIM:
+		case SRL_IMG_FORMAT_PPM_CVIM:	parsed = parse_netpbm(img_data, header); break;
+		default: break;
+		}
+
+		if (!parsed || 0 == header.width || 0 == header.height)
+		{
+			clear_header(header, format);
+			return false;
+		}
+		return true;
+	}
+
+	bool probe_image( Srl_byte_view img_data, Srl_image_header &header )
+	{
+		if (parse_image_header(img_data, header))
+		{
+			return true;
+		}
+
+		const Srl_img_format_enum format = header.format;
+		try
+		{
+			if (!img_data.empty() && ping_image(img_data, header))
+			{
+				header.format = format;
+				return true;
+			}
+		}
+		catch (...)
+		{	//A coder throwing during ping is just an unreadable header
+		}
+		clear_header(header, format);
+		return false;
+	}
+
+	uint64_t estimate_decoded_bytes( const Srl_image_header &header, bool dct_mode )
+	{
+		const uint64_t pixels = saturating_mul(header.width, header.height);
+		if (dct_mode)
+		{	//One 16 bit coefficient per sample, subsampled chroma only makes it smaller
+			return saturating_mul(pixels, saturating_mul(std::max(1u, header.channels), sizeof(int16_t)));
+		}
+
+		//Unrecognised formats are tried on Magick, the larger of the two
+		if (SRL_BACKEND_OPENCV == preferred_backend(header.format))
+		{	//IMREAD_COLOR, the first frame as 8 bit BGR
+			return saturating_mul(pixels, 3);
+		}
+
+		const uint64_t frame_bytes = saturating_mul(pixels, saturating_mul(std::max(1u, header.channels),
+																			sizeof(MagickCore::Quantum)));
+		return saturating_mul(frame_bytes, std::max(1u, header.frames));
+	}
+
+	uint64_t estimate_working_set( const Srl_image_header &header, size_t encoded_bytes, bool dct_mode )
+	{
+		const uint64_t decoded = estimate_decoded_bytes(header, dct_mode);
+		return saturating_add(encoded_bytes, saturating_mul(decoded, 2));
+	}
+}
@@ -0,0 +1,97 @@
+// $Id$
+//------------------------------------------------------------------------------------
+///
+/// @file
+///
+/// @brief Reads image dimensions from the encoded headers without decoding
+///
+/// @section VERSION
+/// 1.0
+///
+/// @section DESCRIPTION
+/// A few hundred KB of PNG can declare a 60 megapixel image, and nothing knew that
+/// until the decoder had allocated for it. The probe walks just far enough into the
+/// common formats to read the dimensions, channel count and frame count (JPEG SOF,
+/// PNG IHDR, GIF descriptors, BMP, TIFF IFDs, WebP, PSD). Anything else falls back
+/// to a Magick ping. The result is turned into an estimate of the memory decoding and
+/// scrubbing the image will take.
+//------------------------------------------------------------------------------------
+
+#pragma once
+
+#ifndef _SRL_IMAGE_PROBE_HPP
+#define _SRL_IMAGE_PROBE_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Srl_steg_data_types.hpp"
+
+namespace srl
+{
+	///
+	/// @brief	Most frames (GIF images or TIFF directories) the probe counts before it stops looking
+	///
+	const uint32_t SRL_PROBE_MAX_FRAMES = 4096;
+
+	///
+	/// @brief	What the headers say the image decodes to
+	///
+	struct Srl_image_header
+	{
+		Srl_img_format_enum format;
+		uint32_t width;
+		uint32_t height;
+
+		///
+		/// @brief	samples per pixel once decoded, palettes count as expanded to RGB
+		///
+		uint32_t channels;
+
+		///
+		/// @brief	bits per sample
+		///
+		uint32_t bit_depth;
+
+		///
+		/// @brief	frames (GIF) or directories (TIFF) in the file, 1 for single image formats
+		///
+		uint32_t frames;
+
+		///
+		/// @brief	true if the frame count stopped at SRL_PROBE_MAX_FRAMES rather than at the end of the file
+		///
+		bool frames_truncated;
+	};
+
+	///
+	/// @brief	Reads the header of the sniffed format, falling back to a Magick ping for formats the
+	///			probe doesn't parse itself
+	///
+	/// @return	bool	false if the dimensions couldn't be read, header is then left zeroed
+	///
+	bool probe_image( Srl_byte_view img_data, Srl_image_header &header );
+
+	///
+	/// @brief	As probe_image() but only the built in header parsers, never Magick
+	///
+	bool parse_image_header( Srl_byte_view img_data, Srl_image_header &header );
+
+	///
+	/// @brief	bytes the decoded pixels take in the backend that will decode them. OpenCV decodes the
+	///			first frame to 8 bit BGR, Magick decodes every frame at its quantum depth
+	///
+	/// @param[in]	dct_mode	the image stays a JPEG coefficient stream, count the coefficients instead
+	///
+	uint64_t estimate_decoded_bytes( const Srl_image_header &header, bool dct_mode = false );
+
+	///
+	/// @brief	Peak memory to decode, scrub and encode the image: the input, the decoded pixels and one
+	///			full size copy for the encoder output or a resize/convert destination
+	///
+	/// @param[in]	encoded_bytes	size of the encoded input
+	///
+	uint64_t estimate_working_set( const Srl_image_header &header, size_t encoded_bytes, bool dct_mode = false );
+}
+
+#endif //_SRL_IMAGE_PROBE_HPP
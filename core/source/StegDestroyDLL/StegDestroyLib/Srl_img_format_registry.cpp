@@ -0,0 +1,231 @@
+//------------------------------------------------------------------------------------
+///
+/// @file   Srl_img_format_registry.cpp
+///
+/// @brief Compile time format table and its perfect hash
+///
+//------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+
+#include "Srl_img_format_registry.hpp"
+
+#include <cstdint>
+
+#include <opencv2\imgcodecs.hpp>
+
+using namespace srl;
+using namespace std;
+
+namespace
+{
+	/***************************************************
+	*
+	*					Format table
+	*
+	****************************************************/
+
+	///
+	/// @brief	Every name of every format in Srl_img_format_enum. The first entry for each format is its
+	///			canonical entry. Adding a name may need HASH_MULTIPLIER changing, the static_assert
+	///			below fails the build if two names land in the same slot.
+	///
+	constexpr Srl_img_format_traits FORMAT_TABLE[] = {
+		//name		canonical	extension	format						backend				 opencv	lossy	alpha	encoder parameter					  value
+		{ "jpeg",	"jpeg",		".jpg",		SRL_IMG_FORMAT_JPEG_CVIM,	SRL_BACKEND_OPENCV,	 true,	true,	false,	cv::IMWRITE_JPEG_QUALITY,			  SRL_COMPRESSION_DEFAULT },
+		{ "jpg",	"jpeg",		".jpg",		SRL_IMG_FORMAT_JPEG_CVIM,	SRL_BACKEND_OPENCV,	 true,	true,	false,	cv::IMWRITE_JPEG_QUALITY,			  SRL_COMPRESSION_DEFAULT },
+		{ "jpe",	"jpeg",		".jpg",		SRL_IMG_FORMAT_JPEG_CVIM,	SRL_BACKEND_OPENCV,	 true,	true,	false,	cv::IMWRITE_JPEG_QUALITY,			  SRL_COMPRESSION_DEFAULT },
+		{ "jfif",	"jpeg",		".jpg",		SRL_IMG_FORMAT_JPEG_CVIM,	SRL_BACKEND_OPENCV,	 true,	true,	false,	cv::IMWRITE_JPEG_QUALITY,			  SRL_COMPRESSION_DEFAULT },
+		{ "png",	"png",		".png",		SRL_IMG_FORMAT_PNG_CVIM,	SRL_BACKEND_OPENCV,	 true,	false,	true,	cv::IMWRITE_PNG_COMPRESSION,		  3 },
+		{ "bmp",	"bmp",		".bmp",		SRL_IMG_FORMAT_BMP_CVIM,	SRL_BACKEND_OPENCV,	 true,	false,	true,	SRL_NO_ENCODER_PARAM,				  0 },
+		{ "dib",	"bmp",		".bmp",		SRL_IMG_FORMAT_BMP_CVIM,	SRL_BACKEND_OPENCV,	 true,	false,	true,	SRL_NO_ENCODER_PARAM,				  0 },
+		{ "tiff",	"tiff",		".tif",		SRL_IMG_FORMAT_TIFF_CVIM,	SRL_BACKEND_OPENCV,	 true,	false,	true,	SRL_NO_ENCODER_PARAM,				  0 },
+		{ "tif",	"tiff",		".tif",		SRL_IMG_FORMAT_TIFF_CVIM,	SRL_BACKEND_OPENCV,	 true,	false,	true,	SRL_NO_ENCODER_PARAM,				  0 },
+		{ "pbm",	"pbm",		".pbm",		SRL_IMG_FORMAT_PBM_CVIM,	SRL_BACKEND_OPENCV,	 true,	false,	false,	cv::IMWRITE_PXM_BINARY,				  1 },
+		{ "pgm",	"pgm",		".pgm",		SRL_IMG_FORMAT_PGM_CVIM,	SRL_BACKEND_OPENCV,	 true,	false,	false,	cv::IMWRITE_PXM_BINARY,				  1 },
+		{ "ppm",	"ppm",		".ppm",		SRL_IMG_FORMAT_PPM_CVIM,	SRL_BACKEND_OPENCV,	 true,	false,	false,	cv::IMWRITE_PXM_BINARY,				  1 },
+		{ "pnm",	"ppm",		".ppm",		SRL_IMG_FORMAT_PPM_CVIM,	SRL_BACKEND_OPENCV,	 true,	false,	false,	cv::IMWRITE_PXM_BINARY,				  1 },
+		{ "pam",	"pam",		".pam",		SRL_IMG_FORMAT_PAM_CVIM,	SRL_BACKEND_OPENCV,	 true,	false,	true,	SRL_NO_ENCODER_PARAM,				  0 },
+		{ "jp2",	"jp2",		".jp2",		SRL_IMG_FORMAT_JP2_CVIM,	SRL_BACKEND_OPENCV,	 true,	false,	true,	SRL_NO_ENCODER_PARAM,				  0 },
+		{ "j2k",	"jp2",		".jp2",		SRL_IMG_FORMAT_JP2_CVIM,	SRL_BACKEND_OPENCV,	 true,	false,	true,	SRL_NO_ENCODER_PARAM,				  0 },
+		{ "webp",	"webp",		".webp",	SRL_IMG_FORMAT_WEBP_CVIM,	SRL_BACKEND_OPENCV,	 true,	true,	true,	cv::IMWRITE_WEBP_QUALITY,			  SRL_COMPRESSION_DEFAULT },
+		{ "ras",	"ras",		".ras",		SRL_IMG_FORMAT_RAS_CVIM,	SRL_BACKEND_OPENCV,	 true,	false,	false,	SRL_NO_ENCODER_PARAM,				  0 },
+		{ "sr",		"ras",		".ras",		SRL_IMG_FORMAT_RAS_CVIM,	SRL_BACKEND_OPENCV,	 true,	false,	false,	SRL_NO_ENCODER_PARAM,				  0 },
+		{ "hdr",	"hdr",		".hdr",		SRL_IMG_FORMAT_HDR_CVIM,	SRL_BACKEND_OPENCV,	 true,	false,	false,	SRL_NO_ENCODER_PARAM,				  0 },
+		{ "pic",	"hdr",		".hdr",		SRL_IMG_FORMAT_HDR_CVIM,	SRL_BACKEND_OPENCV,	 true,	false,	false,	SRL_NO_ENCODER_PARAM,				  0 },
+		{ "gif",	"gif",		".gif",		SRL_IMG_FORMAT_GIF_IM,		SRL_BACKEND_MAGICK,	 false,	false,	true,	SRL_NO_ENCODER_PARAM,				  0 },
+		{ "psd",	"psd",		".psd",		SRL_IMG_FORMAT_PSD_IM,		SRL_BACKEND_MAGICK,	 false,	false,	true,	SRL_NO_ENCODER_PARAM,				  0 },
+		{ "ico",	"ico",		".ico",		SRL_IMG_FORMAT_ICO_IM,		SRL_BACKEND_MAGICK,	 false,	false,	true,	SRL_NO_ENCODER_PARAM,				  0 }
+	};
+
+	constexpr size_t FORMAT_TABLE_SIZE = sizeof(FORMAT_TABLE) / sizeof(FORMAT_TABLE[0]);
+
+	/***************************************************
+	*
+	*					Perfect hash
+	*
+	****************************************************/
+
+	const unsigned int SLOT_BITS = 6;
+	const unsigned int SLOT_COUNT = 1u << SLOT_BITS;
+
+	///
+	/// @brief	odd multiplier chosen so no two names in FORMAT_TABLE share a slot
+	///
+	const uint32_t HASH_MULTIPLIER = 0x9E377D59u;
+
+	constexpr char to_lower(char c)
+	{
+		return ('A' <= c && 'Z' >= c) ? static_cast<char>(c - 'A' + 'a') : c;
+	}
+
+	constexpr size_t name_length(const char *name)
+	{
+		size_t length = 0;
+		while ('\0' != name[length])
+		{
+			length++;
+		}
+		return length;
+	}
+
+	///
+	/// @brief	FNV-1a of the lower cased name, the top SLOT_BITS of the product select the slot
+	///
+	constexpr unsigned int slot_of(const char *name, size_t length)
+	{
+		uint32_t hash = 2166136261u;
+		for (size_t i = 0; i < length; i++)
+		{
+			hash ^= static_cast<unsigned char>(to_lower(name[i]));
+			hash *= 16777619u;
+		}
+		return static_cast<uint32_t>(hash * HASH_MULTIPLIER) >> (32 - SLOT_BITS);
+	}
+
+	///
+	/// @brief	slot to FORMAT_TABLE index, -1 for an empty slot
+	///
+	struct Srl_slot_table
+	{
+		signed char index[SLOT_COUNT];
+	};
+
+	constexpr Srl_slot_table build_slot_table()
+	{
+		Srl_slot_table table = {};
+		for (unsigned int slot = 0; slot < SLOT_COUNT; slot++)
+		{
+			table.index[slot] = -1;
+		}
+		for (size_t i = 0; i < FORMAT_TABLE_SIZE; i++)
+		{
+			table.index[slot_of(FORMAT_TABLE[i].name, name_length(FORMAT_TABLE[i].name))] = static_cast<signed char>(i);
+		}
+		return table;
+	}
+
+	constexpr bool is_perfect_hash()
+	{
+		for (size_t i = 0; i < FORMAT_TABLE_SIZE; i++)
+		{
+			for (size_t j = i + 1; j < FORMAT_TABLE_SIZE; j++)
+			{
+				if (slot_of(FORMAT_TABLE[i].name, name_length(FORMAT_TABLE[i].name)) ==
+					slot_of(FORMAT_TABLE[j].name, name_length(FORMAT_TABLE[j].name)))
+				{
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	static_assert(FORMAT_TABLE_SIZE <= SLOT_COUNT, "Format table has outgrown the hash slots, increase SLOT_BITS");
+	static_assert(is_perfect_hash(), "Two format names share a hash slot, pick a new HASH_MULTIPLIER");
+
+	constexpr Srl_slot_table SLOT_TABLE = build_slot_table();
+
+	/***************************************************
+	*
+	*					Enum index
+	*
+	****************************************************/
+
+	///
+	/// @brief	format enum to the FORMAT_TABLE index of its canonical entry, -1 if absent
+	///
+	struct Srl_enum_table
+	{
+		signed char index[SRL_IMG_FORMAT_COUNT];
+	};
+
+	constexpr Srl_enum_table build_enum_table()
+	{
+		Srl_enum_table table = {};
+		for (int format = 0; format < SRL_IMG_FORMAT_COUNT; format++)
+		{
+			table.index[format] = -1;
+		}
+		//Walk backwards so the first entry of each format is the one left behind
+		for (size_t i = FORMAT_TABLE_SIZE; i > 0; i--)
+		{
+			table.index[FORMAT_TABLE[i - 1].format] = static_cast<signed char>(i - 1);
+		}
+		return table;
+	}
+
+	constexpr Srl_enum_table ENUM_TABLE = build_enum_table();
+}
+
+namespace srl
+{
+	const Srl_img_format_traits* find_format_traits( const char *name, size_t length )
+	{
+		if (nullptr == name)
+		{
+			return nullptr;
+		}
+		if (length > 0 && '.' == name[0])
+		{	//Accept extensions as well as names
+			name++;
+			length--;
+		}
+		if (0 == length)
+		{
+			return nullptr;
+		}
+
+		signed char index = SLOT_TABLE.index[slot_of(name, length)];
+		if (index < 0)
+		{
+			return nullptr;
+		}
+
+		//The slot only proves the hash matched, confirm the name itself
+		const Srl_img_format_traits &entry = FORMAT_TABLE[index];
+		for (size_t i = 0; i < length; i++)
+		{
+			if ('\0' == entry.name[i] || to_lower(name[i]) != entry.name[i])
+			{
+				return nullptr;
+			}
+		}
+		return ('\0' == entry.name[length]) ? &entry : nullptr;
+	}
+
+	const Srl_img_format_traits* find_format_traits( const std::string &name )
+	{
+		return find_format_traits( name.c_str(), name.size() );
+	}
+
+	const Srl_img_format_traits* find_format_traits( Srl_img_format_enum format )
+	{
+		if (format <= SRL_IMG_FORMAT_NONE || format >= SRL_IMG_FORMAT_COUNT)
+		{
+			return nullptr;
+		}
+		signed char index = ENUM_TABLE.index[format];
+		return (index < 0) ? nullptr : &FORMAT_TABLE[index];
+	}
+}
@@ -0,0 +1,103 @@
+// $Id$
+//------------------------------------------------------------------------------------
+///
+/// @file
+///
+/// @brief Compile time table of the image formats with an Srl_img_format_enum value
+///
+/// @section VERSION
+/// 1.0
+///
+/// @section DESCRIPTION
+/// Each format name (including aliases such as jpg/jpe) maps to an entry of traits
+/// describing how the SDK treats it. Lookups by name go through a perfect hash built
+/// at compile time, are case insensitive and never allocate. The table holds every
+/// format OpenCV handles but only the ImageMagick formats the SDK names (gif, psd,
+/// ico). Anything else ImageMagick reads, e.g. tga or pcx, has no entry here and
+/// Srl_magick_coder_cache answers whether Magick supports it.
+//------------------------------------------------------------------------------------
+
+#pragma once
+
+#ifndef _SRL_IMG_FORMAT_REGISTRY_HPP
+#define _SRL_IMG_FORMAT_REGISTRY_HPP
+
+#include <cstddef>
+#include <string>
+
+#include "Srl_steg_data_types.hpp"
+
+namespace srl
+{
+	///
+	/// @brief	value of encoder_param for formats with no OpenCV encoder parameter
+	///
+	const int SRL_NO_ENCODER_PARAM = -1;
+
+	///
+	/// @brief	Static description of an image format
+	///
+	struct Srl_img_format_traits
+	{
+		///
+		/// @brief	lower case name this entry is found under, may be an alias
+		///
+		const char *name;
+
+		///
+		/// @brief	lower case canonical name of the format, shared by all of its aliases
+		///
+		const char *canonical;
+
+		///
+		/// @brief	extension passed to cv::imencode, including the leading '.'
+		///
+		const char *extension;
+
+		Srl_img_format_enum format;
+
+		///
+		/// @brief	backend used to decode and encode the format
+		///
+		Srl_img_backend backend;
+
+		///
+		/// @brief	true if OpenCV can read and write the format, regardless of preferred backend
+		///
+		bool opencv;
+
+		///
+		/// @brief	true if the default encode is lossy, lossless formats need the pixel LSB scrub
+		///
+		bool lossy;
+
+		///
+		/// @brief	true if the format can carry an alpha channel
+		///
+		bool alpha;
+
+		///
+		/// @brief	default cv::IMWRITE_* parameter and its value, SRL_NO_ENCODER_PARAM if there is none.
+		///			For lossy formats the value is a quality and is replaced by the compression level
+		///
+		int encoder_param;
+		int encoder_value;
+	};
+
+	///
+	/// @brief	Looks up a format by name, case insensitive, a leading '.' is ignored
+	///
+	/// @return	nullptr if the name isn't known
+	///
+	const Srl_img_format_traits* find_format_traits( const char *name, size_t length );
+	const Srl_img_format_traits* find_format_traits( const std::string &name );
+
+	///
+	/// @brief	Looks up the canonical entry for a format
+	///
+	/// @return	nullptr for SRL_IMG_FORMAT_NONE
+	///
+	const Srl_img_format_traits* find_format_traits( Srl_img_format_enum format );
+}
+
+#endif //_SRL_IMG_FORMAT_REGISTRY_HPP
@@ -0,0 +1,252 @@
+//------------------------------------------------------------------------------------
+///
+/// @file   Srl_jpeg_coefficients.cpp
+///
+/// @brief libjpeg coefficient read and write passes with the error handling in one place
+///
+//------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+
+#include "Srl_jpeg_coefficients.hpp"
+#include "Srl_jpeg_dct_scrub.hpp"
+
+#include <algorithm>
+#include <csetjmp>
+#include <cstdio>
+#include <new>
+
+#include <jpeglib.h>
+
+using namespace srl;
+using namespace std;
+
+namespace
+{
+	/***************************************************
+	*
+	*				libjpeg error handling
+	*
+	****************************************************/
+
+	///
+	/// @brief	error manager which returns control to the pass instead of calling exit()
+	///
+	struct Srl_jpeg_error_mgr
+	{
+		jpeg_error_mgr pub;
+		jmp_buf jump_buf;
+		char message[JMSG_LENGTH_MAX];
+	};
+
+	void srl_jpeg_error_exit(j_common_ptr cinfo)
+	{
+		Srl_jpeg_error_mgr *err = reinterpret_cast<Srl_jpeg_error_mgr*>(cinfo->err);
+		(*cinfo->err->format_message)(cinfo, err->message);
+		longjmp(err->jump_buf, 1);
+	}
+
+	void srl_jpeg_output_message(j_common_ptr)
+	{
+		//Warnings are not written to stderr, corrupt data still fails through error_exit
+	}
+
+	/***************************************************
+	*
+	*				vector destination manager
+	*
+	****************************************************/
+
+	///
+	/// @brief	destination manager writing straight into a std::vector, avoids the malloc + copy
+	///			of jpeg_mem_dest
+	///
+	struct Srl_vector_dest_mgr
+	{
+		jpeg_destination_mgr pub;
+		vector<unsigned char> *buf_p;
+	};
+
+	const size_t DEST_INITIAL_SIZE = 64 * 1024;
+
+	void srl_init_destination(j_compress_ptr cinfo)
+	{
+		Srl_vector_dest_mgr *dest = reinterpret_cast<Srl_vector_dest_mgr*>(cinfo->dest);
+		try
+		{
+			//Only what the first pass needs is zero filled, the pooled reservation behind it is
+			//taken up by empty_output_buffer as the output grows
+			dest->buf_p->resize(DEST_INITIAL_SIZE);
+			dest->pub.next_output_byte = dest->buf_p->data();
+			dest->pub.free_in_buffer = dest->buf_p->size();
+		}
+		catch (std::bad_alloc &)
+		{	//empty_output_buffer will try again and report the failure
+			dest->buf_p->clear();
+			dest->pub.next_output_byte = nullptr;
+			dest->pub.free_in_buffer = 0;
+		}
+	}
+
+	boolean srl_empty_output_buffer(j_compress_ptr cinfo)
+	{
+		Srl_vector_dest_mgr *dest = reinterpret_cast<Srl_vector_dest_mgr*>(cinfo->dest);
+		size_t used = dest->buf_p->size() - dest->pub.free_in_buffer;
+		try
+		{
+			dest->buf_p->resize(std::max(used * 2, DEST_INITIAL_SIZE));
+		}
+		catch (std::bad_alloc &)
+		{	//Can't longjmp out of a catch block, returning FALSE makes libjpeg raise JERR_CANT_SUSPEND
+			return FALSE;
+		}
+		dest->pub.next_output_byte = dest->buf_p->data() + used;
+		dest->pub.free_in_buffer = dest->buf_p->size() - used;
+		return TRUE;
+	}
+
+	void srl_term_destination(j_compress_ptr cinfo)
+	{
+		Srl_vector_dest_mgr *dest = reinterpret_cast<Srl_vector_dest_mgr*>(cinfo->dest);
+		dest->buf_p->resize(dest->buf_p->size() - dest->pub.free_in_buffer);
+	}
+}
+
+/***************************************************
+*
+*					State
+*
+****************************************************/
+
+struct Srl_jpeg_coefficients::Srl_jpeg_state
+{
+	jpeg_decompress_struct src_info;
+	jpeg_compress_struct dst_info;
+	Srl_jpeg_error_mgr jerr;
+	Srl_vector_dest_mgr dest;
+	bool created;
+
+	///
+	/// @brief	Resets the source from any earlier pass and reads the coefficients of jpeg_data_p.
+	///			Only called below a setjmp on jerr.jump_buf
+	///
+	jvirt_barray_ptr* read_source( const unsigned char *jpeg_data_p, size_t data_length )
+	{
+		jpeg_abort_decompress(&src_info);
+		jpeg_mem_src(&src_info, const_cast<unsigned char*>(jpeg_data_p), static_cast<unsigned long>(data_length));
+		//Markers are deliberately not saved, APPn/COM segments are a payload carrier in their own right
+		jpeg_read_header(&src_info, TRUE);
+		return jpeg_read_coefficients(&src_info);
+	}
+};
+
+/***************************************************
+*
+*					CTOR & DTOR
+*
+****************************************************/
+
+Srl_jpeg_coefficients::Srl_jpeg_coefficients()
+	//Value initialised so a struct whose create failed is still safe to destroy
+	:	m_state_p(new Srl_jpeg_state())
+{
+	Srl_jpeg_state &state = *m_state_p;
+
+	//Both structs share the one error manager so there is a single longjmp target
+	state.src_info.err = jpeg_std_error(&state.jerr.pub);
+	state.dst_info.err = &state.jerr.pub;
+	state.jerr.pub.error_exit = srl_jpeg_error_exit;
+	state.jerr.pub.output_message = srl_jpeg_output_message;
+	state.jerr.message[0] = '\0';
+	state.created = false;
+
+	if (setjmp(state.jerr.jump_buf))
+	{	//Out of memory, the message is kept for the first pass to report
+		return;
+	}
+	jpeg_create_decompress(&state.src_info);
+	jpeg_create_compress(&state.dst_info);
+	state.created = true;
+}
+
+Srl_jpeg_coefficients::~Srl_jpeg_coefficients()
+{
+	jpeg_destroy_compress(&m_state_p->dst_info);
+	jpeg_destroy_decompress(&m_state_p->src_info);
+}
+
+/***************************************************
+*
+*					Passes
+*
+****************************************************/
+
+bool Srl_jpeg_coefficients::read( const unsigned char *jpeg_data_p, size_t data_length,
+								  const Srl_jpeg_coefficient_reader &reader, string &err_msg )
+{
+	Srl_jpeg_state &state = *m_state_p;
+	if (!is_jpeg_stream(jpeg_data_p, data_length))
+	{
+		err_msg = "Not a JPEG stream";
+		return false;
+	}
+	if (!state.created)
+	{
+		err_msg = state.jerr.message;
+		return false;
+	}
+
+	//Nothing with a destructor may be created between setjmp and the end of the libjpeg calls
+	if (setjmp(state.jerr.jump_buf))
+	{
+		err_msg = state.jerr.message;
+		return false;
+	}
+
+	jvirt_barray_ptr *coef_arrays = state.read_source(jpeg_data_p, data_length);
+	reader(&state.src_info, coef_arrays);
+	jpeg_finish_decompress(&state.src_info);
+	return true;
+}
+
+bool Srl_jpeg_coefficients::transcode( const unsigned char *jpeg_data_p, size_t data_length,
+									   const Srl_jpeg_coefficient_transform &transform,
+									   vector<unsigned char> &out_buf, string &err_msg )
+{
+	Srl_jpeg_state &state = *m_state_p;
+	out_buf.clear();
+	if (!is_jpeg_stream(jpeg_data_p, data_length))
+	{
+		err_msg = "Not a JPEG stream";
+		return false;
+	}
+	if (!state.created)
+	{
+		err_msg = state.jerr.message;
+		return false;
+	}
+
+	//Nothing with a destructor may be created between setjmp and the end of the libjpeg calls
+	if (setjmp(state.jerr.jump_buf))
+	{
+		err_msg = state.jerr.message;
+		out_buf.clear();
+		return false;
+	}
+
+	jvirt_barray_ptr *coef_arrays = state.read_source(jpeg_data_p, data_length);
+	jpeg_abort_compress(&state.dst_info);
+	jpeg_copy_critical_parameters(&state.src_info, &state.dst_info);
+	transform(&state.src_info, &state.dst_info, coef_arrays);
+
+	state.dest.buf_p = &out_buf;
+	state.dest.pub.init_destination = srl_init_destination;
+	state.dest.pub.empty_output_buffer = srl_empty_output_buffer;
+	state.dest.pub.term_destination = srl_term_destination;
+	state.dst_info.dest = &state.dest.pub;
+
+	jpeg_write_coefficients(&state.dst_info, coef_arrays);
+	jpeg_finish_compress(&state.dst_info);
+	jpeg_finish_decompress(&state.src_info);
+	return true;
+}
@@ -0,0 +1,105 @@
+// $Id$
+//------------------------------------------------------------------------------------
+///
+/// @file
+///
+/// @brief libjpeg set up for reading a JPEG's quantized DCT coefficients and writing them back
+///
+/// @section VERSION
+/// 1.0
+///
+/// @section DESCRIPTION
+/// Every pass over a JPEG's coefficients needs the same libjpeg plumbing: an error
+/// manager that hands control back instead of calling exit(), a memory source,
+/// jpeg_read_coefficients and, for a pass that writes, jpeg_copy_critical_parameters
+/// and a destination writing into a std::vector. Srl_jpeg_coefficients owns all of it,
+/// the caller only supplies what happens to the coefficients in between. jpeglib.h is
+/// kept out of this header, a callback that touches the structs includes it itself.
+//------------------------------------------------------------------------------------
+
+#pragma once
+
+#ifndef _SRL_JPEG_COEFFICIENTS_HPP
+#define _SRL_JPEG_COEFFICIENTS_HPP
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct jpeg_decompress_struct;
+struct jpeg_compress_struct;
+struct jvirt_barray_control;
+
+namespace srl
+{
+	///
+	/// @brief	Given the source and its coefficient arrays, one per component
+	///
+	typedef std::function<void(jpeg_decompress_struct *src, jvirt_barray_control **coef_arrays)> Srl_jpeg_coefficient_reader;
+
+	///
+	/// @brief	Given the source, the destination its critical parameters have been copied to and the
+	///			coefficient arrays. May replace the destination's quant tables and change the
+	///			coefficients in place, whatever it leaves is written out
+	///
+	typedef std::function<void(jpeg_decompress_struct *src, jpeg_compress_struct *dst,
+							   jvirt_barray_control **coef_arrays)> Srl_jpeg_coefficient_transform;
+
+	///
+	/// @brief	A libjpeg decompress and compress pair sharing one error manager
+	///
+	/// @description	A libjpeg error raised inside a reader or transform jumps straight back out of
+	///					it with longjmp, so they must not hold anything with a destructor. The object
+	///					can be used for any number of passes, one at a time
+	///
+	class Srl_jpeg_coefficients
+	{
+	public:
+
+		///
+		/// @brief	Creates both structs. A failure to do so is reported by the first pass
+		///
+		Srl_jpeg_coefficients();
+
+		///
+		/// @brief	Destroys both structs, also after a failed pass
+		///
+		~Srl_jpeg_coefficients();
+
+		Srl_jpeg_coefficients( const Srl_jpeg_coefficients& ) = delete;
+		Srl_jpeg_coefficients& operator=( const Srl_jpeg_coefficients& ) = delete;
+
+		///
+		/// @brief	Reads the coefficients of a JPEG stream and hands them to reader. APPn and COM
+		///			markers are never saved
+		///
+		/// @param[out]	err_msg		libjpeg's message if the pass fails
+		///
+		/// @return	bool	false if the data isn't a JPEG stream or libjpeg rejected it
+		///
+		bool read( const unsigned char *jpeg_data_p, size_t data_length,
+				   const Srl_jpeg_coefficient_reader &reader, std::string &err_msg );
+
+		///
+		/// @brief	As read(), then writes the coefficients transform leaves back out as a JPEG stream
+		///
+		/// @param[out]	out_buf		replaced with the new stream, empty if the pass fails
+		///
+		bool transcode( const unsigned char *jpeg_data_p, size_t data_length,
+						const Srl_jpeg_coefficient_transform &transform,
+						std::vector<unsigned char> &out_buf, std::string &err_msg );
+
+	private:
+
+		struct Srl_jpeg_state;
+
+		///
+		///	@brief	m_state_p	the libjpeg structs, on the heap so they never move once created
+		///
+		std::unique_ptr<Srl_jpeg_state> m_state_p;
+	};
+}
+
+#endif //_SRL_JPEG_COEFFICIENTS_HPP
@@ -0,0 +1,210 @@
+//------------------------------------------------------------------------------------
+///
+/// @file   Srl_jpeg_dct_scrub.cpp
+///
+/// @brief DCT domain JPEG scrub using the libjpeg coefficient API
+///
+//------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+
+#include "Srl_jpeg_dct_scrub.hpp"
+#include "Srl_counter_rng.hpp"
+#include "Srl_jpeg_coefficients.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+#include <jpeglib.h>
+
+using namespace srl;
+using namespace std;
+
+namespace
+{
+	/***************************************************
+	*
+	*				IJG standard tables
+	*
+	****************************************************/
+
+	///
+	/// @brief	ITU-T T.81 Annex K luminance table, natural order
+	///
+	const unsigned int std_luminance_quant_tbl[DCTSIZE2] = {
+		16,  11,  10,  16,  24,  40,  51,  61,
+		12,  12,  14,  19,  26,  58,  60,  55,
+		14,  13,  16,  24,  40,  57,  69,  56,
+		14,  17,  22,  29,  51,  87,  80,  62,
+		18,  22,  37,  56,  68, 109, 103,  77,
+		24,  35,  55,  64,  81, 104, 113,  92,
+		49,  64,  78,  87, 103, 121, 120, 101,
+		72,  92,  95,  98, 112, 100, 103,  99
+	};
+
+	///
+	/// @brief	ITU-T T.81 Annex K chrominance table, natural order
+	///
+	const unsigned int std_chrominance_quant_tbl[DCTSIZE2] = {
+		17,  18,  24,  47,  99,  99,  99,  99,
+		18,  21,  26,  66,  99,  99,  99,  99,
+		24,  26,  56,  99,  99,  99,  99,  99,
+		47,  66,  99,  99,  99,  99,  99,  99,
+		99,  99,  99,  99,  99,  99,  99,  99,
+		99,  99,  99,  99,  99,  99,  99,  99,
+		99,  99,  99,  99,  99,  99,  99,  99,
+		99,  99,  99,  99,  99,  99,  99,  99
+	};
+
+	/***************************************************
+	*
+	*				Helpers
+	*
+	****************************************************/
+
+	///
+	/// @brief	divides a dequantized value by the new step, rounding half away from zero
+	///
+	inline JCOEF requantize(int coef, int old_step, int new_step)
+	{
+		int scaled = coef * old_step;
+		int half = new_step / 2;
+		if (scaled >= 0)
+		{
+			return static_cast<JCOEF>((scaled + half) / new_step);
+		}
+		return static_cast<JCOEF>(-((-scaled + half) / new_step));
+	}
+
+	///
+	/// @brief	replaces the dst quant tables with the IJG tables for quality, or chroma_quality for
+	///			the chroma components, never going finer than the table the source was encoded with
+	///
+	void set_target_quant_tables(j_decompress_ptr src, j_compress_ptr dst, int quality, int chroma_quality)
+	{
+		int scale = jpeg_quality_scaling(quality);
+		int chroma_scale = jpeg_quality_scaling(chroma_quality);
+		bool has_chroma = (JCS_YCbCr == dst->jpeg_color_space || JCS_YCCK == dst->jpeg_color_space);
+		bool slot_done[NUM_QUANT_TBLS] = { false };
+
+		for (int ci = 0; ci < dst->num_components; ci++)
+		{
+			int slot = dst->comp_info[ci].quant_tbl_no;
+			if (slot_done[slot])
+			{
+				continue;
+			}
+			slot_done[slot] = true;
+
+			//Keep a copy of the source table before jpeg_add_quant_table replaces it
+			JQUANT_TBL *old_tbl = src->comp_info[ci].quant_table;
+			if (nullptr == old_tbl)
+			{
+				old_tbl = src->quant_tbl_ptrs[slot];
+			}
+			UINT16 old_vals[DCTSIZE2];
+			for (int k = 0; k < DCTSIZE2; k++)
+			{
+				old_vals[k] = (nullptr != old_tbl) ? old_tbl->quantval[k] : 1;
+			}
+
+			bool is_chroma = has_chroma && (1 == ci || 2 == ci);
+			jpeg_add_quant_table(dst, slot,
+				is_chroma ? std_chrominance_quant_tbl : std_luminance_quant_tbl,
+				is_chroma ? chroma_scale : scale, TRUE);
+
+			JQUANT_TBL *new_tbl = dst->quant_tbl_ptrs[slot];
+			for (int k = 0; k < DCTSIZE2; k++)
+			{
+				new_tbl->quantval[k] = std::max(new_tbl->quantval[k], old_vals[k]);
+			}
+		}
+	}
+
+	///
+	/// @brief	requantizes every block of every component in place and randomises the AC LSBs
+	///
+	void scrub_coefficients(j_decompress_ptr src, j_compress_ptr dst, jvirt_barray_ptr *coef_arrays, uint64_t seed)
+	{
+		const Srl_counter_rng rng(seed);
+		for (int ci = 0; ci < src->num_components; ci++)
+		{
+			jpeg_component_info *src_comp = &src->comp_info[ci];
+			const JQUANT_TBL *old_tbl = src_comp->quant_table;
+			if (nullptr == old_tbl)
+			{
+				old_tbl = src->quant_tbl_ptrs[src_comp->quant_tbl_no];
+			}
+			const JQUANT_TBL *new_tbl = dst->quant_tbl_ptrs[dst->comp_info[ci].quant_tbl_no];
+
+			for (JDIMENSION row = 0; row < src_comp->height_in_blocks; row++)
+			{
+				//One stream per component block row, indexed by block column
+				const uint64_t stream = (static_cast<uint64_t>(ci) << 32) | row;
+				JBLOCKARRAY block_row = (*src->mem->access_virt_barray)
+					(reinterpret_cast<j_common_ptr>(src), coef_arrays[ci], row, 1, TRUE);
+
+				for (JDIMENSION col = 0; col < src_comp->width_in_blocks; col++)
+				{
+					JCOEFPTR block = block_row[0][col];
+					uint64_t noise = rng.at(stream, col);
+
+					for (int k = 0; k < DCTSIZE2; k++)
+					{
+						int coef = block[k];
+						if (0 != coef && old_tbl->quantval[k] != new_tbl->quantval[k])
+						{
+							coef = requantize(coef, old_tbl->quantval[k], new_tbl->quantval[k]);
+						}
+
+						//Only AC terms of magnitude 2+, flipping 0 <-> 1 would change the sparsity of
+						//the block and the DC term is too visible
+						if (k > 0 && (coef >= 2 || coef <= -2))
+						{
+							int magnitude = (coef < 0) ? -coef : coef;
+							magnitude = (magnitude & ~1) | static_cast<int>((noise >> k) & 1);
+							coef = (coef < 0) ? -magnitude : magnitude;
+						}
+						block[k] = static_cast<JCOEF>(coef);
+					}
+				}
+			}
+		}
+	}
+}
+
+namespace srl
+{
+	bool is_jpeg_stream(const unsigned char *data_p, size_t data_length)
+	{
+		return (nullptr != data_p && data_length >= 3 &&
+				0xFF == data_p[0] && 0xD8 == data_p[1] && 0xFF == data_p[2]);
+	}
+
+	bool jpeg_dct_scrub(const unsigned char *jpeg_data_p,
+						size_t data_length,
+						int quality,
+						uint64_t seed,
+						vector<unsigned char> &out_buf,
+						string &err_msg)
+	{
+		return jpeg_dct_scrub(jpeg_data_p, data_length, quality, quality, seed, out_buf, err_msg);
+	}
+
+	bool jpeg_dct_scrub(const unsigned char *jpeg_data_p,
+						size_t data_length,
+						int quality,
+						int chroma_quality,
+						uint64_t seed,
+						vector<unsigned char> &out_buf,
+						string &err_msg)
+	{
+		Srl_jpeg_coefficients coefficients;
+		return coefficients.transcode(jpeg_data_p, data_length,
+			[&](jpeg_decompress_struct *src, jpeg_compress_struct *dst, jvirt_barray_control **coef_arrays)
+			{
+				set_target_quant_tables(src, dst, quality, chroma_quality);
+				scrub_coefficients(src, dst, coef_arrays, seed);
+			}, out_buf, err_msg);
+	}
+}
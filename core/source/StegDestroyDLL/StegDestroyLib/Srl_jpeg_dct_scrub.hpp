@@ -0,0 +1,76 @@
+// $Id$
+//------------------------------------------------------------------------------------
+///
+/// @file
+///
+/// @brief JPEG scrubbing performed directly on the quantized DCT coefficients
+///
+/// @section VERSION
+/// 1.0
+///
+/// @section DESCRIPTION
+/// Reads the coefficient arrays with libjpeg, requantizes them to the tables for the
+/// requested compression level, randomises the LSB of the non trivial AC coefficients
+/// and writes them straight back out. No IDCT or colour conversion takes place.
+//------------------------------------------------------------------------------------
+
+#pragma once
+
+#ifndef _SRL_JPEG_DCT_SCRUB_HPP
+#define _SRL_JPEG_DCT_SCRUB_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace srl
+{
+	///
+	/// @brief	Scrubs a JPEG stream in the DCT domain
+	///
+	/// @description	Each coefficient is requantized to the standard IJG tables scaled for quality,
+	///					never to a finer step than the source already used. AC coefficients with a
+	///					magnitude of 2 or more then have their LSB replaced by a pseudo random bit
+	///					derived from seed and the block position, so the same input and seed always
+	///					produce the same output. APPn and COM markers are not copied across.
+	///
+	/// @param[in]	jpeg_data_p		pointer to the source JPEG stream
+	///
+	/// @param[in]	data_length		length of the source stream in bytes
+	///
+	/// @param[in]	quality			IJG quality [1-100], normally an Srl_jpgscrub_compression_level
+	///
+	/// @param[in]	seed			seed for the coefficient LSB noise
+	///
+	/// @param[out]	out_buf			replaced with the scrubbed JPEG stream
+	///
+	/// @param[out]	err_msg			libjpeg error message if the function fails
+	///
+	/// @return	bool	true if the stream was scrubbed, false if libjpeg rejected it
+	///
+	bool jpeg_dct_scrub( const unsigned char *jpeg_data_p,
+						 size_t data_length,
+						 int quality,
+						 uint64_t seed,
+						 std::vector<unsigned char> &out_buf,
+						 std::string &err_msg );
+
+	///
+	/// @brief	As above with the chroma tables requantized to chroma_quality rather than quality
+	///
+	bool jpeg_dct_scrub( const unsigned char *jpeg_data_p,
+						 size_t data_length,
+						 int quality,
+						 int chroma_quality,
+						 uint64_t seed,
+						 std::vector<unsigned char> &out_buf,
+						 std::string &err_msg );
+
+	///
+	/// @brief	returns true if the buffer starts with a JPEG start of image marker
+	///
+	bool is_jpeg_stream( const unsigned char *data_p, size_t data_length );
+}
+
+#endif //_SRL_JPEG_DCT_SCRUB_HPP
@@ -0,0 +1,543 @@
+//------------------------------------------------------------------------------------
+///
+/// @file   Srl_latency_histogram.cpp
+///
+/// @brief Per stage latency histograms, recorded per thread and merged on demand
+///
+//------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+
+#include "Srl_latency_histogram.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace srl;
+using namespace std;
+
+namespace
+{
+	const uint64_t NO_MIN = numeric_limits<uint64_t>::max();
+
+	///
+	/// @brief	position of the highest set bit, value must not be 0
+	///
+	unsigned int highest_bit( uint64_t value )
+	{
+		unsigned int bit = 0;
+		for (unsigned int step = 32; step > 0; step >>= 1)
+		{
+			if (value >> step)
+			{
+				value >>= step;
+				bit += step;
+			}
+		}
+		return bit;
+	}
+
+	///
+	/// @brief	add for a counter only the owning thread writes, no locked instruction needed
+	///
+	void bump( atomic<uint64_t> &counter, uint64_t value )
+	{
+		counter.store(counter.load(memory_order_relaxed) + value, memory_order_relaxed);
+	}
+}
+
+///
+/// @brief	One thread's histograms. Only the owning thread records into them, snapshot() and
+///			reset() read and clear them from other threads through the atomics
+///
+struct Srl_latency_recorder::Srl_latency_shard
+{
+	struct Srl_shard_histogram
+	{
+		Srl_shard_histogram( void )
+		{
+			clear();
+		}
+
+		void record( uint64_t nanoseconds )
+		{
+			bump(counts[Srl_latency_histogram::bucket_index(nanoseconds)], 1);
+			bump(sum, nanoseconds);
+			if (nanoseconds < min.load(memory_order_relaxed))
+			{
+				min.store(nanoseconds, memory_order_relaxed);
+			}
+			if (nanoseconds > max.load(memory_order_relaxed))
+			{
+				max.store(nanoseconds, memory_order_relaxed);
+			}
+		}
+
+		void clear( void )
+		{
+			for (size_t i = 0; i < Srl_latency_histogram::BUCKET_COUNT; i++)
+			{
+				counts[i].store(0, memory_order_relaxed);
+			}
+			sum.store(0, memory_order_relaxed);
+			min.store(NO_MIN, memory_order_relaxed);
+			max.store(0, memory_order_relaxed);
+		}
+
+		atomic<uint64_t> counts[Srl_latency_histogram::BUCKET_COUNT];
+		atomic<uint64_t> sum;
+		atomic<uint64_t> min;
+		atomic<uint64_t> max;
+	};
+
+	Srl_latency_shard( void )
+	{
+		for (size_t i = 0; i < SLOT_COUNT; i++)
+		{
+			slots[i].store(nullptr, memory_order_relaxed);
+		}
+	}
+
+	~Srl_latency_shard()
+	{
+		for (size_t i = 0; i < SLOT_COUNT; i++)
+		{
+			delete slots[i].load(memory_order_relaxed);
+		}
+	}
+
+	///
+	/// @brief	created by the owning thread on its first sample for the slot's key
+	///
+	atomic<Srl_shard_histogram*> slots[SLOT_COUNT];
+};
+
+/***************************************************
+*
+*					Srl_latency_histogram
+*
+****************************************************/
+
+Srl_latency_histogram::Srl_latency_histogram( void )
+	:	m_counts(BUCKET_COUNT, 0),
+		m_count(0),
+		m_min(NO_MIN),
+		m_max(0),
+		m_sum(0)
+{
+}
+
+void Srl_latency_histogram::record( uint64_t nanoseconds )
+{
+	m_counts[bucket_index(nanoseconds)]++;
+	m_count++;
+	m_sum += nanoseconds;
+	m_min = std::min(m_min, nanoseconds);
+	m_max = std::max(m_max, nanoseconds);
+}
+
+void Srl_latency_histogram::merge( const Srl_latency_histogram &other )
+{
+	for (size_t i = 0; i < BUCKET_COUNT; i++)
+	{
+		m_counts[i] += other.m_counts[i];
+	}
+	m_count += other.m_count;
+	m_sum += other.m_sum;
+	m_min = std::min(m_min, other.m_min);
+	m_max = std::max(m_max, other.m_max);
+}
+
+void Srl_latency_histogram::add_bucket( size_t index, uint64_t count )
+{
+	if (index < BUCKET_COUNT && 0 != count)
+	{
+		m_counts[index] += count;
+		m_count += count;
+	}
+}
+
+void Srl_latency_histogram::clear( void )
+{
+	std::fill(m_counts.begin(), m_counts.end(), 0);
+	m_count = 0;
+	m_sum = 0;
+	m_min = NO_MIN;
+	m_max = 0;
+}
+
+uint64_t Srl_latency_histogram::count( void ) const
+{
+	return m_count;
+}
+
+uint64_t Srl_latency_histogram::min_ns( void ) const
+{
+	return (0 == m_count) ? 0 : m_min;
+}
+
+uint64_t Srl_latency_histogram::max_ns( void ) const
+{
+	return m_max;
+}
+
+double Srl_latency_histogram::mean_ns( void ) const
+{
+	return (0 == m_count) ? 0.0 : static_cast<double>(m_sum) / static_cast<double>(m_count);
+}
+
+uint64_t Srl_latency_histogram::value_at_percentile( double percentile ) const
+{
+	if (0 == m_count)
+	{
+		return 0;
+	}
+
+	percentile = std::min(100.0, std::max(0.0, percentile));
+	uint64_t rank = static_cast<uint64_t>(std::ceil(percentile / 100.0 * static_cast<double>(m_count)));
+	rank = std::max<uint64_t>(1, std::min(rank, m_count));
+
+	uint64_t seen = 0;
+	for (size_t i = 0; i < BUCKET_COUNT; i++)
+	{
+		seen += m_counts[i];
+		if (seen >= rank)
+		{
+			return std::min(m_max, std::max(m_min, bucket_ceiling(i)));
+		}
+	}
+	return m_max;
+}
+
+size_t Srl_latency_histogram::bucket_index( uint64_t nanoseconds )
+{
+	const size_t linear = size_t(1) << SUB_BUCKET_BITS;
+	const size_t per_power = linear >> 1;
+
+	if (nanoseconds < linear)
+	{
+		return static_cast<size_t>(nanoseconds);
+	}
+
+	const unsigned int bit = highest_bit(nanoseconds);
+	if (bit >= HIGHEST_BIT)
+	{
+		return BUCKET_COUNT - 1;
+	}
+
+	//The top SUB_BUCKET_BITS bits pick the bucket within the power of two
+	const unsigned int shift = bit - (SUB_BUCKET_BITS - 1);
+	const size_t top = static_cast<size_t>(nanoseconds >> shift);
+	return linear + (bit - SUB_BUCKET_BITS) * per_power + (top - per_power);
+}
+
+uint64_t Srl_latency_histogram::bucket_ceiling( size_t index )
+{
+	const size_t linear = size_t(1) << SUB_BUCKET_BITS;
+	const size_t per_power = linear >> 1;
+
+	if (index < linear)
+	{
+		return index;
+	}
+	if (index >= BUCKET_COUNT - 1)
+	{
+		return numeric_limits<uint64_t>::max();
+	}
+
+	const unsigned int bit = static_cast<unsigned int>((index - linear) / per_power) + SUB_BUCKET_BITS;
+	const uint64_t top = per_power + (index - linear) % per_power;
+	const unsigned int shift = bit - (SUB_BUCKET_BITS - 1);
+	return ((top + 1) << shift) - 1;
+}
+
+/***************************************************
+*
+*					Snapshot
+*
+****************************************************/
+
+const vector<Srl_latency_row>& Srl_latency_snapshot::rows( void ) const
+{
+	return m_rows;
+}
+
+Srl_latency_histogram Srl_latency_snapshot::stage_histogram( Srl_latency_stage stage ) const
+{
+	Srl_latency_histogram merged;
+	for (size_t i = 0; i < m_rows.size(); i++)
+	{
+		if (stage == m_rows[i].stage)
+		{
+			merged.merge(m_rows[i].histogram);
+		}
+	}
+	return merged;
+}
+
+const Srl_latency_row* Srl_latency_snapshot::find( Srl_latency_stage stage, Srl_img_format_enum format,
+												   Srl_img_backend backend ) const
+{
+	for (size_t i = 0; i < m_rows.size(); i++)
+	{
+		if (stage == m_rows[i].stage && format == m_rows[i].format && backend == m_rows[i].backend)
+		{
+			return &m_rows[i];
+		}
+	}
+	return nullptr;
+}
+
+/***************************************************
+*
+*					Srl_latency_recorder
+*
+****************************************************/
+
+Srl_latency_recorder& Srl_latency_recorder::instance( void )
+{
+	static Srl_latency_recorder recorder;
+	return recorder;
+}
+
+Srl_latency_recorder::Srl_latency_recorder( void )
+	:	m_enabled(true)
+{
+}
+
+Srl_latency_recorder::~Srl_latency_recorder()
+{
+	//Defined here where Srl_latency_shard is complete
+}
+
+size_t Srl_latency_recorder::slot_index( Srl_latency_stage stage, Srl_img_format_enum format, Srl_img_backend backend )
+{
+	if (format < SRL_IMG_FORMAT_NONE || format >= SRL_IMG_FORMAT_COUNT)
+	{
+		format = SRL_IMG_FORMAT_NONE;
+	}
+	if (backend < SRL_BACKEND_NONE || backend > SRL_BACKEND_MAGICK)
+	{
+		backend = SRL_BACKEND_NONE;
+	}
+	return (static_cast<size_t>(stage) * SRL_IMG_FORMAT_COUNT + format) * (SRL_BACKEND_MAGICK + 1) + backend;
+}
+
+Srl_latency_recorder::Srl_latency_shard& Srl_latency_recorder::thread_shard( void )
+{
+	///
+	/// @brief	Hands the thread's shard back to the free list when the thread exits
+	///
+	struct Srl_shard_holder
+	{
+		explicit Srl_shard_holder( Srl_latency_recorder &owner )
+			:	recorder(owner), shard_p(nullptr) {}
+
+		~Srl_shard_holder()
+		{
+			if (nullptr != shard_p)
+			{
+				lock_guard<mutex> lock(recorder.m_lock);
+				recorder.m_free_shards.push_back(shard_p);
+			}
+		}
+
+		Srl_latency_recorder &recorder;
+		Srl_latency_shard *shard_p;
+	};
+
+	static thread_local Srl_shard_holder holder(*this);
+	if (nullptr == holder.shard_p)
+	{
+		lock_guard<mutex> lock(m_lock);
+		if (!m_free_shards.empty())
+		{
+			holder.shard_p = m_free_shards.back();
+			m_free_shards.pop_back();
+		}
+		else
+		{
+			m_shards.emplace_back(new Srl_latency_shard);
+			holder.shard_p = m_shards.back().get();
+		}
+	}
+	return *holder.shard_p;
+}
+
+void Srl_latency_recorder::record( Srl_latency_stage stage, Srl_img_format_enum format, Srl_img_backend backend,
+								   uint64_t nanoseconds )
+{
+	if (stage < SRL_STAGE_INGEST || stage >= SRL_STAGE_COUNT)
+	{
+		return;
+	}
+
+	atomic<Srl_latency_shard::Srl_shard_histogram*> &slot = thread_shard().slots[slot_index(stage, format, backend)];
+	Srl_latency_shard::Srl_shard_histogram *histogram_p = slot.load(memory_order_relaxed);
+	if (nullptr == histogram_p)
+	{
+		histogram_p = new Srl_latency_shard::Srl_shard_histogram;
+		slot.store(histogram_p, memory_order_release);
+	}
+	histogram_p->record(nanoseconds);
+}
+
+Srl_latency_snapshot Srl_latency_recorder::snapshot( void )
+{
+	//Only the keys something recorded against get a histogram
+	vector< unique_ptr<Srl_latency_histogram> > merged(SLOT_COUNT);
+	{
+		lock_guard<mutex> lock(m_lock);
+		for (size_t shard = 0; shard < m_shards.size(); shard++)
+		{
+			for (size_t slot = 0; slot < SLOT_COUNT; slot++)
+			{
+				const Srl_latency_shard::Srl_shard_histogram *source_p = m_shards[shard]->slots[slot].load(memory_order_acquire);
+				if (nullptr == source_p)
+				{
+					continue;
+				}
+				if (nullptr == merged[slot])
+				{
+					merged[slot].reset(new Srl_latency_histogram);
+				}
+
+				Srl_latency_histogram &target = *merged[slot];
+				const uint64_t before = target.m_count;
+				for (size_t bucket = 0; bucket < Srl_latency_histogram::BUCKET_COUNT; bucket++)
+				{
+					target.add_bucket(bucket, source_p->counts[bucket].load(memory_order_relaxed));
+				}
+				if (target.m_count != before)
+				{
+					target.m_sum += source_p->sum.load(memory_order_relaxed);
+					target.m_min = std::min(target.m_min, source_p->min.load(memory_order_relaxed));
+					target.m_max = std::max(target.m_max, source_p->max.load(memory_order_relaxed));
+				}
+			}
+		}
+	}
+
+	Srl_latency_snapshot snapshot;
+	const size_t backends = SRL_BACKEND_MAGICK + 1;
+	for (size_t slot = 0; slot < SLOT_COUNT; slot++)
+	{
+		if (nullptr == merged[slot] || 0 == merged[slot]->count())
+		{
+			continue;
+		}
+
+		Srl_latency_row row;
+		row.stage = static_cast<Srl_latency_stage>(slot / (SRL_IMG_FORMAT_COUNT * backends));
+		row.format = static_cast<Srl_img_format_enum>((slot / backends) % SRL_IMG_FORMAT_COUNT);
+		row.backend = static_cast<Srl_img_backend>(slot % backends);
+		row.histogram = std::move(*merged[slot]);
+		snapshot.m_rows.push_back(std::move(row));
+	}
+	return snapshot;
+}
+
+void Srl_latency_recorder::reset( void )
+{
+	lock_guard<mutex> lock(m_lock);
+	for (size_t shard = 0; shard < m_shards.size(); shard++)
+	{
+		for (size_t slot = 0; slot < SLOT_COUNT; slot++)
+		{
+			Srl_latency_shard::Srl_shard_histogram *histogram_p = m_shards[shard]->slots[slot].load(memory_order_acquire);
+			if (nullptr != histogram_p)
+			{
+				histogram_p->clear();
+			}
+		}
+	}
+}
+
+void Srl_latency_recorder::set_enabled( bool enabled )
+{
+	m_enabled.store(enabled, memory_order_relaxed);
+}
+
+bool Srl_latency_recorder::enabled( void ) const
+{
+	return m_enabled.load(memory_order_relaxed);
+}
+
+/***************************************************
+*
+*					Srl_stage_timer
+*
+****************************************************/
+
+Srl_stage_timer::Srl_stage_timer( Srl_latency_stage stage, Srl_img_format_enum format, Srl_img_backend backend )
+	:	m_stage(stage),
+		m_format(format),
+		m_backend(backend),
+		m_active(Srl_latency_recorder::instance().enabled())
+{
+	if (m_active)
+	{
+		m_start = Srl_latency_clock::now();
+	}
+}
+
+Srl_stage_timer::~Srl_stage_timer()
+{
+	finish();
+}
+
+void Srl_stage_timer::set_key( Srl_img_format_enum format, Srl_img_backend backend )
+{
+	m_format = format;
+	m_backend = backend;
+}
+
+void Srl_stage_timer::restart( void )
+{
+	if (m_active)
+	{
+		m_start = Srl_latency_clock::now();
+	}
+}
+
+void Srl_stage_timer::finish( void )
+{
+	if (m_active)
+	{
+		const chrono::nanoseconds elapsed = chrono::duration_cast<chrono::nanoseconds>(Srl_latency_clock::now() - m_start);
+		Srl_latency_recorder::instance().record(m_stage, m_format, m_backend, static_cast<uint64_t>(elapsed.count()));
+		m_active = false;
+	}
+}
+
+namespace srl
+{
+	const char* stage_name( Srl_latency_stage stage )
+	{
+		switch (stage)
+		{
+		case SRL_STAGE_INGEST:	return "ingest";
+		case SRL_STAGE_SNIFF:	return "sniff";
+		case SRL_STAGE_DECODE:	return "decode";
+		case SRL_STAGE_SCRUB:	return "scrub";
+		case SRL_STAGE_ENCODE:	return "encode";
+		case SRL_STAGE_EMIT:	return "emit";
+		case SRL_STAGE_COUNT:	break;
+		}
+		return "unknown stage";
+	}
+
+	Srl_latency_summary summarise( const Srl_latency_histogram &histogram )
+	{
+		Srl_latency_summary summary;
+		summary.count = histogram.count();
+		summary.min_ns = histogram.min_ns();
+		summary.max_ns = histogram.max_ns();
+		summary.mean_ns = histogram.mean_ns();
+		summary.p50_ns = histogram.value_at_percentile(50.0);
+		summary.p99_ns = histogram.value_at_percentile(99.0);
+		summary.p999_ns = histogram.value_at_percentile(99.9);
+		return summary;
+	}
+}
@@ -0,0 +1,282 @@
+// $Id$
+//------------------------------------------------------------------------------------
+///
+/// @file
+///
+/// @brief Per stage latency histograms, recorded per thread and merged on demand
+///
+/// @section VERSION
+/// 1.0
+///
+/// @section DESCRIPTION
+/// Every stage an image goes through (ingest, sniff, decode, scrub, encode and emit)
+/// records how long it took into a log linear histogram keyed by stage, image format
+/// and backend. Buckets are exact below 64ns and split each power of two above that
+/// into 32, so any recorded value is within about 3% of its bucket. Each thread records
+/// into histograms of its own with plain relaxed stores, there is no lock and no shared
+/// cache line on the recording path. snapshot() merges every thread's histograms into
+/// one per key, which is where p50, p99 and p999 come from.
+//------------------------------------------------------------------------------------
+
+#pragma once
+
+#ifndef _SRL_LATENCY_HISTOGRAM_HPP
+#define _SRL_LATENCY_HISTOGRAM_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "Srl_steg_data_types.hpp"
+
+namespace srl
+{
+	///
+	/// @brief	Stages latency is recorded for
+	///
+	enum Srl_latency_stage
+	{
+		SRL_STAGE_INGEST,	///< Srl_scrub_pipeline::push, header probe, memory admission and queueing
+		SRL_STAGE_SNIFF,	///< signature sniff and header check against the decode limits
+		SRL_STAGE_DECODE,	///< one decode to pixels, including re-decodes of an earlier output
+		SRL_STAGE_SCRUB,	///< bit plane scrub of the decoded pixels
+		SRL_STAGE_ENCODE,	///< encode to the target format, for DCT mode the coefficient requantization
+		SRL_STAGE_EMIT,		///< wait in the pipeline's result queue until the consumer takes the image
+		SRL_STAGE_COUNT		//must stay last
+	};
+
+	///
+	/// @brief	short name of a stage, e.g. "decode"
+	///
+	const char* stage_name( Srl_latency_stage stage );
+
+	typedef std::chrono::steady_clock Srl_latency_clock;
+
+	///
+	/// @brief	Log linear histogram of nanosecond latencies
+	///
+	class Srl_latency_histogram
+	{
+	public:
+
+		///
+		/// @brief	values are exact below 2^SUB_BUCKET_BITS, each power of two above is split
+		///			in 2^(SUB_BUCKET_BITS - 1)
+		///
+		static const unsigned int SUB_BUCKET_BITS = 6;
+
+		///
+		/// @brief	values from 2^HIGHEST_BIT (about 18 minutes) up share the last bucket
+		///
+		static const unsigned int HIGHEST_BIT = 40;
+
+		static const size_t BUCKET_COUNT = ( size_t( 1 ) << SUB_BUCKET_BITS ) +
+										   ( HIGHEST_BIT - SUB_BUCKET_BITS ) * ( size_t( 1 ) << ( SUB_BUCKET_BITS - 1 ) ) + 1;
+
+		Srl_latency_histogram( void );
+
+		void record( uint64_t nanoseconds );
+
+		///
+		/// @brief	adds every sample of other
+		///
+		void merge( const Srl_latency_histogram &other );
+
+		///
+		/// @brief	adds count samples to one bucket, used when merging the per thread histograms
+		///
+		void add_bucket( size_t index, uint64_t count );
+
+		void clear( void );
+
+		uint64_t count( void ) const;
+		uint64_t min_ns( void ) const;
+		uint64_t max_ns( void ) const;
+		double mean_ns( void ) const;
+
+		///
+		/// @brief	The highest value in the bucket holding the percentile'th sample, clamped to the
+		///			recorded min and max. 0 if nothing has been recorded
+		///
+		/// @param[in]	percentile	0 to 100, e.g. 99.9 for p999
+		///
+		uint64_t value_at_percentile( double percentile ) const;
+
+		static size_t bucket_index( uint64_t nanoseconds );
+
+		///
+		/// @brief	highest value that falls in bucket index
+		///
+		static uint64_t bucket_ceiling( size_t index );
+
+	private:
+		friend class Srl_latency_recorder;
+
+		std::vector<uint64_t> m_counts;
+		uint64_t m_count;
+		uint64_t m_min;
+		uint64_t m_max;
+		uint64_t m_sum;
+	};
+
+	///
+	/// @brief	Percentiles of one histogram
+	///
+	struct Srl_latency_summary
+	{
+		uint64_t count;
+		uint64_t min_ns;
+		uint64_t max_ns;
+		double mean_ns;
+		uint64_t p50_ns;
+		uint64_t p99_ns;
+		uint64_t p999_ns;
+	};
+
+	Srl_latency_summary summarise( const Srl_latency_histogram &histogram );
+
+	///
+	/// @brief	Merged histogram of one stage, format and backend
+	///
+	struct Srl_latency_row
+	{
+		Srl_latency_stage stage;
+		Srl_img_format_enum format;		///< SRL_IMG_FORMAT_NONE where the format wasn't known yet
+		Srl_img_backend backend;		///< SRL_BACKEND_NONE where the stage doesn't use one
+		Srl_latency_histogram histogram;
+	};
+
+	///
+	/// @brief	Every thread's histograms merged at one point in time
+	///
+	class Srl_latency_snapshot
+	{
+	public:
+
+		///
+		/// @brief	one row per key that has samples, ordered by stage, format then backend
+		///
+		const std::vector<Srl_latency_row>& rows( void ) const;
+
+		///
+		/// @brief	all formats and backends of a stage merged together
+		///
+		Srl_latency_histogram stage_histogram( Srl_latency_stage stage ) const;
+
+		///
+		/// @brief	nullptr if the key has no samples
+		///
+		const Srl_latency_row* find( Srl_latency_stage stage, Srl_img_format_enum format, Srl_img_backend backend ) const;
+
+	private:
+		friend class Srl_latency_recorder;
+
+		std::vector<Srl_latency_row> m_rows;
+	};
+
+	///
+	/// @brief	Process wide owner of the per thread histograms
+	///
+	/// @description	A thread's histograms are created the first time it records for a key and
+	///					outlive the thread, they are handed to the next new thread so a pipeline
+	///					starting and stopping its stage threads doesn't grow the set.
+	///
+	class Srl_latency_recorder
+	{
+	public:
+
+		static Srl_latency_recorder& instance( void );
+
+		///
+		/// @brief	Adds one sample to the calling thread's histogram for the key. Lock free after the
+		///			thread's first sample for the key
+		///
+		void record( Srl_latency_stage stage, Srl_img_format_enum format, Srl_img_backend backend,
+					 uint64_t nanoseconds );
+
+		///
+		/// @brief	Merges every thread's histograms. Samples recorded while it runs may or may not be in it
+		///
+		Srl_latency_snapshot snapshot( void );
+
+		///
+		/// @brief	Empties every histogram. A sample recorded at the same moment may be half counted
+		///
+		void reset( void );
+
+		///
+		/// @brief	Turns recording on or off, Srl_stage_timer doesn't read the clock while it is off.
+		///			On by default
+		///
+		void set_enabled( bool enabled );
+		bool enabled( void ) const;
+
+	private:
+
+		///
+		/// @brief	one slot per stage, format and backend
+		///
+		static const size_t SLOT_COUNT = SRL_STAGE_COUNT * SRL_IMG_FORMAT_COUNT * ( SRL_BACKEND_MAGICK + 1 );
+
+		struct Srl_latency_shard;
+
+		Srl_latency_recorder( void );
+		~Srl_latency_recorder();
+		Srl_latency_recorder( const Srl_latency_recorder& ) = delete;
+		Srl_latency_recorder& operator=( const Srl_latency_recorder& ) = delete;
+
+		///
+		/// @brief	the calling thread's histograms, taken from the free list or created on first use
+		///
+		Srl_latency_shard& thread_shard( void );
+
+		static size_t slot_index( Srl_latency_stage stage, Srl_img_format_enum format, Srl_img_backend backend );
+
+		std::mutex m_lock;
+		std::vector< std::unique_ptr<Srl_latency_shard> > m_shards;
+		std::vector<Srl_latency_shard*> m_free_shards;
+		std::atomic<bool> m_enabled;
+	};
+
+	///
+	/// @brief	Records the time from construction (or restart()) to destruction against a stage
+	///
+	class Srl_stage_timer
+	{
+	public:
+		explicit Srl_stage_timer( Srl_latency_stage stage,
+								  Srl_img_format_enum format = SRL_IMG_FORMAT_NONE,
+								  Srl_img_backend backend = SRL_BACKEND_NONE );
+		~Srl_stage_timer();
+
+		Srl_stage_timer( const Srl_stage_timer& ) = delete;
+		Srl_stage_timer& operator=( const Srl_stage_timer& ) = delete;
+
+		///
+		/// @brief	sets the key for stages where the format is only known part way through
+		///
+		void set_key( Srl_img_format_enum format, Srl_img_backend backend );
+
+		///
+		/// @brief	starts timing again from now, drops the time so far
+		///
+		void restart( void );
+
+		///
+		/// @brief	records now rather than at destruction, nothing more is recorded after
+		///
+		void finish( void );
+
+	private:
+		Srl_latency_stage m_stage;
+		Srl_img_format_enum m_format;
+		Srl_img_backend m_backend;
+		bool m_active;
+		Srl_latency_clock::time_point m_start;
+	};
+}
+
+#endif //_SRL_LATENCY_HISTOGRAM_HPP
@@ -0,0 +1,198 @@
+//------------------------------------------------------------------------------------
+///
+/// @file   Srl_lsb_scrub.cpp
+///
+/// @brief Pixel domain bit plane scrub with runtime selected SIMD kernels
+///
+//------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+
+#include "Srl_lsb_scrub.hpp"
+#include "Srl_counter_rng.hpp"
+#include "Srl_cpu_features.hpp"
+#include "Srl_tile_parallel.hpp"
+
+#include <algorithm>
+
+#include <immintrin.h>
+
+using namespace srl;
+using namespace std;
+
+namespace
+{
+	/***************************************************
+	*
+	*					Row kernels
+	*
+	****************************************************/
+
+	///
+	/// @brief	Scrubs one row in place. Bits set in plane_mask are cleared, then filled from noise_p
+	///			if it isn't nullptr
+	///
+	typedef void (*Srl_lsb_row_kernel)(unsigned char *row_p, const unsigned char *noise_p, size_t length, unsigned char plane_mask);
+
+	void lsb_row_scalar(unsigned char *row_p, const unsigned char *noise_p, size_t length, unsigned char plane_mask)
+	{
+		const unsigned char keep_mask = static_cast<unsigned char>(~plane_mask);
+		if (nullptr == noise_p)
+		{
+			for (size_t i = 0; i < length; i++)
+			{
+				row_p[i] &= keep_mask;
+			}
+		}
+		else
+		{
+			for (size_t i = 0; i < length; i++)
+			{
+				row_p[i] = static_cast<unsigned char>((row_p[i] & keep_mask) | (noise_p[i] & plane_mask));
+			}
+		}
+	}
+
+	///
+	/// @brief	16 bytes a step. Only and/andnot/or are needed, all of which are SSE2 and so always
+	///			present on x64
+	///
+	void lsb_row_sse2(unsigned char *row_p, const unsigned char *noise_p, size_t length, unsigned char plane_mask)
+	{
+		const __m128i mask = _mm_set1_epi8(static_cast<char>(plane_mask));
+		size_t i = 0;
+		if (nullptr == noise_p)
+		{
+			for (; i + 16 <= length; i += 16)
+			{
+				__m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row_p + i));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(row_p + i), _mm_andnot_si128(mask, px));
+			}
+		}
+		else
+		{
+			for (; i + 16 <= length; i += 16)
+			{
+				__m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row_p + i));
+				__m128i noise = _mm_loadu_si128(reinterpret_cast<const __m128i*>(noise_p + i));
+				px = _mm_or_si128(_mm_andnot_si128(mask, px), _mm_and_si128(mask, noise));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(row_p + i), px);
+			}
+		}
+		lsb_row_scalar(row_p + i, (nullptr == noise_p) ? nullptr : noise_p + i, length - i, plane_mask);
+	}
+
+	///
+	/// @brief	32 bytes a step, the tail is handed to the SSE2 kernel
+	///
+	SRL_TARGET_AVX2
+	void lsb_row_avx2(unsigned char *row_p, const unsigned char *noise_p, size_t length, unsigned char plane_mask)
+	{
+		const __m256i mask = _mm256_set1_epi8(static_cast<char>(plane_mask));
+		size_t i = 0;
+		if (nullptr == noise_p)
+		{
+			for (; i + 32 <= length; i += 32)
+			{
+				__m256i px = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row_p + i));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(row_p + i), _mm256_andnot_si256(mask, px));
+			}
+		}
+		else
+		{
+			for (; i + 32 <= length; i += 32)
+			{
+				__m256i px = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row_p + i));
+				__m256i noise = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(noise_p + i));
+				px = _mm256_or_si256(_mm256_andnot_si256(mask, px), _mm256_and_si256(mask, noise));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(row_p + i), px);
+			}
+		}
+		//Avoid the AVX to SSE transition penalty before dropping to the narrower kernel
+		_mm256_zeroupper();
+		lsb_row_sse2(row_p + i, (nullptr == noise_p) ? nullptr : noise_p + i, length - i, plane_mask);
+	}
+
+	/***************************************************
+	*
+	*					CPU dispatch
+	*
+	****************************************************/
+
+	Srl_lsb_row_kernel select_row_kernel()
+	{
+		switch (cpu_simd_level())
+		{
+		case SRL_SIMD_AVX2:
+			return lsb_row_avx2;
+		case SRL_SIMD_SSE2:
+			return lsb_row_sse2;
+		default:
+			return lsb_row_scalar;
+		}
+	}
+
+	/***************************************************
+	*
+	*					Noise
+	*
+	****************************************************/
+
+	///
+	/// @brief	bytes of noise generated at a time, small enough to stay in L1 alongside the row. Must be
+	///			a multiple of Srl_counter_rng::SRL_RNG_BLOCK_BYTES
+	///
+	const size_t NOISE_CHUNK = 4096;
+}
+
+namespace srl
+{
+	bool lsb_scrub( cv::Mat &img, unsigned int bit_planes, Srl_lsb_scrub_mode mode, uint64_t seed,
+					Srl_thread_pool *pool_p )
+	{
+		if (0 == bit_planes)
+		{	//Scrubbing turned off
+			return true;
+		}
+		if (img.empty() || CV_8U != img.depth() || bit_planes > SRL_LSB_MAX_PLANES)
+		{
+			return false;
+		}
+
+		static const Srl_lsb_row_kernel kernel = select_row_kernel();
+		const unsigned char plane_mask = static_cast<unsigned char>((1u << bit_planes) - 1);
+		const size_t row_bytes = static_cast<size_t>(img.cols) * img.elemSize();
+		const Srl_counter_rng rng(seed);
+
+		for_each_band(img, pool_p, [&](int row_begin, int row_end)
+		{
+			if (SRL_LSB_CLEAR == mode)
+			{
+				if (img.isContinuous())
+				{	//No padding to skip so the band is one long row
+					kernel(img.ptr<unsigned char>(row_begin), nullptr, row_bytes * (row_end - row_begin), plane_mask);
+					return;
+				}
+				for (int y = row_begin; y < row_end; y++)
+				{
+					kernel(img.ptr<unsigned char>(y), nullptr, row_bytes, plane_mask);
+				}
+				return;
+			}
+
+			//Each pixel row is its own stream so rows can be scrubbed in any order on any thread
+			unsigned char noise[NOISE_CHUNK];
+			for (int y = row_begin; y < row_end; y++)
+			{
+				unsigned char *row_p = img.ptr<unsigned char>(y);
+				for (size_t offset = 0; offset < row_bytes; offset += NOISE_CHUNK)
+				{
+					size_t length = std::min(NOISE_CHUNK, row_bytes - offset);
+					rng.fill(static_cast<uint64_t>(y), offset, noise, length);
+					kernel(row_p + offset, noise, length, plane_mask);
+				}
+			}
+		});
+		return true;
+	}
+}
@@ -0,0 +1,84 @@
+// $Id$
+//------------------------------------------------------------------------------------
+///
+/// @file
+///
+/// @brief Pixel domain scrub of the low bit planes of 8 bit images
+///
+/// @section VERSION
+/// 1.0
+///
+/// @section DESCRIPTION
+/// Lossless formats (PNG, BMP, TIFF...) keep every pixel bit, so requantization never
+/// touches an LSB payload hidden in them. This stage clears or randomises the low bit
+/// planes of a cv::Mat a row at a time with AVX2 or SSE2 kernels, falling back to a
+/// scalar loop on CPUs without them. The kernel is picked once at runtime.
+//------------------------------------------------------------------------------------
+
+#pragma once
+
+#ifndef _SRL_LSB_SCRUB_HPP
+#define _SRL_LSB_SCRUB_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include <opencv2\core.hpp>
+
+#include "Srl_thread_pool.hpp"
+
+namespace srl
+{
+	///
+	/// @brief	What is written into the scrubbed bit planes
+	///
+	enum Srl_lsb_scrub_mode
+	{
+		///
+		/// @brief	planes are zeroed, cheapest but leaves a recognisable all zero plane behind
+		///
+		SRL_LSB_CLEAR,
+
+		///
+		/// @brief	planes are replaced with noise derived from the seed and the pixel position
+		///
+		SRL_LSB_RANDOMIZE
+	};
+
+	///
+	/// @brief	number of low bit planes scrubbed when the caller doesn't choose
+	///
+	const unsigned int SRL_LSB_DEFAULT_PLANES = 2;
+
+	///
+	/// @brief	largest number of bit planes lsb_scrub() will touch, any more is visible damage
+	///
+	const unsigned int SRL_LSB_MAX_PLANES = 4;
+
+	///
+	/// @brief	Scrubs the low bit planes of every channel of an 8 bit image in place
+	///
+	/// @description	ROIs and other non continuous Mats are walked row by row so the padding between
+	///					rows is never written. Randomised output depends only on the seed and the pixel
+	///					position, never on how the image is split across threads.
+	///
+	/// @param[in,out]	img			CV_8U image of any channel count
+	///
+	/// @param[in]		bit_planes	number of low bit planes to scrub [0-SRL_LSB_MAX_PLANES], 0 leaves the
+	///								image untouched
+	///
+	/// @param[in]		mode		clear or randomise the planes
+	///
+	/// @param[in]		seed		per image Srl_counter_rng seed for SRL_LSB_RANDOMIZE, ignored when clearing
+	///
+	/// @param[in]		pool_p		pool to spread the bands of a large image over, nullptr to run on the
+	///								calling thread
+	///
+	/// @return	bool	false if the image is empty, not 8 bit, or bit_planes is out of range. Always true
+	///					for 0 planes
+	///
+	bool lsb_scrub( cv::Mat &img, unsigned int bit_planes, Srl_lsb_scrub_mode mode, uint64_t seed,
+					Srl_thread_pool *pool_p = nullptr );
+}
+
+#endif //_SRL_LSB_SCRUB_HPP
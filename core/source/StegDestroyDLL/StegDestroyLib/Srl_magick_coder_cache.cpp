@@ -0,0 +1,147 @@
+//------------------------------------------------------------------------------------
+///
+/// @file   Srl_magick_coder_cache.cpp
+///
+/// @brief Process wide cache of the ImageMagick coder capabilities
+///
+//------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+
+#include "Srl_magick_coder_cache.hpp"
+
+#include <atomic>
+#include <list>
+
+#include <Magick++.h>
+
+using namespace srl;
+using namespace std;
+
+namespace
+{
+	///
+	/// @brief	ASCII lower case, coder names are upper case in ImageMagick. Taken as unsigned char so
+	///			a byte over 0x7F is passed through rather than sign extended
+	///
+	inline unsigned char lower_ascii(unsigned char c)
+	{
+		return ('A' <= c && 'Z' >= c) ? static_cast<unsigned char>(c - 'A' + 'a') : c;
+	}
+
+	///
+	/// @brief	lower case copy of the name, only made once per coder as the table is built
+	///
+	string to_lower(const string &name)
+	{
+		string lower(name);
+		for (string::iterator it = lower.begin(); it != lower.end(); ++it)
+		{
+			*it = static_cast<char>(lower_ascii(static_cast<unsigned char>(*it)));
+		}
+		return lower;
+	}
+}
+
+size_t Srl_magick_coder_cache::Srl_nocase_hash::operator()( const string &name ) const
+{
+	//FNV-1a over the lower cased bytes
+	size_t hash = static_cast<size_t>(14695981039346656037ULL);
+	for (string::const_iterator it = name.begin(); it != name.end(); ++it)
+	{
+		hash ^= lower_ascii(static_cast<unsigned char>(*it));
+		hash *= static_cast<size_t>(1099511628211ULL);
+	}
+	return hash;
+}
+
+bool Srl_magick_coder_cache::Srl_nocase_equal::operator()( const string &lhs, const string &rhs ) const
+{
+	if (lhs.size() != rhs.size())
+	{
+		return false;
+	}
+	for (size_t i = 0; i < lhs.size(); i++)
+	{
+		if (lower_ascii(static_cast<unsigned char>(lhs[i])) != lower_ascii(static_cast<unsigned char>(rhs[i])))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+Srl_magick_coder_cache& Srl_magick_coder_cache::instance( void )
+{
+	//Function local static initialisation is thread safe
+	static Srl_magick_coder_cache cache;
+	return cache;
+}
+
+Srl_magick_coder_cache::Srl_magick_coder_cache( void )
+{
+	refresh();
+}
+
+void Srl_magick_coder_cache::refresh( void )
+{
+	shared_ptr<Srl_coder_table> table_p(new Srl_coder_table);
+
+	list<Magick::CoderInfo> coder_list;
+	try
+	{
+		Magick::coderInfoList( &coder_list ,
+			Magick::CoderInfo::AnyMatch ,   // readable and writable are recorded separately
+			Magick::CoderInfo::AnyMatch ,
+			Magick::CoderInfo::AnyMatch     // Multi-frame is not a primary concern
+			);
+	}
+	catch (Magick::Exception &)
+	{	//Leave the table empty, every Magick lookup will then report unsupported
+		coder_list.clear();
+	}
+
+	for (list<Magick::CoderInfo>::const_iterator entry = coder_list.begin(); entry != coder_list.end(); ++entry)
+	{
+		unsigned int flags = 0;
+		if (entry->isReadable())
+		{
+			flags |= SRL_CODER_READABLE;
+		}
+		if (entry->isWritable())
+		{
+			flags |= SRL_CODER_WRITABLE;
+		}
+		(*table_p)[to_lower(entry->name())] = flags;
+	}
+
+	std::atomic_store(&m_table_p, shared_ptr<const Srl_coder_table>(table_p));
+}
+
+unsigned int Srl_magick_coder_cache::lookup( const string &format ) const
+{
+	shared_ptr<const Srl_coder_table> table_p = std::atomic_load(&m_table_p);
+	if (nullptr == table_p || format.empty())
+	{
+		return 0;
+	}
+
+	Srl_coder_table::const_iterator found = table_p->find(format);
+	return (table_p->end() == found) ? 0 : found->second;
+}
+
+bool Srl_magick_coder_cache::is_supported( const string &format ) const
+{
+	unsigned int required = SRL_CODER_READABLE | SRL_CODER_WRITABLE;
+	return required == (lookup(format) & required);
+}
+
+bool Srl_magick_coder_cache::is_readable( const string &format ) const
+{
+	return 0 != (lookup(format) & SRL_CODER_READABLE);
+}
+
+bool Srl_magick_coder_cache::is_writable( const string &format ) const
+{
+	return 0 != (lookup(format) & SRL_CODER_WRITABLE);
+}
@@ -0,0 +1,111 @@
+// $Id$
+//------------------------------------------------------------------------------------
+///
+/// @file
+///
+/// @brief Process wide cache of the ImageMagick coder capabilities
+///
+/// @section VERSION
+/// 1.0
+///
+/// @section DESCRIPTION
+/// Magick::coderInfoList builds a list of every registered coder on each call, far too
+/// slow to do per image. The table is built once, held as an immutable snapshot and
+/// only rebuilt when refresh() is called explicitly.
+//------------------------------------------------------------------------------------
+
+#pragma once
+
+#ifndef _SRL_MAGICK_CODER_CACHE_HPP
+#define _SRL_MAGICK_CODER_CACHE_HPP
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+namespace srl
+{
+	///
+	/// @brief	Readable/writable lookup for Magick++ coders, safe to query from any thread
+	///
+	class Srl_magick_coder_cache
+	{
+	public:
+
+		///
+		/// @brief	returns the process wide cache, building the table on first use
+		///
+		static Srl_magick_coder_cache& instance( void );
+
+		///
+		/// @brief	true if Magick++ can both read and write the format
+		///
+		/// @param[in]	format	format name in any case, e.g. "jpeg" or "GIF"
+		///
+		bool is_supported( const std::string &format ) const;
+
+		///
+		/// @brief	true if Magick++ can read the format
+		///
+		bool is_readable( const std::string &format ) const;
+
+		///
+		/// @brief	true if Magick++ can write the format
+		///
+		bool is_writable( const std::string &format ) const;
+
+		///
+		/// @brief	Rebuilds the table from Magick::coderInfoList, e.g. after loading extra coder modules.
+		///			Readers carry on using the previous table until the new one is swapped in
+		///
+		void refresh( void );
+
+	private:
+
+		Srl_magick_coder_cache( void );
+
+		Srl_magick_coder_cache( const Srl_magick_coder_cache& ) = delete;
+		Srl_magick_coder_cache& operator=( const Srl_magick_coder_cache& ) = delete;
+
+		///
+		/// @brief	capability flags stored per coder
+		///
+		enum Srl_coder_flags
+		{
+			SRL_CODER_READABLE = 1,
+			SRL_CODER_WRITABLE = 2
+		};
+
+		///
+		/// @brief	ASCII case insensitive hash and equality, so a lookup can use the name it is given
+		///			rather than a lower cased copy
+		///
+		struct Srl_nocase_hash
+		{
+			size_t operator()( const std::string &name ) const;
+		};
+
+		struct Srl_nocase_equal
+		{
+			bool operator()( const std::string &lhs, const std::string &rhs ) const;
+		};
+
+		///
+		/// @brief	lower case coder name to Srl_coder_flags
+		///
+		typedef std::unordered_map<std::string, unsigned int, Srl_nocase_hash, Srl_nocase_equal> Srl_coder_table;
+
+		///
+		/// @brief	flags for the format, 0 if Magick++ has no coder for it
+		///
+		unsigned int lookup( const std::string &format ) const;
+
+		///
+		///	@brief	m_table_p	current snapshot, only ever accessed through std::atomic_load/atomic_store
+		///
+		std::shared_ptr<const Srl_coder_table> m_table_p;
+	};
+}
+
+#endif //_SRL_MAGICK_CODER_CACHE_HPP
@@ -0,0 +1,246 @@
+//------------------------------------------------------------------------------------
+///
+/// @file   Srl_memory_budget.cpp
+///
+/// @brief Memory ceiling shared by every image in flight, with admission control
+///
+//------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+
+#include "Srl_memory_budget.hpp"
+
+#include <algorithm>
+
+using namespace srl;
+using namespace std;
+
+/***************************************************
+*
+*					Srl_memory_budget
+*
+****************************************************/
+
+Srl_memory_budget::Srl_memory_budget( uint64_t ceiling_bytes )
+	:	m_ceiling(ceiling_bytes),
+		m_in_use(0),
+		m_peak(0),
+		m_waiting(0)
+{
+	std::fill(m_stage_bytes, m_stage_bytes + SRL_BUDGET_STAGE_COUNT, 0);
+}
+
+bool Srl_memory_budget::fits( uint64_t bytes ) const
+{
+	return SRL_BUDGET_UNLIMITED == m_ceiling || bytes <= m_ceiling;
+}
+
+Srl_memory_ticket Srl_memory_budget::admit( uint64_t bytes, Srl_budget_stage stage, const atomic<bool> *cancel_p )
+{
+	if (!fits(bytes))
+	{
+		return Srl_memory_ticket();
+	}
+
+	unique_lock<mutex> lock(m_lock);
+	m_waiting++;
+	m_room_cv.wait(lock, [&]()
+	{
+		return has_room(bytes) || (nullptr != cancel_p && cancel_p->load());
+	});
+	m_waiting--;
+
+	if (!has_room(bytes))
+	{	//Cancelled
+		return Srl_memory_ticket();
+	}
+	add(bytes, stage);
+	return Srl_memory_ticket(this, bytes, stage);
+}
+
+Srl_memory_ticket Srl_memory_budget::try_admit( uint64_t bytes, Srl_budget_stage stage )
+{
+	if (!fits(bytes))
+	{
+		return Srl_memory_ticket();
+	}
+
+	lock_guard<mutex> lock(m_lock);
+	if (!has_room(bytes))
+	{
+		return Srl_memory_ticket();
+	}
+	add(bytes, stage);
+	return Srl_memory_ticket(this, bytes, stage);
+}
+
+void Srl_memory_budget::wake_waiters( void )
+{
+	//Taking the lock orders the caller's cancel flag store before any waiter's recheck
+	lock_guard<mutex> lock(m_lock);
+	m_room_cv.notify_all();
+}
+
+uint64_t Srl_memory_budget::ceiling( void ) const
+{
+	return m_ceiling;
+}
+
+uint64_t Srl_memory_budget::in_use( void ) const
+{
+	lock_guard<mutex> lock(m_lock);
+	return m_in_use;
+}
+
+uint64_t Srl_memory_budget::in_use( Srl_budget_stage stage ) const
+{
+	lock_guard<mutex> lock(m_lock);
+	return m_stage_bytes[stage];
+}
+
+uint64_t Srl_memory_budget::peak( void ) const
+{
+	lock_guard<mutex> lock(m_lock);
+	return m_peak;
+}
+
+size_t Srl_memory_budget::waiting( void ) const
+{
+	lock_guard<mutex> lock(m_lock);
+	return m_waiting;
+}
+
+bool Srl_memory_budget::has_room( uint64_t bytes ) const
+{
+	//Anything that fits is let in when nothing else is held, even after a resize overshoot
+	return SRL_BUDGET_UNLIMITED == m_ceiling || 0 == m_in_use || bytes <= m_ceiling - std::min(m_ceiling, m_in_use);
+}
+
+void Srl_memory_budget::add( uint64_t bytes, Srl_budget_stage stage )
+{
+	m_in_use += bytes;
+	m_stage_bytes[stage] += bytes;
+	m_peak = std::max(m_peak, m_in_use);
+}
+
+void Srl_memory_budget::release( uint64_t bytes, Srl_budget_stage stage )
+{
+	{
+		lock_guard<mutex> lock(m_lock);
+		m_in_use -= bytes;
+		m_stage_bytes[stage] -= bytes;
+	}
+	m_room_cv.notify_all();
+}
+
+void Srl_memory_budget::move( uint64_t bytes, Srl_budget_stage from, Srl_budget_stage to )
+{
+	lock_guard<mutex> lock(m_lock);
+	m_stage_bytes[from] -= bytes;
+	m_stage_bytes[to] += bytes;
+}
+
+void Srl_memory_budget::resize( uint64_t old_bytes, uint64_t new_bytes, Srl_budget_stage stage )
+{
+	{
+		lock_guard<mutex> lock(m_lock);
+		m_in_use = m_in_use - old_bytes + new_bytes;
+		m_stage_bytes[stage] = m_stage_bytes[stage] - old_bytes + new_bytes;
+		m_peak = std::max(m_peak, m_in_use);
+	}
+	if (new_bytes < old_bytes)
+	{
+		m_room_cv.notify_all();
+	}
+}
+
+/***************************************************
+*
+*					Srl_memory_ticket
+*
+****************************************************/
+
+Srl_memory_ticket::Srl_memory_ticket( void )
+	:	m_budget_p(nullptr),
+		m_bytes(0),
+		m_stage(SRL_BUDGET_QUEUED)
+{
+}
+
+Srl_memory_ticket::Srl_memory_ticket( Srl_memory_budget *budget_p, uint64_t bytes, Srl_budget_stage stage )
+	:	m_budget_p(budget_p),
+		m_bytes(bytes),
+		m_stage(stage)
+{
+}
+
+Srl_memory_ticket::~Srl_memory_ticket()
+{
+	release();
+}
+
+Srl_memory_ticket::Srl_memory_ticket( Srl_memory_ticket &&other )
+	:	m_budget_p(other.m_budget_p),
+		m_bytes(other.m_bytes),
+		m_stage(other.m_stage)
+{
+	other.m_budget_p = nullptr;
+	other.m_bytes = 0;
+}
+
+Srl_memory_ticket& Srl_memory_ticket::operator=( Srl_memory_ticket &&other )
+{
+	if (this != &other)
+	{
+		release();
+		m_budget_p = other.m_budget_p;
+		m_bytes = other.m_bytes;
+		m_stage = other.m_stage;
+		other.m_budget_p = nullptr;
+		other.m_bytes = 0;
+	}
+	return *this;
+}
+
+Srl_memory_ticket::operator bool( void ) const
+{
+	return nullptr != m_budget_p;
+}
+
+uint64_t Srl_memory_ticket::bytes( void ) const
+{
+	return m_bytes;
+}
+
+Srl_budget_stage Srl_memory_ticket::stage( void ) const
+{
+	return m_stage;
+}
+
+void Srl_memory_ticket::move_to( Srl_budget_stage stage )
+{
+	if (nullptr != m_budget_p && stage != m_stage)
+	{
+		m_budget_p->move(m_bytes, m_stage, stage);
+		m_stage = stage;
+	}
+}
+
+void Srl_memory_ticket::resize( uint64_t bytes )
+{
+	if (nullptr != m_budget_p && bytes != m_bytes)
+	{
+		m_budget_p->resize(m_bytes, bytes, m_stage);
+		m_bytes = bytes;
+	}
+}
+
+void Srl_memory_ticket::release( void )
+{
+	if (nullptr != m_budget_p)
+	{
+		m_budget_p->release(m_bytes, m_stage);
+		m_budget_p = nullptr;
+		m_bytes = 0;
+	}
+}
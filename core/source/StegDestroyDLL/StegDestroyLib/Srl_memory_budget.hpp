@@ -0,0 +1,189 @@
+// $Id$
+//------------------------------------------------------------------------------------
+///
+/// @file
+///
+/// @brief Memory ceiling shared by every image in flight, with admission control
+///
+/// @section VERSION
+/// 1.0
+///
+/// @section DESCRIPTION
+/// Before an image is decoded its working set is estimated from its headers (see
+/// Srl_image_probe) and a ticket for that many bytes is taken from the budget. Work
+/// that would take the total over the ceiling waits for running images to finish,
+/// and an image that could never fit is rejected outright. As an image moves through
+/// the stages its ticket is moved with it and resized to what the image really holds,
+/// so the per stage counts show where the memory is.
+//------------------------------------------------------------------------------------
+
+#pragma once
+
+#ifndef _SRL_MEMORY_BUDGET_HPP
+#define _SRL_MEMORY_BUDGET_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+namespace srl
+{
+	///
+	/// @brief	Where the bytes of a ticket are currently held
+	///
+	enum Srl_budget_stage
+	{
+		SRL_BUDGET_QUEUED,		///< admitted, still encoded, waiting to be decoded
+		SRL_BUDGET_DECODE,
+		SRL_BUDGET_SCRUB,
+		SRL_BUDGET_ENCODE,
+		SRL_BUDGET_OUTPUT,		///< encoded, waiting for the consumer to take it
+		SRL_BUDGET_STAGE_COUNT	//must stay last
+	};
+
+	///
+	/// @brief	ceiling value meaning no limit, tickets are still counted
+	///
+	const uint64_t SRL_BUDGET_UNLIMITED = 0;
+
+	class Srl_memory_budget;
+
+	///
+	/// @brief	Bytes held against a budget, given back when the ticket is destroyed. Move only
+	///
+	class Srl_memory_ticket
+	{
+	public:
+		Srl_memory_ticket( void );
+		~Srl_memory_ticket();
+
+		Srl_memory_ticket( Srl_memory_ticket &&other );
+		Srl_memory_ticket& operator=( Srl_memory_ticket &&other );
+
+		Srl_memory_ticket( const Srl_memory_ticket& ) = delete;
+		Srl_memory_ticket& operator=( const Srl_memory_ticket& ) = delete;
+
+		///
+		/// @brief	false for a default constructed, released, or refused ticket
+		///
+		explicit operator bool( void ) const;
+
+		uint64_t bytes( void ) const;
+		Srl_budget_stage stage( void ) const;
+
+		///
+		/// @brief	moves the ticket's bytes to another stage's count
+		///
+		void move_to( Srl_budget_stage stage );
+
+		///
+		/// @brief	Replaces the estimate with what the image actually holds. Growing never blocks, the
+		///			work has already been admitted, shrinking lets waiting work in
+		///
+		void resize( uint64_t bytes );
+
+		///
+		/// @brief	gives the bytes back early
+		///
+		void release( void );
+
+	private:
+		friend class Srl_memory_budget;
+
+		Srl_memory_ticket( Srl_memory_budget *budget_p, uint64_t bytes, Srl_budget_stage stage );
+
+		Srl_memory_budget *m_budget_p;
+		uint64_t m_bytes;
+		Srl_budget_stage m_stage;
+	};
+
+	///
+	/// @brief	Thread safe byte budget, one can be shared by any number of pipelines and sessions. It must
+	///			outlive every ticket taken from it
+	///
+	class Srl_memory_budget
+	{
+	public:
+
+		///
+		/// @param[in]	ceiling_bytes	most bytes admitted at once, SRL_BUDGET_UNLIMITED to only count
+		///
+		explicit Srl_memory_budget( uint64_t ceiling_bytes );
+
+		Srl_memory_budget( const Srl_memory_budget& ) = delete;
+		Srl_memory_budget& operator=( const Srl_memory_budget& ) = delete;
+
+		///
+		/// @brief	true if bytes could ever be admitted, i.e. they don't exceed the ceiling on their own
+		///
+		bool fits( uint64_t bytes ) const;
+
+		///
+		/// @brief	Takes a ticket for bytes, waiting until they fit under the ceiling
+		///
+		/// @param[in]	cancel_p	if not nullptr the wait gives up once it is set, call wake_waiters()
+		///							after setting it
+		///
+		/// @return	Srl_memory_ticket	false if bytes can never fit, or the wait was cancelled
+		///
+		Srl_memory_ticket admit( uint64_t bytes, Srl_budget_stage stage = SRL_BUDGET_QUEUED,
+								 const std::atomic<bool> *cancel_p = nullptr );
+
+		///
+		/// @brief	as admit() but returns a false ticket rather than waiting
+		///
+		Srl_memory_ticket try_admit( uint64_t bytes, Srl_budget_stage stage = SRL_BUDGET_QUEUED );
+
+		///
+		/// @brief	wakes every admit() so they recheck their cancel flag
+		///
+		void wake_waiters( void );
+
+		uint64_t ceiling( void ) const;
+
+		///
+		/// @brief	bytes held by every live ticket
+		///
+		uint64_t in_use( void ) const;
+
+		///
+		/// @brief	bytes held by tickets currently at stage
+		///
+		uint64_t in_use( Srl_budget_stage stage ) const;
+
+		///
+		/// @brief	most bytes held at once since construction
+		///
+		uint64_t peak( void ) const;
+
+		///
+		/// @brief	admit() calls currently waiting
+		///
+		size_t waiting( void ) const;
+
+	private:
+
+		friend class Srl_memory_ticket;
+
+		bool has_room( uint64_t bytes ) const;
+		void add( uint64_t bytes, Srl_budget_stage stage );
+
+		void release( uint64_t bytes, Srl_budget_stage stage );
+		void move( uint64_t bytes, Srl_budget_stage from, Srl_budget_stage to );
+		void resize( uint64_t old_bytes, uint64_t new_bytes, Srl_budget_stage stage );
+
+		const uint64_t m_ceiling;
+
+		mutable std::mutex m_lock;
+		std::condition_variable m_room_cv;
+
+		uint64_t m_in_use;
+		uint64_t m_peak;
+		uint64_t m_stage_bytes[SRL_BUDGET_STAGE_COUNT];
+		size_t m_waiting;
+	};
+}
+
+#endif //_SRL_MEMORY_BUDGET_HPP
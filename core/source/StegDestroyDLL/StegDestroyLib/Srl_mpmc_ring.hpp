@@ -0,0 +1,165 @@
+// $Id$
+//------------------------------------------------------------------------------------
+///
+/// @file
+///
+/// @brief Fixed capacity lock free multi producer, multi consumer ring
+///
+/// @section VERSION
+/// 1.0
+///
+/// @section DESCRIPTION
+/// Each cell carries a sequence number saying whether it is free for the push at that
+/// position or holds the value for the pop at that position. Producers and consumers
+/// claim positions with a compare and swap and never wait on each other: a push to a
+/// full ring and a pop from an empty one fail straight away. Used where the caller
+/// must never block, e.g. the scrub workers handing records to the logger.
+//------------------------------------------------------------------------------------
+
+#pragma once
+
+#ifndef _SRL_MPMC_RING_HPP
+#define _SRL_MPMC_RING_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace srl
+{
+	///
+	/// @brief	Bounded lock free FIFO, T must be default constructible and move assignable
+	///
+	template <typename T>
+	class Srl_mpmc_ring
+	{
+	public:
+
+		///
+		/// @param[in]	capacity	rounded up to a power of two, at least 2
+		///
+		explicit Srl_mpmc_ring( size_t capacity )
+			:	m_capacity( round_up( capacity ) ),
+				m_mask( m_capacity - 1 ),
+				m_cells( new Srl_ring_cell[m_capacity] ),
+				m_push_pos( 0 ),
+				m_pop_pos( 0 )
+		{
+			for ( size_t i = 0; i < m_capacity; i++ )
+			{
+				m_cells[i].sequence.store( i, std::memory_order_relaxed );
+			}
+		}
+
+		Srl_mpmc_ring( const Srl_mpmc_ring& ) = delete;
+		Srl_mpmc_ring& operator=( const Srl_mpmc_ring& ) = delete;
+
+		///
+		/// @brief	Adds value unless the ring is full, never blocks
+		///
+		/// @return	bool	false if the ring was full, value is left untouched
+		///
+		template <typename U>
+		bool try_push( U &&value )
+		{
+			size_t pos = m_push_pos.load( std::memory_order_relaxed );
+			for (;;)
+			{
+				Srl_ring_cell &cell = m_cells[pos & m_mask];
+				const size_t sequence = cell.sequence.load( std::memory_order_acquire );
+				const ptrdiff_t diff = static_cast<ptrdiff_t>( sequence ) - static_cast<ptrdiff_t>( pos );
+
+				if ( 0 == diff )
+				{	//Free for this position, claim it
+					if ( m_push_pos.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) )
+					{
+						cell.value = std::forward<U>( value );
+						cell.sequence.store( pos + 1, std::memory_order_release );
+						return true;
+					}
+				}
+				else if ( diff < 0 )
+				{	//Still holds the value from a lap ago
+					return false;
+				}
+				else
+				{	//Another producer got there first
+					pos = m_push_pos.load( std::memory_order_relaxed );
+				}
+			}
+		}
+
+		///
+		/// @brief	Removes the oldest value unless the ring is empty, never blocks
+		///
+		bool try_pop( T &value )
+		{
+			size_t pos = m_pop_pos.load( std::memory_order_relaxed );
+			for (;;)
+			{
+				Srl_ring_cell &cell = m_cells[pos & m_mask];
+				const size_t sequence = cell.sequence.load( std::memory_order_acquire );
+				const ptrdiff_t diff = static_cast<ptrdiff_t>( sequence ) - static_cast<ptrdiff_t>( pos + 1 );
+
+				if ( 0 == diff )
+				{
+					if ( m_pop_pos.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) )
+					{
+						value = std::move( cell.value );
+						//Free the cell for the push one lap ahead
+						cell.sequence.store( pos + m_capacity, std::memory_order_release );
+						return true;
+					}
+				}
+				else if ( diff < 0 )
+				{
+					return false;
+				}
+				else
+				{
+					pos = m_pop_pos.load( std::memory_order_relaxed );
+				}
+			}
+		}
+
+		size_t capacity( void ) const
+		{
+			return m_capacity;
+		}
+
+	private:
+
+		struct Srl_ring_cell
+		{
+			std::atomic<size_t> sequence;
+			T value;
+		};
+
+		static size_t round_up( size_t capacity )
+		{
+			size_t rounded = 2;
+			while ( rounded < capacity )
+			{
+				rounded <<= 1;
+			}
+			return rounded;
+		}
+
+		const size_t m_capacity;
+		const size_t m_mask;
+		std::unique_ptr<Srl_ring_cell[]> m_cells;
+
+		///
+		///	@brief	Producer and consumer positions on their own cache lines so pushes and pops don't
+		///			invalidate each other
+		///
+		char m_pad0[64];
+		std::atomic<size_t> m_push_pos;
+		char m_pad1[64];
+		std::atomic<size_t> m_pop_pos;
+		char m_pad2[64];
+	};
+}
+
+#endif //_SRL_MPMC_RING_HPP
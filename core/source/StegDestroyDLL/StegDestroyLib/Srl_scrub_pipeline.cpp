@@ -0,0 +1,434 @@
+//------------------------------------------------------------------------------------
+///
+/// @file   Srl_scrub_pipeline.cpp
+///
+/// @brief Streaming ingest, decode, scrub, encode and emit pipeline
+///
+//------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+
+#include "Srl_scrub_pipeline.hpp"
+#include "Srl_img_format_registry.hpp"
+#include "Srl_batch_arena.hpp"
+#include "Srl_trace.hpp"
+
+#include <algorithm>
+#include <exception>
+
+using namespace srl;
+using namespace std;
+
+namespace
+{
+	///
+	/// @brief	raises peak to value if it is larger, safe against concurrent callers
+	///
+	void update_peak(atomic<size_t> &peak, size_t value)
+	{
+		size_t current = peak.load();
+		while (value > current && !peak.compare_exchange_weak(current, value))
+		{
+		}
+	}
+}
+
+/***************************************************
+*
+*					CTOR & DTOR
+*
+****************************************************/
+
+Srl_scrub_pipeline::Srl_scrub_pipeline( const Srl_img_format_pair &img_format,
+										bool use_original,
+										unsigned int thread_count,
+										size_t queue_depth,
+										Srl_jpgscrub_compression_level compression_lvl,
+										Srl_jpgscrub_mode scrub_mode,
+										Srl_thread_pool *tile_pool_p,
+										shared_ptr<Srl_memory_budget> budget_p )
+	:	m_format(img_format),
+		m_use_original(use_original),
+		m_compression_level(compression_lvl),
+		m_scrub_mode(scrub_mode),
+		m_tile_pool_p(tile_pool_p),
+		m_budget_p(budget_p),
+		m_aborted(false),
+		m_decode_q(queue_depth),
+		m_scrub_q(queue_depth),
+		m_encode_q(queue_depth),
+		m_result_q(queue_depth),
+		m_decode_active(0),
+		m_scrub_active(0),
+		m_encode_active(0),
+		m_next_index(0),
+		m_in_flight(0),
+		m_peak_in_flight(0)
+{
+	if (0 == thread_count)
+	{
+		thread_count = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	//Decode and encode dominate, the SIMD scrub needs far less. The stages share thread_count
+	//between them so callers can budget for exactly that many, only below 3 does the one thread
+	//each stage needs take the total over
+	const unsigned int scrub_threads = std::max(1u, thread_count / 5);
+	const unsigned int codec_threads = (thread_count > scrub_threads) ? thread_count - scrub_threads : 0;
+	const unsigned int decode_threads = std::max(1u, codec_threads / 2);
+	const unsigned int encode_threads = std::max(1u, codec_threads - codec_threads / 2);
+
+	m_decode_active = decode_threads;
+	m_scrub_active = scrub_threads;
+	m_encode_active = encode_threads;
+
+	m_threads.reserve(decode_threads + scrub_threads + encode_threads);
+	for (unsigned int i = 0; i < decode_threads; i++)
+	{
+		m_threads.emplace_back(&Srl_scrub_pipeline::stage_loop, this, std::ref(m_decode_q), std::ref(m_scrub_q),
+							   std::ref(m_decode_active), &Srl_scrub_pipeline::decode_stage, "decode");
+	}
+	for (unsigned int i = 0; i < scrub_threads; i++)
+	{
+		m_threads.emplace_back(&Srl_scrub_pipeline::stage_loop, this, std::ref(m_scrub_q), std::ref(m_encode_q),
+							   std::ref(m_scrub_active), &Srl_scrub_pipeline::scrub_stage, "scrub");
+	}
+	for (unsigned int i = 0; i < encode_threads; i++)
+	{
+		m_threads.emplace_back(&Srl_scrub_pipeline::stage_loop, this, std::ref(m_encode_q), std::ref(m_result_q),
+							   std::ref(m_encode_active), &Srl_scrub_pipeline::encode_stage, "encode");
+	}
+}
+
+Srl_scrub_pipeline::~Srl_scrub_pipeline()
+{
+	shutdown();
+}
+
+/***************************************************
+*
+*					Public
+*
+****************************************************/
+
+bool Srl_scrub_pipeline::push( Srl_pipeline_input &&input, size_t &index )
+{
+	return SRL_PUSH_TAKEN == push_item(input, index, true);
+}
+
+Srl_push_status Srl_scrub_pipeline::try_push( Srl_pipeline_input &&input, size_t &index )
+{
+	return push_item(input, index, false);
+}
+
+Srl_push_status Srl_scrub_pipeline::push_item( Srl_pipeline_input &input, size_t &index, bool wait_for_budget )
+{
+	Srl_stage_timer timer(SRL_STAGE_INGEST, input.format.first);
+
+	//Covers waiting for memory and for room in the decode queue
+	Srl_trace_span span("ingest", input.format.first);
+	item_ptr item(new Srl_pipeline_item);
+	item->status = Srl_status();
+	item->success = true;
+	item->probed = false;
+
+	if (nullptr != m_budget_p)
+	{
+		Srl_byte_view view(input.data.data(), input.data.size());
+		uint64_t estimate = input.data.size();
+		//A header that couldn't be read is still passed on zeroed, the image would only fail the same probe
+		item->probed = true;
+		if (probe_image(view, item->header))
+		{
+			timer.set_key(item->header.format, SRL_BACKEND_NONE);
+			const bool dct_mode = SRL_SCRUB_DCT == m_scrub_mode && SRL_IMG_FORMAT_JPEG_CVIM == item->header.format;
+			estimate = estimate_working_set(item->header, input.data.size(), dct_mode);
+		}
+
+		if (!m_budget_p->fits(estimate))
+		{	//Still pushed so the result keeps its place in the order, the decode stage passes it through
+			static const Srl_message_id over_budget = intern_message("the estimated working set is larger than the memory budget");
+			item->status = Srl_status(SRL_ERROR_MEMORY_BUDGET, over_budget);
+			item->success = false;
+		}
+		else if (wait_for_budget)
+		{
+			item->ticket = m_budget_p->admit(estimate, SRL_BUDGET_QUEUED, &m_aborted);
+			if (!item->ticket)
+			{	//Shut down while waiting
+				return SRL_PUSH_CLOSED;
+			}
+		}
+		else
+		{
+			item->ticket = m_budget_p->try_admit(estimate, SRL_BUDGET_QUEUED);
+			if (!item->ticket)
+			{
+				return m_aborted ? SRL_PUSH_CLOSED : SRL_PUSH_NO_ROOM;
+			}
+		}
+	}
+
+	//Numbered once admitted so a refused image leaves no gap in the order
+	item->index = m_next_index++;
+	item->input = std::move(input);
+	index = item->index;
+	span.set_image(static_cast<int64_t>(item->index));
+	update_peak(m_peak_in_flight, ++m_in_flight);
+
+	if (!m_decode_q.push(std::move(item)))
+	{
+		m_in_flight--;
+		return SRL_PUSH_CLOSED;
+	}
+	return SRL_PUSH_TAKEN;
+}
+
+void Srl_scrub_pipeline::close_input( void )
+{
+	m_decode_q.close();
+}
+
+bool Srl_scrub_pipeline::pop_result( Srl_pipeline_result &result )
+{
+	item_ptr item;
+	if (!m_result_q.pop(item))
+	{
+		return false;
+	}
+
+	if (Srl_latency_recorder::instance().enabled())
+	{
+		const Srl_img_format_enum format = (nullptr != item->image) ? item->image->m_format.first : item->input.format.first;
+		const Srl_img_backend backend = (nullptr != item->image) ? item->image->backend() : SRL_BACKEND_NONE;
+		const chrono::nanoseconds waited = chrono::duration_cast<chrono::nanoseconds>(Srl_latency_clock::now() - item->queued_at);
+		Srl_latency_recorder::instance().record(SRL_STAGE_EMIT, format, backend, static_cast<uint64_t>(waited.count()));
+	}
+
+	result.index = item->index;
+	result.image = std::move(item->image);
+	result.status = item->status;
+	if (!item->success && result.status.ok())
+	{
+		result.status = (nullptr != result.image) ? result.image->status() : Srl_status(SRL_EXCEPT_READ);
+		if (result.status.ok())
+		{	//Failed without the image recording why, e.g. a stage threw
+			result.status = Srl_status(SRL_ERROR_OTHER);
+		}
+	}
+	result.input = std::move(item->input.data);
+	result.completion = std::move(item->input.completion);
+	result.success = item->success;
+	//The ticket goes with the pixels and output so the consumer's copies stay under the ceiling
+	result.ticket = std::move(item->ticket);
+	m_in_flight--;
+	return true;
+}
+
+Srl_exception_status Srl_scrub_pipeline::run( const Srl_pipeline_source &source, const Srl_pipeline_sink &sink )
+{
+	exception_ptr ingest_error;
+	thread ingest([&]()
+	{
+		try
+		{
+			Srl_pipeline_input input;
+			size_t index = 0;
+			while (source(input) && push(std::move(input), index))
+			{
+				input = Srl_pipeline_input();
+			}
+		}
+		catch (...)
+		{
+			ingest_error = std::current_exception();
+		}
+		close_input();
+	});
+
+	Srl_exception_status status = SRL_EXCEPT_NONE;
+	try
+	{
+		Srl_pipeline_result result;
+		while (pop_result(result))
+		{
+			if (!result.success)
+			{
+				status = result.status.code;
+			}
+			{
+				Srl_trace_image_scope trace_image(static_cast<int64_t>(result.index));
+				Srl_trace_span span("sink", (nullptr != result.image) ? result.image->m_format.first : SRL_IMG_FORMAT_NONE);
+				sink(result);
+			}
+			//Released here rather than held until the batch is done
+			result.image = nullptr;
+			vector<unsigned char>().swap(result.input);
+			result.ticket.release();
+		}
+	}
+	catch (...)
+	{
+		//A throwing sink ends the run. The ingest thread may be waiting on the budget, which the
+		//results still queued would never give back, or on a full decode queue. shutdown() cancels
+		//both waits, so it has to come before the join
+		shutdown();
+		ingest.join();
+		throw;
+	}
+
+	ingest.join();
+	if (nullptr != ingest_error)
+	{
+		std::rethrow_exception(ingest_error);
+	}
+	return status;
+}
+
+size_t Srl_scrub_pipeline::peak_in_flight( void ) const
+{
+	return m_peak_in_flight.load();
+}
+
+shared_ptr<Srl_memory_budget> Srl_scrub_pipeline::memory_budget( void ) const
+{
+	return m_budget_p;
+}
+
+/***************************************************
+*
+*					Stages
+*
+****************************************************/
+
+void Srl_scrub_pipeline::stage_loop( item_queue &in_q, item_queue &out_q, atomic<unsigned int> &active,
+									 void (Srl_scrub_pipeline::*stage)(Srl_pipeline_item&), const char *name_p )
+{
+	Srl_trace_recorder::instance().name_thread(name_p);
+
+	item_ptr item;
+	while (in_q.pop(item))
+	{
+		if (item->success)
+		{
+			Srl_trace_image_scope trace_image(static_cast<int64_t>(item->index));
+			Srl_trace_span span(name_p, item->input.format.first);
+			try
+			{
+				(this->*stage)(*item);
+			}
+			catch (...)
+			{	//Pass the image on as failed rather than losing it and the stage thread with it
+				item->success = false;
+			}
+			if (nullptr != item->image)
+			{	//The sniffed format rather than the caller's label
+				span.set_format(item->image->m_format.first);
+			}
+		}
+		item->queued_at = Srl_latency_clock::now();
+		if (!out_q.push(std::move(item)))
+		{	//Aborted
+			break;
+		}
+	}
+
+	if (0 == --active)
+	{
+		out_q.close();
+	}
+}
+
+void Srl_scrub_pipeline::decode_stage( Srl_pipeline_item &item )
+{
+	item.ticket.move_to(SRL_BUDGET_DECODE);
+	Srl_byte_view view(item.input.data.data(), item.input.data.size());
+	item.image.reset(new Srl_steg_image(view, item.input.format, m_scrub_mode, item.probed ? &item.header : nullptr));
+	item.image->set_tile_pool(m_tile_pool_p);
+
+	if (!item.image->has_pixels() && !item.image->is_dct_mode())
+	{
+		item.success = false;
+		return;
+	}
+
+	if (!item.image->is_dct_mode())
+	{	//The pixels are held by the image now, the encoded input can go
+		item.image->detach_source();
+		vector<unsigned char>().swap(item.input.data);
+	}
+	//The estimate admitted also covers the scrub and encode scratch still to come
+	account(item, false);
+}
+
+void Srl_scrub_pipeline::scrub_stage( Srl_pipeline_item &item )
+{
+	Srl_arena_scope arena_scope;
+	item.ticket.move_to(SRL_BUDGET_SCRUB);
+	const Srl_img_format_pair &target = m_use_original ? item.image->m_format : m_format;
+	const Srl_img_format_traits *traits_p = find_format_traits(target.first);
+
+	//Lossy targets are scrubbed by requantization during the encode. Magick held images (GIF,
+	//PSD, ICO) are scrubbed here too, through a cv::Mat copy of their pixels, and an unknown
+	//format counts as lossless as it does in encode()
+	if ((nullptr == traits_p || !traits_p->lossy) && !item.image->is_dct_mode() && !item.image->scrub_lsb())
+	{
+		item.success = false;
+	}
+}
+
+void Srl_scrub_pipeline::encode_stage( Srl_pipeline_item &item )
+{
+	//Only the scratch of this stage, a DCT mode image decoded lazily by encode() takes its pixels
+	//from the heap through Srl_arena_bypass so they can outlive the scope
+	Srl_arena_scope arena_scope;
+	item.ticket.move_to(SRL_BUDGET_ENCODE);
+	const Srl_img_format_pair &target = m_use_original ? item.image->m_format : m_format;
+	item.success = item.image->encode(target, m_compression_level);
+
+	if (item.success)
+	{	//A DCT mode image now reads from its own output buffer
+		item.image->detach_source();
+		vector<unsigned char>().swap(item.input.data);
+	}
+	item.ticket.move_to(SRL_BUDGET_OUTPUT);
+	account(item, true);
+}
+
+void Srl_scrub_pipeline::account( Srl_pipeline_item &item, bool settled ) const
+{
+	if (item.ticket)
+	{
+		uint64_t bytes = item.input.data.capacity();
+		if (nullptr != item.image)
+		{
+			bytes += item.image->memory_footprint();
+		}
+		if (settled || bytes > item.ticket.bytes())
+		{
+			item.ticket.resize(bytes);
+		}
+	}
+}
+
+void Srl_scrub_pipeline::shutdown( void )
+{
+	m_aborted = true;
+	if (nullptr != m_budget_p)
+	{
+		m_budget_p->wake_waiters();
+	}
+	m_decode_q.abort();
+	m_scrub_q.abort();
+	m_encode_q.abort();
+	m_result_q.abort();
+
+	for (size_t i = 0; i < m_threads.size(); i++)
+	{
+		if (m_threads[i].joinable())
+		{
+			m_threads[i].join();
+		}
+	}
+	m_threads.clear();
+}
@@ -0,0 +1,361 @@
+// $Id$
+//------------------------------------------------------------------------------------
+///
+/// @file
+///
+/// @brief Streaming ingest, decode, scrub, encode and emit pipeline
+///
+/// @section VERSION
+/// 1.0
+///
+/// @section DESCRIPTION
+/// Images enter as encoded bytes and leave as encoded bytes. Each stage runs on its own
+/// threads and hands images on through a bounded queue, so a slow stage holds back the
+/// ones before it rather than letting decoded images pile up. The number of images
+/// resident at once is bounded by the queue depths and thread counts, not the batch
+/// size, and each image is released as soon as the consumer has taken its output.
+///
+/// Given a Srl_memory_budget the pipeline also bounds the bytes resident: each image's
+/// working set is estimated from its headers as it is pushed, and the push waits until
+/// that fits under the ceiling. The bytes stay held until the image's result is
+/// destroyed, so the ceiling covers images the consumer has taken but not yet dropped.
+//------------------------------------------------------------------------------------
+
+#pragma once
+
+#ifndef _SRL_SCRUB_PIPELINE_HPP
+#define _SRL_SCRUB_PIPELINE_HPP
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "Srl_bounded_queue.hpp"
+#include "Srl_image_probe.hpp"
+#include "Srl_latency_histogram.hpp"
+#include "Srl_memory_budget.hpp"
+#include "Srl_steg_data_types.hpp"
+#include "Srl_stegimg.hpp"
+#include "Srl_status.hpp"
+#include "Srl_thread_pool.hpp"
+
+namespace srl
+{
+	///
+	/// @brief	queue depth between each pair of stages when the caller doesn't choose
+	///
+	const size_t SRL_PIPELINE_DEFAULT_DEPTH = 4;
+
+	///
+	/// @brief	Outcome of a push that must not wait for memory
+	///
+	enum Srl_push_status
+	{
+		SRL_PUSH_TAKEN,			///< the image is in the pipeline
+		SRL_PUSH_NO_ROOM,		///< refused for now, the budget has no room until results are dropped
+		SRL_PUSH_CLOSED			///< refused for good, the input has been closed
+	};
+
+	struct Srl_pipeline_result;
+
+	///
+	/// @brief	Called with an image's result as it leaves the pipeline
+	///
+	typedef std::function<void(Srl_pipeline_result &result)> Srl_pipeline_completion;
+
+	///
+	/// @brief	One encoded image handed to the pipeline, the pipeline owns the bytes from then on
+	///
+	struct Srl_pipeline_input
+	{
+		std::vector<unsigned char> data;
+
+		///
+		/// @brief	caller's label for the data, INVALID_IMG_FORMAT_PAIR to rely on sniffing alone
+		///
+		Srl_img_format_pair format;
+
+		///
+		/// @brief	optional per image completion, carried through untouched and handed back in the result
+		///
+		Srl_pipeline_completion completion;
+	};
+
+	///
+	/// @brief	One finished image as it leaves the pipeline. Move only, the image is owned by whoever
+	///			holds the result
+	///
+	struct Srl_pipeline_result
+	{
+		///
+		/// @brief	order the image was pushed in, starting at 0
+		///
+		size_t index;
+
+		///
+		/// @brief	the image, its output is image->encoded_data() when success is true
+		///
+		std::unique_ptr<Srl_steg_image> image;
+
+		///
+		/// @brief	why the image failed, ok() when success is true. describe_status() gives the text
+		///
+		Srl_status status;
+
+		///
+		/// @brief	the input bytes, only kept for a DCT mode image which failed while still reading them
+		///
+		std::vector<unsigned char> input;
+
+		///
+		/// @brief	the completion the image was pushed with, empty if it had none
+		///
+		Srl_pipeline_completion completion;
+
+		///
+		/// @brief	what the image and input hold against the pipeline's budget, given back when the result
+		///			is destroyed. Release it early once the image has been dropped
+		///
+		Srl_memory_ticket ticket;
+
+		bool success;
+	};
+
+	///
+	/// @brief	Fills input with the next image, returns false once there are no more
+	///
+	typedef std::function<bool(Srl_pipeline_input &input)> Srl_pipeline_source;
+
+	///
+	/// @brief	Receives each finished image, the image is released once it returns
+	///
+	typedef Srl_pipeline_completion Srl_pipeline_sink;
+
+	///
+	/// @brief	Stage threads and the queues between them, started on construction
+	///
+	class Srl_scrub_pipeline
+	{
+		/*************************************************************************
+		*
+		*					Constructors + Destructors
+		*
+		*************************************************************************/
+	public:
+
+		///
+		/// @param[in]	img_format		format every image is encoded to, ignored if use_original is true
+		///
+		/// @param[in]	use_original	encode each image back to its own format
+		///
+		/// @param[in]	thread_count	threads shared out between the decode, scrub and encode stages, 0
+		///								uses one per hardware thread. The stages start exactly this many,
+		///								or 3 if it is less as every stage needs one
+		///
+		/// @param[in]	queue_depth		capacity of each inter stage queue
+		///
+		/// @param[in]	tile_pool_p		pool the pixel stages of large images are split across, not owned,
+		///								nullptr to keep each image on its stage thread
+		///
+		/// @param[in]	budget_p		memory budget images are admitted against, may be shared with other
+		///								pipelines, nullptr for no limit
+		///
+		Srl_scrub_pipeline( const Srl_img_format_pair &img_format,
+							bool use_original,
+							unsigned int thread_count = 0,
+							size_t queue_depth = SRL_PIPELINE_DEFAULT_DEPTH,
+							Srl_jpgscrub_compression_level compression_lvl = SRL_COMPRESSION_DEFAULT,
+							Srl_jpgscrub_mode scrub_mode = SRL_SCRUB_PIXEL,
+							Srl_thread_pool *tile_pool_p = nullptr,
+							std::shared_ptr<Srl_memory_budget> budget_p = nullptr );
+
+		///
+		/// @brief	Abandons anything still in flight and joins the stage threads
+		///
+		~Srl_scrub_pipeline();
+
+		Srl_scrub_pipeline( const Srl_scrub_pipeline& ) = delete;
+		Srl_scrub_pipeline& operator=( const Srl_scrub_pipeline& ) = delete;
+
+		/*************************************************************************
+		*
+		*					            Methods
+		*
+		*************************************************************************/
+	public:
+
+		///
+		/// @brief	Feeds one image in, blocking while the decode queue is full or, with a budget, until
+		///			the image's estimated working set fits under the ceiling. An image that could never
+		///			fit is passed through as failed with SRL_ERROR_MEMORY_BUDGET rather than decoded
+		///
+		/// @description	The budget is only given back as results are destroyed, so with a budget the
+		///					results must be taken and dropped on another thread than the one pushing, or the images
+		///					pushed with try_push()
+		///
+		/// @param[out]	index	index the image's result will carry
+		///
+		/// @return	bool	false if the input has been closed
+		///
+		bool push( Srl_pipeline_input &&input, size_t &index );
+
+		///
+		/// @brief	As push() but an image the budget has no room for right now is refused rather than
+		///			waited on, for a caller that holds results itself and so would wait on its own bytes.
+		///			It may still wait for the decode queue, which drains without the caller's help
+		///
+		/// @param[in]	input	left untouched when SRL_PUSH_NO_ROOM is returned
+		/// @param[out]	index	index the image's result will carry
+		///
+		Srl_push_status try_push( Srl_pipeline_input &&input, size_t &index );
+
+		///
+		/// @brief	Signals that no more images will be pushed
+		///
+		void close_input( void );
+
+		///
+		/// @brief	Takes the next finished image in completion order, blocking until one is ready
+		///
+		/// @return	bool	false once the input is closed and every image has been taken
+		///
+		bool pop_result( Srl_pipeline_result &result );
+
+		///
+		/// @brief	Pulls every image from source and hands each result to sink on the calling thread.
+		///			The source is read on a separate ingest thread so decoding starts straight away
+		///
+		/// @return	Srl_exception_status	status of the last image to fail, SRL_EXCEPT_NONE if none did
+		///
+		Srl_exception_status run( const Srl_pipeline_source &source, const Srl_pipeline_sink &sink );
+
+		/*************************************************************************
+		*
+		*					        Accessors
+		*
+		*************************************************************************/
+	public:
+
+		///
+		/// @brief	most images that have been pushed but not yet popped at any one time
+		///
+		size_t peak_in_flight( void ) const;
+
+		///
+		/// @brief	the budget images are admitted against, nullptr if there is none
+		///
+		std::shared_ptr<Srl_memory_budget> memory_budget( void ) const;
+
+	private:
+
+		///
+		/// @brief	An image moving between the stages
+		///
+		struct Srl_pipeline_item
+		{
+			size_t index;
+			Srl_pipeline_input input;
+			std::unique_ptr<Srl_steg_image> image;
+
+			///
+			/// @brief	bytes held against the budget, moved from stage to stage with the image
+			///
+			Srl_memory_ticket ticket;
+
+			///
+			/// @brief	header push() probed for the estimate, handed to the image so it isn't probed twice.
+			///			Only set when probed is true
+			///
+			Srl_image_header header;
+			bool probed;
+
+			Srl_status status;
+			bool success;
+
+			///
+			/// @brief	when the item was handed to its current queue, the result queue's wait is
+			///			recorded as SRL_STAGE_EMIT
+			///
+			Srl_latency_clock::time_point queued_at;
+		};
+
+		typedef std::unique_ptr<Srl_pipeline_item> item_ptr;
+		typedef Srl_bounded_queue<item_ptr> item_queue;
+
+		///
+		/// @brief	Body of push() and try_push(), input is only moved from once the image is admitted
+		///
+		Srl_push_status push_item( Srl_pipeline_input &input, size_t &index, bool wait_for_budget );
+
+		///
+		/// @brief	Stage bodies, a stage clears item.success on failure and the later stages pass the
+		///			item straight through
+		///
+		void decode_stage( Srl_pipeline_item &item );
+		void scrub_stage( Srl_pipeline_item &item );
+		void encode_stage( Srl_pipeline_item &item );
+
+		///
+		/// @brief	Replaces the item's ticket with what it actually holds now
+		///
+		/// @param[in]	settled		the image is done with its scrub and encode scratch, the ticket may
+		///							shrink below the estimate it was admitted with
+		///
+		void account( Srl_pipeline_item &item, bool settled ) const;
+
+		///
+		/// @brief	Worker loop shared by every stage, the last worker of a stage to finish closes the
+		///			queue to the next stage
+		///
+		/// @param[in]	name_p	stage name the thread and its spans are given in a trace
+		///
+		void stage_loop( item_queue &in_q, item_queue &out_q, std::atomic<unsigned int> &active,
+						 void (Srl_scrub_pipeline::*stage)(Srl_pipeline_item&), const char *name_p );
+
+		///
+		/// @brief	Aborts every queue and joins the stage threads
+		///
+		void shutdown( void );
+
+		/*************************************************************************
+		*
+		*					            Members
+		*
+		*************************************************************************/
+	private:
+
+		const Srl_img_format_pair m_format;
+		const bool m_use_original;
+		const Srl_jpgscrub_compression_level m_compression_level;
+		const Srl_jpgscrub_mode m_scrub_mode;
+		Srl_thread_pool *const m_tile_pool_p;
+		const std::shared_ptr<Srl_memory_budget> m_budget_p;
+
+		///
+		///	@brief	m_aborted	set by shutdown() to cancel a push waiting on the budget
+		///
+		std::atomic<bool> m_aborted;
+
+		item_queue m_decode_q;
+		item_queue m_scrub_q;
+		item_queue m_encode_q;
+		item_queue m_result_q;
+
+		///
+		///	@brief	workers of each stage still running
+		///
+		std::atomic<unsigned int> m_decode_active;
+		std::atomic<unsigned int> m_scrub_active;
+		std::atomic<unsigned int> m_encode_active;
+
+		std::vector<std::thread> m_threads;
+
+		std::atomic<size_t> m_next_index;
+		std::atomic<size_t> m_in_flight;
+		std::atomic<size_t> m_peak_in_flight;
+	};
+}
+
+#endif //_SRL_SCRUB_PIPELINE_HPP
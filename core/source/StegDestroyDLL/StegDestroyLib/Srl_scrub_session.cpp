@@ -0,0 +1,230 @@
+//------------------------------------------------------------------------------------
+///
+/// @file   Srl_scrub_session.cpp
+///
+/// @brief Push style session over the scrub pipeline
+///
+//------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+
+#include "Srl_scrub_session.hpp"
+
+#include <algorithm>
+#include <memory>
+
+using namespace srl;
+using namespace std;
+
+/***************************************************
+*
+*					CTOR & DTOR
+*
+****************************************************/
+
+Srl_scrub_session::Srl_scrub_session( const Srl_img_format_pair &img_format,
+									  bool use_original,
+									  unsigned int thread_count,
+									  size_t queue_depth,
+									  Srl_jpgscrub_compression_level compression_lvl,
+									  Srl_jpgscrub_mode scrub_mode,
+									  Srl_thread_pool *tile_pool_p,
+									  shared_ptr<Srl_memory_budget> budget_p )
+	:	m_pipeline(img_format, use_original, thread_count, queue_depth, compression_lvl, scrub_mode, tile_pool_p, budget_p),
+		m_finished(false),
+		m_completed_capacity(std::max<size_t>(1, queue_depth)),
+		m_undrained(0),
+		m_pending(0)
+{
+	m_emit_thread = thread(&Srl_scrub_session::emit_loop, this);
+}
+
+Srl_scrub_session::~Srl_scrub_session()
+{
+	try
+	{
+		finish();
+	}
+	catch (...)
+	{	//Nothing sensible to do with a completion's exception during destruction
+	}
+}
+
+/***************************************************
+*
+*					Submission
+*
+****************************************************/
+
+future<Srl_pipeline_result> Srl_scrub_session::submit( vector<unsigned char> &&data, Srl_img_format_pair format )
+{
+	//shared_ptr as std::function needs a copyable target and promise is move only
+	shared_ptr< promise<Srl_pipeline_result> > promise_p = make_shared< promise<Srl_pipeline_result> >();
+	future<Srl_pipeline_result> result = promise_p->get_future();
+
+	Srl_pipeline_input input;
+	input.data = std::move(data);
+	input.format = format;
+	input.completion = [promise_p](Srl_pipeline_result &finished)
+	{
+		promise_p->set_value(std::move(finished));
+	};
+
+	if (SRL_PUSH_TAKEN != push(std::move(input), true))
+	{
+		return future<Srl_pipeline_result>();
+	}
+	return result;
+}
+
+bool Srl_scrub_session::submit( vector<unsigned char> &&data, Srl_img_format_pair format,
+								const Srl_pipeline_completion &completion )
+{
+	Srl_pipeline_input input;
+	input.data = std::move(data);
+	input.format = format;
+	input.completion = completion;
+	return SRL_PUSH_TAKEN == push(std::move(input), true);
+}
+
+Srl_push_status Srl_scrub_session::submit_for_drain( vector<unsigned char> &&data,
+													 vector<Srl_pipeline_result> &completed,
+													 Srl_img_format_pair format )
+{
+	drain(completed);
+	{
+		//Counted before pushing so a racing submit_for_drain() can't take the last place too
+		lock_guard<mutex> lock(m_completed_lock);
+		if (m_undrained >= m_completed_capacity)
+		{
+			return SRL_PUSH_NO_ROOM;
+		}
+		m_undrained++;
+	}
+
+	Srl_pipeline_input input;
+	input.data = std::move(data);
+	input.format = format;
+	//The caller is the one thread that frees drain() results, so waiting for the budget could wait forever
+	const Srl_push_status pushed = push(std::move(input), false);
+	if (SRL_PUSH_TAKEN != pushed)
+	{
+		lock_guard<mutex> lock(m_completed_lock);
+		m_undrained--;
+		data = std::move(input.data);
+	}
+	return pushed;
+}
+
+Srl_push_status Srl_scrub_session::push( Srl_pipeline_input &&input, bool wait_for_budget )
+{
+	if (m_finished)
+	{
+		return SRL_PUSH_CLOSED;
+	}
+
+	m_pending++;
+	size_t index = 0;
+	Srl_push_status pushed = SRL_PUSH_CLOSED;
+	if (!wait_for_budget)
+	{
+		pushed = m_pipeline.try_push(std::move(input), index);
+	}
+	else if (m_pipeline.push(std::move(input), index))
+	{
+		pushed = SRL_PUSH_TAKEN;
+	}
+	if (SRL_PUSH_TAKEN != pushed)
+	{
+		m_pending--;
+	}
+	return pushed;
+}
+
+/***************************************************
+*
+*					Delivery
+*
+****************************************************/
+
+size_t Srl_scrub_session::drain( vector<Srl_pipeline_result> &results, size_t max_results )
+{
+	lock_guard<mutex> lock(m_completed_lock);
+	size_t count = std::min(max_results, m_completed.size());
+	for (size_t i = 0; i < count; i++)
+	{
+		results.push_back(std::move(m_completed.front()));
+		m_completed.pop_front();
+	}
+	m_undrained -= count;
+	if (0 < count)
+	{
+		m_completed_room.notify_one();
+	}
+	return count;
+}
+
+void Srl_scrub_session::finish( void )
+{
+	lock_guard<mutex> lock(m_finish_lock);
+	if (!m_finished)
+	{
+		m_finished = true;
+		m_pipeline.close_input();
+	}
+
+	if (m_emit_thread.joinable())
+	{
+		m_emit_thread.join();
+	}
+	m_budget_lease.release();
+
+	if (nullptr != m_completion_error)
+	{
+		exception_ptr error = m_completion_error;
+		m_completion_error = nullptr;
+		std::rethrow_exception(error);
+	}
+}
+
+void Srl_scrub_session::hold_thread_budget( Srl_budget_lease &&lease )
+{
+	lock_guard<mutex> lock(m_finish_lock);
+	m_budget_lease = std::move(lease);
+}
+
+size_t Srl_scrub_session::pending( void ) const
+{
+	return m_pending.load();
+}
+
+void Srl_scrub_session::emit_loop( void )
+{
+	Srl_pipeline_result result;
+	while (m_pipeline.pop_result(result))
+	{
+		if (result.completion)
+		{
+			try
+			{
+				result.completion(result);
+			}
+			catch (...)
+			{	//Keep delivering, the first failure is reported by finish()
+				if (nullptr == m_completion_error)
+				{
+					m_completion_error = std::current_exception();
+				}
+			}
+			result = Srl_pipeline_result();
+		}
+		else
+		{	//submit_for_drain() keeps m_undrained within the capacity so this never waits for it, the bound
+			//is kept here as well so undrained results can never pile up without limit
+			unique_lock<mutex> lock(m_completed_lock);
+			m_completed_room.wait(lock, [this] { return m_completed.size() < m_completed_capacity; });
+			m_completed.push_back(std::move(result));
+		}
+		m_pending--;
+	}
+}
@@ -0,0 +1,206 @@
+// $Id$
+//------------------------------------------------------------------------------------
+///
+/// @file
+///
+/// @brief Push style session over the scrub pipeline
+///
+/// @section VERSION
+/// 1.0
+///
+/// @section DESCRIPTION
+/// Images are submitted one at a time as they arrive, e.g. attachment by attachment
+/// off the network, and scrubbing starts straight away rather than waiting for a whole
+/// batch. Each submission picks how its result comes back: a future, a callback, or
+/// the session's completed list which the caller drains whenever it likes.
+//------------------------------------------------------------------------------------
+
+#pragma once
+
+#ifndef _SRL_SCRUB_SESSION_HPP
+#define _SRL_SCRUB_SESSION_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Srl_scrub_pipeline.hpp"
+#include "Srl_thread_budget.hpp"
+
+namespace srl
+{
+	///
+	/// @brief	Accepts images for scrubbing until finish() is called
+	///
+	class Srl_scrub_session
+	{
+		/*************************************************************************
+		*
+		*					Constructors + Destructors
+		*
+		*************************************************************************/
+	public:
+
+		///
+		/// @brief	Starts the pipeline, parameters are as for Srl_scrub_pipeline
+		///
+		Srl_scrub_session( const Srl_img_format_pair &img_format,
+						   bool use_original,
+						   unsigned int thread_count = 0,
+						   size_t queue_depth = SRL_PIPELINE_DEFAULT_DEPTH,
+						   Srl_jpgscrub_compression_level compression_lvl = SRL_COMPRESSION_DEFAULT,
+						   Srl_jpgscrub_mode scrub_mode = SRL_SCRUB_PIXEL,
+						   Srl_thread_pool *tile_pool_p = nullptr,
+						   std::shared_ptr<Srl_memory_budget> budget_p = nullptr );
+
+		///
+		/// @brief	Calls finish(), any exception it would raise is dropped
+		///
+		~Srl_scrub_session();
+
+		Srl_scrub_session( const Srl_scrub_session& ) = delete;
+		Srl_scrub_session& operator=( const Srl_scrub_session& ) = delete;
+
+		/*************************************************************************
+		*
+		*					            Methods
+		*
+		*************************************************************************/
+	public:
+
+		///
+		/// @brief	Submits an image, its result is delivered through the returned future
+		///
+		/// @description	Blocks while the pipeline's input queue is full or the memory budget has no
+		///					room for the image. A result holds its bytes against the budget until it is
+		///					destroyed, including results waiting in drain(). The future is left without
+		///					a value (broken_promise) if the session is torn down before the image finishes
+		///
+		/// @return	std::future<Srl_pipeline_result>	invalid if the session has already been finished
+		///
+		std::future<Srl_pipeline_result> submit( std::vector<unsigned char> &&data,
+												 Srl_img_format_pair format = INVALID_IMG_FORMAT_PAIR );
+
+		///
+		/// @brief	Submits an image, completion is called with its result on the session's emit thread.
+		///			Completions must be quick, a slow one holds up every result behind it
+		///
+		/// @return	bool	false if the session has already been finished
+		///
+		bool submit( std::vector<unsigned char> &&data, Srl_img_format_pair format,
+					 const Srl_pipeline_completion &completion );
+
+		///
+		/// @brief	Submits an image whose result is kept for drain(), for a caller that submits and drains
+		///			on the same thread. Never waits on results only the caller can free, an image is
+		///			refused instead and can be submitted again once results have been dropped
+		///
+		/// @description	Results already finished are moved into completed first, whether or not the image
+		///					is taken. Refused with SRL_PUSH_NO_ROOM while as many drain() results as the
+		///					queue depth are outstanding, or while the memory budget has no room for the image
+		///
+		/// @param[in]	data	handed back untouched when SRL_PUSH_NO_ROOM is returned
+		///
+		Srl_push_status submit_for_drain( std::vector<unsigned char> &&data,
+										  std::vector<Srl_pipeline_result> &completed,
+										  Srl_img_format_pair format = INVALID_IMG_FORMAT_PAIR );
+
+		///
+		/// @brief	Moves up to max_results finished drain() results into results without blocking
+		///
+		/// @return	size_t	number of results moved
+		///
+		size_t drain( std::vector<Srl_pipeline_result> &results, size_t max_results = SIZE_MAX );
+
+		///
+		/// @brief	Stops accepting images and waits until every submitted image has been delivered.
+		///			Rethrows the first exception thrown by a completion
+		///
+		void finish( void );
+
+		///
+		/// @brief	Keeps lease in force until the session finishes
+		///
+		void hold_thread_budget( Srl_budget_lease &&lease );
+
+		/*************************************************************************
+		*
+		*					        Accessors
+		*
+		*************************************************************************/
+	public:
+
+		///
+		/// @brief	images submitted but not yet delivered
+		///
+		size_t pending( void ) const;
+
+	private:
+
+		Srl_push_status push( Srl_pipeline_input &&input, bool wait_for_budget );
+
+		///
+		/// @brief	Emit thread body, delivers each result through its completion or to m_completed,
+		///			waiting while m_completed is full
+		///
+		void emit_loop( void );
+
+		/*************************************************************************
+		*
+		*					            Members
+		*
+		*************************************************************************/
+	private:
+
+		Srl_scrub_pipeline m_pipeline;
+
+		///
+		///	@brief	m_finished	set by finish(), later submissions are refused. A submission racing with
+		///						finish() is refused by the closed pipeline instead
+		///
+		std::atomic<bool> m_finished;
+
+		///
+		///	@brief	m_finish_lock	lets finish() be called from more than one thread, and the destructor
+		///
+		std::mutex m_finish_lock;
+
+		///
+		///	@brief	m_completed		results of submit_for_drain() images, guarded by m_completed_lock and
+		///							never longer than m_completed_capacity, the queue depth
+		///
+		std::deque<Srl_pipeline_result> m_completed;
+		const size_t m_completed_capacity;
+		mutable std::mutex m_completed_lock;
+		std::condition_variable m_completed_room;
+
+		///
+		///	@brief	m_undrained		submit_for_drain() images taken but not yet drained, guarded by
+		///							m_completed_lock
+		///
+		size_t m_undrained;
+
+		std::atomic<size_t> m_pending;
+
+		///
+		///	@brief	m_completion_error	first exception thrown by a completion, rethrown by finish()
+		///
+		std::exception_ptr m_completion_error;
+
+		std::thread m_emit_thread;
+
+		///
+		///	@brief	m_budget_lease	thread budget held for the session, released by finish()
+		///
+		Srl_budget_lease m_budget_lease;
+	};
+}
+
+#endif //_SRL_SCRUB_SESSION_HPP
@@ -0,0 +1,149 @@
+//------------------------------------------------------------------------------------
+///
+/// @file   Srl_status.cpp
+///
+/// @brief Compact error status with interned messages
+///
+//------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+
+#include "Srl_status.hpp"
+
+#include <deque>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+
+using namespace srl;
+using namespace std;
+
+namespace
+{
+	///
+	/// @brief	Interned messages. The deque never moves its strings so message_text() can hand out
+	///			pointers without holding the lock
+	///
+	class Srl_message_table
+	{
+	public:
+		static Srl_message_table& instance( void )
+		{
+			static Srl_message_table table;
+			return table;
+		}
+
+		Srl_message_id intern( const string &text )
+		{
+			if (text.empty())
+			{
+				return SRL_NO_MESSAGE;
+			}
+
+			lock_guard<mutex> lock(m_lock);
+			unordered_map<string, Srl_message_id>::const_iterator found = m_ids.find(text);
+			if (m_ids.end() != found)
+			{
+				return found->second;
+			}
+			if (m_texts.size() >= SRL_MAX_INTERNED_MESSAGES)
+			{
+				return SRL_MESSAGE_TABLE_FULL;
+			}
+
+			const Srl_message_id id = static_cast<Srl_message_id>(m_texts.size());
+			m_texts.push_back(text);
+			m_ids.emplace(text, id);
+			return id;
+		}
+
+		const char* text( Srl_message_id id )
+		{
+			lock_guard<mutex> lock(m_lock);
+			return (id < m_texts.size()) ? m_texts[id].c_str() : "";
+		}
+
+	private:
+		Srl_message_table( void )
+		{
+			m_texts.push_back(string());
+			m_texts.push_back("message table full, further messages were not kept");
+		}
+
+		mutex m_lock;
+		deque<string> m_texts;
+		unordered_map<string, Srl_message_id> m_ids;
+	};
+}
+
+namespace srl
+{
+	Srl_message_id intern_message( const string &text )
+	{
+		return Srl_message_table::instance().intern(text);
+	}
+
+	Srl_message_id intern_message( const char *text_p )
+	{
+		return (nullptr == text_p) ? SRL_NO_MESSAGE : intern_message(string(text_p));
+	}
+
+	const char* message_text( Srl_message_id id )
+	{
+		return Srl_message_table::instance().text(id);
+	}
+
+	string status_text( const Srl_status &status )
+	{
+		string text = message_text(status.message);
+		if (nullptr != status.detail)
+		{
+			if (!text.empty())
+			{
+				text += ": ";
+			}
+			text += *status.detail;
+		}
+		return text;
+	}
+
+	const char* status_name( Srl_exception_status code )
+	{
+		switch (code)
+		{
+		case SRL_EXCEPT_NONE:				return "SRL_EXCEPT_NONE";
+		case SRL_WARNING_CHTYPE:			return "SRL_WARNING_CHTYPE";
+		case SRL_WARNING_FORMAT_INVALID:	return "SRL_WARNING_FORMAT_INVALID";
+		case SRL_EXCEPT_OPENCV:				return "SRL_EXCEPT_OPENCV";
+		case SRL_EXCEPT_IMAGEMAGICK:		return "SRL_EXCEPT_IMAGEMAGICK";
+		case SRL_ERROR_IMAGEMAGICK:			return "SRL_ERROR_IMAGEMAGICK";
+		case SRL_EXCEPT_OTHER:				return "SRL_EXCEPT_OTHER";
+		case SRL_ERROR_OTHER:				return "SRL_ERROR_OTHER";
+		case SRL_EXCEPT_READ:				return "SRL_EXCEPT_READ";
+		case SRL_ERROR_MEMORY_BUDGET:		return "SRL_ERROR_MEMORY_BUDGET";
+		case SRL_ERROR_LIMIT_EXCEEDED:		return "SRL_ERROR_LIMIT_EXCEEDED";
+		}
+		return "unknown status";
+	}
+
+	string describe_status( const Srl_status &status )
+	{
+		ostringstream out;
+		out << status_name(status.code);
+		if (SRL_SOURCE_OPENCV == status.source)
+		{
+			out << " (OpenCV " << status.backend_code << ")";
+		}
+		else if (SRL_SOURCE_MAGICK == status.source)
+		{
+			out << " (ImageMagick " << status.backend_code << ")";
+		}
+
+		const string text = status_text(status);
+		if (!text.empty())
+		{
+			out << ": " << text;
+		}
+		return out.str();
+	}
+}
@@ -0,0 +1,137 @@
+// $Id$
+//------------------------------------------------------------------------------------
+///
+/// @file
+///
+/// @brief Compact error status with interned messages, the diagnostic is only built
+///        when something asks for it
+///
+/// @section VERSION
+/// 1.0
+///
+/// @section DESCRIPTION
+/// A failed decode used to heap allocate an Srl_exception holding a deep copy of the
+/// cv::Exception or Magick::Exception, then share it and format strings from it. On
+/// spam where a large share of the "images" are garbage that was most of the work.
+/// Failures are now an Srl_status: the status code, the backend's own code and the id
+/// of the backend message in a process wide table. Only fixed text is interned, so the
+/// table stays small and a repeat failure costs a hash lookup. Text formatted per input
+/// (a libjpeg or ImageMagick message quoting offsets and byte values) would fill the
+/// table with one entry per image, it is carried by the status that reported it as its
+/// detail instead. The readable diagnostic, and an Srl_exception for callers that still
+/// want one, are built from the status on request.
+//------------------------------------------------------------------------------------
+
+#pragma once
+
+#ifndef _SRL_STATUS_HPP
+#define _SRL_STATUS_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "Srl_steg_data_types.hpp"
+
+namespace srl
+{
+	///
+	/// @brief	Id of a message in the interned message table
+	///
+	typedef uint32_t Srl_message_id;
+
+	///
+	/// @brief	id for no message, message_text() gives an empty string
+	///
+	const Srl_message_id SRL_NO_MESSAGE = 0;
+
+	///
+	/// @brief	id given out once the table is full, so hostile input can't grow it without bound
+	///
+	const Srl_message_id SRL_MESSAGE_TABLE_FULL = 1;
+
+	///
+	/// @brief	most distinct messages kept
+	///
+	const size_t SRL_MAX_INTERNED_MESSAGES = 4096;
+
+	///
+	/// @brief	which library a status came from
+	///
+	enum Srl_status_source
+	{
+		SRL_SOURCE_LIBRARY,
+		SRL_SOURCE_OPENCV,
+		SRL_SOURCE_MAGICK
+	};
+
+	///
+	/// @brief	Result of a decode or encode. Cheap to copy, the detail text is shared
+	///
+	struct Srl_status
+	{
+		Srl_status( void )
+			:	code(SRL_EXCEPT_NONE), source(SRL_SOURCE_LIBRARY), backend_code(0), message(SRL_NO_MESSAGE) {}
+
+		explicit Srl_status( Srl_exception_status status_code,
+							 Srl_message_id message_id = SRL_NO_MESSAGE,
+							 Srl_status_source status_source = SRL_SOURCE_LIBRARY,
+							 int32_t library_code = 0 )
+			:	code(status_code), source(status_source), backend_code(library_code), message(message_id) {}
+
+		bool ok( void ) const { return SRL_EXCEPT_NONE == code; }
+
+		///
+		/// @brief	Attaches text which varies from input to input, see detail
+		///
+		Srl_status& with_detail( const std::string &text )
+		{
+			detail = text.empty() ? nullptr : std::make_shared<const std::string>(text);
+			return *this;
+		}
+
+		Srl_exception_status code;
+		Srl_status_source source;
+
+		///
+		/// @brief	cv::Error::Code or MagickCore::ExceptionType, 0 from the library itself
+		///
+		int32_t backend_code;
+
+		Srl_message_id message;
+
+		///
+		/// @brief	backend text formatted for this input alone, never interned. nullptr if there is none
+		///
+		std::shared_ptr<const std::string> detail;
+	};
+
+	///
+	/// @brief	Id of text in the message table, adding it if it isn't there yet. Thread safe. Only for
+	///			fixed text, anything formatted from the input goes in Srl_status::detail
+	///
+	Srl_message_id intern_message( const std::string &text );
+	Srl_message_id intern_message( const char *text_p );
+
+	///
+	/// @brief	Text of an interned message. The pointer stays valid for the life of the process
+	///
+	const char* message_text( Srl_message_id id );
+
+	///
+	/// @brief	the status's message followed by its detail, empty if it has neither
+	///
+	std::string status_text( const Srl_status &status );
+
+	///
+	/// @brief	short name of a status code, e.g. "SRL_EXCEPT_READ"
+	///
+	const char* status_name( Srl_exception_status code );
+
+	///
+	/// @brief	Builds the full readable diagnostic, e.g. "SRL_EXCEPT_OPENCV (OpenCV -215): <message>"
+	///
+	std::string describe_status( const Srl_status &status );
+}
+
+#endif //_SRL_STATUS_HPP
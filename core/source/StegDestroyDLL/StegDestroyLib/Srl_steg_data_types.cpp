@@ -17,8 +17,11 @@
 
 #include "stdafx.h"
 #include "Srl_steg_data_types.hpp"
+#include "Srl_magick_coder_cache.hpp"
+#include "Srl_img_format_registry.hpp"
+#include "Srl_batch_arena.hpp"
+#include "Srl_decode_limits.hpp"
 
-#include <algorithm>
 
 using namespace cv;
 using namespace std;
@@ -42,10 +45,10 @@ namespace srl
 	///
 	Srl_img_format_pair get_format_pair(string format)
 	{
-		Srl_img_format_map::const_iterator iter = img_format_mappings.find(format);
-		if (!(img_format_mappings.end() == iter) )
+		const Srl_img_format_traits *traits_p = find_format_traits(format);
+		if (nullptr != traits_p)
 		{	
-			return iter->second;
+			return Srl_img_format_pair(traits_p->format, traits_p->name);
 		}
 		else
 		{
@@ -63,80 +66,39 @@ namespace srl
 	/// @return	bool	Returns true if format supported by one of them & no otherwise
     bool is_format_supported( string format )
     {
-		bool success = false;
-        if ( !format.empty() )
+        if ( format.empty() )
         {
-            string lowercase_format = format;
-            std::transform( lowercase_format.begin() , lowercase_format.end() , lowercase_format.begin() , ::tolower );
-
-            if ( is_format_CV_supported( format ) || is_format_magick_supported( format ) )
-            {   //if supported by CV drop out earlier to avoid unnecessary processing
-                success = true;
-            }
-
+            return false;
         }
-        // format string empty TODO
-		return false;
+        //if supported by CV drop out earlier to avoid unnecessary processing
+        return ( is_format_CV_supported( format ) || is_format_magick_supported( format ) );
     }
 
     bool is_format_CV_supported( string format )
     {
-        bool supported = false;
-        if ( !format.empty() )
-        {
-            // Lower the string for performance
-            string lowercase_format = format;
-            std::transform( lowercase_format.begin() , lowercase_format.end() , lowercase_format.begin() , ::tolower );
-
-            unsigned int index = 0;
-
-            while ( !supported && !OPENCV_SUPPORTED_LIST[index].empty() )
-            {
-                if ( lowercase_format.compare( OPENCV_SUPPORTED_LIST[index] ) )
-                {
-                    supported = true;
-                    break;
-                }
-                index++;
-            }
-        }
-        return supported;
+        const Srl_img_format_traits *traits_p = find_format_traits( format );
+        return ( nullptr != traits_p && traits_p->opencv );
     }
 
     bool is_format_magick_supported( string format )
     {
-        // Lower the string for performance
-        bool supported = false;
-        if ( !format.empty() )
-        {            
-            string lower_format = format;
-            std::transform( lower_format.begin() , lower_format.end() , lower_format.begin() , ::tolower );
-
-            // the 
-            std::list<Magick::CoderInfo> coderList;
-            Magick::coderInfoList( &coderList ,
-                Magick::CoderInfo::TrueMatch ,   // match Readable formats
-                Magick::CoderInfo::TrueMatch ,   // match Writeable formats
-                Magick::CoderInfo::AnyMatch     // Multi-frame is not a primary concern
-                );                              // only secondary for particular image formats
-
-            std::list<Magick::CoderInfo>::iterator entry = coderList.begin();
-
-            // Iterate through list of supported formats
-            while ( !supported && ( entry != coderList.end() ) )
-            {
-                if ( format.compare( entry->name() ) )
-                {   //Matched on format name now check read/write capabilities
-                    if ( entry->isReadable() && entry->isWritable() )
-                    {
-                        supported = true;
-                    }
-                }
-            }           
-        }
-        return supported;
+        //Answered from the table built at library init rather than walking Magick::coderInfoList
+        return Srl_magick_coder_cache::instance().is_supported( format );
     }
 
+	///
+	/// @brief	One off initialisation, call before constructing any images
+	///
+	void initialise_library( void )
+	{
+		//Magick's memory methods can only be swapped before it starts
+		Srl_batch_arena::install();
+		Magick::InitializeMagick( nullptr );
+		set_decode_limits( default_decode_limits() );
+		//Builds the coder table now rather than on the first image
+		Srl_magick_coder_cache::instance();
+	}
+
     /*************************************************************************
     *
     *			Srl Exception Base implementation
@@ -54,7 +54,9 @@ namespace srl
 		SRL_ERROR_IMAGEMAGICK,
         SRL_EXCEPT_OTHER,
 		SRL_ERROR_OTHER,
-        SRL_EXCEPT_READ
+        SRL_EXCEPT_READ,
+		SRL_ERROR_MEMORY_BUDGET,	///< the estimated working set is over the memory budget's ceiling
+		SRL_ERROR_LIMIT_EXCEEDED	///< the headers declare more than Srl_decode_limits allows, nothing was decoded
     };
 
 	///
@@ -164,8 +166,18 @@ namespace srl
     ///
     /// @param[in]   format    string value indicating the type of image
     ///
+    /// @note	answered from Srl_magick_coder_cache, call Srl_magick_coder_cache::instance().refresh()
+    ///			if coders are registered after initialise_library()
+    ///
     bool is_format_magick_supported( std::string format );
 
+    ///
+    /// @brief	Installs the batch arena allocators, initialises ImageMagick, applies the default decode
+    ///			limits and builds the cached coder table. Call once at startup before any Srl_steg_image
+    ///			is constructed
+    ///
+    void initialise_library( void );
+
     ///
     /// @brief indicates whether the image format is supported by the SDK 
     ///
@@ -173,15 +185,43 @@ namespace srl
     ///
     bool is_format_supported( std::string format );
 
+    ///
+    /// @brief	Non owning view of an image held in caller memory (pointer plus length)
+    ///
+    /// @description	Nothing is copied when an image is constructed from a view, the backends decode
+    ///					straight from the caller's bytes. The memory must stay valid and unmodified for 
+    ///					the whole lifetime of any Srl_steg_image constructed from it; images held in 
+    ///					SRL_SCRUB_DCT mode keep reading it until they are encoded.
+    ///
+    class Srl_byte_view
+    {
+    public:
+        Srl_byte_view( void ) 
+            : m_data_p( nullptr ), m_length( 0 ) {}
+
+        Srl_byte_view( const unsigned char *data_p, size_t length ) 
+            : m_data_p( data_p ), m_length( ( nullptr != data_p ) ? length : 0 ) {}
+
+        const unsigned char* data( void ) const { return m_data_p; }
+        size_t size( void ) const { return m_length; }
+        bool empty( void ) const { return 0 == m_length; }
+
+    private:
+        const unsigned char *m_data_p;
+        size_t m_length;
+    };
+
     ///
     ///	@brief	holds a singular pair of img format to string values
     ///
     typedef std::pair<Srl_img_format_enum , std::string > Srl_img_format_pair;
 
     ///
-    ///	@brief	Typedef'ed map of enum to string to hold our image formats and facilitate the interface
+    /// @brief	get image format pair for a format string, INVALID_IMG_FORMAT_PAIR if not found. 
+    ///			Looked up in the format registry so any alias or case is accepted. Prefer 
+    ///			sniff_format_pair() when the image data is available
     ///
-    typedef std::map< std::string, Srl_img_format_pair> Srl_img_format_map;
+    Srl_img_format_pair get_format_pair( std::string format );
 
 	/*************************************************************************
 	*
@@ -190,20 +230,38 @@ namespace srl
 	*************************************************************************/
 
 	///
-	/// @brief list of img format strings always supported by OpenCV. Must be terminated 
-	/// with an empty string. 
+	/// @brief Image formats known to the SDK. The suffix shows which libraries can handle the 
+	/// format, _CVIM for both OpenCV and Magick++, _IM for Magick++ only
 	///
-	static const std::string OPENCV_SUPPORTED_LIST[] = { "jpeg", "jpg" , "jpe", "jp2", "bmp", "png", "pbm",
-		"tiff", "tif", "dib", "pbm", "pgm", "ppm", "ras", "sr", "" };
+	enum Srl_img_format_enum
+	{
+		SRL_IMG_FORMAT_NONE,
+		SRL_IMG_FORMAT_JPEG_CVIM,
+		SRL_IMG_FORMAT_PNG_CVIM,
+		SRL_IMG_FORMAT_BMP_CVIM,
+		SRL_IMG_FORMAT_TIFF_CVIM,
+		SRL_IMG_FORMAT_PBM_CVIM,
+		SRL_IMG_FORMAT_PGM_CVIM,
+		SRL_IMG_FORMAT_PPM_CVIM,
+		SRL_IMG_FORMAT_PAM_CVIM,
+		SRL_IMG_FORMAT_JP2_CVIM,
+		SRL_IMG_FORMAT_WEBP_CVIM,
+		SRL_IMG_FORMAT_RAS_CVIM,
+		SRL_IMG_FORMAT_HDR_CVIM,
+		SRL_IMG_FORMAT_GIF_IM,
+		SRL_IMG_FORMAT_PSD_IM,
+		SRL_IMG_FORMAT_ICO_IM,
+		SRL_IMG_FORMAT_COUNT		//must stay last
+	};
 
 	///
-	/// @brief list of img format strings always supported by OpenCV. Must be terminated 
-	/// with an empty string. 
+	/// @brief	The library used to decode and encode an image
 	///
-	enum Srl_img_format_enum
+	enum Srl_img_backend
 	{
-		SRL_IMG_FORMAT_NONE,
-		SRL_IMG_FORMAT_JPEG_CVIM
+		SRL_BACKEND_NONE,
+		SRL_BACKEND_OPENCV,
+		SRL_BACKEND_MAGICK
 	};
 
 	///
@@ -216,23 +274,22 @@ namespace srl
 		SRL_COMRPESSION_HIGH = 100
 	};
 
+	///
+	/// @brief	How JPEG images are scrubbed. SRL_SCRUB_DCT keeps JPEG input as its coefficient stream
+	///			and requantizes it directly, it is never decoded to pixels. Non JPEG input always
+	///			uses SRL_SCRUB_PIXEL.
+	///
+	enum Srl_jpgscrub_mode
+	{
+		SRL_SCRUB_PIXEL,
+		SRL_SCRUB_DCT
+	};
+
 	///
 	/// @brief	Used to indicate invalid pairs or pairs not found
 	///
 	const static Srl_img_format_pair INVALID_IMG_FORMAT_PAIR(SRL_IMG_FORMAT_NONE, "INVALID");
 
-    ///
-    /// @brief	a static map to hold the values for the supported formats
-	///			where formats can have multiple common names (jpeg, jpg) 
-	///			there can be multiple entries here, however only a single 
-	///			entry in the img_format enum 
-    ///
-    const static Srl_img_format_map img_format_mappings = {
-        { "jpeg", Srl_img_format_pair(SRL_IMG_FORMAT_JPEG_CVIM, "jpeg") },
-		{ "jpg", Srl_img_format_pair(SRL_IMG_FORMAT_JPEG_CVIM, "jpg") }
-        //Add rest
-    };
-
 } // srl
 
 
@@ -5,6 +5,7 @@ ADD DESCRIPTION
 #include "stdafx.h"
 #include "Srl_steg_logger.hpp"
 
+#include <algorithm>
 #include <iostream>
 #include <Windows.h>
 #include <stdio.h>
@@ -20,8 +21,9 @@ const vector<string> sysinfo_tokens
 };
 
 //Don't need to check the log level as it is enumerated and must be on of the specified values
-steg_logger::steg_logger(Log_level log_lvl, string altlog_filename)
-	: m_log_level(log_lvl), m_permalog_filename(perma_log_filepath), m_using_altlog(false), m_details_outstanding(false)
+steg_logger::steg_logger(Log_level log_lvl, string altlog_filename, size_t ring_capacity)
+	: m_log_level(log_lvl), m_permalog_filename(perma_log_filepath), m_using_altlog(false), 
+	  m_ring(ring_capacity), m_dropped(0), m_dropped_total(0), m_stopping(false), m_flush_requests(0), m_flushes_done(0)
 {
 	if (!altlog_filename.empty())
 	{
@@ -31,109 +33,197 @@ steg_logger::steg_logger(Log_level log_lvl, string altlog_filename)
 
 	//Automatically get the sysinfo string as the first thing we do in the logger
 	//Will be the first part of all the sysinfo entries
-	string sysinfo = get_sysinfo_string();
-	m_logfile_details.push_back(sysinfo);
-	m_details_outstanding = true;
+	m_sysinfo = get_sysinfo_string();
+
+	//Started last, everything it touches is set up
+	m_flusher = thread(&steg_logger::flush_loop, this);
 }
 
 steg_logger::~steg_logger()
 {
-	if (m_details_outstanding)
 	{
-		write_logdetails_to_path();
+		lock_guard<mutex> lock(m_flush_lock);
+		m_stopping = true;
 	}
+	m_flush_cv.notify_all();
+	m_flusher.join();
 }
 
-void steg_logger::add_logfile_detail(string log_detail)
+void steg_logger::add_logfile_detail(const string &log_detail)
 {
-	m_logfile_details.push_back(log_detail);
-	m_details_outstanding = true;
+	if (NONE == m_log_level)
+	{
+		return;
+	}
+
+	steg_log_record record;
+	record.has_status = false;
+	record.length = static_cast<unsigned short>(min(log_detail.size(), log_record_text_bytes));
+	log_detail.copy(record.text, record.length);
+	push_record(record);
 }
 
-//Write the m_logfile_details to the provided path, if path is not provided 
-//Writes instead to the permalog & altlog if there is one
-bool steg_logger::write_logdetails_to_path(string logpath)
+void steg_logger::add_logfile_detail(const srl::Srl_status &status)
 {
-	bool success = false;
-	if (!logpath.empty()) //Write only to this path 
+	if (NONE == m_log_level)
 	{
-		//Open output stream in output/append mode
-		ofstream logfile(logpath, ios::out | ios::app);
+		return;
+	}
 
-		if (logfile.is_open())
-		{
-			cout << "Writing details to " << logpath << endl;
-			//Divider includes newlines on either side to ensure entries are divided 
-			logfile << logfile_entry_divider;
+	steg_log_record record;
+	record.status = status;
+	record.has_status = true;
+	record.length = 0;
+	push_record(record);
+}
 
-			for (int i = 0; i < m_logfile_details.size(); i++)
-			{
-				logfile << m_logfile_details[i] << ", ";
-			}
-			logfile << endl;
-			logfile.close();
-			success = true;
-		}
-		else
-		{
-			cout << "Unable to open path to: " + logpath;
-		}
+void steg_logger::push_record(steg_log_record &record)
+{
+	//Never waits on the flusher, a full ring means the detail is lost and counted
+	if (!m_ring.try_push(record))
+	{
+		m_dropped.fetch_add(1, memory_order_relaxed);
+		m_dropped_total.fetch_add(1, memory_order_relaxed);
+	}
+}
+
+size_t steg_logger::dropped_details(void) const
+{
+	return m_dropped_total.load(memory_order_relaxed);
+}
 
+void steg_logger::flush(void)
+{
+	unique_lock<mutex> lock(m_flush_lock);
+	const unsigned long long request = ++m_flush_requests;
+	m_flush_cv.notify_all();
+	m_flush_cv.wait(lock, [this, request]() { return m_flushes_done >= request; });
+}
+
+void steg_logger::flush_loop(void)
+{
+	if (NONE != m_log_level)
+	{
+		open_logs();
 	}
-	else //Write to perma/alt 
+
+	string batch;
+	unique_lock<mutex> lock(m_flush_lock);
+	for (;;)
 	{
-		if (m_using_altlog)
+		m_flush_cv.wait_for(lock, log_flush_interval, [this]() 
+		{ 
+			return m_stopping || m_flush_requests != m_flushes_done; 
+		});
+		const unsigned long long requested = m_flush_requests;
+		const bool stopping = m_stopping;
+		lock.unlock();
+
+		batch.clear();
+		if (0 != drain_records(batch))
 		{
-			ofstream alt_logfile(m_alternatelog_filename, ios::out | ios::app);
-
-			if (alt_logfile.is_open())
+			if (m_altlog.is_open())
 			{
-				cout << "Writing details to alt & perma logs" << endl;
-				//Divider includes newlines on either side to ensure entries are divided 
-				alt_logfile << logfile_entry_divider;
-
-				for (int i = 0; i < m_logfile_details.size(); i++)
-				{
-					alt_logfile << m_logfile_details[i] << ", ";
-				}
-				alt_logfile << endl;
-				success = true;
+				m_altlog << batch << endl;
 			}
-			else
+			if (m_permalog.is_open())
 			{
-				cout << "Unable to open path to: " + m_alternatelog_filename;
+				m_permalog << batch << endl;
 			}
 		}
-		ofstream logfile(m_permalog_filename, ios::out | ios::app);
 
-		if (logfile.is_open())
+		lock.lock();
+		m_flushes_done = requested;
+		m_flush_cv.notify_all();
+		if (stopping)
 		{
-			cout << "Writing details to permalog only" << endl;
-			//Divider includes newlines on either side to ensure entries are divided 
-			logfile << logfile_entry_divider;
+			break;
+		}
+	}
+}
 
-			for (int i = 0; i < m_logfile_details.size(); i++)
-			{
-				logfile << m_logfile_details[i] << ", ";
-			}
-			logfile << endl;
-			success = true;
+void steg_logger::open_logs(void)
+{
+	if (m_using_altlog)
+	{
+		m_altlog.open(m_alternatelog_filename, ios::out | ios::app);
+		if (m_altlog.is_open())
+		{
+			//Divider includes newlines on either side to ensure entries are divided 
+			m_altlog << logfile_entry_divider << m_sysinfo << ", " << endl;
 		}
 		else
 		{
-			cout << "Unable to open path to: " + m_permalog_filename;
+			cout << "Unable to open path to: " + m_alternatelog_filename << endl;
 		}
 	}
 
-	if (success)
+	m_permalog.open(m_permalog_filename, ios::out | ios::app);
+	if (m_permalog.is_open())
 	{
-		m_details_outstanding = false;
+		m_permalog << logfile_entry_divider << m_sysinfo << ", " << endl;
 	}
 	else
 	{
-		m_details_outstanding = true;
+		cout << "Unable to open path to: " + m_permalog_filename << endl;
 	}
-	return success;
+}
+
+size_t steg_logger::drain_records(string &batch)
+{
+	size_t count = 0;
+	steg_log_record record;
+
+	//At most one ring's worth so a flood can't keep the flusher here forever
+	while (count < m_ring.capacity() && m_ring.try_pop(record))
+	{
+		if (record.has_status)
+		{
+			batch += srl::describe_status(record.status);
+		}
+		else
+		{
+			batch.append(record.text, record.length);
+		}
+		batch += ", ";
+		count++;
+	}
+
+	const size_t dropped = m_dropped.exchange(0, memory_order_relaxed);
+	if (0 != dropped)
+	{
+		batch += to_string(dropped) + " details dropped as the log ring was full, ";
+		count++;
+	}
+	return count;
+}
+
+//Writes the queued details to the provided path, if path is not provided 
+//flushes instead to the permalog & altlog if there is one
+bool steg_logger::write_logdetails_to_path(string logpath)
+{
+	if (logpath.empty())
+	{
+		flush();
+		return m_permalog.is_open() || m_altlog.is_open();
+	}
+
+	//Open output stream in output/append mode
+	ofstream logfile(logpath, ios::out | ios::app);
+	if (!logfile.is_open())
+	{
+		cout << "Unable to open path to: " + logpath << endl;
+		return false;
+	}
+
+	//Takes the details from the ring itself, whatever the flusher has already 
+	//taken goes to the perma/alt logs as usual
+	string batch;
+	drain_records(batch);
+
+	//Divider includes newlines on either side to ensure entries are divided 
+	logfile << logfile_entry_divider << batch << endl;
+	return true;
 }
 
 //This is only for Unix systems though works agnostically if setup correctly
@@ -9,6 +9,13 @@
 #include <chrono>
 #include <string>
 #include <vector>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "Srl_mpmc_ring.hpp"
+#include "Srl_status.hpp"
 
 using namespace std;
 
@@ -18,6 +25,15 @@ const string perma_log_filepath("..\\resources\\logs\\perma_log.txt");
 //Divides every new entry to the logfile (between runs)
 const string logfile_entry_divider("\\r\\n#NEW_ENTRY\\r\\n");
 
+//Records the ring holds before further details are dropped, about 1MB
+const size_t log_default_ring_capacity = 4096;
+
+//Longest text detail kept, longer details are truncated
+const size_t log_record_text_bytes = 240;
+
+//How long queued details wait before the flusher writes them out
+const chrono::milliseconds log_flush_interval(100);
+
 
 enum Log_level {
 	NONE = 0,
@@ -26,6 +42,19 @@ enum Log_level {
 	HIGH = 3
 };
 
+//One queued detail, either text or a status the flusher describes. Fixed size so 
+//queuing one never allocates
+struct steg_log_record
+{
+	srl::Srl_status status;
+	bool has_status;
+	unsigned short length;
+	char text[log_record_text_bytes];
+};
+
+//Details are queued on a lock free ring and written out in batches by a flusher 
+//thread which keeps the log files open. Adding a detail never blocks, if the ring 
+//is full the detail is dropped and counted, and the count is logged in its place
 class steg_logger
 {
 private:
@@ -43,11 +72,29 @@ private:
 	//Quick access for determining whether to also write to the alternate log
 	bool m_using_altlog;
 
-	//Contains the details to be written to the logfile, vectored to reduce 
-	//the need for constant file IO. we'll open + write all of it in one go. 
-	//All entries will be comma seperated in a single entry, that way in the 
-	//Future, maybe just use Excel to handle them 
-	vector<string> m_logfile_details;
+	//Contains the details waiting to be written to the logfile, the flusher 
+	//writes all that are waiting in one go. All entries will be comma seperated 
+	//in a single entry, that way in the Future, maybe just use Excel to handle them 
+	srl::Srl_mpmc_ring<steg_log_record> m_ring;
+
+	//Details dropped because the ring was full, since the last batch and in total
+	atomic<size_t> m_dropped;
+	atomic<size_t> m_dropped_total;
+
+	//Written after the divider when the logs are opened
+	string m_sysinfo;
+
+	//Kept open by the flusher for the lifetime of the logger
+	ofstream m_permalog;
+	ofstream m_altlog;
+
+	//Flusher thread and its handshake with flush() and the destructor
+	thread m_flusher;
+	mutex m_flush_lock;
+	condition_variable m_flush_cv;
+	bool m_stopping;
+	unsigned long long m_flush_requests;
+	unsigned long long m_flushes_done;
 
 	//Determines the amount of information to be logged to the system
 	//For this project will only check if NONE otherwise will just log all
@@ -63,9 +110,17 @@ private:
 	//extract information from a unix sysinfo string given a set of tokens check /proc/cpuinfo 
 	string extract_info_from_sysstring(string extraction_string, vector<string> tokens_to_match);
 
-	//this will be true when there are strings in the logfile details member to be written still 
-	//And allows the destructor to manage writing those to disk before they are lost
-	bool m_details_outstanding;
+	//Flusher thread body, writes a batch every log_flush_interval or when asked
+	void flush_loop(void);
+
+	//Opens the perma and alt logs for append and writes the entry header
+	void open_logs(void);
+
+	//Pops everything queued and formats it into batch, returns the number of details
+	size_t drain_records(string &batch);
+
+	//Queues a record, counting it as dropped if the ring is full
+	void push_record(steg_log_record &record);
 
 public:
 
@@ -76,20 +131,31 @@ public:
 	*************************************************/
 
 	//If altlog_filename provided writes the details to a seperate logfile as well
-	//otherwise uses default permalog path only
-	steg_logger(Log_level log_lvl, string altlog_filename = "");
+	//otherwise uses default permalog path only. ring_capacity bounds the details
+	//waiting to be written
+	steg_logger(Log_level log_lvl, string altlog_filename = "", size_t ring_capacity = log_default_ring_capacity);
 
+	//Writes anything still queued and closes the logs
 	~steg_logger();
 
+	steg_logger(const steg_logger&) = delete;
+	steg_logger& operator=(const steg_logger&) = delete;
+
 	/************************************************
 
 	UTILITY
 
 	*************************************************/
 
-	//Adds a single string detail to m_logfile_details, used for most of the fractal 
+	//Queues a single string detail, never blocks. Used for most of the fractal 
 	//generation details that we don't need to store in this class 
-	void add_logfile_detail(string log_detail);
+	void add_logfile_detail(const string &log_detail);
+
+	//Queues a failure status, the text is only built by the flusher
+	void add_logfile_detail(const srl::Srl_status &status);
+
+	//Details dropped since construction because the ring was full
+	size_t dropped_details(void) const;
 
 
 	/************************************************
@@ -98,8 +164,11 @@ public:
 
 	*************************************************/
 
-	//Write the m_logfile_details to the provided path, if path is not provided 
-	//Writes instead to the permalog & altlog if there is one
+	//Waits until everything queued so far has been written to the permalog & altlog
+	void flush(void);
+
+	//Writes the queued details to the provided path instead of the logs, if path is 
+	//not provided flushes to the permalog & altlog if there is one
 	bool write_logdetails_to_path(string logpath = "");
 };
 
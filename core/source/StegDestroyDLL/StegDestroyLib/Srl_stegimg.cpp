@@ -12,12 +12,127 @@
 #include "stdafx.h"
 
 #include "Srl_stegimg.hpp"
+#include "Srl_jpeg_dct_scrub.hpp"
+#include "Srl_format_sniffer.hpp"
+#include "Srl_img_format_registry.hpp"
+#include "Srl_batch_arena.hpp"
+#include "Srl_buffer_pool.hpp"
+#include "Srl_decode_limits.hpp"
+#include "Srl_status.hpp"
+#include "Srl_latency_histogram.hpp"
+#include "Srl_trace.hpp"
+#include "Srl_tile_parallel.hpp"
+
+#include <algorithm>
+#include <climits>
 
 using namespace srl;
 using namespace Magick;
 using namespace cv;
 using namespace std;
 
+namespace
+{
+	///
+	/// @brief	Status for the exception MagickCore recorded, with the same codes the Magick++ exception
+	///			catches used to give. A read only fails on errors, a warning's status is kept with
+	///			the image and reported. The encode still fails on either
+	///
+	Srl_status magick_status(const MagickCore::ExceptionInfo *except_p)
+	{
+		string message;
+		if (nullptr != except_p->reason)
+		{
+			message = except_p->reason;
+		}
+		if (nullptr != except_p->description)
+		{
+			message += " (";
+			message += except_p->description;
+			message += ")";
+		}
+
+		Srl_exception_status code = SRL_ERROR_IMAGEMAGICK;
+		if (MagickCore::CoderWarning == except_p->severity && string::npos != message.find("FORMAT_INVALID"))
+		{
+			code = SRL_WARNING_FORMAT_INVALID;
+		}
+		else if (MagickCore::CoderWarning == except_p->severity && string::npos != message.find("WRONG_CH_TYPE"))
+		{
+			code = SRL_WARNING_CHTYPE;
+		}
+		else if (MagickCore::ResourceLimitError == except_p->severity)
+		{	//One of the decode limits set by set_decode_limits() caught what the header probe couldn't
+			code = SRL_ERROR_LIMIT_EXCEEDED;
+		}
+		else if (except_p->severity < MagickCore::ErrorException)
+		{
+			code = SRL_EXCEPT_IMAGEMAGICK;
+		}
+		//The reason is formatted from the input (byte values, offsets), so it isn't interned
+		return Srl_status(code, SRL_NO_MESSAGE, SRL_SOURCE_MAGICK, static_cast<int32_t>(except_p->severity)).with_detail(message);
+	}
+
+	///
+	/// @brief	status for an exception thrown by OpenCV
+	///
+	Srl_status cv_status(const cv::Exception &e)
+	{
+		//err can quote values from the input, e.g. the channel count an assertion rejected
+		return Srl_status(SRL_EXCEPT_OPENCV, SRL_NO_MESSAGE, SRL_SOURCE_OPENCV, e.code).with_detail(e.err);
+	}
+
+	///
+	/// @brief	Reads an image straight out of caller memory. Nothing is thrown, an error the coder
+	///			raises is returned in status and the image discarded. A warning (an unknown TIFF tag, a
+	///			truncated JPEG scan) keeps the image, as the Magick::Image read did, and is returned in
+	///			warning
+	///
+	MagickCore::Image* read_magick_image(Srl_byte_view img_data, Srl_status &status, Srl_status &warning)
+	{
+		MagickCore::ImageInfo *info_p = MagickCore::AcquireImageInfo();
+		MagickCore::ExceptionInfo *except_p = MagickCore::AcquireExceptionInfo();
+
+		MagickCore::Image *image_p = MagickCore::BlobToImage(info_p, img_data.data(), img_data.size(), except_p);
+		MagickCore::DestroyImageInfo(info_p);
+
+		if (except_p->severity >= MagickCore::ErrorException)
+		{
+			if (nullptr != image_p)
+			{
+				image_p = MagickCore::DestroyImageList(image_p);
+			}
+			status = magick_status(except_p);
+		}
+		else if (nullptr == image_p)
+		{
+			static const Srl_message_id no_image = intern_message("no image could be read from the buffer");
+			status = Srl_status(SRL_ERROR_IMAGEMAGICK, no_image, SRL_SOURCE_MAGICK, MagickCore::CorruptImageError);
+		}
+		else if (MagickCore::UndefinedException != except_p->severity)
+		{
+			warning = magick_status(except_p);
+		}
+		MagickCore::DestroyExceptionInfo(except_p);
+		return image_p;
+	}
+
+	///
+	/// @brief	FNV-1a over the length and leading bytes of the input, enough to give each image its 
+	///			own noise without hashing the whole stream
+	///
+	uint64_t derive_scrub_seed(const unsigned char *data_p, size_t data_length)
+	{
+		uint64_t hash = 0xCBF29CE484222325ULL ^ static_cast<uint64_t>(data_length);
+		size_t count = (data_length < 4096) ? data_length : 4096;
+		for (size_t i = 0; i < count; i++)
+		{
+			hash = (hash ^ data_p[i]) * 0x100000001B3ULL;
+		}
+		return hash;
+	}
+}
+
 /***************************************************
 *
 *					Steg Image base
@@ -47,147 +162,212 @@ void* Srl_steg_image_base::data(void)
 *				JpgScrub steg_image
 *
 ****************************************************/
-Srl_steg_image::Srl_steg_image( unsigned char * data_p , size_t data_length , Srl_img_format_pair img_format )
-    :   Srl_steg_image_base( (void*)data_p, img_format.second),
+Srl_steg_image::Srl_steg_image( unsigned char * data_p , size_t data_length , Srl_img_format_pair img_format, Srl_jpgscrub_mode scrub_mode )
+    :   Srl_steg_image( Srl_byte_view( data_p, data_length ), img_format, scrub_mode )
+{
+}
+
+Srl_steg_image::Srl_steg_image( Srl_byte_view img_data, Srl_jpgscrub_mode scrub_mode )
+    :   Srl_steg_image( img_data, INVALID_IMG_FORMAT_PAIR, scrub_mode )
+{
+}
+
+Srl_steg_image::Srl_steg_image( Srl_byte_view img_data, Srl_img_format_pair img_format, Srl_jpgscrub_mode scrub_mode,
+								const Srl_image_header *header_p )
+    :   Srl_steg_image_base( const_cast<unsigned char*>( img_data.data() ), img_format.second),
 		m_format(img_format),
+		m_backend(SRL_BACKEND_NONE),
+		m_encoded_format(INVALID_IMG_FORMAT_PAIR),
+		m_lsb_planes(SRL_LSB_DEFAULT_PLANES),
+		m_lsb_mode(SRL_LSB_RANDOMIZE),
+		m_lsb_scrubbed(false),
+		m_chroma_quality(0),
+		m_resample_scale(1.0),
+		m_resampled(false),
+		m_tile_pool_p(nullptr),
         m_exception_p(nullptr),
-        m_err_status(SRL_EXCEPT_NONE)
+		m_scrub_seed(derive_scrub_seed(img_data.data(), img_data.size()))
 {
-    if ( is_format_magick_supported( img_format.second ) )
-    {
-        try
-        {
-            // as this can fail, we'll avoid potential memory leak by putting this first step
-            // into it's own try catch 
-            Blob temp_blob( data_p , data_length );
-            try
-            {
-                // this is where we try to read our data into the blob and the image so there is potential 
-                // for a fair few things going wrong hence the number of errors to catch
-                m_img_p.reset( new Magick::Image( temp_blob ) );
-            }
-			catch (Magick::Error & e)
-			{
-				m_exception_p.reset(new Srl_exception(e));
-				m_err_status = SRL_ERROR_IMAGEMAGICK;
-			}
-            // If we got here then we have successfully read the image data into the image member
-			m_mat_p = nullptr;
-        }
-        catch ( Magick::Exception & e )
-        {
-			m_exception_p.reset(new Srl_exception(e));
-			m_err_status = SRL_EXCEPT_IMAGEMAGICK;
-        }
-    }
+	Srl_trace_span span( "construct", img_format.first );
+	Srl_stage_timer sniff_timer( SRL_STAGE_SNIFF );
 
-	//EXAMPLE CODE----------------
-#include <iostream>
-	string error_msg;
-	if (is_format_magick_supported(img_format.second))
+	//Trust the signature over the caller's label, mislabelled attachments are common in mail
+	Srl_img_format_pair sniffed = sniff_format_pair( img_data );
+	if ( SRL_IMG_FORMAT_NONE != sniffed.first )
 	{
-		try
-		{
-			// as this can fail, we'll avoid potential memory leak by putting this first step
-			// into it's own try catch 
-			Blob temp_blob(data_p, data_length);
-			try
-			{
-				// this is where we try to read our data into the blob and the image so there is potential 
-				// for a fair few things going wrong hence the number of errors to catch
-				m_img_p.reset(new Magick::Image(temp_blob));
-			}
-			catch (Magick::WarningCoder &e)
-			{
-				if ("CODER::FORMAT_INVALID" == e.what())
-				{
-					error_msg = "Warning: non-critical error with format of :" + img_format.second;
-					m_err_status = SRL_WARNING_FORMAT_INVALID;
-				}
-				else if("CODER::WRONG_CH_TYPE" == e.what())
-				{
-					error_msg = "Warning: non-critical error with channel type of:" + img_format.second;
-					m_err_status = SRL_WARNING_CHTYPE;
-				}
-			}
-			catch (Magick::Error & e)
-			{
-				m_exception_p.reset(new Srl_exception(e));
-				m_err_status = SRL_ERROR_IMAGEMAGICK;
-			}
-			// If we got here then we have successfully read the image data into the image member
-			m_mat_p = nullptr;
-		}
-		catch (Magick::Exception & e)
-		{
-			m_exception_p.reset(new Srl_exception(e));
-			m_err_status = SRL_EXCEPT_IMAGEMAGICK;
-		}
+		m_format = sniffed;
+		m_backend = preferred_backend( sniffed.first );
+	}
+	else if ( SRL_IMG_FORMAT_NONE != img_format.first )
+	{
+		m_backend = preferred_backend( img_format.first );
+	}
+	else if ( is_format_magick_supported( img_format.second ) )
+	{
+		m_backend = SRL_BACKEND_MAGICK;
+	}
+	else
+	{
+		m_backend = SRL_BACKEND_OPENCV;
 	}
 
-	//EXAMPLE CODE-----------
+	const bool dct_mode = SRL_SCRUB_DCT == scrub_mode && SRL_IMG_FORMAT_JPEG_CVIM == m_format.first && 
+						  is_jpeg_stream( img_data.data(), img_data.size() );
 
-	//Magick++ doesn't provide a validate() function like the scripting versions do, perhaps
-	//because this is done by default in the image constructor but because we're carpet catching 
-	//errors & exceptions, any issues with the image should be caught in there so check if our 
-	//exception member was set instead
-    else if( nullptr == m_exception_p ) 
-    {
-        //we haven't been able to read the image using Magick++ so try with OpenCV
-        //Try to Decode the buffer to a matrix 
-        try
-        {
-			m_mat_p.reset( new cv::Mat );
-            imdecode( std::vector<char>( *data_p ) , IMREAD_COLOR , m_mat_p.get() );
-        }
-        catch ( cv::Exception & e )
-        {
-			m_exception_p.reset(new Srl_exception(e));
-			m_err_status = SRL_EXCEPT_OPENCV;
-        }
-
-        //Make sure that the data is there 
-        if ( nullptr == m_mat_p->data  )
-        {  //this value will be checked for before any encoding is done 
-            m_err_status = SRL_EXCEPT_READ;
-        }
-		else
-		{
-			m_img_p = nullptr;
-		}
-    }
-}
-/*
-//Rework with smart pointers
-Srl_steg_image::Srl_steg_image( Srl_steg_image & img_copy )
-	:	Srl_steg_image_base(img_copy.data(), img_copy.format(), img_copy.exception_status(), img_copy.m_exception),
-		m_format(img_copy.m_format),
-		m_exception_p(img_copy.exception()),
-		m_err_status(img_copy.m_err_status)
-{
-    m_err_status = SRL_EXCEPT_NONE;
-    //First copy the image data from either CV or Magick member
-    if ( nullptr != img_copy.m_img_p.get() )
-    {
-        m_img_p.reset(new shared_ptr<Magick::Image>( img_copy.m_img_p));
-		m_mat_p = nullptr;
-    }
-    else if ( nullptr != img_copy.m_mat_p.get() )
+	//Refuse what the headers say would be a hostile allocation before any decoder sees it
+	Srl_exception_status limit_status = ( nullptr != header_p ) ?
+		check_decode_limits( *header_p, decode_limits(), dct_mode ) : check_decode_limits( img_data, dct_mode );
+	sniff_timer.set_key( m_format.first, m_backend );
+	sniff_timer.finish();
+	span.set_format( m_format.first );
+	if ( SRL_EXCEPT_NONE != limit_status )
+	{
+		static const Srl_message_id over_limit = intern_message( "the image headers exceed the decode limits" );
+		set_status( Srl_status( limit_status, over_limit ) );
+		return;
+	}
+
+	if ( dct_mode )
+	{
+		//Coefficients are read straight from the caller's bytes at encode time so there is no pixel decode
+		m_jpeg_src = img_data;
+		return;
+	}
+
+	//Exactly one decode attempt, a failure here is reported rather than retried on the other backend
+    if ( SRL_BACKEND_MAGICK == m_backend )
     {
-        m_mat_p.reset(new shared_ptr<cv::Mat>(img_copy.m_mat_p));
+		decode_magick( img_data );
     }
-    //now the format + check the error status to see if we need to get the exception
-    m_format = img_copy.m_format;
-    if ( SRL_EXCEPT_NONE != img_copy.m_err_status )
+    else
     {
-        m_err_status = img_copy.m_err_status;
-		m_exception_p.reset(new Srl_exception(img_copy.m_exception_p));
+		decode_cv( img_data );
     }
 }
-*/
+
+bool Srl_steg_image::decode_magick( Srl_byte_view img_data )
+{
+	Srl_stage_timer timer( SRL_STAGE_DECODE, m_format.first, SRL_BACKEND_MAGICK );
+	//The pixels live as long as the image, a lazy decode inside a stage's scope would pin its arena
+	Srl_arena_bypass bypass;
+
+	// BlobToImage reads the caller's buffer in place where Magick::Blob would take a copy first
+	Srl_status status;
+	Srl_status warning;
+	MagickCore::Image *image_p = read_magick_image( img_data, status, warning );
+	if ( nullptr == image_p )
+	{
+		set_status( status );
+		return false;
+	}
+	m_warning = warning;
+
+	m_img_p.reset( new Magick::Image( image_p ) );
+	m_mat_p = nullptr;
+	m_lsb_scrubbed = false;
+	m_resampled = false;
+	return true;
+}
+
+bool Srl_steg_image::decode_cv( Srl_byte_view img_data )
+{
+	Srl_stage_timer timer( SRL_STAGE_DECODE, m_format.first, SRL_BACKEND_OPENCV );
+	//As in decode_magick, the pixels outlive any scope this is called in
+	Srl_arena_bypass bypass;
+
+	if ( img_data.empty() || img_data.size() > static_cast<size_t>( INT_MAX ) )
+	{	//A single row Mat can't address more than INT_MAX bytes
+		set_status( Srl_status( SRL_EXCEPT_READ ) );
+		return false;
+	}
+
+	cv::Mat decoded;
+	try
+	{
+		//Mat header over the caller's bytes, imdecode reads them in place. Garbage input normally
+		//comes back as an empty Mat, the catch is only for decoders that still throw
+		const Mat raw_mat( 1, static_cast<int>( img_data.size() ), CV_8UC1, const_cast<unsigned char*>( img_data.data() ) );
+		decoded = imdecode( raw_mat, IMREAD_COLOR );
+	}
+	catch ( cv::Exception & e )
+	{
+		set_status( cv_status( e ) );
+		return false;
+	}
+
+	//Make sure that the data is there 
+	if ( nullptr == decoded.data )
+	{  //this value will be checked for before any encoding is done 
+		static const Srl_message_id no_image = intern_message( "imdecode found no image in the buffer" );
+		set_status( Srl_status( SRL_EXCEPT_READ, no_image, SRL_SOURCE_OPENCV ) );
+		return false;
+	}
+	m_mat_p.reset( new cv::Mat( std::move( decoded ) ) );
+	m_img_p = nullptr;
+	m_lsb_scrubbed = false;
+	m_resampled = false;
+	return true;
+}
+
+Srl_steg_image::Srl_steg_image( Srl_steg_image &&other ) noexcept
+	:	Srl_steg_image_base( std::move( other ) ),
+		m_mat_p( std::move( other.m_mat_p ) ),
+		m_img_p( std::move( other.m_img_p ) ),
+		m_backend( other.m_backend ),
+		m_jpeg_src( other.m_jpeg_src ),
+		m_encoded_buf( std::move( other.m_encoded_buf ) ),
+		m_encoded_format( std::move( other.m_encoded_format ) ),
+		m_scrub_seed( other.m_scrub_seed ),
+		m_lsb_planes( other.m_lsb_planes ),
+		m_lsb_mode( other.m_lsb_mode ),
+		m_lsb_scrubbed( other.m_lsb_scrubbed ),
+		m_chroma_quality( other.m_chroma_quality ),
+		m_resample_scale( other.m_resample_scale ),
+		m_resampled( other.m_resampled ),
+		m_tile_pool_p( other.m_tile_pool_p ),
+		m_status( other.m_status ),
+		m_warning( other.m_warning ),
+		m_exception_p( std::move( other.m_exception_p ) ),
+		m_format( std::move( other.m_format ) )
+{
+	//The vector keeps its heap block across the move, so a view into it stays valid here, 
+	//and the moved from image mustn't keep viewing it
+	other.m_jpeg_src = Srl_byte_view();
+}
+
+Srl_steg_image& Srl_steg_image::operator=( Srl_steg_image &&other ) noexcept
+{
+	if ( this != &other )
+	{
+		Srl_steg_image_base::operator=( std::move( other ) );
+		m_mat_p = std::move( other.m_mat_p );
+		m_img_p = std::move( other.m_img_p );
+		m_backend = other.m_backend;
+		m_jpeg_src = other.m_jpeg_src;
+		m_encoded_buf = std::move( other.m_encoded_buf );
+		m_encoded_format = std::move( other.m_encoded_format );
+		m_scrub_seed = other.m_scrub_seed;
+		m_lsb_planes = other.m_lsb_planes;
+		m_lsb_mode = other.m_lsb_mode;
+		m_lsb_scrubbed = other.m_lsb_scrubbed;
+		m_chroma_quality = other.m_chroma_quality;
+		m_resample_scale = other.m_resample_scale;
+		m_resampled = other.m_resampled;
+		m_tile_pool_p = other.m_tile_pool_p;
+		m_status = other.m_status;
+		m_warning = other.m_warning;
+		m_exception_p = std::move( other.m_exception_p );
+		m_format = std::move( other.m_format );
+
+		other.m_jpeg_src = Srl_byte_view();
+	}
+	return *this;
+}
+
 Srl_steg_image::~Srl_steg_image()
 {
-    //All managed using smart pointers so nothing to worry about 
+    //Pixels are managed using smart pointers. The encoded buffer is freed rather than pooled, the
+    //destroying thread is often a consumer that never encodes, or one tearing down its thread_locals
 }
 
 ///
@@ -199,10 +379,28 @@ std::string Srl_steg_image::format( void ) const
 }
 
 ///
-/// @brief returns the Srl_exception member if there is one otherwise nullptr
+/// @brief returns the backend chosen to decode the image 
+///
+Srl_img_backend Srl_steg_image::backend( void ) const
+{
+    return m_backend;
+}
+
+///
+/// @brief builds the Srl_exception for a backend failure the first time it's asked for, otherwise nullptr
 ///
 std::shared_ptr<Srl_exception> Srl_steg_image::exception( void ) 
 {
+    if ( nullptr == m_exception_p.get() && SRL_SOURCE_OPENCV == m_status.source )
+    {
+        cv::Exception e( m_status.backend_code, status_text( m_status ), "", "", 0 );
+        m_exception_p.reset( new Srl_exception( e ) );
+    }
+    else if ( nullptr == m_exception_p.get() && SRL_SOURCE_MAGICK == m_status.source )
+    {
+        Magick::Exception e( status_text( m_status ) );
+        m_exception_p.reset( new Srl_exception( e ) );
+    }
     return m_exception_p;
 }
 
@@ -211,7 +409,40 @@ std::shared_ptr<Srl_exception> Srl_steg_image::exception( void )
 ///
 Srl_exception_status Srl_steg_image::exception_status( void )
 {
-    return m_err_status;
+    return m_status.code;
+}
+
+///
+/// @brief returns the full status of the last decode or encode
+///
+Srl_status Srl_steg_image::status( void ) const
+{
+    return m_status;
+}
+
+///
+/// @brief returns the warning of the last successful decode
+///
+Srl_status Srl_steg_image::warning( void ) const
+{
+    return m_warning;
+}
+
+///
+/// @brief formats the status, only done when asked
+///
+std::string Srl_steg_image::diagnostic( void ) const
+{
+    return describe_status( m_status );
+}
+
+///
+/// @brief replaces the status, dropping any exception built from the old one
+///
+void Srl_steg_image::set_status( const Srl_status &status )
+{
+    m_status = status;
+    m_exception_p = nullptr;
 }
 
 ///
@@ -219,16 +450,127 @@ Srl_exception_status Srl_steg_image::exception_status( void )
 ///
 const void* Srl_steg_image::get_img_data( void ) const
 {
-    if ( nullptr != m_img_p.get() )
+    if ( !m_encoded_buf.empty() )
+    {   //Once encoded the encoded stream is the image's primary data
+        return m_encoded_buf.data();
+    }
+    else if ( !m_jpeg_src.empty() )
     {
-        Blob blob;
-        m_img_p->write( &blob );
-        return blob.data();
+        return m_jpeg_src.data();
     }
-    else 
-    {   //This will either return the data or nullptr 
+    else if ( nullptr != m_mat_p.get() )
+    {
         return m_mat_p->data;
     }
+    //Magick++ pixels aren't held in one contiguous buffer, encode first
+    return nullptr;
+}
+
+///
+/// @brief returns a view over the output of the last successful encode
+///
+Srl_byte_view Srl_steg_image::encoded_data( void ) const
+{
+    return Srl_byte_view( m_encoded_buf.data(), m_encoded_buf.size() );
+}
+
+///
+/// @brief hands the encoded buffer over to the caller, swapping in the caller's buffer for reuse
+///
+void Srl_steg_image::swap_encoded_buffer( std::vector<uchar> &buffer )
+{
+	if ( !m_jpeg_src.empty() && m_jpeg_src.data() == m_encoded_buf.data() )
+	{	//The DCT stream went with the buffer
+		m_jpeg_src = Srl_byte_view();
+	}
+	m_encoded_buf.swap( buffer );
+	m_encoded_buf.clear();
+	m_encoded_format = INVALID_IMG_FORMAT_PAIR;
+}
+
+///
+/// @brief drops every view into the caller's bytes
+///
+void Srl_steg_image::detach_source( void )
+{
+	m_raw_buf_p = nullptr;
+	if ( !m_jpeg_src.empty() && m_jpeg_src.data() != m_encoded_buf.data() )
+	{	//Still reading the source, there is nothing left for it to read
+		m_jpeg_src = Srl_byte_view();
+	}
+}
+
+///
+/// @brief replaces the encoded output, returning the previous buffer to the pool
+///
+void Srl_steg_image::store_encoded( std::vector<uchar> &out_buf, Srl_img_format_pair img_format )
+{
+	Srl_buffer_pool &pool = Srl_buffer_pool::thread_local_pool();
+	pool.record_size( out_buf.size() );
+
+	std::vector<uchar> previous;
+	previous.swap( m_encoded_buf );
+	if ( out_buf.capacity() - out_buf.size() > out_buf.size() / 4 )
+	{	//The image may be held for the rest of the batch, a high-water sized buffer each would
+		//cost images x peak. It keeps a copy sized to the output, the buffer stays with the thread
+		m_encoded_buf.assign( out_buf.begin(), out_buf.end() );
+		pool.release( std::move( out_buf ) );
+	}
+	else
+	{
+		m_encoded_buf.swap( out_buf );
+	}
+	m_encoded_format = img_format;
+	pool.release( std::move( previous ) );
+}
+
+///
+/// @brief returns the format of the last successful encode
+///
+Srl_img_format_pair Srl_steg_image::encoded_format( void ) const
+{
+    return m_encoded_format;
+}
+
+///
+/// @brief true if the image currently holds decoded pixels
+///
+bool Srl_steg_image::has_pixels( void ) const
+{
+    return ( nullptr != m_mat_p.get() || nullptr != m_img_p.get() );
+}
+
+///
+/// @brief bytes held by the pixels and the encoded output
+///
+size_t Srl_steg_image::memory_footprint( void ) const
+{
+    size_t bytes = m_encoded_buf.capacity();
+    if ( nullptr != m_mat_p.get() )
+    {
+        bytes += m_mat_p->total() * m_mat_p->elemSize();
+    }
+    if ( nullptr != m_img_p.get() )
+    {   //Magick holds every channel of the pixel cache at its quantum depth
+        bytes += m_img_p->columns() * m_img_p->rows() * m_img_p->channels() * sizeof( MagickCore::Quantum );
+    }
+    return bytes;
+}
+
+///
+/// @brief encodes to a format given by name at the default compression level
+///
+bool Srl_steg_image::encode( std::string format )
+{
+    return encode( get_format_pair( format ) );
+}
+
+///
+/// @brief returns the base class exception member
+///
+std::shared_ptr<Srl_exception_base> Srl_steg_image::error( void )
+{
+    return m_exception;
 }
 
 ///
@@ -236,50 +578,364 @@ const void* Srl_steg_image::get_img_data( void ) const
 ///
 bool Srl_steg_image::encode( Srl_img_format_pair img_format_in, Srl_jpgscrub_compression_level compression_lvl)
 {
+	Srl_trace_span span("encode", img_format_in.first);
 	bool success = false;
+	if (!m_jpeg_src.empty())
+	{
+		//Resampling needs the pixels, JPEG to JPEG otherwise never leaves the coefficient domain
+		if (SRL_IMG_FORMAT_JPEG_CVIM == img_format_in.first && m_resample_scale >= 1.0)
+		{
+			Srl_stage_timer timer(SRL_STAGE_ENCODE, img_format_in.first, SRL_BACKEND_NONE);
+
+			//The source may view m_encoded_buf itself so the scrub always writes to a second buffer
+			vector<uchar> scrubbed = Srl_buffer_pool::thread_local_pool().acquire(m_jpeg_src.size());
+			string err_msg;
+			const int chroma_quality = (0 != m_chroma_quality) ? m_chroma_quality : static_cast<int>(compression_lvl);
+			if (jpeg_dct_scrub(m_jpeg_src.data(), m_jpeg_src.size(), compression_lvl, chroma_quality, m_scrub_seed,
+							   scrubbed, err_msg))
+			{
+				store_encoded(scrubbed, img_format_in);
+				m_jpeg_src = encoded_data();
+				return true;
+			}
+			Srl_buffer_pool::thread_local_pool().release(std::move(scrubbed));
+			set_status(Srl_status(SRL_EXCEPT_READ).with_detail(err_msg));
+			return false;
+		}
+		else if (!leave_dct_mode())
+		{
+			return false;
+		}
+	}
+	else if (!has_pixels() && !decode_pixels())
+	{	//Pixels of an earlier encode are dropped, this re-encode needs them back
+		return false;
+	}
+
+	if (!resample_scrub())
+	{
+		return false;
+	}
+
+	const Srl_img_format_traits *traits_p = find_format_traits(img_format_in.first);
+	if (nullptr == traits_p)
+	{
+		traits_p = find_format_traits(img_format_in.second);
+	}
+
+	//Lossless formats keep every pixel bit, requantization won't reach an LSB payload in them.
+	//Magick held images (GIF, PSD, ICO) are scrubbed too, a format the registry doesn't know
+	//is taken to be lossless
+	if ((nullptr == traits_p || !traits_p->lossy) && !scrub_lsb())
+	{
+		if (m_lsb_planes > SRL_LSB_MAX_PLANES)
+		{
+			static const Srl_message_id bad_planes = intern_message("more bit planes than the scrub supports");
+			set_status(Srl_status(SRL_ERROR_OTHER, bad_planes));
+		}
+		else if (nullptr != m_mat_p.get())
+		{	//The kernels only take 8 bit samples
+			set_status(Srl_status(SRL_WARNING_CHTYPE));
+		}
+		//Otherwise scrub_magick_lsb() recorded why
+		return false;
+	}
+
+	//Started after any decode, resample and scrub above, which record their own time
+	Srl_stage_timer timer(SRL_STAGE_ENCODE, img_format_in.first, (nullptr != m_img_p.get()) ? SRL_BACKEND_MAGICK : SRL_BACKEND_OPENCV);
+
 	if (nullptr != m_img_p.get()) 
 	{
+		//ImagesToBlob reports through the ExceptionInfo where Magick::Image::write would throw
+		MagickCore::ExceptionInfo *except_p = MagickCore::AcquireExceptionInfo();
+		void *blob_p = nullptr;
+		size_t length = 0;
 		try
-		{
+		{	//The option setters still throw for a format name Magick doesn't know
 			m_img_p->magick(img_format_in.second);
+			m_img_p->quality(compression_lvl);
+			blob_p = MagickCore::ImagesToBlob(m_img_p->constImageInfo(), m_img_p->image(), &length, except_p);
 		}
 		catch (Magick::Exception &e)
 		{
-			m_exception_p.reset(new Srl_exception(e));
-			m_err_status = SRL_EXCEPT_IMAGEMAGICK;
+			set_status(Srl_status(SRL_EXCEPT_IMAGEMAGICK, SRL_NO_MESSAGE, SRL_SOURCE_MAGICK).with_detail(e.what()));
 		}
+
+		if (MagickCore::UndefinedException != except_p->severity)
+		{	//Warnings fail the encode as they did when write() threw them
+			Srl_status status = magick_status(except_p);
+			status.code = SRL_EXCEPT_IMAGEMAGICK;
+			set_status(status);
+		}
+		else if (nullptr != blob_p)
+		{
+			//The length is known up front, so the one copy out of Magick's memory goes into a buffer
+			//sized to it that store_encoded() keeps as it is. A pooled buffer reserved to the
+			//high-water mark would only be copied a second time to trim it
+			const unsigned char *data_p = static_cast<const unsigned char*>(blob_p);
+			vector<uchar> out_buf(data_p, data_p + length);
+			store_encoded(out_buf, img_format_in);
+			//Only decoded again if a later stage asks for the pixels
+			m_img_p = nullptr;
+			success = true;
+		}
+
+		if (nullptr != blob_p)
+		{
+			MagickCore::RelinquishMagickMemory(blob_p);
+		}
+		MagickCore::DestroyExceptionInfo(except_p);
 	}
 	else if (nullptr != m_mat_p.get())
 	{
+		if (nullptr == traits_p || !traits_p->opencv)
+		{
+			set_status(Srl_status(SRL_WARNING_FORMAT_INVALID));
+			return false;
+		}
+
 		vector<int> cv_params;
-		vector<uchar> cv_outbuf;
 
-		//Push the JPEG quality parameters on 
-		cv_params.push_back(CV_IMWRITE_JPEG_QUALITY);
-		cv_params.push_back(compression_lvl);
+		//Push the format's default encoder parameter on, lossy formats take the compression level
+		if (SRL_NO_ENCODER_PARAM != traits_p->encoder_param)
+		{
+			cv_params.push_back(traits_p->encoder_param);
+			cv_params.push_back(traits_p->lossy ? static_cast<int>(compression_lvl) : traits_p->encoder_value);
+		}
 
-		//This reserves the current amount of memory the matrix holds, in theory we're 
-		//Only ever going to be shrinking images in size, however multiply by 1.5 for a buffer
-		size_t reserve_bytes = 1.5 * m_mat_p->rows * m_mat_p->cols * 3;
-		cv_outbuf.reserve(reserve_bytes);
+		//Reserved from the thread's high-water mark rather than the pixel size, steady state 
+		//batches then encode into memory that is already faulted in
+		vector<uchar> out_buf = Srl_buffer_pool::thread_local_pool().acquire();
 
 		try {
-			if (imencode(img_format_in.second, *m_mat_p, cv_outbuf, cv_params))
+			if (imencode(traits_p->extension, *m_mat_p, out_buf, cv_params))
+			{
+				//The encoded buffer is now the output, the pixels are only decoded 
+				//again if a later stage asks for them
+				store_encoded(out_buf, img_format_in);
+				m_mat_p = nullptr;
+				success = true;
+			}
+			else
 			{
-				//Sucessfully encoded the image into the new output buffer
-				//Should be able to just copy it into the member matrix without it 
-				//being deallocated.
-				*m_mat_p = imdecode(cv_outbuf, IMREAD_COLOR);
+				static const Srl_message_id not_encoded = intern_message("imencode could not write the image");
+				set_status(Srl_status(SRL_EXCEPT_OPENCV, not_encoded, SRL_SOURCE_OPENCV));
 			}
 		}
 		catch(cv::Exception &e)
 		{
-			m_exception_p.reset(new Srl_exception(e));
-			m_err_status = SRL_EXCEPT_OPENCV;
+			set_status(cv_status(e));
+		}
+
+		if (!success)
+		{
+			Srl_buffer_pool::thread_local_pool().release(std::move(out_buf));
 		}
 	}
 	else
 	{
-		m_err_status = SRL_ERROR_OTHER;
+		set_status(Srl_status(SRL_ERROR_OTHER));
+	}
+	return success;
+}
+
+///
+/// @brief sets the bit plane scrub applied before a lossless encode
+///
+void Srl_steg_image::set_lsb_scrub( unsigned int bit_planes, Srl_lsb_scrub_mode mode )
+{
+	m_lsb_planes = bit_planes;
+	m_lsb_mode = mode;
+	m_lsb_scrubbed = false;
+}
+
+///
+/// @brief scrubs the low bit planes of the held pixels with the set_lsb_scrub() settings
+///
+bool Srl_steg_image::scrub_lsb( void )
+{
+	if ( !m_lsb_scrubbed )
+	{
+		m_lsb_scrubbed = scrub_lsb( m_lsb_planes, m_lsb_mode );
+	}
+	return m_lsb_scrubbed;
+}
+
+///
+/// @brief scrubs the low bit planes of the held pixels
+///
+bool Srl_steg_image::scrub_lsb( unsigned int bit_planes, Srl_lsb_scrub_mode mode )
+{
+	if ( 0 == bit_planes )
+	{	//Nothing to scrub, so nothing to decode
+		return true;
+	}
+	if ( !decode_pixels() )
+	{
+		return false;
+	}
+
+	Srl_stage_timer timer( SRL_STAGE_SCRUB, m_format.first, m_backend );
+	if ( nullptr != m_mat_p.get() )
+	{
+		return lsb_scrub( *m_mat_p, bit_planes, mode, m_scrub_seed, m_tile_pool_p );
+	}
+	return ( nullptr != m_img_p.get() ) && scrub_magick_lsb( bit_planes, mode );
+}
+
+///
+/// @brief scrubs the low bit planes of the Magick held pixels through a cv::Mat copy
+///
+bool Srl_steg_image::scrub_magick_lsb( unsigned int bit_planes, Srl_lsb_scrub_mode mode )
+{
+	const size_t columns = m_img_p->columns();
+	const size_t rows = m_img_p->rows();
+	//Alpha goes through the kernels with the colour channels, as it does for an OpenCV held BGRA image
+	const bool alpha = m_img_p->alpha();
+	const char *map_p = alpha ? "BGRA" : "BGR";
+
+	try
+	{
+		cv::Mat pixels( static_cast<int>( rows ), static_cast<int>( columns ), alpha ? CV_8UC4 : CV_8UC3 );
+		m_img_p->write( 0, 0, columns, rows, map_p, Magick::CharPixel, pixels.data );
+		if ( !lsb_scrub( pixels, bit_planes, mode, m_scrub_seed, m_tile_pool_p ) )
+		{
+			return false;
+		}
+		//Replaces the pixels but keeps the image's options, the encode sets the format again anyway
+		m_img_p->read( columns, rows, map_p, Magick::CharPixel, pixels.data );
+	}
+	catch ( Magick::Exception &e )
+	{
+		set_status( Srl_status( SRL_EXCEPT_IMAGEMAGICK, SRL_NO_MESSAGE, SRL_SOURCE_MAGICK ).with_detail( e.what() ) );
+		return false;
+	}
+	return true;
+}
+
+///
+/// @brief sets the chroma quality of a DCT mode scrub
+///
+void Srl_steg_image::set_chroma_quality( int quality )
+{
+	m_chroma_quality = quality;
+}
+
+///
+/// @brief sets the down and up scale applied before an encode
+///
+void Srl_steg_image::set_resample_scrub( double scale )
+{
+	m_resample_scale = scale;
+	m_resampled = false;
+}
+
+///
+/// @brief resamples the held pixels with the set_resample_scrub() scale
+///
+bool Srl_steg_image::resample_scrub( void )
+{
+	if ( m_resample_scale >= 1.0 || m_resample_scale <= 0.0 || m_resampled )
+	{
+		return true;
+	}
+	if ( !decode_pixels() )
+	{
+		return false;
+	}
+
+	Srl_stage_timer timer( SRL_STAGE_SCRUB, m_format.first, m_backend );
+	if ( nullptr != m_mat_p.get() )
+	{
+		const cv::Size full( m_mat_p->cols, m_mat_p->rows );
+		const cv::Size reduced( std::max( 1, cvRound( full.width * m_resample_scale ) ),
+								std::max( 1, cvRound( full.height * m_resample_scale ) ) );
+		try
+		{	//Area averaging down so nothing is skipped, interpolated back up
+			cv::Mat small_mat;
+			tiled_resize( *m_mat_p, small_mat, reduced, INTER_AREA, m_tile_pool_p );
+			tiled_resize( small_mat, *m_mat_p, full, INTER_LINEAR, m_tile_pool_p );
+		}
+		catch ( cv::Exception &e )
+		{
+			set_status( cv_status( e ) );
+			return false;
+		}
+	}
+	else if ( nullptr != m_img_p.get() )
+	{
+		const size_t columns = m_img_p->columns();
+		const size_t rows = m_img_p->rows();
+		try
+		{
+			Magick::Geometry reduced( std::max<size_t>( 1, static_cast<size_t>( columns * m_resample_scale + 0.5 ) ),
+									  std::max<size_t>( 1, static_cast<size_t>( rows * m_resample_scale + 0.5 ) ) );
+			Magick::Geometry full( columns, rows );
+			reduced.aspect( true );
+			full.aspect( true );
+			m_img_p->resize( reduced );
+			m_img_p->resize( full );
+		}
+		catch ( Magick::Exception &e )
+		{
+			set_status( Srl_status( SRL_EXCEPT_IMAGEMAGICK, SRL_NO_MESSAGE, SRL_SOURCE_MAGICK ).with_detail( e.what() ) );
+			return false;
+		}
+	}
+	m_resampled = true;
+	return true;
+}
+
+///
+/// @brief sets the pool large images are tiled across
+///
+void Srl_steg_image::set_tile_pool( Srl_thread_pool *pool_p )
+{
+	m_tile_pool_p = pool_p;
+}
+
+///
+/// @brief true if the image is still held as a JPEG coefficient stream 
+///
+bool Srl_steg_image::is_dct_mode( void ) const
+{
+	return !m_jpeg_src.empty();
+}
+
+///
+/// @brief decodes the held JPEG stream so the pixel encode path can be used
+///
+bool Srl_steg_image::leave_dct_mode( void )
+{
+	if ( !decode_cv( m_jpeg_src ) )
+	{
+		return false;
+	}
+	m_jpeg_src = Srl_byte_view();
+	return true;
+}
+
+///
+/// @brief brings the pixels back from the encoded output, does nothing if they are already held
+///
+bool Srl_steg_image::decode_pixels( void )
+{
+	if ( has_pixels() )
+	{
+		return true;
+	}
+	else if ( !m_jpeg_src.empty() )
+	{
+		return leave_dct_mode();
+	}
+	else if ( m_encoded_buf.empty() )
+	{	//Construction failed, there is nothing to decode from
+		return false;
+	}
+
+	if ( SRL_BACKEND_MAGICK == m_backend )
+	{
+		return decode_magick( encoded_data() );
 	}
+	return decode_cv( encoded_data() );
 }
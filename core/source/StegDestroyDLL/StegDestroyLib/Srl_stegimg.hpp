@@ -22,12 +22,16 @@
 
 #include "Srl_steg_data_types.hpp"
 #include <opencv2\core\types_c.h>
+#include <cstdint>
 #include <utility>
 #include <string>
 #include <vector>
 #include <iostream>
 
 #include "Srl_stegimg_base.hpp"
+#include "Srl_lsb_scrub.hpp"
+#include "Srl_thread_pool.hpp"
+#include "Srl_status.hpp"
 
 
     ///
@@ -36,6 +40,8 @@
     ///
 namespace srl
 {
+	struct Srl_image_header;
+
     ///
     /// @brief   This is the core container for all image based steganography removal. it has the ability to hold 
     ///	data using the OpenCV  Matrix class or the Magick++ Image class to account for as many image formats as possible
@@ -59,19 +65,56 @@ namespace srl
         ///
         /// @param[in]	data_p		a pointer to the raw image data 
         /// @param[in]	img_format	a pair of enum to string created using get_format_pair()
+        /// @param[in]	scrub_mode	SRL_SCRUB_DCT keeps JPEG input in the coefficient domain, see Srl_jpgscrub_mode
         ///
         Srl_steg_image( unsigned char* img_data_p , 
 						size_t data_length, 
-						Srl_img_format_pair img_format );
+						Srl_img_format_pair img_format,
+						Srl_jpgscrub_mode scrub_mode = SRL_SCRUB_PIXEL );
+
+        ///
+        /// @brief	zero copy constructor which identifies the format from the image signature alone
+        ///
+        /// @param[in]	img_data	non owning view over the encoded image, see Srl_byte_view
+        /// @param[in]	scrub_mode	SRL_SCRUB_DCT keeps JPEG input in the coefficient domain, see Srl_jpgscrub_mode
+        ///
+        explicit Srl_steg_image( Srl_byte_view img_data,
+								 Srl_jpgscrub_mode scrub_mode = SRL_SCRUB_PIXEL );
 
         ///
-        /// @brief	Copy constructor for the steg image; 
+        /// @brief	zero copy constructor, decodes straight from the caller's memory
+        ///
+        /// @description	See Srl_byte_view for the lifetime contract: img_data must stay valid and 
+        ///					unmodified until this image is destroyed. The pointer constructor above 
+        ///					forwards to this one and is bound by the same contract.
+        ///
+        ///					The format is sniffed from the leading bytes and a single backend is chosen
+        ///					before decoding, img_format is only used when the signature isn't recognised.
+        ///
+        /// @param[in]	img_data	non owning view over the encoded image
+        /// @param[in]	img_format	a pair of enum to string created using get_format_pair()
+        /// @param[in]	scrub_mode	SRL_SCRUB_DCT keeps JPEG input in the coefficient domain, see Srl_jpgscrub_mode
+        /// @param[in]	header_p	what probe_image() already returned for img_data, checked against the
+        ///							decode limits in place of probing again. nullptr to probe here
+        ///
+        Srl_steg_image( Srl_byte_view img_data,
+						Srl_img_format_pair img_format,
+						Srl_jpgscrub_mode scrub_mode = SRL_SCRUB_PIXEL,
+						const Srl_image_header *header_p = nullptr );
+
         ///
-        /// @description    TODO/NOTE - MIGHT NOT BE NECESSARY BUT IS GOOD TO HAVE 
+        /// @brief	Move constructor and assignment. The pixels, encoded output and any DCT mode stream
+        ///			view are handed over without copying, the moved from image is left empty
         ///
-        /// @param[in]	    img_copy_r  a reference to the image to be copied
+        /// @description    Images are move only values so containers can hold them directly. A copy 
+        ///                 would mean a deep copy of the pixels, use encode() and construct a new image
+        ///                 from the output where a duplicate is really wanted
         ///
-        Srl_steg_image( Srl_steg_image& img_copy_r );
+        Srl_steg_image( Srl_steg_image &&other ) noexcept;
+        Srl_steg_image& operator=( Srl_steg_image &&other ) noexcept;
+
+        Srl_steg_image( const Srl_steg_image& ) = delete;
+        Srl_steg_image& operator=( const Srl_steg_image& ) = delete;
 
         ///
         /// @brief  destructor
@@ -90,9 +133,15 @@ namespace srl
         /// @brief  retrieves the string equivalent of the image format pair
         ///
         std::string format( void ) const;       
+
+        ///
+        /// @brief  retrieves the backend chosen for the image when it was constructed
+        ///
+        Srl_img_backend backend( void ) const;
             
         ///
-        /// @brief  retrieves the m_exception_p member to translate to a friendly error message by the handler
+        /// @brief  Srl_exception for the OpenCV or ImageMagick failure, nullptr for any other status. 
+        ///         Built from the status the first time it's asked for, prefer status() and diagnostic()
         ///
         std::shared_ptr<Srl_exception> exception( void );
 		
@@ -101,12 +150,65 @@ namespace srl
         ///
         Srl_exception_status exception_status( void );
 
+        ///
+        /// @brief  status of the last failed decode or encode with the backend's code and message id
+        ///
+        Srl_status status( void ) const;
+
+        ///
+        /// @brief  warning the backend raised on the last decode that still produced an image, ok() if none
+        ///
+        Srl_status warning( void ) const;
+
+        ///
+        /// @brief  readable description of status(), formatted on each call
+        ///
+        std::string diagnostic( void ) const;
+
         ///
         /// @brief  retrieves the pointer to the buffer containing the image data
         ///
-        /// @description    TODO
+        /// @description    The encoded output once encoded, otherwise the OpenCV pixels or the DCT mode
+        ///                 stream. nullptr for an unencoded Magick++ image, encode it first
         ///
         const void* get_img_data( void ) const;
+
+        ///
+        /// @brief  retrieves a view over the output of the last successful encode, empty before then
+        ///
+        /// @description    The view is invalidated by the next encode or by destroying the image
+        ///
+        Srl_byte_view encoded_data( void ) const;
+
+        ///
+        /// @brief  Takes the encoded output without copying it. The caller's buffer is swapped in and
+        ///         reused by the next encode, so a caller writing images out can recycle one buffer
+        ///
+        /// @description    The image is left with no encoded output. A DCT mode image whose stream lived in
+        ///                 the encoded buffer is left with no data at all
+        ///
+        void swap_encoded_buffer( std::vector<uchar> &buffer );
+
+        ///
+        /// @brief  Forgets the bytes the image was constructed from, call it before freeing them. The
+        ///         base class data() view is cleared, as is a DCT mode stream that still reads them
+        ///
+        void detach_source( void );
+
+        ///
+        /// @brief  retrieves the format of the last successful encode, INVALID_IMG_FORMAT_PAIR before then
+        ///
+        Srl_img_format_pair encoded_format( void ) const;
+
+        ///
+        /// @brief  true if decoded pixels are currently held, false once encoded until decode_pixels()
+        ///
+        bool has_pixels( void ) const;
+
+        ///
+        /// @brief  bytes held by the image itself: decoded pixels and encoded output, not the caller's input
+        ///
+        size_t memory_footprint( void ) const;
         
 
         /*************************************************************************
@@ -119,20 +221,91 @@ namespace srl
         ///
         ///	@brief	m_mat_p		Matrix used to store any OpenCV compliant image files for cleaning
         ///
-        std::shared_ptr<cv::Mat> m_mat_p;
+        std::unique_ptr<cv::Mat> m_mat_p;
 
         ///
         ///	@brief	m_img_p		Image class used to store any ImageMagick compliant image files that OpenCV couldn't handle
         ///
-        std::shared_ptr<Magick::Image> m_img_p;
+        std::unique_ptr<Magick::Image> m_img_p;
+
+        ///
+        ///	@brief	m_backend	backend picked from the sniffed format before decoding
+        ///
+        Srl_img_backend m_backend;
+
+        ///
+        ///	@brief	m_jpeg_src	JPEG stream of an image held in SRL_SCRUB_DCT mode. Views the caller's memory 
+        ///						until the first encode, then m_encoded_buf. Empty for every other image
+        ///
+        Srl_byte_view m_jpeg_src;
+
+        ///
+        ///	@brief	m_encoded_buf	output of the last successful encode. This is the image's primary data once
+        ///							encoded, the pixel members are released and only decoded again on request
+        ///
+        std::vector<uchar> m_encoded_buf;
+
+        ///
+        ///	@brief	m_encoded_format	format m_encoded_buf is encoded in
+        ///
+        Srl_img_format_pair m_encoded_format;
+
+        ///
+        ///	@brief	m_scrub_seed	Srl_counter_rng seed for the coefficient and bit plane noise, derived from the 
+        ///							input so the same image always scrubs to the same output on any thread count
+        ///
+        uint64_t m_scrub_seed;
+
+        ///
+        ///	@brief	m_lsb_planes	number of low bit planes scrubbed before a lossless encode
+        ///
+        unsigned int m_lsb_planes;
+
+        ///
+        ///	@brief	m_lsb_mode	whether those planes are cleared or randomised
+        ///
+        Srl_lsb_scrub_mode m_lsb_mode;
+
+        ///
+        ///	@brief	m_lsb_scrubbed	true once the held pixels have had the set_lsb_scrub() scrub applied, so a
+        ///							pipeline scrub stage and the encode don't both do it
+        ///
+        bool m_lsb_scrubbed;
+
+        ///
+        ///	@brief	m_chroma_quality	IJG quality the chroma tables of a DCT mode scrub are set to, 0 to use the
+        ///								compression level passed to encode() as the luma tables do
+        ///
+        int m_chroma_quality;
+
+        ///
+        ///	@brief	m_resample_scale	factor the pixels are scaled down by and back up from before encoding,
+        ///								1.0 to leave them be
+        ///
+        double m_resample_scale;
+
+        ///
+        ///	@brief	m_resampled	true once the held pixels have been resampled, reset by every decode
+        ///
+        bool m_resampled;
+
+        ///
+        ///	@brief	m_tile_pool_p	pool large images split their pixel stages across, not owned, may be nullptr
+        ///
+        Srl_thread_pool *m_tile_pool_p;
         
         ///
-        ///	@brief	m_err_status	contains the current error status or NONE if there were no problems 
+        ///	@brief	m_status	contains the current error status or NONE if there were no problems 
         ///
-        Srl_exception_status m_err_status;
+        Srl_status m_status;
 
         ///
-        /// @brief	m_exception_p	pointer to the exception raised during processing if any, otherwise Nullptr
+        ///	@brief	m_warning	warning raised by a decode that succeeded anyway, see warning()
+        ///
+        Srl_status m_warning;
+
+        ///
+        /// @brief	m_exception_p	exception() built from m_status, nullptr until then
         ///
         std::shared_ptr<Srl_exception> m_exception_p;
 
@@ -152,12 +325,128 @@ namespace srl
         ///
         /// @brief	Overridden base class Function to encode the image data into the provided format. Returns true if it succeeded without error
         ///
+        /// @description	The encoded bytes are kept as the image's output, see encoded_data(). The pixels are
+        ///					released on success rather than decoded back from the output
+        ///
         /// @param[in]	img_format_in	image format to encode to 
         ///
         /// @return bool    true if img format was successfully encoded or false if an error occurred
         ///
         bool encode(	Srl_img_format_pair img_format_in, 
 						Srl_jpgscrub_compression_level compression_lvl = SRL_COMPRESSION_DEFAULT);
+
+        ///
+        /// @brief	Srl_steg_image_base override, encodes to the format named by format (e.g. ".png") at the
+        ///			default compression level
+        ///
+        bool encode( std::string format ) override;
+
+        ///
+        /// @brief	Srl_steg_image_base override, the base exception member. Use exception() for the 
+        ///			OpenCV or ImageMagick detail
+        ///
+        std::shared_ptr<Srl_exception_base> error( void ) override;
+
+        ///
+        /// @brief	true if the image is being held as a JPEG coefficient stream rather than pixels
+        ///
+        bool is_dct_mode( void ) const;
+
+        ///
+        /// @brief	Decodes the encoded output (or DCT mode stream) back to pixels for stages that need
+        ///			them. Encode no longer does this itself, it saves a full decode per image when the
+        ///			encoded output is all the caller wants
+        ///
+        /// @return	bool	true if pixels are held on return
+        ///
+        bool decode_pixels( void );
+
+        ///
+        /// @brief	Sets the bit plane scrub encode applies before writing a lossless format. Defaults to
+        ///			randomising SRL_LSB_DEFAULT_PLANES planes, 0 planes turns it off
+        ///
+        void set_lsb_scrub( unsigned int bit_planes, Srl_lsb_scrub_mode mode );
+
+        ///
+        /// @brief	Scrubs the low bit planes of the pixels now, decoding them first if needed
+        ///
+        /// @return	bool	false if the pixels aren't 8 bit or couldn't be copied out of and back into
+        ///					Magick++. Always true for 0 planes
+        ///
+        bool scrub_lsb( unsigned int bit_planes, Srl_lsb_scrub_mode mode );
+
+        ///
+        /// @brief	As above with the set_lsb_scrub() settings. Does nothing if the held pixels have
+        ///			already been scrubbed this way
+        ///
+        bool scrub_lsb( void );
+
+        ///
+        /// @brief	Sets the IJG quality the chroma quant tables are requantized to by a DCT mode scrub,
+        ///			coarser chroma costs less visually than coarser luma. 0 (the default) uses the
+        ///			compression level given to encode(). The pixel path encodes through cv::imencode,
+        ///			which takes a single quality, and ignores it
+        ///
+        void set_chroma_quality( int quality );
+
+        ///
+        /// @brief	Sets a resampling scrub encode applies before writing any format: the pixels are
+        ///			scaled down by scale and back up to their own size, which smears every bit plane and
+        ///			coefficient payload across neighbouring pixels. 1.0 (the default) turns it off. A
+        ///			DCT mode image is decoded to pixels first. Large images are scaled back up with
+        ///			tiled_resize(), an approximation of cv::resize
+        ///
+        void set_resample_scrub( double scale );
+
+        ///
+        /// @brief	Resamples the pixels now with the set_resample_scrub() scale, decoding them first if
+        ///			needed. Does nothing if it is off or the held pixels were already resampled
+        ///
+        /// @return	bool	false if the pixels couldn't be decoded or resized
+        ///
+        bool resample_scrub( void );
+
+        ///
+        /// @brief	Sets the pool the pixel stages of a large image are split across, nullptr (the default)
+        ///			keeps them on the calling thread. The pool must outlive any use of the image
+        ///
+        void set_tile_pool( Srl_thread_pool *pool_p );
+
+    private:
+
+        ///
+        /// @brief	Decodes img_data into m_img_p, setting the error members on failure
+        ///
+        bool decode_magick( Srl_byte_view img_data );
+
+        ///
+        /// @brief	Scrubs the low bit planes of m_img_p by copying its pixels out to a cv::Mat, alpha
+        ///			included, and back, setting the error members on failure
+        ///
+        bool scrub_magick_lsb( unsigned int bit_planes, Srl_lsb_scrub_mode mode );
+
+        ///
+        /// @brief	Makes the contents of out_buf the encoded output, copied out if out_buf has far more
+        ///			capacity than it uses. out_buf and the previous output buffer are released to the
+        ///			calling thread's buffer pool, the caller mustn't use out_buf afterwards
+        ///
+        void store_encoded( std::vector<uchar> &out_buf, Srl_img_format_pair img_format );
+
+        ///
+        /// @brief	Decodes img_data into m_mat_p, setting the error members on failure
+        ///
+        bool decode_cv( Srl_byte_view img_data );
+
+        ///
+        /// @brief	Decodes m_jpeg_src to m_mat_p and leaves DCT mode, used when a DCT mode image is 
+        ///			asked for a non JPEG format
+        ///
+        bool leave_dct_mode( void );
+
+        ///
+        /// @brief	Records a failure, any exception() built for the previous status is dropped
+        ///
+        void set_status( const Srl_status &status );
     };
 }
 
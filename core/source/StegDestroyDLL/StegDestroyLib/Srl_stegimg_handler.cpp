@@ -13,25 +13,52 @@
 
 #include "Srl_stegimg_handler.hpp"
 #include "Srl_steg_data_types.hpp"
+#include "Srl_batch_arena.hpp"
+#include "Srl_trace.hpp"
+
+#include <algorithm>
 
 using namespace srl;
 using namespace std;
 
-typedef std::vector<shared_ptr<Srl_steg_image>>::iterator image_iterator;
+typedef std::vector<Srl_steg_image>::iterator image_iterator;
 
 Srl_stegimg_handler_base::Srl_stegimg_handler_base(std::shared_ptr<steg_logger> logger)
 	: m_logger(logger)
 {
 }
 
-Srl_jpgscrub_stegimg_handler::Srl_jpgscrub_stegimg_handler(std::vector<std::shared_ptr<Srl_steg_image> >& img_data_v)
-	: Srl_stegimg_handler_base(m_logger)
+Srl_jpgscrub_stegimg_handler::Srl_jpgscrub_stegimg_handler(std::vector<Srl_steg_image>& img_data_v,
+														   unsigned int thread_count)
+	: Srl_jpgscrub_stegimg_handler(img_data_v, default_thread_budget(thread_count))
+{
+}
+
+Srl_jpgscrub_stegimg_handler::Srl_jpgscrub_stegimg_handler(unsigned int thread_count)
+	: Srl_jpgscrub_stegimg_handler(default_thread_budget(thread_count))
+{
+}
+
+Srl_jpgscrub_stegimg_handler::Srl_jpgscrub_stegimg_handler(std::vector<Srl_steg_image>& img_data_v,
+														   const Srl_thread_budget &budget)
+	: Srl_jpgscrub_stegimg_handler(budget)
 {
-	//Swap ownership to our own image vector member 
+	//Take the images themselves, moving the vector moves no pixels
 	m_images_v = std::move(img_data_v);
+	img_data_v.clear();
+}
+
+Srl_jpgscrub_stegimg_handler::Srl_jpgscrub_stegimg_handler(const Srl_thread_budget &budget)
+	: Srl_stegimg_handler_base(m_logger),
+	  m_pool_p(new Srl_thread_pool(budget.outer_threads)),
+	  m_budget(budget)
+{
+	//The pool resolves 0 to the hardware thread count
+	m_budget.outer_threads = m_pool_p->thread_count();
 
 	//Set to default for testing, will be extended to use values [0-100; +=10]
 	m_compression_level = SRL_COMPRESSION_DEFAULT;
+	m_scrub_mode = SRL_SCRUB_PIXEL;
 }
 
 Srl_jpgscrub_stegimg_handler::~Srl_jpgscrub_stegimg_handler()
@@ -39,13 +66,93 @@ Srl_jpgscrub_stegimg_handler::~Srl_jpgscrub_stegimg_handler()
 	//Handled by smart pointers
 }
 
-vector<shared_ptr<Srl_steg_image>> srl::Srl_jpgscrub_stegimg_handler::get_images()
+vector<Srl_steg_image>& srl::Srl_jpgscrub_stegimg_handler::get_images()
 {
 	return m_images_v;
 }
 
+const vector<size_t>& srl::Srl_jpgscrub_stegimg_handler::get_err_indices() const
+{
+	return m_err_indices_v;
+}
+
+vector<Srl_steg_image*> srl::Srl_jpgscrub_stegimg_handler::get_err_images()
+{
+	vector<Srl_steg_image*> err_images;
+	err_images.reserve(m_err_indices_v.size());
+	for (size_t i = 0; i < m_err_indices_v.size(); i++)
+	{
+		err_images.push_back(&m_images_v[m_err_indices_v[i]]);
+	}
+	return err_images;
+}
+
+unsigned int Srl_jpgscrub_stegimg_handler::thread_count(void) const
+{
+	return m_pool_p->thread_count();
+}
+
+const Srl_thread_budget& Srl_jpgscrub_stegimg_handler::thread_budget(void) const
+{
+	return m_budget;
+}
+
+void Srl_jpgscrub_stegimg_handler::set_thread_budget(const Srl_thread_budget &budget)
+{
+	m_budget.opencv_threads = budget.opencv_threads;
+	m_budget.magick_threads = budget.magick_threads;
+}
+
+void Srl_jpgscrub_stegimg_handler::set_compression_level(Srl_jpgscrub_compression_level compression_lvl)
+{
+	m_compression_level = compression_lvl;
+}
+
+Srl_jpgscrub_compression_level Srl_jpgscrub_stegimg_handler::compression_level(void) const
+{
+	return m_compression_level;
+}
+
+void Srl_jpgscrub_stegimg_handler::set_scrub_mode(Srl_jpgscrub_mode scrub_mode)
+{
+	m_scrub_mode = scrub_mode;
+}
+
+Srl_jpgscrub_mode Srl_jpgscrub_stegimg_handler::scrub_mode(void) const
+{
+	return m_scrub_mode;
+}
+
+void Srl_jpgscrub_stegimg_handler::set_memory_budget(uint64_t ceiling_bytes)
+{
+	//A running session keeps the budget it was opened with
+	m_memory_budget_p = make_shared<Srl_memory_budget>(ceiling_bytes);
+}
+
+shared_ptr<Srl_memory_budget> Srl_jpgscrub_stegimg_handler::memory_budget(void) const
+{
+	return m_memory_budget_p;
+}
+
+void Srl_jpgscrub_stegimg_handler::set_logger(shared_ptr<steg_logger> logger_p)
+{
+	m_logger_p = logger_p;
+}
+
+Srl_latency_snapshot Srl_jpgscrub_stegimg_handler::latency_snapshot(void) const
+{
+	return Srl_latency_recorder::instance().snapshot();
+}
+
+void Srl_jpgscrub_stegimg_handler::reset_latency(void)
+{
+	Srl_latency_recorder::instance().reset();
+}
+
 void Srl_jpgscrub_stegimg_handler::mat_to_magick(cv::Mat &cv_mat, Magick::Image &magick_img)
 {
+	Srl_trace_span span("mat_to_magick");
+
 	//Construct an Magick Image using the array style conversion
 	// (Columns, Rows, Colour mapping, Storage Type, and pointer to the data)
 	magick_img = Magick::Image(cv_mat.cols, cv_mat.rows, "BGR", Magick::CharPixel, cv_mat.data);
@@ -53,6 +160,8 @@ void Srl_jpgscrub_stegimg_handler::mat_to_magick(cv::Mat &cv_mat, Magick::Image
 
 void Srl_jpgscrub_stegimg_handler::magick_to_mat(Magick::Image &magick_img, cv::Mat &cv_mat)
 {
+	Srl_trace_span span("magick_to_mat");
+
 	//Write the contents of the Magick Image to the cv_mat data member
 	// (x, y, columsn, rows, colour mapping, storage type, pointer to data )
 	magick_img.write(0, 0, magick_img.columns(), magick_img.rows(), "BGR", Magick::CharPixel, cv_mat.data);
@@ -60,37 +169,110 @@ void Srl_jpgscrub_stegimg_handler::magick_to_mat(Magick::Image &magick_img, cv::
 
 Srl_exception_status Srl_jpgscrub_stegimg_handler::encode_all_to_format(Srl_img_format_pair img_format)
 {
+	return encode_all(img_format, false, true);
+}
+
+Srl_exception_status srl::Srl_jpgscrub_stegimg_handler::encode_all_to_original_format()
+{
+	return encode_all(INVALID_IMG_FORMAT_PAIR, true, false);
+}
+
+Srl_exception_status Srl_jpgscrub_stegimg_handler::scrub_stream(const Srl_pipeline_source &source,
+																 const Srl_pipeline_sink &sink,
+																 Srl_img_format_pair img_format,
+																 size_t queue_depth)
+{
+	Srl_trace_span span("scrub_stream", img_format.first);
+	const bool use_original = (SRL_IMG_FORMAT_NONE == img_format.first);
+	Srl_budget_lease lease(m_budget);
+
+	//The pipeline's stage threads add up to the pool's thread count, so the lease above counts
+	//them. The pool's workers sit idle but for the tiles of any outlier sized images, and the
+	//stage thread waiting on those tiles sleeps rather than spins
+	Srl_scrub_pipeline pipeline(img_format, use_original, m_pool_p->thread_count(), queue_depth, m_compression_level,
+								m_scrub_mode, m_pool_p.get(), m_memory_budget_p);
+	return pipeline.run(source, sink);
+}
+
+unique_ptr<Srl_scrub_session> Srl_jpgscrub_stegimg_handler::open_session(Srl_img_format_pair img_format, size_t queue_depth)
+{
+	const bool use_original = (SRL_IMG_FORMAT_NONE == img_format.first);
+	unique_ptr<Srl_scrub_session> session_p(
+		new Srl_scrub_session(img_format, use_original, m_pool_p->thread_count(), queue_depth, m_compression_level,
+							  m_scrub_mode, m_pool_p.get(), m_memory_budget_p));
+	session_p->hold_thread_budget(Srl_budget_lease(m_budget));
+	return session_p;
+}
+
+Srl_exception_status Srl_jpgscrub_stegimg_handler::encode_all(const Srl_img_format_pair &img_format, bool use_original, bool log_errors)
+{
+	Srl_trace_span span("encode_all", img_format.first);
 	Srl_exception_status status = SRL_EXCEPT_NONE;
+	m_err_indices_v.clear();
+
+	//Keeps OpenCV and ImageMagick from each spawning a thread per core under every worker
+	Srl_budget_lease lease(m_budget);
+
+	//One flag per image, each written only by the body for its own index, so no lock is needed
+	//while encoding however the pool spreads the bodies across threads
+	vector<unsigned char> failed_flags(m_images_v.size(), 0);
 
-	for (image_iterator iter = m_images_v.begin(); iter != m_images_v.end(); ++iter)
+	m_pool_p->parallel_for(0, m_images_v.size(), [&](size_t index)
 	{
-		if (!(*iter)->encode(img_format, m_compression_level))
+		Srl_steg_image &image = m_images_v[index];
+		const Srl_img_format_pair &target = use_original ? image.m_format : img_format;
+
+		//The gap between one image span and the next on a worker is time spent finding work
+		Srl_trace_image_scope trace_image(static_cast<int64_t>(index));
+		Srl_trace_span image_span("image", image.m_format.first);
+
+		//An outlier sized image spreads its pixel stages over the same pool
+		image.set_tile_pool(m_pool_p.get());
+
+		//Scratch Mats and Magick blobs come out of the worker's arena and go in one step
+		Srl_arena_scope arena_scope;
+
+		if (!image.encode(target, m_compression_level))
 		{
 			//Error occured during encoding 
-			status = (*iter)->exception_status();
-			string err_string;
-			(*iter)->exception()->get_basic_except_info(err_string);
-			m_logger_p->add_logfile_detail(err_string);
-			m_err_images_v.push_back((*iter));
+			failed_flags[index] = 1;
 		}
-	}
-	//Let the caller know that an error occurred on at least one image and 
-	//the caller can handle the Error images as desired
-	return status;
-}
+	});
 
-Srl_exception_status srl::Srl_jpgscrub_stegimg_handler::encode_all_to_original_format()
-{
-	Srl_exception_status status = SRL_EXCEPT_NONE;
+	//In the same order as m_images_v regardless of which thread hit them
+	vector<size_t> failed;
+	for (size_t index = 0; index < failed_flags.size(); index++)
+	{
+		if (0 != failed_flags[index])
+		{
+			failed.push_back(index);
+		}
+	}
 
-	for (image_iterator iter = m_images_v.begin(); iter != m_images_v.end(); ++iter)
+	for (size_t i = 0; i < failed.size(); i++)
 	{
-		if (!(*iter)->encode( (*iter)->m_format , m_compression_level))
+		Srl_steg_image &image = m_images_v[failed[i]];
+		status = image.exception_status();
+
+		if (log_errors && nullptr != m_logger_p)
+		{	//Queued as the status, the logger's flusher builds the text
+			m_logger_p->add_logfile_detail(image.status());
+		}
+	}
+	m_err_indices_v = std::move(failed);
+
+	if (log_errors && nullptr != m_logger_p)
+	{	//Coder warnings don't fail an image but are worth a line, a run of them points at a bad source
+		for (size_t i = 0; i < m_images_v.size(); i++)
 		{
-			//Error occured during encoding 
-			status = (*iter)->exception_status();
-			m_err_images_v.push_back((*iter));
+			if (!m_images_v[i].warning().ok())
+			{
+				m_logger_p->add_logfile_detail(m_images_v[i].warning());
+			}
 		}
 	}
+
+	//Let the caller know that an error occurred on at least one image and 
+	//the caller can handle the Error images as desired
 	return status;
 }
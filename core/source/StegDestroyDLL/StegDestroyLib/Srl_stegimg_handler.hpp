@@ -18,9 +18,15 @@
 #define _SRL_STEGIMG_HANDLER_HPP
 
 #include <vector>
+#include <memory>
 #include "Srl_stegimg.hpp"
 #include "Srl_steg_logger.hpp"
 #include "Srl_stegimg_handler_base.hpp"
+#include "Srl_thread_pool.hpp"
+#include "Srl_scrub_pipeline.hpp"
+#include "Srl_scrub_session.hpp"
+#include "Srl_thread_budget.hpp"
+#include "Srl_latency_histogram.hpp"
 
 namespace srl
 {
@@ -37,11 +43,31 @@ namespace srl
 		/// @brief	default constructor for the steg image handler, takes Srl_stegimg wrapped images
 		///
 		/// @description	Using this constructor means the user has already called the img helper
-		///					functions to determine whether the img format is supported and wrapped 
-		///					each into it's own shared_ptr to an Srl_steg_image and added to a vector.
-		///					It is done like this to make use of the efficiency of the std::move operator
+		///					functions to determine whether the img format is supported and constructed
+		///					each Srl_steg_image into a vector. The images are moved into the handler,
+		///					img_data_v is left empty
 		///
-		Srl_jpgscrub_stegimg_handler( std::vector<std::shared_ptr<Srl_steg_image> > &img_data_v );
+		/// @param[in]	thread_count	number of worker threads used by the encode_all functions,
+		///								0 uses one per hardware thread
+		///
+		Srl_jpgscrub_stegimg_handler( std::vector<Srl_steg_image> &img_data_v,
+									  unsigned int thread_count = 0 );
+
+		///
+		/// @brief	constructs a handler with no images of its own, for use with scrub_stream()
+		///
+		explicit Srl_jpgscrub_stegimg_handler( unsigned int thread_count );
+
+		///
+		/// @brief	as the constructors above with the thread split given explicitly
+		///
+		/// @param[in]	budget	outer_threads sizes the worker pool (0 for one per hardware thread), the
+		///						OpenCV and ImageMagick limits are applied while the handler is working
+		///
+		Srl_jpgscrub_stegimg_handler( std::vector<Srl_steg_image> &img_data_v,
+									  const Srl_thread_budget &budget );
+
+		explicit Srl_jpgscrub_stegimg_handler( const Srl_thread_budget &budget );
 
 		~Srl_jpgscrub_stegimg_handler();
 
@@ -56,11 +82,84 @@ namespace srl
 		///
 		/// @brief  Retrieve vector of all images
 		///
-		/// @note	if calling this method prior to destruction of the img_handler the user must 
-		///			transfer ownership using the std::move() function, or else the images will go 
-		///			out of scope. 
+		/// @note	the images are owned by the handler and go with it. To keep them past the handler
+		///			take them with std::move( handler.get_images() ), which leaves the handler empty
+		///
+		std::vector<Srl_steg_image>& get_images();
+
+		///
+		/// @brief  Indices into get_images() of the images which failed during the last encode_all call,
+		///			in ascending order
+		///
+		const std::vector<size_t>& get_err_indices() const;
+
+		///
+		/// @brief  The images which failed during the last encode_all call, in the same relative order as
+		///			they appear in get_images(). The pointers are only valid until get_images() changes
+		///
+		std::vector<Srl_steg_image*> get_err_images();
+
+		///
+		/// @brief  number of worker threads used by the encode_all functions
+		///
+		unsigned int thread_count( void ) const;
+
+		///
+		/// @brief  thread split between the worker pool, OpenCV and ImageMagick
+		///
+		const Srl_thread_budget& thread_budget( void ) const;
+
+		///
+		/// @brief  changes the OpenCV and ImageMagick limits used by later calls. outer_threads is
+		///			ignored, the pool keeps the size it was constructed with
+		///
+		void set_thread_budget( const Srl_thread_budget &budget );
+
+		///
+		/// @brief  quality lossy targets are encoded at by later calls, SRL_COMPRESSION_DEFAULT until set.
+		///			Any value from 0 to 100 is accepted, not just the named levels
+		///
+		void set_compression_level( Srl_jpgscrub_compression_level compression_lvl );
+		Srl_jpgscrub_compression_level compression_level( void ) const;
+
+		///
+		/// @brief  how JPEG images are scrubbed by later scrub_stream() calls and sessions opened after
+		///			this call, SRL_SCRUB_PIXEL until set. Images given to the constructor keep the mode
+		///			they were constructed with
+		///
+		void set_scrub_mode( Srl_jpgscrub_mode scrub_mode );
+		Srl_jpgscrub_mode scrub_mode( void ) const;
+
+		///
+		/// @brief  Caps the bytes held by every image in flight across scrub_stream() and the sessions
+		///			opened after this call, which all share the one budget. SRL_BUDGET_UNLIMITED only
+		///			counts them. An image whose estimated working set is over the ceiling on its own
+		///			fails with SRL_ERROR_MEMORY_BUDGET
+		///
+		void set_memory_budget( uint64_t ceiling_bytes );
+
+		///
+		/// @brief  the budget set by set_memory_budget(), nullptr before then
+		///
+		std::shared_ptr<Srl_memory_budget> memory_budget( void ) const;
+
+		///
+		/// @brief  Sets the logger encode_all_to_format() reports each failed image to, nullptr (the
+		///			default) for none. Only the failure's status is queued, the logger formats it
 		///
-		vector< shared_ptr<Srl_steg_image> > get_images();
+		void set_logger( std::shared_ptr<steg_logger> logger_p );
+
+		///
+		/// @brief  Latency of every ingest, sniff, decode, scrub, encode and emit so far, merged from each
+		///			thread's histograms and keyed by stage, format and backend. The histograms are process
+		///			wide, so images of every handler and session are in it
+		///
+		Srl_latency_snapshot latency_snapshot( void ) const;
+
+		///
+		/// @brief  Empties the latency histograms, e.g. to leave warm up out of the percentiles
+		///
+		void reset_latency( void );
 		
 		/*************************************************************************
 		*
@@ -79,21 +178,42 @@ namespace srl
 		Srl_jpgscrub_compression_level m_compression_level;
 
 		///
-		///	@brief	m_images_p		Vector containing shared_ptrs to all images, element indices for the vector
+		///	@brief	m_scrub_mode	mode the streaming paths construct their images with
+		///
+		Srl_jpgscrub_mode m_scrub_mode;
+
+		///
+		///	@brief	m_images_v		Vector holding all images by value, element indices for the vector
 		///							passed to the constructor remain the same throughout the program.
 		///
-		std::vector< shared_ptr<Srl_steg_image> > m_images_v;
+		std::vector<Srl_steg_image> m_images_v;
 
 		///
-		///	@brief	m_err_images_p	Vector containing shared_ptrs to only the images that encountered errors during
+		///	@brief	m_err_indices_v	Indices into m_images_v of only the images that encountered errors during
 		///							the processing or encoding of the images themselves. Read/Write errors are likely
 		///							the cause of an external reason so would not be included for example. 
 		///
-		std::vector< shared_ptr<Srl_steg_image> > m_err_images_v;
+		std::vector<size_t> m_err_indices_v;
 
 
 		std::shared_ptr<steg_logger> m_logger_p;
 
+		///
+		///	@brief	m_pool_p	Worker pool the encode_all functions spread the images across
+		///
+		std::unique_ptr<Srl_thread_pool> m_pool_p;
+
+		///
+		///	@brief	m_budget	thread split leased from Srl_thread_budget_controller while the handler,
+		///						or a session it opened, is working
+		///
+		Srl_thread_budget m_budget;
+
+		///
+		///	@brief	m_memory_budget_p	byte budget the streaming paths admit images against, nullptr for none
+		///
+		std::shared_ptr<Srl_memory_budget> m_memory_budget_p;
+
 		/*************************************************************************
 		*
 		*					            Methods
@@ -148,6 +268,55 @@ namespace srl
 		/// @return		Srl_exception_status	SRL_EXCEPT_NONE if all images were encoded without major errors
 		///
 		Srl_exception_status encode_all_to_original_format(void);
+
+		///
+		/// @brief	Scrubs a stream of encoded images without holding the whole batch in memory
+		///
+		/// @description	Images are pulled from source as they are needed and run through the decode,
+		///					scrub and encode stages of an Srl_scrub_pipeline. Each finished image is given
+		///					to sink on the calling thread and released as soon as sink returns, so peak
+		///					memory depends on queue_depth and the thread count rather than the batch size.
+		///					The handler's own image vector is not touched.
+		///
+		/// @param[in]	img_format		image format to encode to, INVALID_IMG_FORMAT_PAIR to encode each
+		///								image back to its original format
+		///
+		/// @param[in]	queue_depth		capacity of each queue between the stages
+		///
+		/// @return		Srl_exception_status	SRL_EXCEPT_NONE if all images were encoded without major errors
+		///
+		Srl_exception_status scrub_stream( const Srl_pipeline_source &source,
+										   const Srl_pipeline_sink &sink,
+										   Srl_img_format_pair img_format,
+										   size_t queue_depth = SRL_PIPELINE_DEFAULT_DEPTH );
+
+		///
+		/// @brief	Opens a session images can be submitted to one at a time as they arrive
+		///
+		/// @description	The session uses the handler's thread count, compression level and scrub mode and runs
+		///					until it is finished or destroyed, holding the handler's thread budget until then.
+		///					It tiles large images over the handler's pool, so the handler must outlive it
+		///
+		/// @param[in]	img_format		image format to encode to, INVALID_IMG_FORMAT_PAIR to encode each
+		///								image back to its original format
+		///
+		std::unique_ptr<Srl_scrub_session> open_session( Srl_img_format_pair img_format,
+														 size_t queue_depth = SRL_PIPELINE_DEFAULT_DEPTH );
+
+	private:
+
+		///
+		/// @brief	Shared implementation of the encode_all functions. Each image is encoded on the worker
+		///			pool, failures are gathered per worker and merged into m_err_indices_v in index order
+		///			once every image has finished
+		///
+		/// @param[in]	img_format		format to encode to, ignored if use_original is true
+		///
+		/// @param[in]	use_original	encode each image back to its own m_format
+		///
+		/// @param[in]	log_errors		add the basic exception info of each failure, and any decode warning, to the logger
+		///
+		Srl_exception_status encode_all(const Srl_img_format_pair &img_format, bool use_original, bool log_errors);
 	};
 
 }
@@ -0,0 +1,195 @@
+//------------------------------------------------------------------------------------
+///
+/// @file   Srl_thread_budget.cpp
+///
+/// @brief Shares the machine's threads between the library's own workers, OpenCV and
+///        ImageMagick
+///
+//------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+
+#include "Srl_thread_budget.hpp"
+#include "Srl_trace.hpp"
+
+#include <algorithm>
+#include <thread>
+
+#include <opencv2\core.hpp>
+#include <Magick++.h>
+
+using namespace srl;
+using namespace std;
+
+namespace
+{
+	unsigned int hardware_threads( void )
+	{
+		return std::max(1u, std::thread::hardware_concurrency());
+	}
+}
+
+namespace srl
+{
+	Srl_thread_budget default_thread_budget( unsigned int outer_threads )
+	{
+		const unsigned int hardware = hardware_threads();
+
+		Srl_thread_budget budget;
+		budget.outer_threads = (0 == outer_threads) ? hardware : outer_threads;
+		budget.opencv_threads = std::max(1u, hardware / budget.outer_threads);
+		budget.magick_threads = budget.opencv_threads;
+		return budget;
+	}
+}
+
+/***************************************************
+*
+*					CTOR & DTOR
+*
+****************************************************/
+
+Srl_thread_budget_controller& Srl_thread_budget_controller::instance( void )
+{
+	static Srl_thread_budget_controller controller;
+	return controller;
+}
+
+Srl_thread_budget_controller::Srl_thread_budget_controller( void )
+	:	m_leases(0),
+		m_outer_active(0),
+		m_opencv_applied(0),
+		m_magick_applied(0),
+		m_opencv_saved(0),
+		m_magick_saved(0)
+{
+}
+
+/***************************************************
+*
+*					Leases
+*
+****************************************************/
+
+void Srl_thread_budget_controller::acquire( const Srl_thread_budget &budget )
+{
+	lock_guard<mutex> lock(m_lock);
+
+	if (0 == m_leases)
+	{
+		m_opencv_saved = cv::getNumThreads();
+		m_magick_saved = static_cast<unsigned long long>(Magick::ResourceLimits::thread());
+	}
+
+	m_leases++;
+	m_outer_active += std::max(1u, budget.outer_threads);
+	m_opencv_limits.insert(std::max(1u, budget.opencv_threads));
+	m_magick_limits.insert(std::max(1u, budget.magick_threads));
+	apply();
+}
+
+void Srl_thread_budget_controller::release( const Srl_thread_budget &budget )
+{
+	lock_guard<mutex> lock(m_lock);
+
+	m_leases--;
+	m_outer_active -= std::max(1u, budget.outer_threads);
+	m_opencv_limits.erase(m_opencv_limits.find(std::max(1u, budget.opencv_threads)));
+	m_magick_limits.erase(m_magick_limits.find(std::max(1u, budget.magick_threads)));
+
+	if (0 == m_leases)
+	{
+		cv::setNumThreads(m_opencv_saved);
+		Magick::ResourceLimits::thread(static_cast<MagickCore::MagickSizeType>(m_magick_saved));
+		m_opencv_applied = 0;
+		m_magick_applied = 0;
+		Srl_trace_recorder::instance().record_thread_budget(0, static_cast<unsigned int>(m_opencv_saved), static_cast<unsigned int>(m_magick_saved));
+		return;
+	}
+	apply();
+}
+
+void Srl_thread_budget_controller::apply( void )
+{
+	//Whatever each lease asked for, the workers of every lease share the one machine
+	const unsigned int per_worker = std::max(1u, hardware_threads() / std::max(1u, m_outer_active));
+	const unsigned int opencv_threads = std::min(*m_opencv_limits.begin(), per_worker);
+	const unsigned int magick_threads = std::min(*m_magick_limits.begin(), per_worker);
+
+	//Both calls tear down and rebuild thread pools, skip them when nothing changed
+	if (opencv_threads != m_opencv_applied)
+	{
+		cv::setNumThreads(static_cast<int>(opencv_threads));
+		m_opencv_applied = opencv_threads;
+	}
+	if (magick_threads != m_magick_applied)
+	{
+		Magick::ResourceLimits::thread(static_cast<MagickCore::MagickSizeType>(magick_threads));
+		m_magick_applied = magick_threads;
+	}
+	Srl_trace_recorder::instance().record_thread_budget(m_outer_active, opencv_threads, magick_threads);
+}
+
+unsigned int Srl_thread_budget_controller::opencv_threads( void ) const
+{
+	lock_guard<mutex> lock(m_lock);
+	return m_opencv_applied;
+}
+
+unsigned int Srl_thread_budget_controller::magick_threads( void ) const
+{
+	lock_guard<mutex> lock(m_lock);
+	return m_magick_applied;
+}
+
+/***************************************************
+*
+*					Srl_budget_lease
+*
+****************************************************/
+
+Srl_thread_budget_controller::Srl_budget_lease::Srl_budget_lease( void )
+	:	m_active(false),
+		m_budget()
+{
+}
+
+Srl_thread_budget_controller::Srl_budget_lease::Srl_budget_lease( const Srl_thread_budget &budget )
+	:	m_active(true),
+		m_budget(budget)
+{
+	Srl_thread_budget_controller::instance().acquire(m_budget);
+}
+
+Srl_thread_budget_controller::Srl_budget_lease::~Srl_budget_lease()
+{
+	release();
+}
+
+Srl_thread_budget_controller::Srl_budget_lease::Srl_budget_lease( Srl_budget_lease &&other )
+	:	m_active(other.m_active),
+		m_budget(other.m_budget)
+{
+	other.m_active = false;
+}
+
+Srl_thread_budget_controller::Srl_budget_lease& Srl_thread_budget_controller::Srl_budget_lease::operator=( Srl_budget_lease &&other )
+{
+	if (this != &other)
+	{
+		release();
+		m_active = other.m_active;
+		m_budget = other.m_budget;
+		other.m_active = false;
+	}
+	return *this;
+}
+
+void Srl_thread_budget_controller::Srl_budget_lease::release( void )
+{
+	if (m_active)
+	{
+		m_active = false;
+		Srl_thread_budget_controller::instance().release(m_budget);
+	}
+}
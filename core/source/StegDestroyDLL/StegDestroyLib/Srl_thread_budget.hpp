@@ -0,0 +1,159 @@
+// $Id$
+//------------------------------------------------------------------------------------
+///
+/// @file
+///
+/// @brief Shares the machine's threads between the library's own workers, OpenCV and
+///        ImageMagick
+///
+/// @section VERSION
+/// 1.0
+///
+/// @section DESCRIPTION
+/// OpenCV runs its own parallel_for_ backend and ImageMagick uses OpenMP, both sized to
+/// every core by default. With the handler's workers on top each image can end up with
+/// a core's worth of threads per library per worker. The budget makes the split
+/// explicit and the controller applies it to both libraries, shrinking their share as
+/// more outer workers become active and restoring their settings once none are.
+//------------------------------------------------------------------------------------
+
+#pragma once
+
+#ifndef _SRL_THREAD_BUDGET_HPP
+#define _SRL_THREAD_BUDGET_HPP
+
+#include <cstddef>
+#include <mutex>
+#include <set>
+
+namespace srl
+{
+	///
+	/// @brief	How many threads each layer may use
+	///
+	struct Srl_thread_budget
+	{
+		///
+		/// @brief	workers the handler runs images on
+		///
+		unsigned int outer_threads;
+
+		///
+		/// @brief	cv::setNumThreads value while the handler is working, upper limit per outer worker
+		///
+		unsigned int opencv_threads;
+
+		///
+		/// @brief	Magick::ResourceLimits::thread value while the handler is working
+		///
+		unsigned int magick_threads;
+	};
+
+	///
+	/// @brief	Splits the hardware threads between outer_threads workers (0 for one per hardware
+	///			thread) and the libraries. Each library gets what is left per worker, at least 1
+	///
+	Srl_thread_budget default_thread_budget( unsigned int outer_threads = 0 );
+
+	///
+	/// @brief	Process wide owner of the OpenCV and ImageMagick thread settings
+	///
+	/// @description	Both settings are global to the process, so every handler (and session) running at
+	///					once is counted. While leases are held the libraries get the smallest of the leased
+	///					budgets and the hardware threads divided by the total outer workers.
+	///
+	class Srl_thread_budget_controller
+	{
+	public:
+
+		static Srl_thread_budget_controller& instance( void );
+
+		///
+		/// @brief	Holds a budget in force for its lifetime
+		///
+		class Srl_budget_lease
+		{
+		public:
+			Srl_budget_lease( void );
+			explicit Srl_budget_lease( const Srl_thread_budget &budget );
+			~Srl_budget_lease();
+
+			Srl_budget_lease( Srl_budget_lease &&other );
+			Srl_budget_lease& operator=( Srl_budget_lease &&other );
+
+			Srl_budget_lease( const Srl_budget_lease& ) = delete;
+			Srl_budget_lease& operator=( const Srl_budget_lease& ) = delete;
+
+			///
+			/// @brief	ends the lease early, does nothing if it has already ended
+			///
+			void release( void );
+
+		private:
+			bool m_active;
+			Srl_thread_budget m_budget;
+		};
+
+		///
+		/// @brief	threads OpenCV is currently limited to, 0 if no lease is held
+		///
+		unsigned int opencv_threads( void ) const;
+
+		///
+		/// @brief	threads ImageMagick is currently limited to, 0 if no lease is held
+		///
+		unsigned int magick_threads( void ) const;
+
+	private:
+
+		Srl_thread_budget_controller( void );
+
+		Srl_thread_budget_controller( const Srl_thread_budget_controller& ) = delete;
+		Srl_thread_budget_controller& operator=( const Srl_thread_budget_controller& ) = delete;
+
+		void acquire( const Srl_thread_budget &budget );
+		void release( const Srl_thread_budget &budget );
+
+		///
+		/// @brief	works out the library limits for the current leases and applies any that changed.
+		///			Called with m_lock held
+		///
+		void apply( void );
+
+		mutable std::mutex m_lock;
+
+		///
+		///	@brief	m_leases	leases currently held, the library settings are restored when it drops to 0
+		///
+		size_t m_leases;
+
+		///
+		///	@brief	m_outer_active	outer workers across every held lease
+		///
+		unsigned int m_outer_active;
+
+		///
+		///	@brief	m_opencv_limits, m_magick_limits	limits of every held lease, the smallest applies
+		///
+		std::multiset<unsigned int> m_opencv_limits;
+		std::multiset<unsigned int> m_magick_limits;
+
+		///
+		///	@brief	m_opencv_applied, m_magick_applied	limits last handed to the libraries, 0 when
+		///												they have their own settings
+		///
+		unsigned int m_opencv_applied;
+		unsigned int m_magick_applied;
+
+		///
+		///	@brief	m_opencv_saved, m_magick_saved	settings the libraries had before the first lease,
+		///											put back after the last
+		///
+		int m_opencv_saved;
+		unsigned long long m_magick_saved;
+	};
+
+	typedef Srl_thread_budget_controller::Srl_budget_lease Srl_budget_lease;
+}
+
+#endif //_SRL_THREAD_BUDGET_HPP
@@ -0,0 +1,266 @@
+//------------------------------------------------------------------------------------
+///
+/// @file   Srl_thread_pool.cpp
+///
+/// @brief Work stealing worker pool implementation
+///
+//------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+
+#include "Srl_thread_pool.hpp"
+#include "Srl_trace.hpp"
+
+#include <algorithm>
+#include <exception>
+
+using namespace srl;
+using namespace std;
+
+namespace
+{
+	///
+	/// @brief	pool the calling thread is a worker of, nullptr for any thread outside of a pool
+	///
+	thread_local const Srl_thread_pool *s_current_pool = nullptr;
+
+	///
+	/// @brief	worker index of the calling thread within s_current_pool
+	///
+	thread_local unsigned int s_current_index = 0;
+}
+
+/***************************************************
+*
+*					CTOR & DTOR
+*
+****************************************************/
+
+Srl_thread_pool::Srl_thread_pool(unsigned int thread_count)
+	:	m_pending(0),
+		m_next_queue(0),
+		m_stopping(false)
+{
+	if (0 == thread_count)
+	{
+		thread_count = std::thread::hardware_concurrency();
+	}
+	if (0 == thread_count)
+	{	//hardware_concurrency is allowed to return 0 when it can't tell
+		thread_count = 1;
+	}
+
+	for (unsigned int i = 0; i < thread_count; i++)
+	{
+		m_queues.push_back(unique_ptr<Srl_task_queue>(new Srl_task_queue));
+	}
+	//Queues must all exist before any worker starts stealing from them
+	for (unsigned int i = 0; i < thread_count; i++)
+	{
+		m_workers.push_back(std::thread(&Srl_thread_pool::worker_loop, this, i));
+	}
+}
+
+Srl_thread_pool::~Srl_thread_pool()
+{
+	{
+		lock_guard<mutex> lock(m_idle_lock);
+		m_stopping = true;
+	}
+	m_idle_cv.notify_all();
+
+	for (size_t i = 0; i < m_workers.size(); i++)
+	{
+		m_workers[i].join();
+	}
+}
+
+/***************************************************
+*
+*					Accessors
+*
+****************************************************/
+
+unsigned int Srl_thread_pool::thread_count(void) const
+{
+	return static_cast<unsigned int>(m_workers.size());
+}
+
+/***************************************************
+*
+*					Methods
+*
+****************************************************/
+
+void Srl_thread_pool::submit(task_type task)
+{
+	//Workers push onto their own deque so nested work stays cache local,
+	//anything else is spread round robin across the workers
+	unsigned int target = current_worker();
+	if (target >= m_queues.size())
+	{
+		target = m_next_queue.fetch_add(1, memory_order_relaxed) % m_queues.size();
+	}
+
+	m_pending.fetch_add(1);
+	{
+		lock_guard<mutex> lock(m_queues[target]->m_lock);
+		m_queues[target]->m_tasks.push_back(std::move(task));
+	}
+
+	//Taking the idle lock here closes the gap between a worker checking m_pending
+	//and going to sleep, otherwise the wake up could be lost
+	{
+		lock_guard<mutex> lock(m_idle_lock);
+	}
+	m_idle_cv.notify_one();
+}
+
+void Srl_thread_pool::parallel_for(size_t begin, size_t end, const loop_body_type &body, size_t grain)
+{
+	if (begin >= end)
+	{
+		return;
+	}
+
+	size_t count = end - begin;
+	if (0 == grain)
+	{	//A few chunks per thread gives the thieves something to take from stragglers
+		grain = std::max<size_t>(1, count / ((thread_count() + 1) * 4));
+	}
+	size_t chunks = (count + grain - 1) / grain;
+
+	atomic<size_t> remaining(chunks);
+	exception_ptr first_error;
+	mutex error_lock;
+
+	for (size_t chunk = 0; chunk < chunks; chunk++)
+	{
+		size_t chunk_begin = begin + chunk * grain;
+		size_t chunk_end = std::min(end, chunk_begin + grain);
+
+		submit([this, chunk_begin, chunk_end, &body, &remaining, &first_error, &error_lock]()
+		{
+			try
+			{
+				for (size_t i = chunk_begin; i < chunk_end; i++)
+				{
+					body(i);
+				}
+			}
+			catch (...)
+			{
+				lock_guard<mutex> lock(error_lock);
+				if (nullptr == first_error)
+				{
+					first_error = current_exception();
+				}
+			}
+			//Must be the last access to anything on the caller's stack
+			if (1 == remaining.fetch_sub(1))
+			{	//The caller may be asleep waiting on this, taking the lock closes the same gap as in submit
+				{
+					lock_guard<mutex> lock(m_idle_lock);
+				}
+				m_idle_cv.notify_all();
+			}
+		});
+	}
+
+	//Help out rather than block, this is what makes nested parallel_for safe
+	unsigned int self = current_worker();
+	task_type task;
+	while (0 != remaining.load())
+	{
+		if (try_get_task(self, task))
+		{
+			task();
+			task = nullptr;
+			continue;
+		}
+
+		//Every chunk has been taken, sleep until the last one finishes or a nested loop in
+		//one of them queues more work to help with
+		unique_lock<mutex> lock(m_idle_lock);
+		m_idle_cv.wait(lock, [this, &remaining]() { return 0 == remaining.load() || 0 != m_pending.load(); });
+	}
+
+	if (nullptr != first_error)
+	{
+		rethrow_exception(first_error);
+	}
+}
+
+unsigned int Srl_thread_pool::current_worker(void) const
+{
+	if (this == s_current_pool)
+	{
+		return s_current_index;
+	}
+	return thread_count();
+}
+
+void Srl_thread_pool::worker_loop(unsigned int index)
+{
+	s_current_pool = this;
+	s_current_index = index;
+	Srl_trace_recorder::instance().name_thread("pool worker");
+
+	task_type task;
+	while (true)
+	{
+		if (try_get_task(index, task))
+		{
+			task();
+			task = nullptr;
+			continue;
+		}
+
+		unique_lock<mutex> lock(m_idle_lock);
+		m_idle_cv.wait(lock, [this]() { return m_stopping || 0 != m_pending.load(); });
+		if (m_stopping && 0 == m_pending.load())
+		{
+			break;
+		}
+	}
+}
+
+bool Srl_thread_pool::try_get_task(unsigned int preferred, task_type &task)
+{
+	size_t queue_count = m_queues.size();
+
+	//Own deque first, newest task is the most likely to still be in cache
+	if (preferred < queue_count)
+	{
+		Srl_task_queue &own = *m_queues[preferred];
+		lock_guard<mutex> lock(own.m_lock);
+		if (!own.m_tasks.empty())
+		{
+			task = std::move(own.m_tasks.back());
+			own.m_tasks.pop_back();
+			m_pending.fetch_sub(1);
+			return true;
+		}
+	}
+
+	//Steal the oldest task from everyone else
+	for (size_t offset = 1; offset <= queue_count; offset++)
+	{
+		size_t victim = (preferred + offset) % queue_count;
+		if (victim == preferred)
+		{
+			continue;
+		}
+
+		Srl_task_queue &other = *m_queues[victim];
+		lock_guard<mutex> lock(other.m_lock);
+		if (!other.m_tasks.empty())
+		{
+			task = std::move(other.m_tasks.front());
+			other.m_tasks.pop_front();
+			m_pending.fetch_sub(1);
+			return true;
+		}
+	}
+	return false;
+}
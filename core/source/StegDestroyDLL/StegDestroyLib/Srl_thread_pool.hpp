@@ -0,0 +1,183 @@
+// $Id$
+//------------------------------------------------------------------------------------
+///
+/// @file
+///
+/// @brief Work stealing worker pool used to spread image processing across cores
+///
+/// @section VERSION
+/// 1.0
+///
+/// @section DESCRIPTION
+/// Each worker owns a task deque which it pops from the back of, idle workers steal
+/// from the front of the other deques. Threads waiting on a parallel_for help run
+/// queued tasks and only block once there is nothing left to take, so nested
+/// parallel_for calls cannot deadlock.
+//------------------------------------------------------------------------------------
+
+#pragma once
+
+#ifndef _SRL_THREAD_POOL_HPP
+#define _SRL_THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace srl
+{
+	///
+	/// @brief	Work stealing thread pool, one task deque per worker
+	///
+	class Srl_thread_pool
+	{
+		/*************************************************************************
+		*
+		*					Types
+		*
+		*************************************************************************/
+	public:
+
+		///
+		/// @brief	Unit of work queued on the pool
+		///
+		typedef std::function<void(void)> task_type;
+
+		///
+		/// @brief	Body of a parallel_for, receives the element index. Bodies for different indices run
+		///			concurrently on any thread, including helping callers of other loops, so per thread
+		///			state can't be keyed on anything but the index
+		///
+		typedef std::function<void(size_t index)> loop_body_type;
+
+		/*************************************************************************
+		*
+		*					Constructors + Destructors
+		*
+		*************************************************************************/
+	public:
+
+		///
+		/// @brief	Starts the worker threads
+		///
+		/// @param[in]	thread_count	number of workers, 0 uses std::thread::hardware_concurrency()
+		///
+		explicit Srl_thread_pool(unsigned int thread_count = 0);
+
+		///
+		/// @brief	Runs any outstanding tasks then joins the workers
+		///
+		~Srl_thread_pool();
+
+		Srl_thread_pool(const Srl_thread_pool&) = delete;
+		Srl_thread_pool& operator=(const Srl_thread_pool&) = delete;
+
+		/*************************************************************************
+		*
+		*					        Accessors
+		*
+		*************************************************************************/
+	public:
+
+		///
+		/// @brief	number of worker threads owned by the pool
+		///
+		unsigned int thread_count(void) const;
+
+		/*************************************************************************
+		*
+		*					            Methods
+		*
+		*************************************************************************/
+	public:
+
+		///
+		/// @brief	Queues a single task, no completion notification is given
+		///
+		void submit(task_type task);
+
+		///
+		/// @brief	Runs body for every index in [begin, end) across the pool and returns once all
+		///			have completed. The calling thread takes part in the work while it waits.
+		///
+		/// @param[in]	grain	number of consecutive indices given to each task, 0 picks one
+		///						based on the range and thread count
+		///
+		/// @note	A body that throws ends its own chunk, the other chunks still run. Once all have finished
+		///			the first exception caught is rethrown on the calling thread, any later ones are dropped
+		///
+		void parallel_for(size_t begin, size_t end, const loop_body_type &body, size_t grain = 0);
+
+	private:
+
+		///
+		/// @brief	worker index of the calling thread, thread_count() if it is not a worker of this pool
+		///
+		unsigned int current_worker(void) const;
+
+		///
+		/// @brief	Worker thread main loop
+		///
+		void worker_loop(unsigned int index);
+
+		///
+		/// @brief	Pops a task from the given deque, or steals from another. Returns false if all are empty
+		///
+		bool try_get_task(unsigned int preferred, task_type &task);
+
+		/*************************************************************************
+		*
+		*					            Members
+		*
+		*************************************************************************/
+	private:
+
+		///
+		/// @brief	A single worker's task deque, owner works from the back, thieves from the front
+		///
+		struct Srl_task_queue
+		{
+			std::mutex m_lock;
+			std::deque<task_type> m_tasks;
+		};
+
+		///
+		///	@brief	m_queues	one deque per worker, indexed by worker slot
+		///
+		std::vector<std::unique_ptr<Srl_task_queue>> m_queues;
+
+		///
+		///	@brief	m_workers	worker threads, m_workers[i] owns m_queues[i]
+		///
+		std::vector<std::thread> m_workers;
+
+		///
+		///	@brief	m_pending	number of tasks queued but not yet taken by a thread
+		///
+		std::atomic<size_t> m_pending;
+
+		///
+		///	@brief	m_next_queue	round robin index used to distribute externally submitted tasks
+		///
+		std::atomic<unsigned int> m_next_queue;
+
+		///
+		///	@brief	m_stopping	set by the destructor to release the workers
+		///
+		std::atomic<bool> m_stopping;
+
+		///
+		///	@brief	m_idle_lock, m_idle_cv	used to park workers when there is nothing to do, and threads
+		///									in parallel_for once all of their chunks have been taken
+		///
+		std::mutex m_idle_lock;
+		std::condition_variable m_idle_cv;
+	};
+}
+
+#endif //_SRL_THREAD_POOL_HPP
@@ -0,0 +1,102 @@
+//------------------------------------------------------------------------------------
+///
+/// @file   Srl_tile_parallel.cpp
+///
+/// @brief Splits the pixel stages of one large image across the worker pool
+///
+//------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+
+#include "Srl_tile_parallel.hpp"
+
+#include <algorithm>
+
+#include <opencv2\imgproc.hpp>
+
+using namespace srl;
+using namespace std;
+
+namespace srl
+{
+	bool use_tiles( const cv::Mat &img )
+	{
+		return img.total() >= SRL_TILE_PARALLEL_MIN_PIXELS;
+	}
+
+	int band_rows( const cv::Mat &img )
+	{
+		const size_t row_bytes = std::max<size_t>(1, static_cast<size_t>(img.cols) * img.elemSize());
+		return static_cast<int>(std::max<size_t>(1, SRL_TILE_TARGET_BYTES / row_bytes));
+	}
+
+	void for_each_band( const cv::Mat &img, Srl_thread_pool *pool_p, const Srl_band_body &body )
+	{
+		if (img.rows <= 0)
+		{
+			return;
+		}
+		if (nullptr == pool_p || !use_tiles(img))
+		{
+			body(0, img.rows);
+			return;
+		}
+
+		//Band boundaries depend only on the image, never on the thread count
+		const int rows_per_band = band_rows(img);
+		const size_t band_count = (static_cast<size_t>(img.rows) + rows_per_band - 1) / rows_per_band;
+
+		pool_p->parallel_for(0, band_count, [&](size_t band)
+		{
+			int row_begin = static_cast<int>(band) * rows_per_band;
+			body(row_begin, std::min(img.rows, row_begin + rows_per_band));
+		}, 1);
+	}
+
+	void tiled_resize( const cv::Mat &src, cv::Mat &dst, cv::Size dst_size, int interpolation,
+					   Srl_thread_pool *pool_p )
+	{
+		//Decided without looking at the pool so attaching one never changes the output
+		const bool large = use_tiles(src) || static_cast<size_t>(dst_size.area()) >= SRL_TILE_PARALLEL_MIN_PIXELS;
+		if (!large || cv::INTER_AREA == interpolation || src.empty() ||
+			dst_size.width <= 0 || dst_size.height <= 0 || src.data == dst.data)
+		{
+			cv::resize(src, dst, dst_size, 0, 0, interpolation);
+			return;
+		}
+
+		dst.create(dst_size, src.type());
+		const double inv_sx = static_cast<double>(src.cols) / dst_size.width;
+		const double inv_sy = static_cast<double>(src.rows) / dst_size.height;
+		const int rows_per_band = band_rows(dst);
+		const size_t band_count = (static_cast<size_t>(dst.rows) + rows_per_band - 1) / rows_per_band;
+
+		const Srl_thread_pool::loop_body_type resize_band = [&](size_t band)
+		{
+			const int row_begin = static_cast<int>(band) * rows_per_band;
+			const int row_end = std::min(dst.rows, row_begin + rows_per_band);
+
+			//Inverse map from destination to source pixel centres, as cv::resize uses, shifted so
+			//row 0 of the band is row_begin of the whole destination
+			cv::Mat inverse_map = (cv::Mat_<double>(2, 3) <<
+				inv_sx, 0.0, 0.5 * inv_sx - 0.5,
+				0.0, inv_sy, (row_begin + 0.5) * inv_sy - 0.5);
+
+			cv::Mat dst_band = dst.rowRange(row_begin, row_end);
+			cv::warpAffine(src, dst_band, inverse_map, dst_band.size(), interpolation | cv::WARP_INVERSE_MAP,
+						   cv::BORDER_REPLICATE);
+		};
+
+		if (nullptr != pool_p)
+		{
+			pool_p->parallel_for(0, band_count, resize_band, 1);
+		}
+		else
+		{	//The same bands in turn, a whole image warp would round its positions differently
+			for (size_t band = 0; band < band_count; band++)
+			{
+				resize_band(band);
+			}
+		}
+	}
+}
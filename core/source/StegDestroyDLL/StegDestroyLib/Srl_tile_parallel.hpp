@@ -0,0 +1,84 @@
+// $Id$
+//------------------------------------------------------------------------------------
+///
+/// @file
+///
+/// @brief Splits the pixel stages of one large image across the worker pool
+///
+/// @section VERSION
+/// 1.0
+///
+/// @section DESCRIPTION
+/// Batches are parallel per image, which leaves one core grinding through an outlier
+/// sized attachment while the rest of the pool sits idle. Images over a size threshold
+/// are cut into bands of whole rows, each sized to stay in cache, and the bands are
+/// run on the pool. Bands are whole rows and their boundaries depend only on the image
+/// size, so the bit plane scrub is byte identical to a single pass and the output never
+/// depends on the thread count.
+//------------------------------------------------------------------------------------
+
+#pragma once
+
+#ifndef _SRL_TILE_PARALLEL_HPP
+#define _SRL_TILE_PARALLEL_HPP
+
+#include <cstddef>
+#include <functional>
+
+#include <opencv2\core.hpp>
+
+#include "Srl_thread_pool.hpp"
+
+namespace srl
+{
+	///
+	/// @brief	images with fewer pixels than this are always processed whole
+	///
+	const size_t SRL_TILE_PARALLEL_MIN_PIXELS = 4 * 1024 * 1024;
+
+	///
+	/// @brief	bytes of image data aimed for in each band, about half a typical L2
+	///
+	const size_t SRL_TILE_TARGET_BYTES = 256 * 1024;
+
+	///
+	/// @brief	Body run for each band, rows [row_begin, row_end)
+	///
+	typedef std::function<void(int row_begin, int row_end)> Srl_band_body;
+
+	///
+	/// @brief	true if img is large enough for the band split to pay off
+	///
+	bool use_tiles( const cv::Mat &img );
+
+	///
+	/// @brief	number of rows per band for img, at least 1
+	///
+	int band_rows( const cv::Mat &img );
+
+	///
+	/// @brief	Runs body over every band of img. Runs it once over the whole image on the calling
+	///			thread if pool is nullptr or the image is below SRL_TILE_PARALLEL_MIN_PIXELS
+	///
+	/// @note	Safe to call from a pool worker, the pool supports nested parallel_for
+	///
+	void for_each_band( const cv::Mat &img, Srl_thread_pool *pool_p, const Srl_band_body &body );
+
+	///
+	/// @brief	Resizes src, one destination band at a time with warpAffine when either image is at least
+	///			SRL_TILE_PARALLEL_MIN_PIXELS, otherwise whole with cv::resize
+	///
+	/// @description	The banded path is an approximation of cv::resize: warpAffine works out source
+	///					positions in 1/32 pixel fixed point, so samples can differ from cv::resize by a
+	///					level or so. Which path runs depends only on the sizes and interpolation, the
+	///					bands run on the calling thread without a pool, so the output is the same with
+	///					or without one and whatever its thread count.
+	///
+	/// @param[in]	interpolation	cv::INTER_NEAREST, INTER_LINEAR or INTER_CUBIC. Area interpolation
+	///								has no warpAffine equivalent and is done whole with cv::resize
+	///
+	void tiled_resize( const cv::Mat &src, cv::Mat &dst, cv::Size dst_size, int interpolation,
+					   Srl_thread_pool *pool_p );
+}
+
+#endif //_SRL_TILE_PARALLEL_HPP
@@ -0,0 +1,369 @@
+//------------------------------------------------------------------------------------
+///
+/// @file   Srl_trace.cpp
+///
+/// @brief Optional span tracing written out as Chrome trace event JSON
+///
+//------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+
+#include "Srl_trace.hpp"
+#include "Srl_img_format_registry.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <ostream>
+#include <thread>
+
+using namespace srl;
+using namespace std;
+
+namespace
+{
+	thread_local int64_t t_trace_image = SRL_TRACE_NO_IMAGE;
+
+	///
+	/// @brief	writes nanoseconds as the microseconds Chrome expects, keeping the nanoseconds
+	///
+	void write_micros( ostream &out, uint64_t nanoseconds )
+	{
+		out << (nanoseconds / 1000) << '.' << setw(3) << setfill('0') << (nanoseconds % 1000) << setfill(' ');
+	}
+}
+
+/***************************************************
+*
+*					Srl_trace_recorder
+*
+****************************************************/
+
+Srl_trace_recorder& Srl_trace_recorder::instance( void )
+{
+	static Srl_trace_recorder recorder;
+	return recorder;
+}
+
+Srl_trace_recorder::Srl_trace_recorder( void )
+	:	m_capacity(0),
+		m_enabled(false),
+		m_next(0),
+		m_dropped(0),
+		m_writers(0)
+{
+}
+
+void Srl_trace_recorder::start( size_t max_events )
+{
+	lock_guard<mutex> lock(m_lock);
+	m_enabled = false;
+	while (0 != m_writers.load())
+	{
+		this_thread::yield();
+	}
+
+	max_events = std::max<size_t>(1, max_events);
+	if (max_events != m_capacity)
+	{
+		m_events.reset(new Srl_trace_event[max_events]);
+		m_capacity = max_events;
+	}
+	for (size_t i = 0; i < m_capacity; i++)
+	{
+		m_events[i].ready.store(false, memory_order_relaxed);
+	}
+
+	m_next = 0;
+	m_dropped = 0;
+	m_epoch = Srl_latency_clock::now();
+	m_enabled = true;
+}
+
+void Srl_trace_recorder::stop( void )
+{
+	lock_guard<mutex> lock(m_lock);
+	m_enabled = false;
+	while (0 != m_writers.load())
+	{
+		this_thread::yield();
+	}
+}
+
+bool Srl_trace_recorder::enabled( void ) const
+{
+	return m_enabled.load(memory_order_relaxed);
+}
+
+size_t Srl_trace_recorder::recorded( void )
+{
+	lock_guard<mutex> lock(m_lock);
+	return std::min(m_next.load(), m_capacity);
+}
+
+size_t Srl_trace_recorder::dropped( void ) const
+{
+	return m_dropped.load();
+}
+
+Srl_trace_recorder::Srl_trace_event* Srl_trace_recorder::claim( void )
+{
+	if (!m_enabled.load(memory_order_relaxed))
+	{
+		return nullptr;
+	}
+
+	//Registered as a writer before looking again, so start() and stop() either see this
+	//writer or this writer sees tracing turned off
+	m_writers.fetch_add(1);
+	if (!m_enabled.load())
+	{
+		m_writers.fetch_sub(1);
+		return nullptr;
+	}
+
+	const size_t index = m_next.fetch_add(1, memory_order_relaxed);
+	if (index >= m_capacity)
+	{
+		m_dropped.fetch_add(1, memory_order_relaxed);
+		m_writers.fetch_sub(1);
+		return nullptr;
+	}
+	return &m_events[index];
+}
+
+void Srl_trace_recorder::publish( Srl_trace_event *event_p )
+{
+	event_p->ready.store(true, memory_order_release);
+	m_writers.fetch_sub(1);
+}
+
+uint32_t Srl_trace_recorder::thread_id( void )
+{
+	//A counter would give every short lived stage thread its own name entry, the OS reuses its ids
+	thread_local uint32_t id = static_cast<uint32_t>(std::hash<std::thread::id>()(this_thread::get_id()));
+	return id;
+}
+
+uint64_t Srl_trace_recorder::since_start( Srl_latency_clock::time_point time ) const
+{
+	//A span begun before start() is drawn from the start of the trace
+	if (time <= m_epoch)
+	{
+		return 0;
+	}
+	return static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(time - m_epoch).count());
+}
+
+void Srl_trace_recorder::name_thread( const string &name )
+{
+	//Every pool worker and stage thread calls this, keep it off the lock when nothing is recorded
+	if (!m_enabled.load(memory_order_relaxed))
+	{
+		return;
+	}
+	const uint32_t id = thread_id();
+	lock_guard<mutex> lock(m_names_lock);
+	m_thread_names[id] = name;
+}
+
+void Srl_trace_recorder::record_span( const char *name_p, Srl_latency_clock::time_point begin,
+									  Srl_latency_clock::time_point end, int64_t image, Srl_img_format_enum format )
+{
+	Srl_trace_event *event_p = claim();
+	if (nullptr == event_p)
+	{
+		return;
+	}
+
+	event_p->name_p = name_p;
+	event_p->begin_ns = since_start(begin);
+	event_p->duration_ns = std::max(event_p->begin_ns, since_start(end)) - event_p->begin_ns;
+	event_p->image = image;
+	event_p->thread_id = thread_id();
+	event_p->format = static_cast<uint16_t>(format);
+	event_p->kind = SRL_TRACE_SPAN;
+	publish(event_p);
+}
+
+void Srl_trace_recorder::record_thread_budget( unsigned int outer_threads, unsigned int opencv_threads,
+											   unsigned int magick_threads )
+{
+	Srl_trace_event *event_p = claim();
+	if (nullptr == event_p)
+	{
+		return;
+	}
+
+	event_p->name_p = "thread budget";
+	event_p->begin_ns = since_start(Srl_latency_clock::now());
+	event_p->duration_ns = 0;
+	event_p->image = SRL_TRACE_NO_IMAGE;
+	event_p->thread_id = thread_id();
+	event_p->values[0] = outer_threads;
+	event_p->values[1] = opencv_threads;
+	event_p->values[2] = magick_threads;
+	event_p->format = SRL_IMG_FORMAT_NONE;
+	event_p->kind = SRL_TRACE_BUDGET;
+	publish(event_p);
+}
+
+void Srl_trace_recorder::write_chrome_trace( ostream &out )
+{
+	//Keeps start() from freeing the buffer under the writer, recording carries on
+	lock_guard<mutex> lock(m_lock);
+
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"StegDestroy\"}}";
+	{
+		lock_guard<mutex> names_lock(m_names_lock);
+		for (map<uint32_t, string>::const_iterator it = m_thread_names.begin(); it != m_thread_names.end(); ++it)
+		{
+			out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << it->first << ",\"args\":{\"name\":";
+			write_json_string(out, it->second);
+			out << "}}";
+		}
+	}
+
+	const size_t count = std::min(m_next.load(), m_capacity);
+	for (size_t i = 0; i < count; i++)
+	{
+		const Srl_trace_event &event = m_events[i];
+		if (!event.ready.load(memory_order_acquire))
+		{	//Claimed but still being written
+			continue;
+		}
+
+		out << ",\n{\"name\":";
+		write_json_string(out, event.name_p);
+		out << ",\"cat\":\"srl\",\"pid\":1,\"tid\":" << event.thread_id << ",\"ts\":";
+		write_micros(out, event.begin_ns);
+
+		if (SRL_TRACE_BUDGET == event.kind)
+		{
+			out << ",\"ph\":\"C\",\"args\":{\"outer\":" << event.values[0] << ",\"opencv\":" << event.values[1]
+				<< ",\"magick\":" << event.values[2] << "}}";
+			continue;
+		}
+
+		out << ",\"ph\":\"X\",\"dur\":";
+		write_micros(out, event.duration_ns);
+		out << ",\"args\":{";
+		bool first = true;
+		if (SRL_TRACE_NO_IMAGE != event.image)
+		{
+			out << "\"image\":" << event.image;
+			first = false;
+		}
+		const Srl_img_format_traits *traits_p = find_format_traits(static_cast<Srl_img_format_enum>(event.format));
+		if (SRL_IMG_FORMAT_NONE != event.format && nullptr != traits_p)
+		{
+			out << (first ? "" : ",") << "\"format\":";
+			write_json_string(out, traits_p->canonical);
+		}
+		out << "}}";
+	}
+	out << "\n]}\n";
+}
+
+bool Srl_trace_recorder::write_chrome_trace( const string &path )
+{
+	ofstream out(path.c_str(), ios::out | ios::trunc);
+	if (!out)
+	{
+		return false;
+	}
+	write_chrome_trace(out);
+	out.flush();
+	return out.good();
+}
+
+/***************************************************
+*
+*					Srl_trace_span
+*
+****************************************************/
+
+Srl_trace_span::Srl_trace_span( const char *name_p, Srl_img_format_enum format )
+	:	m_name_p(name_p),
+		m_format(format),
+		m_image(t_trace_image),
+		m_active(Srl_trace_recorder::instance().enabled())
+{
+	if (m_active)
+	{
+		m_begin = Srl_latency_clock::now();
+	}
+}
+
+Srl_trace_span::~Srl_trace_span()
+{
+	if (m_active)
+	{
+		Srl_trace_recorder::instance().record_span(m_name_p, m_begin, Srl_latency_clock::now(), m_image, m_format);
+	}
+}
+
+void Srl_trace_span::set_format( Srl_img_format_enum format )
+{
+	m_format = format;
+}
+
+void Srl_trace_span::set_image( int64_t image )
+{
+	m_image = image;
+}
+
+/***************************************************
+*
+*					Srl_trace_image_scope
+*
+****************************************************/
+
+Srl_trace_image_scope::Srl_trace_image_scope( int64_t image )
+	:	m_previous(t_trace_image)
+{
+	t_trace_image = image;
+}
+
+Srl_trace_image_scope::~Srl_trace_image_scope()
+{
+	t_trace_image = m_previous;
+}
+
+int64_t Srl_trace_image_scope::current( void )
+{
+	return t_trace_image;
+}
+
+/***************************************************
+*
+*					JSON
+*
+****************************************************/
+
+namespace srl
+{
+	void write_json_string( ostream &out, const string &text )
+	{
+		out << '"';
+		for (size_t i = 0; i < text.size(); i++)
+		{
+			const unsigned char c = static_cast<unsigned char>(text[i]);
+			if ('"' == c || '\\' == c)
+			{
+				out << '\\' << c;
+			}
+			else if (c < 0x20)
+			{
+				out << "\\u" << hex << setw(4) << setfill('0') << static_cast<unsigned int>(c) << dec << setfill(' ');
+			}
+			else
+			{
+				out << c;
+			}
+		}
+		out << '"';
+	}
+}
@@ -0,0 +1,239 @@
+// $Id$
+//------------------------------------------------------------------------------------
+///
+/// @file
+///
+/// @brief Optional span tracing written out as Chrome trace event JSON
+///
+/// @section VERSION
+/// 1.0
+///
+/// @section DESCRIPTION
+/// The latency histograms say how slow a stage is on the whole, a trace shows one slow
+/// batch as a timeline: which thread ran which image's stage when, the gaps where images
+/// sat in a queue, the stragglers holding up the end of a batch and how the OpenCV and
+/// ImageMagick thread limits moved as workers came and went. Tracing is off until
+/// start() is called. While it is on each span is written once, when it ends, into a
+/// buffer allocated by start(), so recording never allocates; spans past the end of the
+/// buffer are counted and dropped. write_chrome_trace() produces a file chrome://tracing
+/// and Perfetto both open.
+//------------------------------------------------------------------------------------
+
+#pragma once
+
+#ifndef _SRL_TRACE_HPP
+#define _SRL_TRACE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "Srl_steg_data_types.hpp"
+#include "Srl_latency_histogram.hpp"
+
+namespace srl
+{
+	///
+	/// @brief	events start() allocates room for when not told otherwise, about 56MB
+	///
+	const size_t SRL_TRACE_DEFAULT_EVENTS = size_t( 1 ) << 20;
+
+	///
+	/// @brief	image id of a span recorded outside any Srl_trace_image_scope
+	///
+	const int64_t SRL_TRACE_NO_IMAGE = -1;
+
+	///
+	/// @brief	Process wide trace buffer
+	///
+	class Srl_trace_recorder
+	{
+	public:
+
+		static Srl_trace_recorder& instance( void );
+
+		///
+		/// @brief	Throws away any earlier trace, allocates room for max_events and starts recording
+		///
+		void start( size_t max_events = SRL_TRACE_DEFAULT_EVENTS );
+
+		///
+		/// @brief	Stops recording and waits for spans being written to finish, the trace is kept
+		///
+		void stop( void );
+
+		bool enabled( void ) const;
+
+		///
+		/// @brief	events held, and those dropped because the buffer was full
+		///
+		size_t recorded( void );
+		size_t dropped( void ) const;
+
+		///
+		/// @brief	Writes every event held as Chrome trace event JSON, times in microseconds since start()
+		///
+		void write_chrome_trace( std::ostream &out );
+
+		///
+		/// @return	bool	false if path couldn't be written
+		///
+		bool write_chrome_trace( const std::string &path );
+
+		///
+		/// @brief	Names the calling thread in the trace, e.g. "decode" for a pipeline stage thread. Does
+		///			nothing unless tracing is on, a later thread given the same id replaces the name
+		///
+		void name_thread( const std::string &name );
+
+		///
+		/// @brief	Records one finished span on the calling thread
+		///
+		/// @param[in]	name_p	must have static storage, only the pointer is kept
+		///
+		void record_span( const char *name_p, Srl_latency_clock::time_point begin, Srl_latency_clock::time_point end,
+						  int64_t image, Srl_img_format_enum format );
+
+		///
+		/// @brief	Records the thread split Srl_thread_budget_controller just applied, drawn as a
+		///			counter track under the spans
+		///
+		void record_thread_budget( unsigned int outer_threads, unsigned int opencv_threads, unsigned int magick_threads );
+
+	private:
+
+		enum Srl_trace_event_kind
+		{
+			SRL_TRACE_SPAN,
+			SRL_TRACE_BUDGET
+		};
+
+		struct Srl_trace_event
+		{
+			const char *name_p;
+			uint64_t begin_ns;
+			uint64_t duration_ns;
+			int64_t image;
+			uint32_t thread_id;
+			uint32_t values[3];
+			uint16_t format;
+			uint8_t kind;
+
+			///
+			/// @brief	set once every other field is written, write_chrome_trace() skips events without it
+			///
+			std::atomic<bool> ready;
+		};
+
+		Srl_trace_recorder( void );
+		Srl_trace_recorder( const Srl_trace_recorder& ) = delete;
+		Srl_trace_recorder& operator=( const Srl_trace_recorder& ) = delete;
+
+		///
+		/// @brief	claims the next free event, nullptr if tracing is off or the buffer is full. A
+		///			non null event must be given to publish()
+		///
+		Srl_trace_event* claim( void );
+		void publish( Srl_trace_event *event_p );
+
+		///
+		/// @brief	id of the calling thread, taken from the OS thread id so a thread started after another
+		///			has exited may be given the same one
+		///
+		static uint32_t thread_id( void );
+
+		uint64_t since_start( Srl_latency_clock::time_point time ) const;
+
+		///
+		/// @brief	held by start(), stop() and the writers, never by recording
+		///
+		std::mutex m_lock;
+
+		std::unique_ptr<Srl_trace_event[]> m_events;
+		size_t m_capacity;
+		Srl_latency_clock::time_point m_epoch;
+
+		std::atomic<bool> m_enabled;
+		std::atomic<size_t> m_next;
+		std::atomic<size_t> m_dropped;
+
+		///
+		/// @brief	spans between claim() and publish(), stop() waits for it to reach 0 before anything
+		///			reads or frees the buffer
+		///
+		std::atomic<unsigned int> m_writers;
+
+		///
+		/// @brief	keyed by thread_id(), so reused ids replace their entry rather than adding one
+		///
+		std::mutex m_names_lock;
+		std::map<uint32_t, std::string> m_thread_names;
+	};
+
+	///
+	/// @brief	Records a span from construction to destruction while tracing is on
+	///
+	class Srl_trace_span
+	{
+	public:
+		///
+		/// @param[in]	name_p	must have static storage, e.g. a string literal
+		///
+		explicit Srl_trace_span( const char *name_p, Srl_img_format_enum format = SRL_IMG_FORMAT_NONE );
+		~Srl_trace_span();
+
+		Srl_trace_span( const Srl_trace_span& ) = delete;
+		Srl_trace_span& operator=( const Srl_trace_span& ) = delete;
+
+		///
+		/// @brief	for spans where the format is only known part way through
+		///
+		void set_format( Srl_img_format_enum format );
+
+		///
+		/// @brief	for spans that start before their image is numbered
+		///
+		void set_image( int64_t image );
+
+	private:
+		const char *m_name_p;
+		Srl_img_format_enum m_format;
+		int64_t m_image;
+		bool m_active;
+		Srl_latency_clock::time_point m_begin;
+	};
+
+	///
+	/// @brief	Tags every span the calling thread records in its lifetime with an image id, e.g.
+	///			the image's index in its batch. Scopes nest, the previous id is restored on destruction
+	///
+	class Srl_trace_image_scope
+	{
+	public:
+		explicit Srl_trace_image_scope( int64_t image );
+		~Srl_trace_image_scope();
+
+		Srl_trace_image_scope( const Srl_trace_image_scope& ) = delete;
+		Srl_trace_image_scope& operator=( const Srl_trace_image_scope& ) = delete;
+
+		///
+		/// @brief	id of the innermost scope on the calling thread, SRL_TRACE_NO_IMAGE outside any
+		///
+		static int64_t current( void );
+
+	private:
+		int64_t m_previous;
+	};
+
+	///
+	/// @brief	Writes text as a quoted JSON string, escaping quotes, backslashes and control characters.
+	///			Shared with the tools that write their own JSON reports
+	///
+	void write_json_string( std::ostream &out, const std::string &text );
+}
+
+#endif //_SRL_TRACE_HPP
@@ -0,0 +1,610 @@
+//------------------------------------------------------------------------------------
+///
+/// @file   StegDestroyPareto.cpp
+///
+/// @brief Scrub effectiveness against cost for every scrub configuration
+///
+/// @section DESCRIPTION
+/// Hides a known payload in a set of synthetic covers, scrubs them with each
+/// configuration of quality, chroma quality, LSB planes and resampling, and measures:
+/// - how much of the payload survives, as the bit error rate of reading it back. 0.5 is
+///   a coin flip, nothing survived;
+/// - how much the picture suffers, as PSNR and SSIM against the cover;
+/// - what the scrub costs, as wall time and output bytes per image.
+/// Each scenario pairs a payload with a target format. Its Pareto frontier is the set of
+/// configurations no other one beats on residual payload, SSIM, time and bytes all at
+/// once. The cheapest configuration that still destroys the payload is printed too.
+///
+///	StegDestroyPareto [--seed n] [--images n] [--size WxH] [--repeat n] [--payload-fill f]
+///					  [--destroyed f] [--scenario jpeg_coef|lsb_png|lsb_to_jpeg]
+//------------------------------------------------------------------------------------
+
+#include "Srl_steg_data_types.hpp"
+#include "Srl_img_format_registry.hpp"
+#include "Srl_stegimg.hpp"
+#include "Srl_synthetic_corpus.hpp"
+#include "Srl_tool_options.hpp"
+#include "Srl_thread_pool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <opencv2\imgproc.hpp>
+
+using namespace srl;
+using namespace std;
+
+namespace
+{
+	///
+	/// @brief	printed in place of a setting the scenario doesn't use
+	///
+	const int SRL_SETTING_UNUSED = -1;
+
+	///
+	/// @brief	quality the JPEG covers are written at, high as a fresh camera or stego tool output is
+	///
+	const int SRL_COVER_QUALITY = 92;
+
+	///
+	/// @brief	bit planes the LSB payloads are hidden in
+	///
+	const unsigned int SRL_COVER_LSB_PLANES = 1;
+
+	struct Srl_pareto_cli
+	{
+		uint64_t seed;
+		size_t images;
+		int width;
+		int height;
+		unsigned int repeat;
+		double payload_fill;
+
+		///
+		/// @brief	largest distance of the bit error rate from 0.5 that still counts as destroyed
+		///
+		double destroyed;
+
+		string scenario;
+	};
+
+	///
+	/// @brief	One way of scrubbing, unused settings are SRL_SETTING_UNUSED
+	///
+	struct Srl_scrub_config
+	{
+		int quality;
+		int chroma_quality;
+		int lsb_planes;
+		double resample;
+	};
+
+	///
+	/// @brief	What one configuration did, averaged over the covers
+	///
+	struct Srl_scrub_outcome
+	{
+		Srl_scrub_config config;
+		double ber;
+		double psnr;
+		double ssim;
+		double ms_per_image;
+		double bytes_per_image;
+		size_t failures;
+		bool frontier;
+	};
+
+	///
+	/// @brief	One cover and the payload hidden in it
+	///
+	struct Srl_cover
+	{
+		vector<unsigned char> encoded;
+		cv::Mat pixels;
+		vector<unsigned char> payload;
+		size_t payload_bits;
+	};
+
+	///
+	/// @brief	A payload kind, the format it is delivered in and the format it is scrubbed to
+	///
+	struct Srl_scenario
+	{
+		const char *name;
+		Srl_payload_kind payload;
+		const char *cover_format;
+		const char *target_format;
+		vector<Srl_scrub_config> configs;
+	};
+
+	void usage( void )
+	{
+		cerr << "StegDestroyPareto [--seed n] [--images n] [--size WxH] [--repeat n] [--payload-fill f]\n"
+			 << "                  [--destroyed f] [--scenario jpeg_coef|lsb_png|lsb_to_jpeg]\n";
+	}
+
+	bool parse_cli( int argc, char *argv[], Srl_pareto_cli &cli )
+	{
+		cli.seed = 1;
+		cli.images = 8;
+		cli.width = 640;
+		cli.height = 480;
+		cli.repeat = 3;
+		cli.payload_fill = 0.5;
+		cli.destroyed = 0.02;
+
+		const bool parsed = parse_options(argc, argv, [&](const string &arg, const string &value)
+		{
+			if ("--seed" == arg)
+			{
+				cli.seed = strtoull(value.c_str(), nullptr, 10);
+			}
+			else if ("--images" == arg)
+			{
+				cli.images = static_cast<size_t>(strtoull(value.c_str(), nullptr, 10));
+			}
+			else if ("--size" == arg)
+			{
+				return parse_dimensions(value, cli.width, cli.height);
+			}
+			else if ("--repeat" == arg)
+			{
+				cli.repeat = static_cast<unsigned int>(atoi(value.c_str()));
+			}
+			else if ("--payload-fill" == arg)
+			{
+				cli.payload_fill = atof(value.c_str());
+			}
+			else if ("--destroyed" == arg)
+			{
+				cli.destroyed = atof(value.c_str());
+			}
+			else if ("--scenario" == arg)
+			{
+				cli.scenario = value;
+			}
+			else
+			{
+				return false;
+			}
+			return true;
+		});
+		return parsed && cli.images > 0 && cli.width > 0 && cli.height > 0 && cli.repeat > 0 &&
+			   cli.payload_fill > 0.0 && cli.payload_fill <= 1.0;
+	}
+
+	vector<Srl_scenario> make_scenarios( void )
+	{
+		static const int qualities[] = { 30, 50, 65, SRL_COMPRESSION_DEFAULT, 85, 95 };
+		static const int chroma_qualities[] = { 0, 50, 30 };
+		static const double resamples[] = { 1.0, 0.75, 0.5 };
+
+		vector<Srl_scenario> scenarios;
+
+		//JPEG in, JPEG out: the DCT scrub, where chroma quality applies
+		Srl_scenario jpeg_coef = { "jpeg_coef", SRL_PAYLOAD_JPEG_COEF, "jpeg", "jpeg", vector<Srl_scrub_config>() };
+		for (size_t r = 0; r < sizeof(resamples) / sizeof(resamples[0]); r++)
+		{
+			for (size_t q = 0; q < sizeof(qualities) / sizeof(qualities[0]); q++)
+			{
+				for (size_t c = 0; c < sizeof(chroma_qualities) / sizeof(chroma_qualities[0]); c++)
+				{
+					//Resampled images take the pixel path, which encodes at a single quality
+					if (resamples[r] < 1.0 && 0 != chroma_qualities[c])
+					{
+						continue;
+					}
+					Srl_scrub_config config = { qualities[q], chroma_qualities[c], SRL_SETTING_UNUSED, resamples[r] };
+					jpeg_coef.configs.push_back(config);
+				}
+			}
+		}
+		scenarios.push_back(jpeg_coef);
+
+		//Lossless in, lossless out: only the bit plane scrub and resampling reach the payload
+		Srl_scenario lsb_png = { "lsb_png", SRL_PAYLOAD_LSB, "png", "png", vector<Srl_scrub_config>() };
+		for (size_t r = 0; r < sizeof(resamples) / sizeof(resamples[0]); r++)
+		{
+			//0 planes is resampling alone, the baseline the bit plane scrub has to beat
+			for (unsigned int planes = 0; planes <= SRL_LSB_MAX_PLANES; planes++)
+			{
+				Srl_scrub_config config = { SRL_SETTING_UNUSED, SRL_SETTING_UNUSED, static_cast<int>(planes), resamples[r] };
+				lsb_png.configs.push_back(config);
+			}
+		}
+		scenarios.push_back(lsb_png);
+
+		//Lossless in, JPEG out: requantization alone against a bit plane payload
+		Srl_scenario lsb_to_jpeg = { "lsb_to_jpeg", SRL_PAYLOAD_LSB, "png", "jpeg", vector<Srl_scrub_config>() };
+		for (size_t r = 0; r < sizeof(resamples) / sizeof(resamples[0]); r++)
+		{
+			for (size_t q = 0; q < sizeof(qualities) / sizeof(qualities[0]); q++)
+			{
+				Srl_scrub_config config = { qualities[q], SRL_SETTING_UNUSED, SRL_SETTING_UNUSED, resamples[r] };
+				lsb_to_jpeg.configs.push_back(config);
+			}
+		}
+		scenarios.push_back(lsb_to_jpeg);
+
+		return scenarios;
+	}
+
+	vector<unsigned char> encode_cover( const cv::Mat &mat, const Srl_img_format_traits &traits )
+	{
+		vector<unsigned char> encoded;
+		string err_msg;
+		if (!encode_synthetic_image(mat, traits, SRL_COVER_QUALITY, encoded, err_msg))
+		{
+			throw runtime_error(err_msg);
+		}
+		return encoded;
+	}
+
+	Srl_cover make_cover( const Srl_pareto_cli &cli, const Srl_scenario &scenario, size_t index )
+	{
+		const uint64_t image_seed = cli.seed * 1000003 + index;
+		const Srl_img_format_traits *traits_p = find_format_traits(scenario.cover_format);
+		Srl_cover cover;
+		cv::Mat mat = synthesise_image(cli.width, cli.height, 3, image_seed);
+
+		if (SRL_PAYLOAD_LSB == scenario.payload)
+		{
+			const size_t bytes = static_cast<size_t>(lsb_capacity_bits(mat, SRL_COVER_LSB_PLANES) * cli.payload_fill) / 8;
+			cover.payload = make_payload(bytes, ~image_seed);
+			cover.payload_bits = embed_lsb_payload(mat, cover.payload, SRL_COVER_LSB_PLANES);
+			cover.encoded = encode_cover(mat, *traits_p);
+		}
+		else
+		{
+			const vector<unsigned char> plain = encode_cover(mat, *traits_p);
+			size_t capacity = 0;
+			string err_msg;
+			if (!jpeg_coefficient_payload_capacity(plain.data(), plain.size(), capacity, err_msg))
+			{
+				throw runtime_error("couldn't read back the cover: " + err_msg);
+			}
+			cover.payload = make_payload(static_cast<size_t>(capacity * cli.payload_fill) / 8, ~image_seed);
+			if (!jpeg_embed_coefficient_payload(plain.data(), plain.size(), cover.payload, cover.payload_bits,
+												cover.encoded, err_msg))
+			{
+				throw runtime_error("couldn't embed the payload: " + err_msg);
+			}
+		}
+
+		//Compared against what the recipient of the cover would have seen
+		cover.pixels = cv::imdecode(cover.encoded, cv::IMREAD_COLOR);
+		return cover;
+	}
+
+	///
+	/// @brief	Mean SSIM of the luma, 11x11 Gaussian window with sigma 1.5 as in Wang et al.
+	///
+	double ssim( const cv::Mat &a, const cv::Mat &b )
+	{
+		const double c1 = (0.01 * 255) * (0.01 * 255);
+		const double c2 = (0.03 * 255) * (0.03 * 255);
+
+		cv::Mat grey_a, grey_b;
+		cv::cvtColor(a, grey_a, cv::COLOR_BGR2GRAY);
+		cv::cvtColor(b, grey_b, cv::COLOR_BGR2GRAY);
+		cv::Mat x, y;
+		grey_a.convertTo(x, CV_64F);
+		grey_b.convertTo(y, CV_64F);
+
+		const cv::Size window(11, 11);
+		cv::Mat mu_x, mu_y, xx, yy, xy;
+		cv::GaussianBlur(x, mu_x, window, 1.5);
+		cv::GaussianBlur(y, mu_y, window, 1.5);
+		cv::GaussianBlur(x.mul(x), xx, window, 1.5);
+		cv::GaussianBlur(y.mul(y), yy, window, 1.5);
+		cv::GaussianBlur(x.mul(y), xy, window, 1.5);
+
+		const cv::Mat mu_xx = mu_x.mul(mu_x);
+		const cv::Mat mu_yy = mu_y.mul(mu_y);
+		const cv::Mat mu_xy = mu_x.mul(mu_y);
+		const cv::Mat sigma_xx = xx - mu_xx;
+		const cv::Mat sigma_yy = yy - mu_yy;
+		const cv::Mat sigma_xy = xy - mu_xy;
+
+		cv::Mat numerator = (2 * mu_xy + c1).mul(2 * sigma_xy + c2);
+		cv::Mat denominator = (mu_xx + mu_yy + c1).mul(sigma_xx + sigma_yy + c2);
+		cv::Mat map;
+		cv::divide(numerator, denominator, map);
+		return cv::mean(map)[0];
+	}
+
+	///
+	/// @brief	Bit error rate of the payload read back from the scrubbed output. Bits the output no
+	///			longer has room for count as coin flips, half of them wrong
+	///
+	double payload_ber( const Srl_scenario &scenario, const Srl_cover &cover, Srl_byte_view output,
+						const cv::Mat &output_pixels )
+	{
+		if (0 == cover.payload_bits)
+		{
+			return 0.5;
+		}
+
+		vector<unsigned char> recovered;
+		size_t recovered_bits = 0;
+		if (SRL_PAYLOAD_JPEG_COEF == scenario.payload)
+		{
+			string err_msg;
+			if (!jpeg_extract_coefficient_payload(output.data(), output.size(), cover.payload_bits, recovered,
+												  recovered_bits, err_msg))
+			{
+				recovered_bits = 0;
+			}
+		}
+		else
+		{
+			recovered = extract_lsb_payload(output_pixels, cover.payload_bits, SRL_COVER_LSB_PLANES, recovered_bits);
+		}
+
+		const size_t compared = std::min(recovered_bits, cover.payload_bits);
+		const size_t errors = payload_bit_errors(cover.payload, recovered, compared, compared);
+		return (errors + 0.5 * (cover.payload_bits - compared)) / static_cast<double>(cover.payload_bits);
+	}
+
+	///
+	/// @brief	Scrubs every cover with config. Large images split their pixel stages across
+	///			tile_pool, as they do in the handler, so the times match what a batch sees
+	///
+	Srl_scrub_outcome run_config( const Srl_pareto_cli &cli, const Srl_scenario &scenario, const vector<Srl_cover> &covers,
+								  const Srl_scrub_config &config, Srl_thread_pool &tile_pool )
+	{
+		typedef chrono::steady_clock clock;
+
+		const Srl_img_format_pair cover_format = get_format_pair(scenario.cover_format);
+		const Srl_img_format_pair target_format = get_format_pair(scenario.target_format);
+		const Srl_jpgscrub_compression_level level = static_cast<Srl_jpgscrub_compression_level>(
+			(SRL_SETTING_UNUSED != config.quality) ? config.quality : SRL_COMPRESSION_DEFAULT);
+		const Srl_jpgscrub_mode mode = (SRL_PAYLOAD_JPEG_COEF == scenario.payload) ? SRL_SCRUB_DCT : SRL_SCRUB_PIXEL;
+
+		Srl_scrub_outcome outcome;
+		outcome.config = config;
+		outcome.ber = 0.0;
+		outcome.psnr = 0.0;
+		outcome.ssim = 0.0;
+		outcome.ms_per_image = 0.0;
+		outcome.bytes_per_image = 0.0;
+		outcome.failures = 0;
+		outcome.frontier = false;
+
+		size_t scored = 0;
+		for (size_t i = 0; i < covers.size(); i++)
+		{
+			const Srl_cover &cover = covers[i];
+			const Srl_byte_view input(cover.encoded.data(), cover.encoded.size());
+
+			//Best of the repeats, as a batch that has warmed up would see
+			double best_ns = numeric_limits<double>::max();
+			vector<unsigned char> output;
+			bool success = true;
+			for (unsigned int r = 0; r < cli.repeat && success; r++)
+			{
+				const clock::time_point begin = clock::now();
+				Srl_steg_image image(input, cover_format, mode);
+				image.set_tile_pool(&tile_pool);
+				if (SRL_SETTING_UNUSED != config.lsb_planes)
+				{
+					image.set_lsb_scrub(static_cast<unsigned int>(config.lsb_planes), SRL_LSB_RANDOMIZE);
+				}
+				if (SRL_SETTING_UNUSED != config.chroma_quality)
+				{
+					image.set_chroma_quality(config.chroma_quality);
+				}
+				image.set_resample_scrub(config.resample);
+				success = image.encode(target_format, level);
+				const clock::time_point end = clock::now();
+
+				best_ns = std::min(best_ns, static_cast<double>(chrono::duration_cast<chrono::nanoseconds>(end - begin).count()));
+				if (success)
+				{
+					const Srl_byte_view encoded = image.encoded_data();
+					output.assign(encoded.data(), encoded.data() + encoded.size());
+				}
+			}
+
+			if (!success)
+			{
+				outcome.failures++;
+				continue;
+			}
+
+			const cv::Mat output_pixels = cv::imdecode(output, cv::IMREAD_COLOR);
+			if (output_pixels.empty() || output_pixels.size() != cover.pixels.size())
+			{
+				outcome.failures++;
+				continue;
+			}
+
+			outcome.ber += payload_ber(scenario, cover, Srl_byte_view(output.data(), output.size()), output_pixels);
+			//Identical pictures have an infinite PSNR, capped so the mean stays finite
+			outcome.psnr += std::min(99.0, cv::PSNR(cover.pixels, output_pixels));
+			outcome.ssim += ssim(cover.pixels, output_pixels);
+			outcome.ms_per_image += best_ns / 1e6;
+			outcome.bytes_per_image += static_cast<double>(output.size());
+			scored++;
+		}
+
+		if (0 != scored)
+		{
+			outcome.ber /= scored;
+			outcome.psnr /= scored;
+			outcome.ssim /= scored;
+			outcome.ms_per_image /= scored;
+			outcome.bytes_per_image /= scored;
+		}
+		return outcome;
+	}
+
+	///
+	/// @brief	how far the payload is from destroyed, 0 when reading it back is a coin flip
+	///
+	double residual( const Srl_scrub_outcome &outcome )
+	{
+		return 2.0 * std::fabs(outcome.ber - 0.5);
+	}
+
+	///
+	/// @brief	true if a is at least as good as b on every objective and better on one
+	///
+	bool dominates( const Srl_scrub_outcome &a, const Srl_scrub_outcome &b )
+	{
+		const bool no_worse = residual(a) <= residual(b) && a.ssim >= b.ssim &&
+							  a.ms_per_image <= b.ms_per_image && a.bytes_per_image <= b.bytes_per_image;
+		const bool better = residual(a) < residual(b) || a.ssim > b.ssim ||
+							a.ms_per_image < b.ms_per_image || a.bytes_per_image < b.bytes_per_image;
+		return no_worse && better;
+	}
+
+	void mark_frontier( vector<Srl_scrub_outcome> &outcomes )
+	{
+		for (size_t i = 0; i < outcomes.size(); i++)
+		{
+			outcomes[i].frontier = (0 == outcomes[i].failures);
+			for (size_t j = 0; j < outcomes.size() && outcomes[i].frontier; j++)
+			{
+				if (j != i && 0 == outcomes[j].failures && dominates(outcomes[j], outcomes[i]))
+				{
+					outcomes[i].frontier = false;
+				}
+			}
+		}
+	}
+
+	///
+	/// @param[in]	zero_text	printed for 0, e.g. "=q" for a chroma quality that follows the luma one
+	///
+	string setting_text( int value, const char *zero_text )
+	{
+		return (SRL_SETTING_UNUSED == value) ? string("-") : (0 == value) ? string(zero_text) : to_string(value);
+	}
+
+	void print_outcome( const Srl_scrub_outcome &outcome )
+	{
+		cout << (outcome.frontier ? '*' : ' ')
+			 << ' ' << setw(7) << setting_text(outcome.config.quality, "=q")
+			 << ' ' << setw(7) << setting_text(outcome.config.chroma_quality, "=q")
+			 << ' ' << setw(6) << setting_text(outcome.config.lsb_planes, "0")
+			 << fixed << setprecision(2) << ' ' << setw(8) << outcome.config.resample
+			 << setprecision(4) << ' ' << setw(7) << outcome.ber
+			 << setprecision(2) << ' ' << setw(8) << outcome.psnr
+			 << setprecision(4) << ' ' << setw(7) << outcome.ssim
+			 << setprecision(3) << ' ' << setw(10) << outcome.ms_per_image
+			 << setprecision(0) << ' ' << setw(12) << outcome.bytes_per_image
+			 << ' ' << ((0 != outcome.failures) ? "failed" : "") << '\n';
+	}
+
+	void report( const Srl_pareto_cli &cli, const Srl_scenario &scenario, vector<Srl_scrub_outcome> &outcomes )
+	{
+		mark_frontier(outcomes);
+		std::sort(outcomes.begin(), outcomes.end(), [](const Srl_scrub_outcome &a, const Srl_scrub_outcome &b)
+		{
+			return a.ms_per_image < b.ms_per_image;
+		});
+
+		cout << '\n' << scenario.name << ": " << payload_kind_name(scenario.payload) << " payload in "
+			 << scenario.cover_format << ", scrubbed to " << scenario.target_format << ", " << cli.images
+			 << " images of " << cli.width << 'x' << cli.height << '\n';
+		cout << "  " << setw(7) << "quality" << ' ' << setw(7) << "chroma" << ' ' << setw(6) << "planes"
+			 << ' ' << setw(8) << "resample" << ' ' << setw(7) << "ber" << ' ' << setw(8) << "psnr"
+			 << ' ' << setw(7) << "ssim" << ' ' << setw(10) << "ms/image" << ' ' << setw(12) << "bytes/image" << '\n';
+		for (size_t i = 0; i < outcomes.size(); i++)
+		{
+			print_outcome(outcomes[i]);
+		}
+
+		//Sorted by time, so the first that destroys the payload is the cheapest, ties go to the best picture
+		const Srl_scrub_outcome *best_p = nullptr;
+		for (size_t i = 0; i < outcomes.size(); i++)
+		{
+			const Srl_scrub_outcome &outcome = outcomes[i];
+			if (0 != outcome.failures || residual(outcome) > cli.destroyed)
+			{
+				continue;
+			}
+			if (nullptr == best_p)
+			{
+				best_p = &outcome;
+			}
+			else if (outcome.ms_per_image <= best_p->ms_per_image && outcome.ssim > best_p->ssim)
+			{
+				best_p = &outcome;
+			}
+		}
+
+		if (nullptr != best_p)
+		{
+			cout << "cheapest that destroys the payload (ber within " << fixed << setprecision(3) << cli.destroyed / 2.0
+				 << " of 0.5):\n";
+			print_outcome(*best_p);
+		}
+		else
+		{
+			cout << "no configuration destroyed the payload\n";
+		}
+	}
+}
+
+int main( int argc, char *argv[] )
+{
+	Srl_pareto_cli cli;
+	if (!parse_cli(argc, argv, cli))
+	{
+		usage();
+		return 2;
+	}
+
+	initialise_library();
+
+	const vector<Srl_scenario> scenarios = make_scenarios();
+	Srl_thread_pool tile_pool;
+	bool ran = false;
+	try
+	{
+		for (size_t s = 0; s < scenarios.size(); s++)
+		{
+			const Srl_scenario &scenario = scenarios[s];
+			if (!cli.scenario.empty() && cli.scenario != scenario.name)
+			{
+				continue;
+			}
+			ran = true;
+
+			vector<Srl_cover> covers;
+			for (size_t i = 0; i < cli.images; i++)
+			{
+				covers.push_back(make_cover(cli, scenario, i));
+			}
+
+			vector<Srl_scrub_outcome> outcomes;
+			for (size_t c = 0; c < scenario.configs.size(); c++)
+			{
+				outcomes.push_back(run_config(cli, scenario, covers, scenario.configs[c], tile_pool));
+			}
+			report(cli, scenario, outcomes);
+		}
+	}
+	catch (const exception &ex)
+	{
+		cerr << ex.what() << endl;
+		return 1;
+	}
+
+	if (!ran)
+	{
+		cerr << "unknown scenario " << cli.scenario << endl;
+		return 2;
+	}
+	return 0;
+}
@@ -0,0 +1,429 @@
+//------------------------------------------------------------------------------------
+///
+/// @file   Srl_synthetic_corpus.cpp
+///
+/// @brief Seeded synthetic images and the known payloads hidden in them
+///
+//------------------------------------------------------------------------------------
+
+#include "Srl_synthetic_corpus.hpp"
+#include "Srl_counter_rng.hpp"
+#include "Srl_jpeg_coefficients.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#include <opencv2\imgproc.hpp>
+
+#include <jpeglib.h>
+
+using namespace srl;
+using namespace std;
+
+namespace
+{
+	///
+	/// @brief	streams of the image seed, the scene is drawn from one and the noise rows from the rest
+	///
+	const uint64_t SCENE_STREAM = 0;
+	const uint64_t NOISE_STREAM_BASE = 1;
+
+	///
+	/// @brief	Sequential draws from one stream of the counter generator
+	///
+	class Srl_scene_draws
+	{
+	public:
+		Srl_scene_draws( const Srl_counter_rng &rng, uint64_t stream )
+			: m_rng(rng), m_stream(stream), m_index(0)
+		{
+		}
+
+		///
+		/// @brief	uniform in [low, high]
+		///
+		int uniform( int low, int high )
+		{
+			const uint64_t span = static_cast<uint64_t>(high - low) + 1;
+			return low + static_cast<int>(m_rng.at(m_stream, m_index++) % span);
+		}
+
+		cv::Scalar colour( void )
+		{
+			return cv::Scalar(uniform(0, 255), uniform(0, 255), uniform(0, 255));
+		}
+
+	private:
+		const Srl_counter_rng &m_rng;
+		uint64_t m_stream;
+		uint64_t m_index;
+	};
+
+	///
+	/// @brief	number of samples per pixel a payload is hidden in, alpha is left alone
+	///
+	int colour_channels( const cv::Mat &mat )
+	{
+		return std::min(mat.channels(), 3);
+	}
+
+	///
+	/// @brief	Walks the coefficients a Jsteg style payload is carried in, reading or writing one
+	///			payload bit per coefficient until bit_count bits are done. With bits_p nullptr the
+	///			carriers are only counted
+	///
+	/// @return	number of bits read or written
+	///
+	size_t visit_payload_coefficients( j_decompress_ptr src, jvirt_barray_ptr *coef_arrays, unsigned char *bits_p,
+									   size_t bit_count, bool write )
+	{
+		size_t position = 0;
+		for (int ci = 0; ci < src->num_components && position < bit_count; ci++)
+		{
+			jpeg_component_info *comp = &src->comp_info[ci];
+			for (JDIMENSION row = 0; row < comp->height_in_blocks && position < bit_count; row++)
+			{
+				JBLOCKARRAY block_row = (*src->mem->access_virt_barray)
+					(reinterpret_cast<j_common_ptr>(src), coef_arrays[ci], row, 1, write ? TRUE : FALSE);
+
+				for (JDIMENSION col = 0; col < comp->width_in_blocks && position < bit_count; col++)
+				{
+					JCOEFPTR block = block_row[0][col];
+					for (int k = 1; k < DCTSIZE2 && position < bit_count; k++)
+					{
+						const int coef = block[k];
+						if (coef < 2 && coef > -2)
+						{
+							continue;
+						}
+
+						if (nullptr == bits_p)
+						{
+							position++;
+							continue;
+						}
+
+						const size_t byte = position / 8;
+						const int shift = 7 - static_cast<int>(position % 8);
+						int magnitude = (coef < 0) ? -coef : coef;
+						if (write)
+						{
+							magnitude = (magnitude & ~1) | ((bits_p[byte] >> shift) & 1);
+							block[k] = static_cast<JCOEF>((coef < 0) ? -magnitude : magnitude);
+						}
+						else
+						{
+							bits_p[byte] = static_cast<unsigned char>(bits_p[byte] | ((magnitude & 1) << shift));
+						}
+						position++;
+					}
+				}
+			}
+		}
+		return position;
+	}
+}
+
+const char* srl::payload_kind_name( Srl_payload_kind kind )
+{
+	switch (kind)
+	{
+	case SRL_PAYLOAD_LSB:		return "lsb";
+	case SRL_PAYLOAD_JPEG_COEF:	return "jpeg_coef";
+	default:					return "none";
+	}
+}
+
+cv::Mat srl::synthesise_image( int width, int height, int channels, uint64_t seed )
+{
+	const Srl_counter_rng rng(seed);
+	Srl_scene_draws draws(rng, SCENE_STREAM);
+
+	//A diagonal gradient between two colours for the sky or wall behind everything
+	cv::Mat bgr(height, width, CV_8UC3);
+	const cv::Scalar from = draws.colour();
+	const cv::Scalar to = draws.colour();
+	const bool vertical = 0 != draws.uniform(0, 1);
+	for (int y = 0; y < height; y++)
+	{
+		unsigned char *row_p = bgr.ptr<unsigned char>(y);
+		for (int x = 0; x < width; x++)
+		{
+			const double t = vertical ? (y + 0.5 * x) / (height + 0.5 * width) : (x + 0.5 * y) / (width + 0.5 * height);
+			for (int c = 0; c < 3; c++)
+			{
+				row_p[x * 3 + c] = cv::saturate_cast<unsigned char>(from[c] + (to[c] - from[c]) * t);
+			}
+		}
+	}
+
+	//Flat shapes for objects, their edges are what the blur turns into photo like detail
+	const int shapes = draws.uniform(4, 16);
+	const int extent = std::max(2, std::min(width, height) / 3);
+	for (int i = 0; i < shapes; i++)
+	{
+		const cv::Point centre(draws.uniform(0, width - 1), draws.uniform(0, height - 1));
+		const cv::Size axes(draws.uniform(1, extent), draws.uniform(1, extent));
+		const cv::Scalar fill = draws.colour();
+		if (0 == draws.uniform(0, 2))
+		{
+			cv::rectangle(bgr, centre - cv::Point(axes.width, axes.height), centre + cv::Point(axes.width, axes.height),
+						  fill, cv::FILLED, cv::LINE_AA);
+		}
+		else
+		{
+			cv::ellipse(bgr, centre, axes, draws.uniform(0, 179), 0, 360, fill, cv::FILLED, cv::LINE_AA);
+		}
+	}
+
+	const double sigma = 0.6 + draws.uniform(0, 14) / 10.0;
+	cv::GaussianBlur(bgr, bgr, cv::Size(0, 0), sigma);
+
+	//Sensor noise, a few levels either side, one generator stream per row
+	const int noise_span = draws.uniform(2, 6);
+	vector<unsigned char> noise(static_cast<size_t>(width) * 3);
+	for (int y = 0; y < height; y++)
+	{
+		rng.fill(NOISE_STREAM_BASE + static_cast<uint64_t>(y), 0, noise.data(), noise.size());
+		unsigned char *row_p = bgr.ptr<unsigned char>(y);
+		for (size_t i = 0; i < noise.size(); i++)
+		{
+			const int offset = static_cast<int>(noise[i] % (2 * noise_span + 1)) - noise_span;
+			row_p[i] = cv::saturate_cast<unsigned char>(row_p[i] + offset);
+		}
+	}
+
+	if (1 == channels)
+	{
+		cv::Mat grey;
+		cv::cvtColor(bgr, grey, cv::COLOR_BGR2GRAY);
+		return grey;
+	}
+	if (4 == channels)
+	{
+		//Opaque in the middle fading out towards the edges, as a cut out logo or sticker would be
+		cv::Mat bgra;
+		cv::cvtColor(bgr, bgra, cv::COLOR_BGR2BGRA);
+		const double cx = (width - 1) / 2.0;
+		const double cy = (height - 1) / 2.0;
+		for (int y = 0; y < height; y++)
+		{
+			unsigned char *row_p = bgra.ptr<unsigned char>(y);
+			for (int x = 0; x < width; x++)
+			{
+				const double dx = (x - cx) / std::max(cx, 1.0);
+				const double dy = (y - cy) / std::max(cy, 1.0);
+				const double distance = std::sqrt(dx * dx + dy * dy);
+				row_p[x * 4 + 3] = cv::saturate_cast<unsigned char>(255.0 * std::min(1.0, 2.0 * (1.2 - distance)));
+			}
+		}
+		return bgra;
+	}
+	return bgr;
+}
+
+bool srl::encode_synthetic_image( const cv::Mat &mat, const Srl_img_format_traits &traits, int quality,
+								  vector<unsigned char> &encoded, string &err_msg )
+{
+	encoded.clear();
+	if (traits.opencv)
+	{
+		vector<int> params;
+		if (SRL_NO_ENCODER_PARAM != traits.encoder_param)
+		{
+			params.push_back(traits.encoder_param);
+			params.push_back(traits.lossy ? quality : traits.encoder_value);
+		}
+		try
+		{
+			if (cv::imencode(traits.extension, mat, encoded, params))
+			{
+				return true;
+			}
+			err_msg = string("OpenCV couldn't encode ") + traits.canonical;
+		}
+		catch (cv::Exception &e)
+		{
+			err_msg = e.what();
+		}
+		return false;
+	}
+
+	try
+	{	//Magick reads the pixels in place, so they must be one block
+		const cv::Mat pixels = mat.isContinuous() ? mat : mat.clone();
+		const char *map_p = (1 == pixels.channels()) ? "I" : (4 == pixels.channels()) ? "BGRA" : "BGR";
+		Magick::Image image(pixels.cols, pixels.rows, map_p, Magick::CharPixel, pixels.data);
+		image.magick(traits.canonical);
+		if (traits.lossy)
+		{
+			image.quality(static_cast<size_t>(quality));
+		}
+		Magick::Blob blob;
+		image.write(&blob);
+		const unsigned char *data_p = static_cast<const unsigned char*>(blob.data());
+		encoded.assign(data_p, data_p + blob.length());
+		return true;
+	}
+	catch (Magick::Exception &e)
+	{
+		err_msg = e.what();
+		return false;
+	}
+}
+
+vector<unsigned char> srl::make_payload( size_t bytes, uint64_t seed )
+{
+	vector<unsigned char> payload(bytes);
+	if (0 != bytes)
+	{
+		Srl_counter_rng(seed).fill(0, 0, payload.data(), payload.size());
+	}
+	return payload;
+}
+
+size_t srl::lsb_capacity_bits( const cv::Mat &mat, unsigned int bit_planes )
+{
+	if (CV_8U != mat.depth())
+	{
+		return 0;
+	}
+	return mat.total() * static_cast<size_t>(colour_channels(mat)) * bit_planes;
+}
+
+size_t srl::embed_lsb_payload( cv::Mat &mat, const vector<unsigned char> &payload, unsigned int bit_planes )
+{
+	const size_t bit_count = std::min(payload.size() * 8, lsb_capacity_bits(mat, bit_planes));
+	const int channels = mat.channels();
+	const int colours = colour_channels(mat);
+
+	size_t position = 0;
+	for (int y = 0; y < mat.rows && position < bit_count; y++)
+	{
+		unsigned char *row_p = mat.ptr<unsigned char>(y);
+		for (int x = 0; x < mat.cols && position < bit_count; x++)
+		{
+			for (int c = 0; c < colours && position < bit_count; c++)
+			{
+				unsigned char &sample = row_p[x * channels + c];
+				for (unsigned int plane = 0; plane < bit_planes && position < bit_count; plane++, position++)
+				{
+					const int bit = (payload[position / 8] >> (7 - position % 8)) & 1;
+					sample = static_cast<unsigned char>((sample & ~(1u << plane)) | (bit << plane));
+				}
+			}
+		}
+	}
+	return position;
+}
+
+vector<unsigned char> srl::extract_lsb_payload( const cv::Mat &mat, size_t bit_count, unsigned int bit_planes,
+												size_t &extracted_bits )
+{
+	vector<unsigned char> payload((bit_count + 7) / 8, 0);
+	const size_t available = std::min(bit_count, lsb_capacity_bits(mat, bit_planes));
+	const int channels = mat.channels();
+	const int colours = colour_channels(mat);
+
+	size_t position = 0;
+	for (int y = 0; y < mat.rows && position < available; y++)
+	{
+		const unsigned char *row_p = mat.ptr<unsigned char>(y);
+		for (int x = 0; x < mat.cols && position < available; x++)
+		{
+			for (int c = 0; c < colours && position < available; c++)
+			{
+				const unsigned char sample = row_p[x * channels + c];
+				for (unsigned int plane = 0; plane < bit_planes && position < available; plane++, position++)
+				{
+					payload[position / 8] = static_cast<unsigned char>(payload[position / 8] |
+										    (((sample >> plane) & 1) << (7 - position % 8)));
+				}
+			}
+		}
+	}
+	extracted_bits = position;
+	return payload;
+}
+
+bool srl::jpeg_embed_coefficient_payload( const unsigned char *jpeg_data_p, size_t data_length,
+										  const vector<unsigned char> &payload, size_t &embedded_bits,
+										  vector<unsigned char> &out_buf, string &err_msg )
+{
+	embedded_bits = 0;
+	//Only written through when write is true, payload itself is never modified
+	unsigned char *bits_p = const_cast<unsigned char*>(payload.data());
+	const size_t bit_count = payload.size() * 8;
+	size_t written = 0;
+
+	Srl_jpeg_coefficients coefficients;
+	const bool embedded = coefficients.transcode(jpeg_data_p, data_length,
+		[&](jpeg_decompress_struct *src, jpeg_compress_struct*, jvirt_barray_control **coef_arrays)
+		{
+			written = visit_payload_coefficients(src, coef_arrays, bits_p, bit_count, true);
+		}, out_buf, err_msg);
+	if (embedded)
+	{
+		embedded_bits = written;
+	}
+	return embedded;
+}
+
+bool srl::jpeg_extract_coefficient_payload( const unsigned char *jpeg_data_p, size_t data_length, size_t bit_count,
+											vector<unsigned char> &payload, size_t &extracted_bits, string &err_msg )
+{
+	extracted_bits = 0;
+	payload.assign((bit_count + 7) / 8, 0);
+	unsigned char *bits_p = payload.data();
+	size_t read = 0;
+
+	Srl_jpeg_coefficients coefficients;
+	const bool extracted = coefficients.read(jpeg_data_p, data_length,
+		[&](jpeg_decompress_struct *src, jvirt_barray_control **coef_arrays)
+		{
+			read = visit_payload_coefficients(src, coef_arrays, bits_p, bit_count, false);
+		}, err_msg);
+	if (extracted)
+	{
+		extracted_bits = read;
+	}
+	return extracted;
+}
+
+bool srl::jpeg_coefficient_payload_capacity( const unsigned char *jpeg_data_p, size_t data_length,
+											 size_t &capacity_bits, string &err_msg )
+{
+	capacity_bits = 0;
+	size_t carriers = 0;
+
+	Srl_jpeg_coefficients coefficients;
+	const bool counted = coefficients.read(jpeg_data_p, data_length,
+		[&](jpeg_decompress_struct *src, jvirt_barray_control **coef_arrays)
+		{
+			carriers = visit_payload_coefficients(src, coef_arrays, nullptr, SIZE_MAX, false);
+		}, err_msg);
+	if (counted)
+	{
+		capacity_bits = carriers;
+	}
+	return counted;
+}
+
+size_t srl::payload_bit_errors( const vector<unsigned char> &expected, const vector<unsigned char> &actual,
+								size_t bit_count, size_t actual_bits )
+{
+	bit_count = std::min(bit_count, expected.size() * 8);
+	const size_t compared = std::min(std::min(bit_count, actual_bits), actual.size() * 8);
+
+	size_t errors = bit_count - compared;
+	for (size_t position = 0; position < compared; position++)
+	{
+		const int shift = 7 - static_cast<int>(position % 8);
+		if (((expected[position / 8] ^ actual[position / 8]) >> shift) & 1)
+		{
+			errors++;
+		}
+	}
+	return errors;
+}
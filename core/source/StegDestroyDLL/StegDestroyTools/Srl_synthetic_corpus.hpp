@@ -0,0 +1,152 @@
+// $Id$
+//------------------------------------------------------------------------------------
+///
+/// @file
+///
+/// @brief Seeded synthetic images and the known payloads hidden in them
+///
+/// @section VERSION
+/// 1.0
+///
+/// @section DESCRIPTION
+/// Benchmarks and scrub effectiveness runs need inputs that can be rebuilt anywhere
+/// from a seed instead of files that can't leave the machine they came from. An image
+/// here is a gradient with blurred shapes and sensor like noise over it, so it
+/// compresses roughly like a photo. A payload is seeded random bytes hidden either in
+/// the low bit planes of the pixels, as LSB tools do for lossless formats, or in the
+/// quantized coefficients of a JPEG, as Jsteg style tools do. Reading it back after a
+/// scrub and counting the flipped bits measures how well the scrub destroyed it.
+//------------------------------------------------------------------------------------
+
+#pragma once
+
+#ifndef _SRL_SYNTHETIC_CORPUS_HPP
+#define _SRL_SYNTHETIC_CORPUS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Srl_steg_data_types.hpp"
+#include "Srl_img_format_registry.hpp"
+
+namespace srl
+{
+	///
+	/// @brief	Where a payload is hidden
+	///
+	enum Srl_payload_kind
+	{
+		SRL_PAYLOAD_NONE,
+
+		///
+		/// @brief	low bit planes of the colour channels, for lossless formats
+		///
+		SRL_PAYLOAD_LSB,
+
+		///
+		/// @brief	magnitude LSB of the AC coefficients, for JPEG
+		///
+		SRL_PAYLOAD_JPEG_COEF
+	};
+
+	///
+	/// @brief	Lower case name of a payload kind, e.g. "lsb"
+	///
+	const char* payload_kind_name( Srl_payload_kind kind );
+
+	///
+	/// @brief	Draws an 8 bit image with 1 (grey), 3 (BGR) or 4 (BGRA) channels. The same
+	///			arguments always give the same pixels
+	///
+	cv::Mat synthesise_image( int width, int height, int channels, uint64_t seed );
+
+	///
+	/// @brief	Encodes a synthesised image the way a user's file would arrive. Formats OpenCV can't
+	///			write go through ImageMagick
+	///
+	/// @param[in]	quality		encoder quality, only used for lossy formats
+	///
+	/// @return	bool	false with the backend's message in err_msg if the format couldn't be written
+	///
+	bool encode_synthetic_image( const cv::Mat &mat, const Srl_img_format_traits &traits, int quality,
+								 std::vector<unsigned char> &encoded, std::string &err_msg );
+
+	///
+	/// @brief	bytes of seeded random data, the payload to hide
+	///
+	std::vector<unsigned char> make_payload( size_t bytes, uint64_t seed );
+
+	///
+	/// @brief	bits embed_lsb_payload() can hide in mat, alpha is never used
+	///
+	size_t lsb_capacity_bits( const cv::Mat &mat, unsigned int bit_planes );
+
+	///
+	/// @brief	Replaces the low bit_planes bits of every colour sample, in row order, with the
+	///			payload's bits, most significant first
+	///
+	/// @return	bits hidden, fewer than payload.size() * 8 if the image is too small
+	///
+	size_t embed_lsb_payload( cv::Mat &mat, const std::vector<unsigned char> &payload, unsigned int bit_planes );
+
+	///
+	/// @brief	Reads back bit_count bits hidden by embed_lsb_payload(), zero padded to whole bytes
+	///
+	/// @param[out]	extracted_bits	bits read, fewer than bit_count if mat is now smaller
+	///
+	std::vector<unsigned char> extract_lsb_payload( const cv::Mat &mat, size_t bit_count, unsigned int bit_planes,
+													size_t &extracted_bits );
+
+	///
+	/// @brief	Hides payload in the JPEG's quantized coefficients the way Jsteg style tools do
+	///
+	/// @description	The payload's bits, most significant first, replace the magnitude LSB of each
+	///					AC coefficient of magnitude 2 or more in component, block row, block column
+	///					and natural coefficient order, the same coefficients jpeg_dct_scrub()
+	///					randomises. Quant tables and every other coefficient are left as they were.
+	///
+	/// @param[out]	embedded_bits	payload bits written, fewer than payload.size() * 8 if the image
+	///								didn't have the capacity
+	///
+	/// @return	bool	false if libjpeg rejected the stream
+	///
+	bool jpeg_embed_coefficient_payload( const unsigned char *jpeg_data_p,
+										 size_t data_length,
+										 const std::vector<unsigned char> &payload,
+										 size_t &embedded_bits,
+										 std::vector<unsigned char> &out_buf,
+										 std::string &err_msg );
+
+	///
+	/// @brief	Reads back bit_count bits written by jpeg_embed_coefficient_payload(). payload is
+	///			zero padded to whole bytes
+	///
+	/// @param[out]	extracted_bits	bits actually read, fewer than bit_count if the stream has fewer
+	///								carrier coefficients than it did when the payload was embedded
+	///
+	bool jpeg_extract_coefficient_payload( const unsigned char *jpeg_data_p,
+										   size_t data_length,
+										   size_t bit_count,
+										   std::vector<unsigned char> &payload,
+										   size_t &extracted_bits,
+										   std::string &err_msg );
+
+	///
+	/// @brief	payload bits jpeg_embed_coefficient_payload() can hide in the stream
+	///
+	bool jpeg_coefficient_payload_capacity( const unsigned char *jpeg_data_p,
+											size_t data_length,
+											size_t &capacity_bits,
+											std::string &err_msg );
+
+	///
+	/// @brief	Bits of the first bit_count that differ between the two payloads. Bits missing
+	///			from actual count as errors
+	///
+	size_t payload_bit_errors( const std::vector<unsigned char> &expected, const std::vector<unsigned char> &actual,
+							   size_t bit_count, size_t actual_bits );
+}
+
+#endif //_SRL_SYNTHETIC_CORPUS_HPP
@@ -0,0 +1,58 @@
+//------------------------------------------------------------------------------------
+///
+/// @file   Srl_tool_options.cpp
+///
+/// @brief Command line parsing shared by the benchmark, corpus and Pareto tools
+///
+//------------------------------------------------------------------------------------
+
+#include "Srl_tool_options.hpp"
+
+#include <cstdlib>
+#include <sstream>
+
+using namespace srl;
+using namespace std;
+
+bool srl::parse_options( int argc, char *argv[], const Srl_option_handler &handler )
+{
+	for (int i = 1; i < argc; i += 2)
+	{
+		if (i + 1 >= argc)
+		{
+			return false;
+		}
+		if (!handler(argv[i], argv[i + 1]))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+vector<string> srl::split_list( const string &text )
+{
+	vector<string> items;
+	stringstream stream(text);
+	string item;
+	while (getline(stream, item, ','))
+	{
+		if (!item.empty())
+		{
+			items.push_back(item);
+		}
+	}
+	return items;
+}
+
+bool srl::parse_dimensions( const string &text, int &width, int &height )
+{
+	char *end_p = nullptr;
+	width = static_cast<int>(strtol(text.c_str(), &end_p, 10));
+	if ('x' != *end_p && 'X' != *end_p)
+	{
+		return false;
+	}
+	height = static_cast<int>(strtol(end_p + 1, nullptr, 10));
+	return width > 0 && height > 0;
+}
@@ -0,0 +1,53 @@
+// $Id$
+//------------------------------------------------------------------------------------
+///
+/// @file
+///
+/// @brief Command line parsing shared by the benchmark, corpus and Pareto tools
+///
+/// @section VERSION
+/// 1.0
+///
+/// @section DESCRIPTION
+/// Every tool takes "--name value" pairs. The walk over argv and the parsing of the
+/// values more than one tool takes, lists and WxH sizes, live here so the tools only
+/// say what each option means.
+//------------------------------------------------------------------------------------
+
+#pragma once
+
+#ifndef _SRL_TOOL_OPTIONS_HPP
+#define _SRL_TOOL_OPTIONS_HPP
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace srl
+{
+	///
+	/// @brief	Handles one option, returns false if name isn't known or value is no good
+	///
+	typedef std::function<bool(const std::string &name, const std::string &value)> Srl_option_handler;
+
+	///
+	/// @brief	Hands each "--name value" pair in argv[1..argc) to handler in order
+	///
+	/// @return	bool	false if an option has no value or handler refused one
+	///
+	bool parse_options( int argc, char *argv[], const Srl_option_handler &handler );
+
+	///
+	/// @brief	Splits a comma separated list, empty items are dropped
+	///
+	std::vector<std::string> split_list( const std::string &text );
+
+	///
+	/// @brief	Parses "WxH", e.g. "640x480"
+	///
+	/// @return	bool	false unless both are positive
+	///
+	bool parse_dimensions( const std::string &text, int &width, int &height );
+}
+
+#endif //_SRL_TOOL_OPTIONS_HPP